@@ -0,0 +1,178 @@
+// Measures how fast CSV rows and numbers are formatted with the
+// `std::to_chars` functions in stack_string.hpp, against the `itoa`, `ftoa`
+// and push-and-reverse formatting they replaced.
+//
+//     heappulse-format-benchmark [rows]
+//
+// Rows are written to /dev/null, so only formatting and buffering are timed.
+
+#include <random>
+
+#include <bkmalloc.h>
+#include <config.hpp>
+#include <timer.hpp>
+#include <stack_io.hpp>
+#include <stack_csv.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+// Distinct rows, cycled through for as many rows as are written
+#define BENCHMARK_DISTINCT_ROWS 4096
+#define BENCHMARK_COLUMNS 14
+#define BENCHMARK_DEFAULT_ROWS 2000000
+
+typedef CSVRow<BENCHMARK_COLUMNS> Row;
+
+// How `StackFile` formatted cells before: `itoa`, `ftoa` with 6 digits, and
+// hex digits pushed in reverse
+static void legacy_write(const CSVCell &cell, StackFile &file) {
+    char buf[64];
+    switch (cell.type) {
+        case CSVCell::Type::STRING:
+            for (size_t i=0; i<cell.string.size() && cell.string[i] != '\0'; i++) {
+                file.append(cell.string[i]);
+            }
+            break;
+        case CSVCell::Type::INTEGER:
+            itoa(cell.integer, buf, 10);
+            file.append(buf, strlen(buf));
+            break;
+        case CSVCell::Type::FLOAT:
+            ftoa(cell.floating_point, buf, 6);
+            file.append(buf, strlen(buf));
+            break;
+        case CSVCell::Type::POINTER: {
+            size_t size = 0;
+            for (uintptr_t number = (uintptr_t)cell.pointer; number > 0; number /= 16) {
+                buf[size++] = "0123456789ABCDEF"[number % 16];
+            }
+            if (size > 0) {
+                strreverse(buf, buf + size - 1);
+            }
+            file.append(buf, size);
+            break;
+        }
+        case CSVCell::Type::BOOLEAN:
+            if (cell.boolean) {
+                file.append("true", 4);
+            } else {
+                file.append("false", 5);
+            }
+            break;
+        case CSVCell::Type::EMPTY:
+            break;
+    }
+}
+
+// How `StackString::from_number` formatted before: through a `Size`-byte
+// temporary for decimals, and digit by digit then reversed for hex
+template <size_t Size, typename T>
+static StackString<Size> legacy_from_number(T number, size_t radix=10) {
+    char buf[Size];
+    if constexpr (std::is_floating_point<T>::value) {
+        ftoa(number, buf, 6);
+        buf[Size - 1] = '\0';
+        return StackString<Size>(buf);
+    } else {
+        if (radix == 10) {
+            itoa(number, buf, 10);
+            buf[Size - 1] = '\0';
+            return StackString<Size>(buf);
+        }
+        StackString<Size> str;
+        while (number > 0) {
+            str.push("0123456789ABCDEF"[number % radix]);
+            number /= radix;
+        }
+        return str.reverse();
+    }
+}
+
+// A row shaped like the object and page tables: counts, sizes, ratios, sites and a codec name
+static void fill_row(Row &row, std::mt19937_64 &random) {
+    static const char *codecs[] = {"LZ4", "ZSTD", "Snappy", "ZLIB"};
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    row.add_integer(random() % 100);
+    row[1] = (void*)(0x7F0000000000ULL + random() % (1ULL << 40));
+    row.add_string(CSVString(codecs[random() % 4]));
+    row.add_integer(random() % 100000);
+    row.add_integer(random() % (1ULL << 32));
+    row.add_integer(random() % (1ULL << 30));
+    row.add_float(unit(random));
+    row.add_integer(random() % 10000000);
+    row.add_float(unit(random) * 50.0);
+    row.add_integer(random() % 4096);
+    row[10] = (void*)(0x7F0000000000ULL + (random() % (1ULL << 28)) * PAGE_SIZE);
+    row.add_integer(random() % PAGE_SIZE);
+    row.add_float(unit(random) * 8.0);
+    row.add_boolean(random() & 1);
+}
+
+template <typename WriteRow>
+static double rows_per_second(const char *name, Row *rows, size_t count, WriteRow write_row) {
+    StackFile file(StackString<256>("/dev/null"), Mode::WRITE);
+    Timer timer;
+    for (size_t i=0; i<count; i++) {
+        write_row(rows[i % BENCHMARK_DISTINCT_ROWS], file);
+        file.append('\n');
+    }
+    file.flush();
+    double seconds = timer.elapsed_nanoseconds() / 1e9;
+    double rate = count / seconds;
+    printf("%-40s %12.0f rows/s  (%.3f s)\n", name, rate, seconds);
+    return rate;
+}
+
+template <typename T, typename Format>
+static double numbers_per_second(const char *name, const T *numbers, size_t count, Format format) {
+    // Keep the compiler from dropping the formatting
+    volatile size_t characters = 0;
+    Timer timer;
+    for (size_t i=0; i<count; i++) {
+        characters += format(numbers[i % BENCHMARK_DISTINCT_ROWS]).size();
+    }
+    double seconds = timer.elapsed_nanoseconds() / 1e9;
+    double rate = count / seconds;
+    printf("%-40s %12.0f numbers/s  (%.3f s)\n", name, rate, seconds);
+    return rate;
+}
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : BENCHMARK_DEFAULT_ROWS;
+    std::mt19937_64 random(42);
+
+    static Row rows[BENCHMARK_DISTINCT_ROWS];
+    static int64_t integers[BENCHMARK_DISTINCT_ROWS];
+    static double floats[BENCHMARK_DISTINCT_ROWS];
+    static uintptr_t pointers[BENCHMARK_DISTINCT_ROWS];
+    for (size_t i=0; i<BENCHMARK_DISTINCT_ROWS; i++) {
+        fill_row(rows[i], random);
+        integers[i] = random() % (1ULL << 32);
+        floats[i] = std::uniform_real_distribution<double>(0.0, 1000.0)(random);
+        pointers[i] = 0x7F0000000000ULL + random() % (1ULL << 40);
+    }
+
+    printf("Writing %lu rows of %d columns\n", (unsigned long)count, BENCHMARK_COLUMNS);
+    double before = rows_per_second("Rows, itoa/ftoa (before)", rows, count, [](Row &row, StackFile &file) {
+        for (size_t col=0; col<row.size(); col++) {
+            legacy_write(*row.cell(col), file);
+            if (col + 1 < row.size()) {
+                file.append(',');
+            }
+        }
+    });
+    double after = rows_per_second("Rows, to_chars (after)", rows, count, [](Row &row, StackFile &file) {
+        row.write(file);
+    });
+    printf("%-40s %12.2fx\n", "Row speedup", after / before);
+
+    printf("\nFormatting %lu numbers into StackString<%lu>\n", (unsigned long)count, (unsigned long)CSV_STR_SIZE);
+    numbers_per_second("Integers, itoa (before)", integers, count, [](int64_t n) { return legacy_from_number<CSV_STR_SIZE>(n); });
+    numbers_per_second("Integers, to_chars (after)", integers, count, [](int64_t n) { return CSVString::from_number(n); });
+    numbers_per_second("Floats, ftoa (before)", floats, count, [](double n) { return legacy_from_number<CSV_STR_SIZE>(n); });
+    numbers_per_second("Floats, to_chars (after)", floats, count, [](double n) { return CSVString::from_number(n); });
+    numbers_per_second("Pointers, push and reverse (before)", pointers, count, [](uintptr_t n) { return legacy_from_number<CSV_STR_SIZE>(n, 16); });
+    numbers_per_second("Pointers, to_chars (after)", pointers, count, [](uintptr_t n) { return CSVString::from_number(n, 16); });
+    return 0;
+}
@@ -0,0 +1,242 @@
+// Measures `StackMap` (Robin Hood probing, mixed hashes, backward-shift
+// removal) against the linear-probing map it replaced, at 10k, 1M and 10M
+// entries.
+//
+//     heappulse-map-benchmark [seconds-per-phase]
+//
+// Keys are 16-byte aligned heap-like pointers, as the allocation maps see.
+// Each map is filled to 90% of its size, then timed on hits, misses, a full
+// iteration, and removing half the keys. After the removals every remaining key
+// is looked up again; keys that can no longer be found are counted as lost.
+// A phase stops early once it has run for the given number of seconds
+// (default 10), and its rate is over the operations it got through.
+
+#include <random>
+
+#include <bkmalloc.h>
+#include <config.hpp>
+#include <timer.hpp>
+#include <stack_io.hpp>
+#include <stack_map.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#define BENCHMARK_DEFAULT_SECONDS 10
+// Operations between looks at the clock
+#define BENCHMARK_CHECK_PERIOD 1024
+
+// How `StackMap` was before: identity hash modulo `Size`, linear probing
+// capped at twice the entry count, and removal that only clears the slot
+template <typename KeyType, typename ValueType, std::size_t Size>
+class LegacyStackMap {
+public:
+    std::size_t hash(const KeyType& key) const {
+        return std::hash<KeyType>{}(key) % Size;
+    }
+
+    LegacyStackMap() : hashtable() {
+        memset((uint8_t*)hashtable.data(), 0, sizeof(hashtable));
+    }
+
+    void put(const KeyType& key, const ValueType& value) {
+        if (full() && !has(key)) {
+            return;
+        }
+        std::size_t index = hash(key);
+        size_t i=0;
+        while (hashtable[index].occupied && i++ < entries * 2) {
+            if (hashtable[index].key == key) {
+                hashtable[index].value = value;
+                return;
+            }
+            index = (index + 1) % Size;
+        }
+        if (full()) {
+            return;
+        }
+        hashtable[index].key = key;
+        hashtable[index].value = value;
+        hashtable[index].occupied = true;
+        entries++;
+    }
+
+    ValueType &get(const KeyType& key) {
+        std::size_t index = hash(key);
+        size_t i=0;
+        while (hashtable[index].occupied && i++ < entries * 2) {
+            if (hashtable[index].key == key) {
+                return hashtable[index].value;
+            }
+            index = (index + 1) % Size;
+        }
+        if (full()) {
+            return hashtable[0].value;
+        }
+        hashtable[index].key = key;
+        hashtable[index].occupied = true;
+        entries++;
+        return hashtable[index].value;
+    }
+
+    void remove(const KeyType& key) {
+        std::size_t index = hash(key);
+        for (size_t i=0; i<Size && hashtable[index].occupied; i++) {
+            if (hashtable[index].key == key) {
+                hashtable[index].occupied = false;
+                entries--;
+                return;
+            }
+            index = (index + 1) % Size;
+        }
+    }
+
+    bool has(const KeyType& key) const {
+        std::size_t index = hash(key);
+        size_t i=0;
+        while (hashtable[index].occupied && i++ < entries * 2) {
+            if (hashtable[index].key == key) {
+                return true;
+            }
+            index = (index + 1) % Size;
+        }
+        return false;
+    }
+
+    bool full() const {
+        return entries >= Size;
+    }
+
+    void map(std::function<void(const KeyType&, const ValueType&)> func) const {
+        size_t j = 0;
+        for (uint64_t i=0; i<Size && j<entries; i++) {
+            if (hashtable[i].occupied) {
+                func(hashtable[i].key, hashtable[i].value);
+                j++;
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        KeyType key;
+        ValueType value;
+        bool occupied;
+    };
+    std::array<Entry, Size> hashtable;
+    size_t entries = 0;
+};
+
+/// @brief Times a phase of up to `count` operations, stopping once it runs out of time.
+struct Phase {
+    const char *name;
+    double seconds_allowed;
+    Timer timer;
+    size_t done = 0;
+
+    Phase(const char *name, double seconds_allowed) : name(name), seconds_allowed(seconds_allowed) {}
+
+    // Whether to carry on with operation `i`
+    bool next(size_t i) const {
+        return i % BENCHMARK_CHECK_PERIOD != 0 || i == 0 || timer.elapsed_nanoseconds() / 1e9 < seconds_allowed;
+    }
+
+    double report(size_t count) {
+        double seconds = timer.elapsed_nanoseconds() / 1e9;
+        double rate = done / seconds;
+        printf("  %-28s %14.0f ops/s  (%.3f s", name, rate, seconds);
+        if (done < count) {
+            printf(", stopped after %lu of %lu", (unsigned long)done, (unsigned long)count);
+        }
+        printf(")\n");
+        return rate;
+    }
+};
+
+template <typename Map>
+static void run(const char *label, const std::vector<void*> &keys, const std::vector<void*> &missing, double seconds) {
+    std::unique_ptr<Map> map(new Map());
+    size_t count = keys.size();
+    // Keep the compiler from dropping the lookups
+    volatile uint64_t sink = 0;
+    printf("%s\n", label);
+
+    Phase insert("Insert", seconds);
+    size_t i = 0;
+    for (; i < count && insert.next(i); i++) {
+        map->put(keys[i], (uint64_t)i);
+    }
+    insert.done = i;
+    insert.report(count);
+    size_t inserted = i;
+
+    Phase hit("Lookup (present)", seconds);
+    for (i = 0; i < inserted && hit.next(i); i++) {
+        sink += map->get(keys[(i * 7919) % inserted]);
+    }
+    hit.done = i;
+    hit.report(inserted);
+
+    Phase miss("Lookup (absent)", seconds);
+    for (i = 0; i < missing.size() && miss.next(i); i++) {
+        sink += map->has(missing[i]);
+    }
+    miss.done = i;
+    miss.report(missing.size());
+
+    Phase iterate("Iterate", seconds);
+    map->map([&](void *const &key, const uint64_t &value) {
+        sink += value;
+    });
+    iterate.done = inserted;
+    iterate.report(inserted);
+
+    Phase remove("Remove half", seconds);
+    for (i = 0; i < inserted / 2 && remove.next(i); i++) {
+        map->remove(keys[i * 2]);
+    }
+    remove.done = i;
+    remove.report(inserted / 2);
+    size_t removed = i;
+
+    // Every key that wasn't removed should still be there
+    size_t lost = 0;
+    for (i = 0; i < inserted; i++) {
+        bool was_removed = i % 2 == 0 && i / 2 < removed;
+        if (!was_removed && !map->has(keys[i])) {
+            lost++;
+        }
+    }
+    printf("  %-28s %14lu of %lu\n", "Keys lost after removal", (unsigned long)lost, (unsigned long)(inserted - removed));
+}
+
+template <size_t Size>
+static void compare(double seconds, std::mt19937_64 &random) {
+    size_t count = Size / 10 * 9;
+    // Distinct 16-byte aligned pointers in a 1 TiB region, half of them never inserted
+    std::vector<void*> keys(count * 2);
+    for (size_t i=0; i<keys.size(); i++) {
+        keys[i] = (void*)(0x7F0000000000ULL + (random() % (1ULL << 36)) * 16);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), random);
+    std::vector<void*> missing(keys.begin() + count, keys.end());
+    keys.resize(count);
+
+    printf("\n%lu entries in a map of %lu\n", (unsigned long)count, (unsigned long)Size);
+    run<LegacyStackMap<void*, uint64_t, Size>>("Linear probing (before)", keys, missing, seconds);
+    run<StackMap<void*, uint64_t, Size>>("Robin Hood (after)", keys, missing, seconds);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : BENCHMARK_DEFAULT_SECONDS;
+    std::mt19937_64 random(42);
+    compare<10000>(seconds, random);
+    compare<1000000>(seconds, random);
+    compare<10000000>(seconds, random);
+    return 0;
+}
@@ -77,11 +77,31 @@ static AccessCompressionTest act;
 static HugePageAccessCompressionTest huge_page_act;
 #endif
 
+#ifdef COMPRESSION_ALLOCATOR_TEST
+#include "intervals/compression_alloc.cpp"
+static CompressionAllocator compression_allocator;
+#endif
+
 #ifdef ALL_TEST
 #include "intervals/all.cpp"
 static AllTest all_test;
 #endif
 
+#ifdef CODEC_SELECTION_TEST
+#include "intervals/codec_selection.cpp"
+static CodecSelectionTest codec_selection_test;
+#endif
+
+#ifdef COMPRESSION_TELEMETRY
+#include "intervals/compression_telemetry.cpp"
+static CompressionTelemetryTest compression_telemetry_test;
+#endif
+
+#ifdef LIVE_METRICS
+#include "intervals/live_metrics.cpp"
+static LiveMetricsTest live_metrics_test;
+#endif
+
 static uint64_t malloc_count = 0;
 static uint64_t free_count = 0;
 static uint64_t mmap_count = 0;
@@ -127,9 +147,23 @@ public:
         #ifdef HUGE_PAGE_ACCESS_COMPRESSION_TEST
         its->add_test(&huge_page_act);
         #endif
+        #ifdef COMPRESSION_ALLOCATOR_TEST
+        its->add_test(&compression_allocator);
+        #endif
         #ifdef ALL_TEST
         its->add_test(&all_test);
         #endif
+        #ifdef CODEC_SELECTION_TEST
+        its->add_test(&codec_selection_test);
+        #endif
+        #ifdef COMPRESSION_TELEMETRY
+        // Last, so it reports what the other tests compressed this interval
+        its->add_test(&compression_telemetry_test);
+        #endif
+        #ifdef LIVE_METRICS
+        // After the telemetry test, for the same reason
+        its->add_test(&live_metrics_test);
+        #endif
         
         stack_debugf("Done\n");
 
@@ -284,14 +318,49 @@ public:
     void report_stats() {
         if (stats_timer.has_elapsed(STATS_INTERVAL_MS)) {
             print_stats();
+            flush_logs();
             stats_timer.reset();
         }
+        #ifdef LIVE_METRICS
+        if (metrics_timer.has_elapsed(LIVE_METRICS_PERIOD_MS)) {
+            publish_metrics();
+        }
+        #endif
+    }
+
+    #ifdef LIVE_METRICS
+    /// @brief Publish the counts, rates and overhead to the live metrics page.
+    void publish_metrics() {
+        double seconds = metrics_timer.elapsed_microseconds() / 1e6;
+        uint64_t allocations = malloc_count + mmap_count, frees = free_count + munmap_count;
+        live_metrics.update([&](LiveMetricsData &data) {
+            data.updated_microseconds = hook_timer.elapsed_microseconds();
+            data.malloc_count = malloc_count;
+            data.free_count = free_count;
+            data.mmap_count = mmap_count;
+            data.munmap_count = munmap_count;
+            data.alloc_rate = (allocations - published_allocations) / seconds;
+            data.free_rate = (frees - published_frees) / seconds;
+            data.overhead_microseconds = overhead_sw.elapsed_microseconds();
+            data.update_microseconds = update_sw.elapsed_microseconds();
+            data.invalidate_microseconds = invalidate_sw.elapsed_microseconds();
+            data.dropped_events = live_metrics.dropped_events();
+        });
+        published_allocations = allocations;
+        published_frees = frees;
+        metrics_timer.reset();
     }
+    #endif
 
     ~Hooks() {
         // its->finish();
         stack_infof("*** TESTS FINISHED! ***\n");
         print_stats();
+        #ifdef LIVE_METRICS
+        // The last publish, then mark the page finished
+        publish_metrics();
+        live_metrics.close();
+        #endif
         stack_logf("Hooks destructor\n");
     }
 
@@ -299,6 +368,10 @@ private:
     std::mutex hook_lock;
     Timer stats_timer;
     Timer hook_timer;
+    #ifdef LIVE_METRICS
+    Timer metrics_timer;
+    uint64_t published_allocations = 0, published_frees = 0;
+    #endif
 };
 
 static Hooks hooks;
@@ -344,11 +417,20 @@ void bk_post_alloc_hook(bk_Heap *heap, u64 n_bytes, u64 alignment, int zero_mem,
     setup_protection_handler();
     overhead_sw.start();
     if (hooks.is_done() || !hooks.can_update()) {
+        #ifdef LIVE_METRICS
+        // The interval's own allocations aren't the program's, and aren't dropped
+        if (!hooks.is_done() && !is_working_thread()) {
+            live_metrics.drop();
+        }
+        #endif
         overhead_sw.stop();
         return;
     }
     if (!bk_lock.try_lock()) {
         stack_debugf("Failed to lock\n");
+        #ifdef LIVE_METRICS
+        live_metrics.drop();
+        #endif
         overhead_sw.stop();
         return;
     }
@@ -387,11 +469,20 @@ void bk_post_mmap_hook(void *addr, size_t n_bytes, int prot, int flags, int fd,
     setup_protection_handler();
     overhead_sw.start();
     if (hooks.is_done() || !hooks.can_update()) {
+        #ifdef LIVE_METRICS
+        // The interval's own allocations aren't the program's, and aren't dropped
+        if (!hooks.is_done() && !is_working_thread()) {
+            live_metrics.drop();
+        }
+        #endif
         overhead_sw.stop();
         return;
     }
     if (!bk_lock.try_lock()) {
         stack_debugf("Failed to lock\n");
+        #ifdef LIVE_METRICS
+        live_metrics.drop();
+        #endif
         overhead_sw.stop();
         return;
     }
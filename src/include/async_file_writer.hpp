@@ -0,0 +1,210 @@
+#pragma once
+
+#include "config.hpp"
+#include <bkmalloc.h>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <pthread.h>
+#include <unistd.h>
+
+// The size of each of the writer's two buffers
+#ifndef ASYNC_FILE_WRITER_BUFFER_SIZE
+#define ASYNC_FILE_WRITER_BUFFER_SIZE (1 << 22)
+#endif
+
+// Write all of `data` to `fd`, retrying short writes
+static bool write_fully(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t bytes = ::write(fd, data, size);
+        if (bytes == -1) {
+            return false;
+        }
+        data += bytes;
+        size -= bytes;
+    }
+    return true;
+}
+
+/// @brief Hands file writes to a background thread through a pair of swap buffers.
+///
+/// `submit` copies a write into the buffer being filled and returns. When that
+/// buffer has no room left, it waits for the writer thread to finish the other
+/// one, swaps them and wakes the writer, so a slow disk only holds up the
+/// caller once a whole buffer is already queued behind it. There is a single
+/// writer, so writes reach their files in the order they were submitted.
+///
+/// `drain` waits until everything submitted has been written. Anything that
+/// closes, reopens, seeks, reads or stats a file must drain first, since a
+/// closed descriptor's number can be reused by the next file opened.
+///
+/// The writer drains and stops at exit; anything submitted after that, such
+/// as the last interval's rows written from a static destructor, is written
+/// synchronously. It is never destroyed, so that late use stays safe.
+class AsyncFileWriter {
+public:
+    static AsyncFileWriter &get() {
+        alignas(AsyncFileWriter) static char storage[sizeof(AsyncFileWriter)];
+        static AsyncFileWriter *writer = new (storage) AsyncFileWriter();
+        return *writer;
+    }
+
+    /// @brief Queue `size` bytes of `data` to be written to `fd`.
+    void submit(int fd, const char *data, size_t size) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopped) {
+            lock.unlock();
+            if (!write_fully(fd, data, size)) {
+                bk_printf("Could not write to file\n");
+                throw std::runtime_error("Could not write to file");
+            }
+            return;
+        }
+        check_failure();
+        start();
+
+        while (size > 0) {
+            if (filling->used + sizeof(Record) >= ASYNC_FILE_WRITER_BUFFER_SIZE) {
+                hand_off(lock);
+            }
+            size_t room = ASYNC_FILE_WRITER_BUFFER_SIZE - filling->used - sizeof(Record);
+            Record record = {fd, size < room ? size : room};
+            memcpy(filling->data + filling->used, &record, sizeof(Record));
+            memcpy(filling->data + filling->used + sizeof(Record), data, record.size);
+            filling->used += sizeof(Record) + record.size;
+            data += record.size;
+            size -= record.size;
+        }
+    }
+
+    /// @brief Wait until everything submitted so far has been written.
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!started) {
+            return;
+        }
+        if (filling->used > 0) {
+            hand_off(lock);
+        }
+        done.wait(lock, [&]() { return writing->used == 0; });
+        check_failure();
+    }
+
+    /// @brief Write everything submitted and stop the writer thread.
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (started) {
+            if (filling->used > 0) {
+                hand_off(lock);
+            }
+            stopping = true;
+            wake.notify_one();
+            lock.unlock();
+            pthread_join(thread, nullptr);
+            lock.lock();
+        }
+        stopped = true;
+    }
+
+private:
+    struct Record {
+        int fd;
+        size_t size;
+    };
+
+    struct Buffer {
+        char data[ASYNC_FILE_WRITER_BUFFER_SIZE];
+        size_t used = 0;
+    };
+
+    Buffer buffers[2];
+    // The buffer `submit` copies into, and the one the writer thread owns while it is non-empty
+    Buffer *filling = &buffers[0], *writing = &buffers[1];
+
+    std::mutex mutex;
+    // Signalled when `writing` has work, and when the writer has finished it
+    std::condition_variable wake, done;
+    pthread_t thread;
+    bool started = false, stopping = false, stopped = false, failed = false;
+
+    AsyncFileWriter() {
+        atexit([]() { get().stop(); });
+    }
+
+    void start() {
+        if (started) {
+            return;
+        }
+        if (pthread_create(&thread, nullptr, run, this) != 0) {
+            bk_printf("Could not start the file writer thread\n");
+            throw std::runtime_error("Could not start the file writer thread");
+        }
+        static bool registered_fork_handler = false;
+        if (!registered_fork_handler) {
+            pthread_atfork(nullptr, nullptr, after_fork);
+            registered_fork_handler = true;
+        }
+        started = true;
+    }
+
+    // Wait for the writer to finish the previous buffer, then give it the one being filled
+    void hand_off(std::unique_lock<std::mutex> &lock) {
+        done.wait(lock, [&]() { return writing->used == 0; });
+        Buffer *full = filling;
+        filling = writing;
+        writing = full;
+        wake.notify_one();
+    }
+
+    // Report a write the writer thread failed since the last check, like a synchronous write would
+    void check_failure() {
+        if (failed) {
+            failed = false;
+            throw std::runtime_error("Could not write to file");
+        }
+    }
+
+    static void *run(void *arg) {
+        AsyncFileWriter &writer = *(AsyncFileWriter*)arg;
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        while (true) {
+            writer.wake.wait(lock, [&]() { return writer.writing->used > 0 || writer.stopping; });
+            if (writer.writing->used == 0) {
+                break;
+            }
+            // Nothing else touches `writing` until it is marked empty
+            Buffer &buffer = *writer.writing;
+            lock.unlock();
+            bool ok = true;
+            for (size_t offset=0; offset < buffer.used;) {
+                Record record;
+                memcpy(&record, buffer.data + offset, sizeof(Record));
+                ok = write_fully(record.fd, buffer.data + offset + sizeof(Record), record.size) && ok;
+                offset += sizeof(Record) + record.size;
+            }
+            if (!ok) {
+                bk_printf("Could not write to file\n");
+            }
+            lock.lock();
+            writer.failed = writer.failed || !ok;
+            buffer.used = 0;
+            writer.done.notify_all();
+        }
+        return nullptr;
+    }
+
+    // Only the forking thread survives in the child, and the queued writes are
+    // the parent's to make, so the child starts over with an empty writer
+    static void after_fork() {
+        AsyncFileWriter &writer = get();
+        new (&writer.mutex) std::mutex();
+        new (&writer.wake) std::condition_variable();
+        new (&writer.done) std::condition_variable();
+        writer.buffers[0].used = writer.buffers[1].used = 0;
+        writer.started = writer.stopping = false;
+    }
+};
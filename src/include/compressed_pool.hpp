@@ -0,0 +1,278 @@
+#pragma once
+
+#include <config.hpp>
+#include <compressor.hpp>
+#include <stack_csv.hpp>
+#include <stack_vec.hpp>
+
+// The zsmalloc geometry the pool is modelled on. The defaults are the
+// kernel's for 4K pages: 16 byte class spacing from 32 bytes up to a page,
+// zspages of up to 4 pages, and an 8 byte handle stored with each object.
+#ifndef COMPRESSED_POOL_MIN_CLASS_SIZE
+#define COMPRESSED_POOL_MIN_CLASS_SIZE 32
+#endif
+#ifndef COMPRESSED_POOL_CLASS_DELTA
+#define COMPRESSED_POOL_CLASS_DELTA 16
+#endif
+#ifndef COMPRESSED_POOL_MAX_ZSPAGE_PAGES
+#define COMPRESSED_POOL_MAX_ZSPAGE_PAGES 4
+#endif
+#ifndef COMPRESSED_POOL_HANDLE_SIZE
+#define COMPRESSED_POOL_HANDLE_SIZE 8
+#endif
+#define COMPRESSED_POOL_CLASSES ((PAGE_SIZE - COMPRESSED_POOL_MIN_CLASS_SIZE) / COMPRESSED_POOL_CLASS_DELTA + 1)
+
+static_assert(COMPRESSED_POOL_MIN_CLASS_SIZE > 0 && COMPRESSED_POOL_CLASS_DELTA > 0, "Pool classes must have a size");
+static_assert(COMPRESSED_POOL_MAX_ZSPAGE_PAGES > 0, "A zspage needs at least one page");
+
+/// @brief One size class: every object in it takes `size` bytes of a zspage.
+struct CompressedPoolClass {
+    size_t size = 0;
+    size_t pages_per_zspage = 0, objects_per_zspage = 0;
+    // The class that actually stores this one's objects. Like zsmalloc,
+    // neighbouring classes with the same geometry are merged into the largest.
+    size_t merged_index = 0;
+};
+
+/// @brief What one codec's pages occupy in one class (or the whole pool).
+struct CompressedPoolStats {
+    uint64_t objects = 0, zspages = 0;
+    uint64_t uncompressed_size = 0;
+    // The codec's output, before handles and rounding
+    uint64_t compressed_size = 0;
+    // Objects with their handles, rounded up to their class size
+    uint64_t allocated_size = 0;
+    // Whole pages taken from the system
+    uint64_t footprint = 0;
+
+    uint64_t rounding_waste() const {
+        return allocated_size - compressed_size;
+    }
+
+    uint64_t zspage_waste() const {
+        return footprint - allocated_size;
+    }
+
+    double fragmentation() const {
+        return footprint == 0 ? 0.0 : (double)(footprint - compressed_size) / (double)footprint;
+    }
+
+    int64_t ideal_savings() const {
+        return (int64_t)uncompressed_size - (int64_t)compressed_size;
+    }
+
+    int64_t net_savings() const {
+        return (int64_t)uncompressed_size - (int64_t)footprint;
+    }
+
+    void add(const CompressedPoolStats &other) {
+        objects += other.objects;
+        zspages += other.zspages;
+        uncompressed_size += other.uncompressed_size;
+        compressed_size += other.compressed_size;
+        allocated_size += other.allocated_size;
+        footprint += other.footprint;
+    }
+};
+
+/// @brief Models how a zsmalloc pool, as used by zram and zswap, would store
+///        the pages of the page sweep.
+///
+/// Every page compressed by the sweep is stored as one object of its codec's
+/// pool. An object is its compressed size plus a handle, rounded up to the
+/// next size class; each class is packed into zspages of the size that
+/// wastes the least space. Objects too large for any multi-object class are
+/// stored uncompressed in a page of their own, as zram does.
+///
+/// The pool is rebuilt every interval with no free slots besides those in
+/// each class's last zspage, so the footprint is what a freshly compacted
+/// pool would hold. Fragmentation from objects freed over time comes on top.
+class CompressedPool {
+public:
+    CompressedPool() {
+        for (size_t i=0; i<COMPRESSED_POOL_CLASSES; i++) {
+            CompressedPoolClass &size_class = classes[i];
+            size_class.size = COMPRESSED_POOL_MIN_CLASS_SIZE + i * COMPRESSED_POOL_CLASS_DELTA;
+            size_class.pages_per_zspage = pages_per_zspage(size_class.size);
+            size_class.objects_per_zspage = size_class.pages_per_zspage * PAGE_SIZE / size_class.size;
+        }
+
+        // Walk down from the largest class, merging each run of classes that
+        // pack the same way, and find the first class that holds one object
+        // per page; anything that size or larger is not worth compressing
+        huge_size = PAGE_SIZE;
+        for (size_t i=COMPRESSED_POOL_CLASSES; i-- > 0;) {
+            CompressedPoolClass &size_class = classes[i];
+            const CompressedPoolClass *larger = i + 1 < COMPRESSED_POOL_CLASSES ? &classes[classes[i + 1].merged_index] : nullptr;
+            if (larger != nullptr && larger->pages_per_zspage == size_class.pages_per_zspage && larger->objects_per_zspage == size_class.objects_per_zspage) {
+                size_class.merged_index = classes[i + 1].merged_index;
+            } else {
+                size_class.merged_index = i;
+            }
+            if (size_class.pages_per_zspage == 1 && size_class.objects_per_zspage == 1) {
+                huge_size = size_class.size;
+            }
+        }
+    }
+
+    /// @brief Store a compressed page in a codec's pool.
+    /// @param uncompressed_size The page's size; huge pages are split into base pages
+    /// @param compressed_size The page's compressed size, or 0 if it failed to compress
+    void add(CompressionType type, uint64_t uncompressed_size, uint64_t compressed_size) {
+        size_t pages = uncompressed_size / PAGE_SIZE;
+        if (pages == 0) {
+            return;
+        }
+        // Each base page takes an even share of a huge page's compressed size
+        uint64_t object_size = compressed_size == 0 ? PAGE_SIZE : (compressed_size + pages - 1) / pages;
+
+        type = (CompressionType)(type % MAX_COMPRESSION_TYPES);
+        if (object_size + COMPRESSED_POOL_HANDLE_SIZE >= huge_size) {
+            huge_objects[type] += pages;
+            huge_uncompressed_size[type] += uncompressed_size;
+            // Kept as the codec's output only to report the savings it would
+            // have had; the pool holds the page itself
+            huge_compressed_size[type] += compressed_size == 0 || compressed_size > uncompressed_size ? uncompressed_size : compressed_size;
+            return;
+        }
+        size_t index = classes[class_index(object_size + COMPRESSED_POOL_HANDLE_SIZE)].merged_index;
+        objects[type][index] += pages;
+        stored_size[type][index] += object_size * pages;
+        class_uncompressed_size[type][index] += uncompressed_size;
+    }
+
+    /// @brief Add a row per occupied class and one for the whole pool of
+    ///        every codec to `csv`, and start the next interval.
+    template<size_t Columns, size_t Rows>
+    void write(CSV<Columns, Rows> &csv, StackFile &file, uint64_t interval, const StackVec<CompressionType, 20> &types) {
+        for (size_t t=0; t<types.size(); t++) {
+            CompressionType type = (CompressionType)(types[t] % MAX_COMPRESSION_TYPES);
+            CompressedPoolStats pool;
+            for (size_t i=0; i<COMPRESSED_POOL_CLASSES; i++) {
+                if (objects[type][i] == 0) {
+                    continue;
+                }
+                const CompressedPoolClass &size_class = classes[i];
+                CompressedPoolStats stats;
+                stats.objects = objects[type][i];
+                stats.zspages = (stats.objects + size_class.objects_per_zspage - 1) / size_class.objects_per_zspage;
+                stats.uncompressed_size = class_uncompressed_size[type][i];
+                stats.compressed_size = stored_size[type][i];
+                stats.allocated_size = stats.objects * size_class.size;
+                stats.footprint = stats.zspages * size_class.pages_per_zspage * PAGE_SIZE;
+                write_row(csv, interval, types[t], "Class", size_class.size, size_class.pages_per_zspage, size_class.objects_per_zspage, stats);
+                pool.add(stats);
+                if (csv.full()) {
+                    csv.write(file);
+                    csv.clear();
+                }
+            }
+            if (huge_objects[type] > 0) {
+                CompressedPoolStats stats;
+                stats.objects = stats.zspages = huge_objects[type];
+                stats.compressed_size = huge_compressed_size[type];
+                stats.uncompressed_size = stats.allocated_size = stats.footprint = huge_uncompressed_size[type];
+                write_row(csv, interval, types[t], "Huge", PAGE_SIZE, 1, 1, stats);
+                pool.add(stats);
+            }
+            if (pool.objects == 0) {
+                continue;
+            }
+            write_row(csv, interval, types[t], "Pool", 0, 0, 0, pool);
+            stack_infof("Compressed pool for %s: %d bytes of pages take %d bytes, %f of it lost to fragmentation (%d bytes saved, %d before packing)\n",
+                compression_to_string(types[t]), pool.uncompressed_size, pool.footprint, pool.fragmentation(), pool.net_savings(), pool.ideal_savings());
+            if (csv.full()) {
+                csv.write(file);
+                csv.clear();
+            }
+        }
+        reset();
+    }
+
+    template<size_t Columns, size_t Rows>
+    static void add_titles(CSV<Columns, Rows> &csv) {
+        csv.title().add("Interval #");
+        csv.title().add("Compression Type");
+        csv.title().add("Scope");
+        csv.title().add("Size Class (bytes)");
+        csv.title().add("Pages Per Zspage");
+        csv.title().add("Objects Per Zspage");
+        csv.title().add("Objects");
+        csv.title().add("Zspages");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Compressed Size (bytes)");
+        csv.title().add("Allocated Size (bytes)");
+        csv.title().add("Pool Footprint (bytes)");
+        csv.title().add("Handle and Rounding Waste (bytes)");
+        csv.title().add("Zspage Waste (bytes)");
+        csv.title().add("Internal Fragmentation (fraction of footprint)");
+        csv.title().add("Ideal Savings (bytes)");
+        csv.title().add("Net Savings (bytes)");
+    }
+
+private:
+    CompressedPoolClass classes[COMPRESSED_POOL_CLASSES];
+    // Objects this size or larger, with their handle, are stored as whole pages
+    size_t huge_size;
+
+    uint64_t objects[MAX_COMPRESSION_TYPES][COMPRESSED_POOL_CLASSES] = {{0}};
+    uint64_t stored_size[MAX_COMPRESSION_TYPES][COMPRESSED_POOL_CLASSES] = {{0}};
+    uint64_t class_uncompressed_size[MAX_COMPRESSION_TYPES][COMPRESSED_POOL_CLASSES] = {{0}};
+    uint64_t huge_objects[MAX_COMPRESSION_TYPES] = {0};
+    uint64_t huge_uncompressed_size[MAX_COMPRESSION_TYPES] = {0};
+    uint64_t huge_compressed_size[MAX_COMPRESSION_TYPES] = {0};
+
+    /// @brief The zspage size, in pages, that wastes the least of its tail
+    ///        on a class; zsmalloc's `get_pages_per_zspage`.
+    static size_t pages_per_zspage(size_t size) {
+        size_t best_pages = 1, best_used = 0;
+        for (size_t pages=1; pages<=COMPRESSED_POOL_MAX_ZSPAGE_PAGES; pages++) {
+            size_t zspage_size = pages * PAGE_SIZE;
+            // Used space per mille, so a larger zspage only wins when it packs tighter
+            size_t used = (zspage_size - zspage_size % size) * 1000 / zspage_size;
+            if (used > best_used) {
+                best_used = used;
+                best_pages = pages;
+            }
+        }
+        return best_pages;
+    }
+
+    static size_t class_index(size_t size) {
+        if (size <= COMPRESSED_POOL_MIN_CLASS_SIZE) {
+            return 0;
+        }
+        return (size - COMPRESSED_POOL_MIN_CLASS_SIZE + COMPRESSED_POOL_CLASS_DELTA - 1) / COMPRESSED_POOL_CLASS_DELTA;
+    }
+
+    template<size_t Columns, size_t Rows>
+    static void write_row(CSV<Columns, Rows> &csv, uint64_t interval, CompressionType type, const char *scope, uint64_t class_size, uint64_t pages_per_zspage, uint64_t objects_per_zspage, const CompressedPoolStats &stats) {
+        auto &row = csv.new_row();
+        row.set(csv.title(), "Interval #", interval);
+        row.set(csv.title(), "Compression Type", compression_to_string(type));
+        row.set(csv.title(), "Scope", scope);
+        row.set(csv.title(), "Size Class (bytes)", class_size);
+        row.set(csv.title(), "Pages Per Zspage", pages_per_zspage);
+        row.set(csv.title(), "Objects Per Zspage", objects_per_zspage);
+        row.set(csv.title(), "Objects", stats.objects);
+        row.set(csv.title(), "Zspages", stats.zspages);
+        row.set(csv.title(), "Uncompressed Size (bytes)", stats.uncompressed_size);
+        row.set(csv.title(), "Compressed Size (bytes)", stats.compressed_size);
+        row.set(csv.title(), "Allocated Size (bytes)", stats.allocated_size);
+        row.set(csv.title(), "Pool Footprint (bytes)", stats.footprint);
+        row.set(csv.title(), "Handle and Rounding Waste (bytes)", stats.rounding_waste());
+        row.set(csv.title(), "Zspage Waste (bytes)", stats.zspage_waste());
+        row.set(csv.title(), "Internal Fragmentation (fraction of footprint)", stats.fragmentation());
+        row.set(csv.title(), "Ideal Savings (bytes)", stats.ideal_savings());
+        row.set(csv.title(), "Net Savings (bytes)", stats.net_savings());
+    }
+
+    void reset() {
+        for (size_t t=0; t<MAX_COMPRESSION_TYPES; t++) {
+            for (size_t i=0; i<COMPRESSED_POOL_CLASSES; i++) {
+                objects[t][i] = stored_size[t][i] = class_uncompressed_size[t][i] = 0;
+            }
+            huge_objects[t] = huge_uncompressed_size[t] = huge_compressed_size[t] = 0;
+        }
+    }
+};
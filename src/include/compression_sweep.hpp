@@ -0,0 +1,224 @@
+#pragma once
+
+#include <config.hpp>
+#include <compressor.hpp>
+#include <stack_csv.hpp>
+#include <stack_vec.hpp>
+#include <timer.hpp>
+
+// The most settings a sweep can evaluate
+#define COMPRESSION_SWEEP_MAX_SETTINGS 32
+// The most block sizes a sweep can evaluate
+#define COMPRESSION_SWEEP_MAX_BLOCK_SIZES 8
+// The largest block size; also bounds the pages gathered into one sampled span
+#ifndef COMPRESSION_SWEEP_MAX_SPAN
+#define COMPRESSION_SWEEP_MAX_SPAN 0x40000
+#endif
+// Every this-many-th resident page of the page sweep starts a sampled span
+#ifndef COMPRESSION_SWEEP_SAMPLE_STRIDE
+#define COMPRESSION_SWEEP_SAMPLE_STRIDE 8
+#endif
+// At most this many pages are sampled per interval
+#ifndef COMPRESSION_SWEEP_MAX_SAMPLES
+#define COMPRESSION_SWEEP_MAX_SAMPLES 4096
+#endif
+// Room for any codec's worst case on a largest block
+#define COMPRESSION_SWEEP_OUTPUT_SIZE (COMPRESSION_SWEEP_MAX_SPAN + COMPRESSION_SWEEP_MAX_SPAN / 4 + PAGE_SIZE)
+
+/// @brief The totals for one (setting, block size) pair over an interval's sampled spans.
+struct CompressionSweepResult {
+    uint64_t blocks = 0, pages = 0;
+    uint64_t uncompressed_size = 0, compressed_size = 0;
+    uint64_t compression_ns = 0;
+
+    double ratio() const {
+        return uncompressed_size == 0 ? 1.0 : (double)compressed_size / (double)uncompressed_size;
+    }
+
+    double ns_per_page() const {
+        return pages == 0 ? 0.0 : (double)compression_ns / (double)pages;
+    }
+
+    /// @brief True if this setting compresses at least as well and as fast
+    ///        as `other`, and strictly better at one of them.
+    bool dominates(const CompressionSweepResult &other) const {
+        return ratio() <= other.ratio() && ns_per_page() <= other.ns_per_page()
+            && (ratio() < other.ratio() || ns_per_page() < other.ns_per_page());
+    }
+};
+
+/// @brief Evaluates a list of (codec, level, window) settings at several
+///        block sizes on the same sampled spans, and reports the ratio/CPU
+///        trade-off of each.
+///
+/// Every `COMPRESSION_SWEEP_SAMPLE_STRIDE`th page the page sweep offers
+/// starts a span, which goes on gathering the pages offered after it for as
+/// long as they are contiguous, up to the largest block size. The span is
+/// copied as it grows, while the sweep has each page in cache, and once it
+/// ends it is cut into blocks of every block size and each block compressed
+/// with every setting. A span shorter than a block size ends in one shorter
+/// block, as a compressor working in blocks of that size would have to. So
+/// every (setting, block size) pair sees the same bytes, and a window log
+/// only matters at the block sizes larger than its window.
+///
+/// Only per-pair totals are kept, so an interval costs one row per pair no
+/// matter how large the heap is. A pair is Pareto optimal if no setting at
+/// the same block size dominates it.
+class CompressionSweep {
+public:
+    CompressionSweep() : compressor(DEFAULT_COMPRESSION_TYPE) {}
+
+    void add(const CompressionSetting &setting) {
+        if (settings.full()) {
+            stack_warnf("Compression sweep is full, ignoring %s level %d\n", compression_to_string(setting.type), setting.level);
+            return;
+        }
+        settings.push(setting);
+    }
+
+    void add_block_size(size_t block_size) {
+        if (block_size < PAGE_SIZE || block_size > COMPRESSION_SWEEP_MAX_SPAN || block_size % PAGE_SIZE != 0) {
+            stack_warnf("Compression sweep ignoring block size %d, it must be a multiple of %d up to %d\n", block_size, PAGE_SIZE, COMPRESSION_SWEEP_MAX_SPAN);
+            return;
+        }
+        if (block_sizes.full()) {
+            stack_warnf("Compression sweep is full, ignoring block size %d\n", block_size);
+            return;
+        }
+        block_sizes.push(block_size);
+    }
+
+    /// @brief Offer a resident page (or huge page) from the page sweep.
+    void sample(const uint8_t *page, size_t size) {
+        if (span_size > 0 && page == span_end && span_size < max_block_size() && sampled_pages < COMPRESSION_SWEEP_MAX_SAMPLES) {
+            // Carry on the open span
+            append(page, size);
+            return;
+        }
+        finish_span();
+        if (seen_pages++ % COMPRESSION_SWEEP_SAMPLE_STRIDE != 0 || sampled_pages >= COMPRESSION_SWEEP_MAX_SAMPLES) {
+            return;
+        }
+        append(page, size);
+    }
+
+    /// @brief Add one row per setting and block size to `csv` and start the next interval.
+    template<size_t Columns, size_t Rows>
+    void write(CSV<Columns, Rows> &csv, uint64_t interval) {
+        // The sweep is over, so measure the span it left open
+        finish_span();
+        for (size_t b=0; b<block_sizes.size(); b++) {
+            for (size_t i=0; i<settings.size(); i++) {
+                const CompressionSweepResult &result = results[b][i];
+                bool pareto_optimal = true;
+                for (size_t j=0; j<settings.size() && pareto_optimal; j++) {
+                    pareto_optimal = results[b][j].pages == 0 || !results[b][j].dominates(result);
+                }
+
+                auto &row = csv.new_row();
+                row.set(csv.title(), "Interval #", interval);
+                row.set(csv.title(), "Compression Type", compression_to_string(settings[i].type));
+                row.set(csv.title(), "Level", (int64_t)settings[i].level);
+                row.set(csv.title(), "Window Log", (int64_t)settings[i].window_log);
+                row.set(csv.title(), "Block Size (bytes)", (uint64_t)block_sizes[b]);
+                row.set(csv.title(), "Blocks", result.blocks);
+                row.set(csv.title(), "Sampled Pages", result.pages);
+                row.set(csv.title(), "Uncompressed Size (bytes)", result.uncompressed_size);
+                row.set(csv.title(), "Compressed Size (bytes)", result.compressed_size);
+                row.set(csv.title(), "Compression Ratio (compressed/uncompressed)", result.ratio());
+                row.set(csv.title(), "Compression Time (ns/page)", result.ns_per_page());
+                row.set(csv.title(), "Pareto Optimal?", (uint64_t)pareto_optimal);
+            }
+        }
+        reset();
+    }
+
+    template<size_t Columns, size_t Rows>
+    static void add_titles(CSV<Columns, Rows> &csv) {
+        csv.title().add("Interval #");
+        csv.title().add("Compression Type");
+        csv.title().add("Level");
+        csv.title().add("Window Log");
+        csv.title().add("Block Size (bytes)");
+        csv.title().add("Blocks");
+        csv.title().add("Sampled Pages");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Compressed Size (bytes)");
+        csv.title().add("Compression Ratio (compressed/uncompressed)");
+        csv.title().add("Compression Time (ns/page)");
+        csv.title().add("Pareto Optimal?");
+    }
+
+private:
+    StackVec<CompressionSetting, COMPRESSION_SWEEP_MAX_SETTINGS> settings;
+    StackVec<size_t, COMPRESSION_SWEEP_MAX_BLOCK_SIZES> block_sizes;
+    CompressionSweepResult results[COMPRESSION_SWEEP_MAX_BLOCK_SIZES][COMPRESSION_SWEEP_MAX_SETTINGS];
+    Compressor<PAGE_SIZE, false> compressor;
+
+    // The open span: a copy of its pages, and the address just past the last of them
+    uint8_t span[COMPRESSION_SWEEP_MAX_SPAN];
+    size_t span_size = 0;
+    const uint8_t *span_end = nullptr;
+    uint8_t output[COMPRESSION_SWEEP_OUTPUT_SIZE];
+    uint64_t seen_pages = 0, sampled_pages = 0;
+
+    size_t max_block_size() const {
+        size_t largest = PAGE_SIZE;
+        for (size_t b=0; b<block_sizes.size(); b++) {
+            largest = block_sizes[b] > largest ? block_sizes[b] : largest;
+        }
+        return largest;
+    }
+
+    void append(const uint8_t *page, size_t size) {
+        // Only as much of a huge page as fits in the largest block
+        size_t room = max_block_size() - span_size;
+        size_t length = size < room ? size : room;
+        memcpy(span + span_size, page, length);
+        span_size += length;
+        span_end = page + size;
+        sampled_pages += length / PAGE_SIZE;
+    }
+
+    /// @brief Compress the open span in blocks of every size with every setting, then close it.
+    void finish_span() {
+        if (span_size == 0) {
+            return;
+        }
+        for (size_t i=0; i<settings.size(); i++) {
+            compressor.configure(settings[i]);
+            for (size_t b=0; b<block_sizes.size(); b++) {
+                CompressionSweepResult &result = results[b][i];
+                for (size_t offset=0; offset<span_size; offset+=block_sizes[b]) {
+                    size_t size = span_size - offset < block_sizes[b] ? span_size - offset : block_sizes[b];
+                    Timer timer;
+                    timer.start();
+                    size_t compressed_size = compressor.compress_block(span + offset, size, output, sizeof(output));
+                    uint64_t ns = timer.elapsed_nanoseconds();
+                    if (compressed_size == 0) {
+                        continue;
+                    }
+                    result.blocks++;
+                    result.pages += size / PAGE_SIZE;
+                    result.uncompressed_size += size;
+                    result.compressed_size += compressed_size;
+                    result.compression_ns += ns;
+                }
+            }
+        }
+        span_size = 0;
+        span_end = nullptr;
+    }
+
+    void reset() {
+        for (size_t b=0; b<COMPRESSION_SWEEP_MAX_BLOCK_SIZES; b++) {
+            for (size_t i=0; i<COMPRESSION_SWEEP_MAX_SETTINGS; i++) {
+                results[b][i] = CompressionSweepResult();
+            }
+        }
+        span_size = 0;
+        span_end = nullptr;
+        seen_pages = 0;
+        sampled_pages = 0;
+    }
+};
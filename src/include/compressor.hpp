@@ -5,6 +5,8 @@
 #include <interval_test.hpp>
 #include <timer.hpp>
 #include <stack_csv.hpp>
+#include <sys/uio.h>
+#include <atomic>
 
 #ifdef CHECK_DYNAMIC_LIBRARIES
 #include <dlfcn.h>
@@ -47,12 +49,30 @@ LZO_ALIGN(16) unsigned char __LZO_MMODEL lzo_work[LZO1X_1_MEM_COMPRESS];
 #include <lz4hc.h>
 #endif
 
+#if defined(USE_BDI_COMPRESSION) || defined(USE_FPC_COMPRESSION)
+#include <line_compression.hpp>
+#endif
+
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
 // Path: src/compression_test.cpp
 #define MAX_COMPRESSED_SIZE 0x100000
 #define MAX_PAGES 0x10000
+// One more than the largest `CompressionType` value, for tables indexed by type
+#define MAX_COMPRESSION_TYPES 16
+
+// Streams are fed to the codecs in blocks of at most this many bytes. Codecs
+// without a streaming mode compress each block independently, like the
+// blocks of an LZ4 frame.
+#define COMPRESSION_STREAM_BLOCK_SIZE 0x10000
+// Holds the compressed output of one block for every codec (snappy has the
+// largest bound at about 7/6 of the input)
+#define COMPRESSION_STREAM_BUFFER_SIZE 0x14000
+// The size of the header each independently compressed block is charged
+#define COMPRESSION_STREAM_BLOCK_HEADER_SIZE 4
+// Enough for inflate's state and largest (32K) window, with room to spare
+#define ZLIB_DECOMPRESSION_WORKSPACE 0x10000
 
 #ifdef CHECK_DYNAMIC_LIBRARIES
 void check_dynamic_libraries() {
@@ -166,7 +186,13 @@ typedef enum {
     COMPRESS_LZF = 6,
     #endif
     #ifdef USE_LZ4HC_COMPRESSION
-    COMPRESS_LZ4HC = 7
+    COMPRESS_LZ4HC = 7,
+    #endif
+    #ifdef USE_BDI_COMPRESSION
+    COMPRESS_BDI = 8,
+    #endif
+    #ifdef USE_FPC_COMPRESSION
+    COMPRESS_FPC = 9,
     #endif
 } CompressionType;
 
@@ -200,10 +226,23 @@ CSVString compression_to_string(CompressionType type) {
         case COMPRESS_LZ4HC:
             return "lz4hc";
         #endif
+        #ifdef USE_BDI_COMPRESSION
+        case COMPRESS_BDI:
+            return "bdi";
+        #endif
+        #ifdef USE_FPC_COMPRESSION
+        case COMPRESS_FPC:
+            return "fpc";
+        #endif
     }
     return "unknown";
 }
 
+// The name a typed CSV table (csv_table.hpp) writes for a compression type
+CSVString csv_enum_name(CompressionType type) {
+    return compression_to_string(type);
+}
+
 void init_compression() {
     #ifdef USE_LZO_COMPRESSION
     static bool has_lzo_init = false;
@@ -234,19 +273,170 @@ const CompressionType DEFAULT_COMPRESSION_TYPE = COMPRESS_ZSTD;
 const CompressionType DEFAULT_COMPRESSION_TYPE = COMPRESS_LZF;
 #elif defined(USE_LZ4HC_COMPRESSION)
 const CompressionType DEFAULT_COMPRESSION_TYPE = COMPRESS_LZ4HC;
+#elif defined(USE_BDI_COMPRESSION)
+const CompressionType DEFAULT_COMPRESSION_TYPE = COMPRESS_BDI;
+#elif defined(USE_FPC_COMPRESSION)
+const CompressionType DEFAULT_COMPRESSION_TYPE = COMPRESS_FPC;
 #else
 #error "No compression library defined"
 #endif
 
+/// @brief The level each codec runs at unless told otherwise.
+///
+/// For LZ4 the "level" is its acceleration factor, where higher is faster.
+/// Codecs without levels ignore it.
+int default_compression_level(CompressionType type) {
+    switch (type) {
+        #ifdef USE_ZLIB_COMPRESSION
+        case COMPRESS_ZLIB:
+            return Z_DEFAULT_COMPRESSION;
+        #endif
+        #ifdef USE_LZ4_COMPRESSION
+        case COMPRESS_LZ4:
+            return 1;
+        #endif
+        #ifdef USE_ZSTD_COMPRESSION
+        case COMPRESS_ZSTD:
+            return 1;
+        #endif
+        #ifdef USE_LZ4HC_COMPRESSION
+        case COMPRESS_LZ4HC:
+            return LZ4HC_CLEVEL_MAX;
+        #endif
+        default:
+            return 0;
+    }
+}
+
+/// @brief A codec together with the parameters to run it with.
+struct CompressionSetting {
+    CompressionType type;
+    int level;
+    // The log2 of the match window for zlib and zstd, or 0 for the codec's
+    // default. The LZ4 codecs always use a 64 KiB window.
+    int window_log = 0;
+    // Let zstd streams find matches across the whole window, not just nearby
+    bool long_distance_matching = false;
+};
+
 
 static double total_compressed_sizes = 0;
 static double total_uncompressed_sizes = 0;
 static Stopwatch compression_overhead_timer;
 
+#ifdef COMPRESSION_TELEMETRY
+// Inputs are bucketed by size in powers of two, from 64 bytes or less up to
+// 2 MiB or more
+#define TELEMETRY_SIZE_BUCKETS 16
+#define TELEMETRY_SMALLEST_BUCKET_LOG 6
+// Ratios are bucketed in tenths, with a last bucket for anything that grew
+#define TELEMETRY_RATIO_BUCKETS 11
+
+/// @brief Running counts for one codec and input size bucket.
+///
+/// Every field is a relaxed atomic, so any thread can record without a lock.
+/// Readers take a snapshot and may see a call counted before its bytes.
+struct TelemetryCell {
+    std::atomic<uint64_t> calls{0};
+    // Non-empty inputs the codec failed on
+    std::atomic<uint64_t> failures{0};
+    // Empty inputs, which produce nothing and are left out of every ratio
+    std::atomic<uint64_t> zero_length{0};
+    std::atomic<uint64_t> uncompressed_size{0}, compressed_size{0};
+    std::atomic<uint64_t> nanoseconds{0};
+    std::atomic<uint64_t> ratios[TELEMETRY_RATIO_BUCKETS] = {};
+};
+
+/// @brief A plain copy of a `TelemetryCell` at one point in time.
+struct TelemetrySnapshot {
+    uint64_t calls = 0, failures = 0, zero_length = 0;
+    uint64_t uncompressed_size = 0, compressed_size = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t ratios[TELEMETRY_RATIO_BUCKETS] = {0};
+
+    double ratio() const {
+        return uncompressed_size == 0 ? 1.0 : (double)compressed_size / (double)uncompressed_size;
+    }
+
+    double ns_per_byte() const {
+        return uncompressed_size == 0 ? 0.0 : (double)nanoseconds / (double)uncompressed_size;
+    }
+
+    TelemetrySnapshot operator-(const TelemetrySnapshot &other) const {
+        TelemetrySnapshot delta;
+        delta.calls = calls - other.calls;
+        delta.failures = failures - other.failures;
+        delta.zero_length = zero_length - other.zero_length;
+        delta.uncompressed_size = uncompressed_size - other.uncompressed_size;
+        delta.compressed_size = compressed_size - other.compressed_size;
+        delta.nanoseconds = nanoseconds - other.nanoseconds;
+        for (size_t i=0; i<TELEMETRY_RATIO_BUCKETS; i++) {
+            delta.ratios[i] = ratios[i] - other.ratios[i];
+        }
+        return delta;
+    }
+};
+
+/// @brief Lock-free per-codec, per-input-size compression histograms.
+class CompressionTelemetry {
+public:
+    static size_t size_bucket(size_t size) {
+        size_t bucket = 0;
+        while (bucket + 1 < TELEMETRY_SIZE_BUCKETS && size > ((size_t)1 << (TELEMETRY_SMALLEST_BUCKET_LOG + bucket))) {
+            bucket++;
+        }
+        return bucket;
+    }
+
+    /// @brief The largest input in a size bucket; the last bucket is open-ended.
+    static uint64_t size_bucket_limit(size_t bucket) {
+        return (uint64_t)1 << (TELEMETRY_SMALLEST_BUCKET_LOG + bucket);
+    }
+
+    void record(CompressionType type, size_t uncompressed_size, size_t compressed_size, uint64_t nanoseconds) {
+        TelemetryCell &cell = cells[type % MAX_COMPRESSION_TYPES][size_bucket(uncompressed_size)];
+        cell.calls.fetch_add(1, std::memory_order_relaxed);
+        if (uncompressed_size == 0) {
+            cell.zero_length.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (compressed_size == 0) {
+            cell.failures.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        cell.uncompressed_size.fetch_add(uncompressed_size, std::memory_order_relaxed);
+        cell.compressed_size.fetch_add(compressed_size, std::memory_order_relaxed);
+        cell.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        size_t ratio_bucket = compressed_size * 10 / uncompressed_size;
+        cell.ratios[ratio_bucket < TELEMETRY_RATIO_BUCKETS ? ratio_bucket : TELEMETRY_RATIO_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    TelemetrySnapshot snapshot(CompressionType type, size_t bucket) const {
+        const TelemetryCell &cell = cells[type % MAX_COMPRESSION_TYPES][bucket];
+        TelemetrySnapshot snapshot;
+        snapshot.calls = cell.calls.load(std::memory_order_relaxed);
+        snapshot.failures = cell.failures.load(std::memory_order_relaxed);
+        snapshot.zero_length = cell.zero_length.load(std::memory_order_relaxed);
+        snapshot.uncompressed_size = cell.uncompressed_size.load(std::memory_order_relaxed);
+        snapshot.compressed_size = cell.compressed_size.load(std::memory_order_relaxed);
+        snapshot.nanoseconds = cell.nanoseconds.load(std::memory_order_relaxed);
+        for (size_t i=0; i<TELEMETRY_RATIO_BUCKETS; i++) {
+            snapshot.ratios[i] = cell.ratios[i].load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+private:
+    TelemetryCell cells[MAX_COMPRESSION_TYPES][TELEMETRY_SIZE_BUCKETS];
+};
+
+static CompressionTelemetry compression_telemetry;
+#endif
+
 template<size_t MaxUncompressedSize=0x1000000, bool CreateInternalBuffer = true>
 class Compressor {
 public:
-    Compressor() : type(DEFAULT_COMPRESSION_TYPE) {
+    Compressor() : type(DEFAULT_COMPRESSION_TYPE), level(default_compression_level(DEFAULT_COMPRESSION_TYPE)) {
         check_dynamic_libraries();
         init_compression();
         stack_infof("Intialized compressor with %s\n", compression_to_string(type));
@@ -255,11 +445,64 @@ public:
         }
     }
 
-    Compressor(CompressionType type) : type(type) {
+    Compressor(CompressionType type) : type(type), level(default_compression_level(type)) {
+        check_dynamic_libraries();
+        init_compression();
+    }
+
+    Compressor(const CompressionSetting &setting) : type(setting.type), level(setting.level), window_log(setting.window_log), long_distance_matching(setting.long_distance_matching) {
         check_dynamic_libraries();
         init_compression();
     }
 
+    // Streaming contexts are owned by the compressor
+    Compressor(const Compressor &other) = delete;
+    Compressor &operator=(const Compressor &other) = delete;
+
+    ~Compressor() {
+        free_streams();
+        #ifdef USE_ZSTD_COMPRESSION
+        if (zstd_block != nullptr) {
+            ZSTD_freeCCtx(zstd_block);
+        }
+        if (zstd_dctx != nullptr) {
+            ZSTD_freeDCtx(zstd_dctx);
+        }
+        #endif
+        #ifdef USE_ZLIB_COMPRESSION
+        free(zlib_workspace);
+        #endif
+    }
+
+    /// @brief Allocate what `decompress` needs ahead of time, so that it can
+    /// later run where malloc can't, such as in a fault handler. Only zlib
+    /// and zstd allocate to decompress; the other codecs need nothing.
+    void reserve_decompression_workspace() {
+        #ifdef USE_ZLIB_COMPRESSION
+        if (zlib_workspace == nullptr) {
+            zlib_workspace = (uint8_t*)malloc(ZLIB_DECOMPRESSION_WORKSPACE);
+        }
+        #endif
+        #ifdef USE_ZSTD_COMPRESSION
+        if (zstd_dctx == nullptr) {
+            zstd_dctx = ZSTD_createDCtx();
+        }
+        #endif
+    }
+
+    /// @brief Switch to another codec or level. Any stream in progress is discarded.
+    void configure(const CompressionSetting &setting) {
+        free_streams();
+        type = setting.type;
+        level = setting.level;
+        window_log = setting.window_log;
+        long_distance_matching = setting.long_distance_matching;
+    }
+
+    CompressionSetting get_setting() const {
+        return CompressionSetting{type, level, window_log, long_distance_matching};
+    }
+
     static StackVec<CompressionType, 20> supported_compression_types() {
         auto types = StackVec<CompressionType, 20>();
         #ifdef USE_ZLIB_COMPRESSION
@@ -283,6 +526,12 @@ public:
         #ifdef USE_LZ4HC_COMPRESSION
         types.push(COMPRESS_LZ4HC);
         #endif
+        #ifdef USE_BDI_COMPRESSION
+        types.push(COMPRESS_BDI);
+        #endif
+        #ifdef USE_FPC_COMPRESSION
+        types.push(COMPRESS_FPC);
+        #endif
         return types;
     }
     
@@ -316,6 +565,14 @@ public:
             case COMPRESS_LZ4HC:
                 return LZ4_COMPRESSBOUND(uncompressed_size);
             #endif
+            #ifdef USE_BDI_COMPRESSION
+            case COMPRESS_BDI:
+                return line_compression_bound(uncompressed_size);
+            #endif
+            #ifdef USE_FPC_COMPRESSION
+            case COMPRESS_FPC:
+                return line_compression_bound(uncompressed_size);
+            #endif
         }
         return 0;
     }
@@ -330,20 +587,45 @@ public:
 
     size_t compress(const uint8_t *input_buffer, size_t uncompressed_size, uint8_t *output_buffer, size_t output_size) {
         compression_overhead_timer.start();
+        total_uncompressed_sizes += uncompressed_size;
+        size_t compressed_size = compress_block(input_buffer, uncompressed_size, output_buffer, output_size);
+        total_compressed_sizes += compressed_size;
+        compression_overhead_timer.stop();
+        return compressed_size;
+    }
+
+    /// @brief Compress a buffer in one call without updating the global statistics.
+    /// @return The compressed size, or 0 if compression failed
+    size_t compress_block(const uint8_t *input_buffer, size_t uncompressed_size, uint8_t *output_buffer, size_t output_size) {
+        #ifdef COMPRESSION_TELEMETRY
+        Timer timer;
+        size_t compressed_size = compress_block_untracked(input_buffer, uncompressed_size, output_buffer, output_size);
+        compression_telemetry.record(type, uncompressed_size, compressed_size, timer.elapsed_nanoseconds());
+        return compressed_size;
+        #else
+        return compress_block_untracked(input_buffer, uncompressed_size, output_buffer, output_size);
+        #endif
+    }
+
+    /// @brief `compress_block` without telemetry.
+    size_t compress_block_untracked(const uint8_t *input_buffer, size_t uncompressed_size, uint8_t *output_buffer, size_t output_size) {
         size_t compressed_size;
         if constexpr (CreateInternalBuffer) {
             compressed_size = max_compressed_size();
         } else {
             compressed_size = max_compressed_size(uncompressed_size);
         }
-        total_uncompressed_sizes += uncompressed_size;
 
         [[maybe_unused]] int64_t err = 0;
 
         switch (type) {
             #ifdef USE_ZLIB_COMPRESSION
             case COMPRESS_ZLIB:
-                err = compress2((Bytef*)output_buffer, (uLongf*)&compressed_size, (const Bytef*)input_buffer, uncompressed_size, Z_DEFAULT_COMPRESSION);
+                if (window_log == 0) {
+                    err = compress2((Bytef*)output_buffer, (uLongf*)&compressed_size, (const Bytef*)input_buffer, uncompressed_size, level);
+                } else {
+                    err = compress_zlib_window(input_buffer, uncompressed_size, output_buffer, compressed_size);
+                }
                 // if (err != Z_OK) {
                 //     stack_errorf("Zlib compression failed\n");
                 //     return 0;
@@ -353,37 +635,30 @@ public:
                     break;
                 case Z_MEM_ERROR:
                     stack_errorf("Zlib compression failed: Z_MEM_ERROR\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 case Z_BUF_ERROR:
                     stack_errorf("Zlib compression failed: Z_BUF_ERROR\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 case Z_STREAM_ERROR:
                     stack_errorf("Zlib compression failed: Z_STREAM_ERROR\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 case Z_DATA_ERROR:
                     stack_errorf("Zlib compression failed: Z_DATA_ERROR\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 case Z_VERSION_ERROR:
                     stack_errorf("Zlib compression failed: Z_VERSION_ERROR\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 default:
                     stack_errorf("Zlib compression failed: %d\n", err);
-                    compression_overhead_timer.stop();
                     return 0;
                 }
                 break;
             #endif
             #ifdef USE_LZ4_COMPRESSION
             case COMPRESS_LZ4:
-                compressed_size = LZ4_compress_default((const char*)input_buffer, (char*)output_buffer, uncompressed_size, compressed_size);
+                compressed_size = LZ4_compress_fast((const char*)input_buffer, (char*)output_buffer, uncompressed_size, compressed_size, level);
                 if (compressed_size == 0) {
                     stack_errorf("LZ4 compression failed\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 }
                 break;
@@ -393,7 +668,6 @@ public:
                 err = lzo1x_1_compress((const unsigned char*)input_buffer, uncompressed_size, (unsigned char*)output_buffer, &compressed_size, lzo_work);
                 if (compressed_size == 0) {
                     stack_warnf("LZO compression failed\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 }
                 break;
@@ -403,17 +677,25 @@ public:
                 err = snappy_compress((const char*)input_buffer, uncompressed_size, (char*)output_buffer, &compressed_size);
                 if (err != SNAPPY_OK) {
                     stack_errorf("Snappy compression failed\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 }
                 break;
             #endif
             #ifdef USE_ZSTD_COMPRESSION
             case COMPRESS_ZSTD:
-                compressed_size = ZSTD_compress(output_buffer, compressed_size, input_buffer, uncompressed_size, 1);
+                if (window_log == 0) {
+                    compressed_size = ZSTD_compress(output_buffer, compressed_size, input_buffer, uncompressed_size, level);
+                } else {
+                    if (zstd_block == nullptr) {
+                        zstd_block = ZSTD_createCCtx();
+                    }
+                    ZSTD_CCtx_reset(zstd_block, ZSTD_reset_session_and_parameters);
+                    ZSTD_CCtx_setParameter(zstd_block, ZSTD_c_compressionLevel, level);
+                    ZSTD_CCtx_setParameter(zstd_block, ZSTD_c_windowLog, window_log);
+                    compressed_size = ZSTD_compress2(zstd_block, output_buffer, compressed_size, input_buffer, uncompressed_size);
+                }
                 if (ZSTD_isError(compressed_size)) {
                     stack_errorf("Zstd compression failed\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 }
                 break;
@@ -423,28 +705,341 @@ public:
                 compressed_size = lzf_compress(input_buffer, uncompressed_size, output_buffer, compressed_size);
                 if (compressed_size == 0) {
                     stack_errorf("LZF compression failed\n");
-                    compression_overhead_timer.stop();
                     return 0;
                 }
                 break;
             #endif
             #ifdef USE_LZ4HC_COMPRESSION
             case COMPRESS_LZ4HC:
-                compressed_size = LZ4_compress_HC((const char*)input_buffer, (char*)output_buffer, uncompressed_size, compressed_size, LZ4HC_CLEVEL_MAX);
+                compressed_size = LZ4_compress_HC((const char*)input_buffer, (char*)output_buffer, uncompressed_size, compressed_size, level);
                 if (compressed_size == 0) {
                     stack_errorf("LZ4HC compression failed\n");
-                    compression_overhead_timer.stop();
+                    return 0;
+                }
+                break;
+            #endif
+            #ifdef USE_BDI_COMPRESSION
+            case COMPRESS_BDI:
+                compressed_size = compress_lines(bdi_compress_line, input_buffer, uncompressed_size, output_buffer, output_size);
+                if (compressed_size == 0 && uncompressed_size > 0) {
+                    stack_errorf("BDI compression failed\n");
+                    return 0;
+                }
+                break;
+            #endif
+            #ifdef USE_FPC_COMPRESSION
+            case COMPRESS_FPC:
+                compressed_size = compress_lines(fpc_compress_line, input_buffer, uncompressed_size, output_buffer, output_size);
+                if (compressed_size == 0 && uncompressed_size > 0) {
+                    stack_errorf("FPC compression failed\n");
                     return 0;
                 }
                 break;
             #endif
         }
         stack_debugf("Compressed buffer at %p of %d bytes to fit in %d bytes\n", input_buffer, uncompressed_size, compressed_size);
-        total_compressed_sizes += compressed_size;
-        compression_overhead_timer.stop();
         return compressed_size;
     }
 
+    /// @brief Decompress a buffer produced by `compress` with the same compression type.
+    /// @param input_buffer The compressed data
+    /// @param compressed_size The size of the compressed data
+    /// @param output_buffer Where to write the decompressed data
+    /// @param output_size The size of the output buffer
+    /// @return The decompressed size, or 0 if decompression failed
+    size_t decompress(const uint8_t *input_buffer, size_t compressed_size, uint8_t *output_buffer, size_t output_size) {
+        size_t decompressed_size = output_size;
+
+        [[maybe_unused]] int64_t err = 0;
+
+        switch (type) {
+            #ifdef USE_ZLIB_COMPRESSION
+            case COMPRESS_ZLIB: {
+                uLongf zlib_size = output_size;
+                if (zlib_workspace != nullptr) {
+                    err = uncompress_zlib_workspace(input_buffer, compressed_size, output_buffer, zlib_size);
+                } else {
+                    err = uncompress((Bytef*)output_buffer, &zlib_size, (const Bytef*)input_buffer, compressed_size);
+                }
+                if (err != Z_OK) {
+                    stack_errorf("Zlib decompression failed: %d\n", err);
+                    return 0;
+                }
+                decompressed_size = zlib_size;
+                break;
+            }
+            #endif
+            #ifdef USE_LZ4_COMPRESSION
+            case COMPRESS_LZ4:
+                err = LZ4_decompress_safe((const char*)input_buffer, (char*)output_buffer, compressed_size, output_size);
+                if (err < 0) {
+                    stack_errorf("LZ4 decompression failed: %d\n", err);
+                    return 0;
+                }
+                decompressed_size = err;
+                break;
+            #endif
+            #ifdef USE_LZO_COMPRESSION
+            case COMPRESS_LZO: {
+                lzo_uint lzo_size = output_size;
+                err = lzo1x_decompress_safe((const unsigned char*)input_buffer, compressed_size, (unsigned char*)output_buffer, &lzo_size, NULL);
+                if (err != LZO_E_OK) {
+                    stack_errorf("LZO decompression failed: %d\n", err);
+                    return 0;
+                }
+                decompressed_size = lzo_size;
+                break;
+            }
+            #endif
+            #ifdef USE_SNAPPY_COMPRESSION
+            case COMPRESS_SNAPPY:
+                err = snappy_uncompress((const char*)input_buffer, compressed_size, (char*)output_buffer, &decompressed_size);
+                if (err != SNAPPY_OK) {
+                    stack_errorf("Snappy decompression failed\n");
+                    return 0;
+                }
+                break;
+            #endif
+            #ifdef USE_ZSTD_COMPRESSION
+            case COMPRESS_ZSTD:
+                if (zstd_dctx != nullptr) {
+                    decompressed_size = ZSTD_decompressDCtx(zstd_dctx, output_buffer, output_size, input_buffer, compressed_size);
+                } else {
+                    decompressed_size = ZSTD_decompress(output_buffer, output_size, input_buffer, compressed_size);
+                }
+                if (ZSTD_isError(decompressed_size)) {
+                    stack_errorf("Zstd decompression failed: %s\n", ZSTD_getErrorName(decompressed_size));
+                    return 0;
+                }
+                break;
+            #endif
+            #ifdef USE_LZF_COMPRESSION
+            case COMPRESS_LZF:
+                decompressed_size = lzf_decompress(input_buffer, compressed_size, output_buffer, output_size);
+                if (decompressed_size == 0) {
+                    stack_errorf("LZF decompression failed\n");
+                    return 0;
+                }
+                break;
+            #endif
+            #ifdef USE_LZ4HC_COMPRESSION
+            case COMPRESS_LZ4HC:
+                // LZ4HC produces regular LZ4 blocks
+                err = LZ4_decompress_safe((const char*)input_buffer, (char*)output_buffer, compressed_size, output_size);
+                if (err < 0) {
+                    stack_errorf("LZ4HC decompression failed: %d\n", err);
+                    return 0;
+                }
+                decompressed_size = err;
+                break;
+            #endif
+            #ifdef USE_BDI_COMPRESSION
+            case COMPRESS_BDI:
+                decompressed_size = decompress_lines(bdi_decompress_line, input_buffer, compressed_size, output_buffer, output_size);
+                if (decompressed_size == 0) {
+                    stack_errorf("BDI decompression failed\n");
+                    return 0;
+                }
+                break;
+            #endif
+            #ifdef USE_FPC_COMPRESSION
+            case COMPRESS_FPC:
+                decompressed_size = decompress_lines(fpc_decompress_line, input_buffer, compressed_size, output_buffer, output_size);
+                if (decompressed_size == 0) {
+                    stack_errorf("FPC decompression failed\n");
+                    return 0;
+                }
+                break;
+            #endif
+        }
+        stack_debugf("Decompressed %d bytes at %p into %d bytes\n", compressed_size, input_buffer, decompressed_size);
+        return decompressed_size;
+    }
+
+    /// @brief Start a new compressed stream, discarding any previous one.
+    ///
+    /// Only the size of the stream is measured: the compressed output goes
+    /// to a small scratch buffer and is thrown away, so inputs of any size
+    /// can be measured without a matching output buffer. Data fed to the
+    /// stream must stay mapped and unmodified until `end_stream`, because
+    /// the LZ4 codecs use earlier blocks as their dictionary.
+    void begin_stream() {
+        stream_size = 0;
+        stream_failed = false;
+        #ifdef COMPRESSION_TELEMETRY
+        stream_input_size = 0;
+        stream_nanoseconds = 0;
+        #endif
+
+        switch (type) {
+            #ifdef USE_ZLIB_COMPRESSION
+            case COMPRESS_ZLIB:
+                if (!zlib_stream_initialized) {
+                    memset(&zlib_stream, 0, sizeof(zlib_stream));
+                    if (deflateInit2(&zlib_stream, level, Z_DEFLATED, window_log == 0 ? MAX_WBITS : window_log, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                        stack_errorf("Zlib stream initialization failed\n");
+                        stream_failed = true;
+                        return;
+                    }
+                    zlib_stream_initialized = true;
+                } else {
+                    deflateReset(&zlib_stream);
+                }
+                break;
+            #endif
+            #ifdef USE_ZSTD_COMPRESSION
+            case COMPRESS_ZSTD:
+                if (zstd_stream == nullptr) {
+                    zstd_stream = ZSTD_createCCtx();
+                    ZSTD_CCtx_setParameter(zstd_stream, ZSTD_c_compressionLevel, level);
+                    if (window_log != 0) {
+                        ZSTD_CCtx_setParameter(zstd_stream, ZSTD_c_windowLog, window_log);
+                    }
+                    if (long_distance_matching) {
+                        ZSTD_CCtx_setParameter(zstd_stream, ZSTD_c_enableLongDistanceMatching, 1);
+                    }
+                } else {
+                    ZSTD_CCtx_reset(zstd_stream, ZSTD_reset_session_only);
+                }
+                break;
+            #endif
+            #ifdef USE_LZ4_COMPRESSION
+            case COMPRESS_LZ4:
+                if (lz4_stream == nullptr) {
+                    lz4_stream = LZ4_createStream();
+                } else {
+                    LZ4_resetStream_fast(lz4_stream);
+                }
+                break;
+            #endif
+            #ifdef USE_LZ4HC_COMPRESSION
+            case COMPRESS_LZ4HC:
+                if (lz4hc_stream == nullptr) {
+                    lz4hc_stream = LZ4_createStreamHC();
+                }
+                LZ4_resetStreamHC_fast(lz4hc_stream, level);
+                break;
+            #endif
+            default:
+                // Block codecs have no state between blocks
+                break;
+        }
+    }
+
+    /// @brief Feed the next chunk of input to the current stream.
+    void stream(const uint8_t *input_buffer, size_t size) {
+        if (stream_failed) {
+            return;
+        }
+        compression_overhead_timer.start();
+        total_uncompressed_sizes += size;
+        #ifdef COMPRESSION_TELEMETRY
+        Timer timer;
+        stream_input_size += size;
+        #endif
+        for (size_t offset=0; offset < size && !stream_failed; offset += COMPRESSION_STREAM_BLOCK_SIZE) {
+            stream_block(input_buffer + offset, min(size - offset, (size_t)COMPRESSION_STREAM_BLOCK_SIZE));
+        }
+        #ifdef COMPRESSION_TELEMETRY
+        stream_nanoseconds += timer.elapsed_nanoseconds();
+        #endif
+        compression_overhead_timer.stop();
+    }
+
+    /// @brief Feed scattered chunks of input to the current stream, in order.
+    ///
+    /// The chunks are read where they are, so non-contiguous pages of an
+    /// object can be compressed as one stream without staging them into a
+    /// contiguous buffer first.
+    /// @param segments The chunks to compress
+    /// @param count The number of chunks
+    void stream(const struct iovec *segments, size_t count) {
+        for (size_t i=0; i<count && !stream_failed; i++) {
+            stream((const uint8_t*)segments[i].iov_base, segments[i].iov_len);
+        }
+    }
+
+    /// @brief Finish the current stream.
+    /// @return The compressed size of everything fed to the stream, or 0 on failure
+    size_t end_stream() {
+        if (stream_failed) {
+            #ifdef COMPRESSION_TELEMETRY
+            compression_telemetry.record(type, stream_input_size, 0, stream_nanoseconds);
+            #endif
+            return 0;
+        }
+        compression_overhead_timer.start();
+        #ifdef COMPRESSION_TELEMETRY
+        Timer timer;
+        #endif
+        [[maybe_unused]] uint8_t *output_buffer = stream_buffer();
+
+        switch (type) {
+            #ifdef USE_ZLIB_COMPRESSION
+            case COMPRESS_ZLIB: {
+                int err;
+                zlib_stream.next_in = NULL;
+                zlib_stream.avail_in = 0;
+                do {
+                    zlib_stream.next_out = (Bytef*)output_buffer;
+                    zlib_stream.avail_out = COMPRESSION_STREAM_BUFFER_SIZE;
+                    err = deflate(&zlib_stream, Z_FINISH);
+                    stream_size += COMPRESSION_STREAM_BUFFER_SIZE - zlib_stream.avail_out;
+                } while (err == Z_OK);
+                if (err != Z_STREAM_END) {
+                    stack_errorf("Zlib stream compression failed: %d\n", err);
+                    stream_failed = true;
+                }
+                break;
+            }
+            #endif
+            #ifdef USE_ZSTD_COMPRESSION
+            case COMPRESS_ZSTD: {
+                ZSTD_inBuffer input = {NULL, 0, 0};
+                size_t remaining;
+                do {
+                    ZSTD_outBuffer output = {output_buffer, COMPRESSION_STREAM_BUFFER_SIZE, 0};
+                    remaining = ZSTD_compressStream2(zstd_stream, &output, &input, ZSTD_e_end);
+                    if (ZSTD_isError(remaining)) {
+                        stack_errorf("Zstd stream compression failed: %s\n", ZSTD_getErrorName(remaining));
+                        stream_failed = true;
+                        break;
+                    }
+                    stream_size += output.pos;
+                } while (remaining != 0);
+                break;
+            }
+            #endif
+            default:
+                break;
+        }
+        compression_overhead_timer.stop();
+
+        #ifdef COMPRESSION_TELEMETRY
+        // The whole stream counts as a single call
+        compression_telemetry.record(type, stream_input_size, stream_failed ? 0 : stream_size, stream_nanoseconds + timer.elapsed_nanoseconds());
+        #endif
+        if (stream_failed) {
+            return 0;
+        }
+        total_compressed_sizes += stream_size;
+        return stream_size;
+    }
+
+    /// @brief Measure the compressed size of a buffer of any size as one stream.
+    size_t compress_stream(const uint8_t *input_buffer, size_t size) {
+        begin_stream();
+        stream(input_buffer, size);
+        return end_stream();
+    }
+
+    /// @brief Measure the compressed size of scattered chunks as one stream.
+    size_t compress_stream(const struct iovec *segments, size_t count) {
+        begin_stream();
+        stream(segments, count);
+        return end_stream();
+    }
+
     size_t compress_object(const Allocation &alloc) {
         return compress(alloc.ptr, alloc.size);
     }
@@ -454,6 +1049,20 @@ public:
         stack_infof("Total uncompressed size: %f\n", total_uncompressed_sizes);
         stack_infof("Total compressed size: %f\n", total_compressed_sizes);
         stack_infof("Overall compression ratio: %f\n", total_compressed_sizes / total_uncompressed_sizes);
+        #ifdef COMPRESSION_TELEMETRY
+        auto types = supported_compression_types();
+        for (size_t i=0; i<types.size(); i++) {
+            for (size_t bucket=0; bucket<TELEMETRY_SIZE_BUCKETS; bucket++) {
+                TelemetrySnapshot stats = compression_telemetry.snapshot(types[i], bucket);
+                if (stats.calls == 0) {
+                    continue;
+                }
+                stack_infof("  %s up to %d bytes: %d calls, ratio %f, %f ns/byte, %d failures, %d empty\n",
+                    compression_to_string(types[i]), CompressionTelemetry::size_bucket_limit(bucket),
+                    stats.calls, stats.ratio(), stats.ns_per_byte(), stats.failures, stats.zero_length);
+            }
+        }
+        #endif
     }
 
     template<size_t MaxPhysicalPages=10000>
@@ -467,8 +1076,205 @@ public:
     }
 private:
     CompressionType type;
+    int level;
+    int window_log = 0;
+    bool long_distance_matching = false;
     
     uint8_t internal_buffer[CreateInternalBuffer ? int(MaxUncompressedSize * 1.5) : 1];
+
+    // The state of the current stream
+    size_t stream_size = 0;
+    bool stream_failed = false;
+    #ifdef COMPRESSION_TELEMETRY
+    size_t stream_input_size = 0;
+    uint64_t stream_nanoseconds = 0;
+    #endif
+    #ifdef USE_ZLIB_COMPRESSION
+    z_stream zlib_stream;
+    bool zlib_stream_initialized = false;
+    #endif
+    #ifdef USE_ZSTD_COMPRESSION
+    ZSTD_CCtx *zstd_stream = nullptr;
+    // Only needed for one-shot compression with a non-default window
+    ZSTD_CCtx *zstd_block = nullptr;
+    // Only made by `reserve_decompression_workspace`
+    ZSTD_DCtx *zstd_dctx = nullptr;
+    #endif
+    #ifdef USE_ZLIB_COMPRESSION
+    // What `inflate` allocates from once reserved, reset for every call
+    uint8_t *zlib_workspace = nullptr;
+    size_t zlib_workspace_used = 0;
+    #endif
+    #if defined(USE_LZ4_COMPRESSION) || defined(USE_LZ4HC_COMPRESSION)
+    LZ4_stream_t *lz4_stream = nullptr;
+    #endif
+    #ifdef USE_LZ4HC_COMPRESSION
+    LZ4_streamHC_t *lz4hc_stream = nullptr;
+    #endif
+
+    void free_streams() {
+        #ifdef USE_ZLIB_COMPRESSION
+        if (zlib_stream_initialized) {
+            deflateEnd(&zlib_stream);
+            zlib_stream_initialized = false;
+        }
+        #endif
+        #ifdef USE_ZSTD_COMPRESSION
+        if (zstd_stream != nullptr) {
+            ZSTD_freeCCtx(zstd_stream);
+            zstd_stream = nullptr;
+        }
+        #endif
+        #if defined(USE_LZ4_COMPRESSION) || defined(USE_LZ4HC_COMPRESSION)
+        if (lz4_stream != nullptr) {
+            LZ4_freeStream(lz4_stream);
+            lz4_stream = nullptr;
+        }
+        #endif
+        #ifdef USE_LZ4HC_COMPRESSION
+        if (lz4hc_stream != nullptr) {
+            LZ4_freeStreamHC(lz4hc_stream);
+            lz4hc_stream = nullptr;
+        }
+        #endif
+    }
+
+    #ifdef USE_ZLIB_COMPRESSION
+    /// @brief `compress2` with a custom window size.
+    int compress_zlib_window(const uint8_t *input_buffer, size_t uncompressed_size, uint8_t *output_buffer, size_t &compressed_size) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        int err = deflateInit2(&stream, level, Z_DEFLATED, window_log, 8, Z_DEFAULT_STRATEGY);
+        if (err != Z_OK) {
+            return err;
+        }
+        stream.next_in = (Bytef*)input_buffer;
+        stream.avail_in = uncompressed_size;
+        stream.next_out = (Bytef*)output_buffer;
+        stream.avail_out = compressed_size;
+        err = deflate(&stream, Z_FINISH);
+        compressed_size = stream.total_out;
+        deflateEnd(&stream);
+        return err == Z_STREAM_END ? Z_OK : Z_BUF_ERROR;
+    }
+    #endif
+
+    #ifdef USE_ZLIB_COMPRESSION
+    static voidpf zlib_workspace_alloc(voidpf opaque, uInt items, uInt size) {
+        Compressor *compressor = (Compressor*)opaque;
+        size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+        if (compressor->zlib_workspace_used + bytes > ZLIB_DECOMPRESSION_WORKSPACE) {
+            return Z_NULL;
+        }
+        voidpf memory = compressor->zlib_workspace + compressor->zlib_workspace_used;
+        compressor->zlib_workspace_used += bytes;
+        return memory;
+    }
+
+    static void zlib_workspace_free(voidpf opaque, voidpf address) {}
+
+    /// @brief `uncompress` with `inflate` allocating from the reserved workspace.
+    int uncompress_zlib_workspace(const uint8_t *input_buffer, size_t compressed_size, uint8_t *output_buffer, uLongf &output_size) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        stream.zalloc = zlib_workspace_alloc;
+        stream.zfree = zlib_workspace_free;
+        stream.opaque = this;
+        zlib_workspace_used = 0;
+        int err = inflateInit(&stream);
+        if (err != Z_OK) {
+            return err;
+        }
+        stream.next_in = (Bytef*)input_buffer;
+        stream.avail_in = compressed_size;
+        stream.next_out = (Bytef*)output_buffer;
+        stream.avail_out = output_size;
+        err = inflate(&stream, Z_FINISH);
+        output_size = stream.total_out;
+        inflateEnd(&stream);
+        return err == Z_STREAM_END ? Z_OK : (err == Z_OK ? Z_BUF_ERROR : err);
+    }
+    #endif
+
+    // Stream output is only measured, so every stream shares one scratch buffer
+    static uint8_t *stream_buffer() {
+        static uint8_t buffer[COMPRESSION_STREAM_BUFFER_SIZE];
+        return buffer;
+    }
+
+    void stream_block(const uint8_t *input_buffer, size_t size) {
+        uint8_t *output_buffer = stream_buffer();
+        switch (type) {
+            #ifdef USE_ZLIB_COMPRESSION
+            case COMPRESS_ZLIB:
+                zlib_stream.next_in = (Bytef*)input_buffer;
+                zlib_stream.avail_in = size;
+                while (zlib_stream.avail_in > 0) {
+                    zlib_stream.next_out = (Bytef*)output_buffer;
+                    zlib_stream.avail_out = COMPRESSION_STREAM_BUFFER_SIZE;
+                    int err = deflate(&zlib_stream, Z_NO_FLUSH);
+                    if (err != Z_OK && err != Z_BUF_ERROR) {
+                        stack_errorf("Zlib stream compression failed: %d\n", err);
+                        stream_failed = true;
+                        return;
+                    }
+                    stream_size += COMPRESSION_STREAM_BUFFER_SIZE - zlib_stream.avail_out;
+                }
+                break;
+            #endif
+            #ifdef USE_ZSTD_COMPRESSION
+            case COMPRESS_ZSTD: {
+                ZSTD_inBuffer input = {input_buffer, size, 0};
+                while (input.pos < input.size) {
+                    ZSTD_outBuffer output = {output_buffer, COMPRESSION_STREAM_BUFFER_SIZE, 0};
+                    size_t err = ZSTD_compressStream2(zstd_stream, &output, &input, ZSTD_e_continue);
+                    if (ZSTD_isError(err)) {
+                        stack_errorf("Zstd stream compression failed: %s\n", ZSTD_getErrorName(err));
+                        stream_failed = true;
+                        return;
+                    }
+                    stream_size += output.pos;
+                }
+                break;
+            }
+            #endif
+            #ifdef USE_LZ4_COMPRESSION
+            case COMPRESS_LZ4: {
+                int compressed_size = LZ4_compress_fast_continue(lz4_stream, (const char*)input_buffer, (char*)output_buffer, size, COMPRESSION_STREAM_BUFFER_SIZE, level);
+                if (compressed_size <= 0) {
+                    stack_errorf("LZ4 stream compression failed\n");
+                    stream_failed = true;
+                    return;
+                }
+                stream_size += compressed_size + COMPRESSION_STREAM_BLOCK_HEADER_SIZE;
+                break;
+            }
+            #endif
+            #ifdef USE_LZ4HC_COMPRESSION
+            case COMPRESS_LZ4HC: {
+                int compressed_size = LZ4_compress_HC_continue(lz4hc_stream, (const char*)input_buffer, (char*)output_buffer, size, COMPRESSION_STREAM_BUFFER_SIZE);
+                if (compressed_size <= 0) {
+                    stack_errorf("LZ4HC stream compression failed\n");
+                    stream_failed = true;
+                    return;
+                }
+                stream_size += compressed_size + COMPRESSION_STREAM_BLOCK_HEADER_SIZE;
+                break;
+            }
+            #endif
+            default: {
+                // Codecs without a streaming mode compress each block on its
+                // own; telemetry counts the stream as a whole in `end_stream`
+                size_t compressed_size = compress_block_untracked(input_buffer, size, output_buffer, COMPRESSION_STREAM_BUFFER_SIZE);
+                if (compressed_size == 0) {
+                    stream_failed = true;
+                    return;
+                }
+                stream_size += compressed_size + COMPRESSION_STREAM_BLOCK_HEADER_SIZE;
+                break;
+            }
+        }
+    }
 };
 
 
@@ -28,6 +28,8 @@
 // #define ACCESS_PATTERN_TEST
 // #define ACCESS_COMPRESSION_TEST
 // #define HUGE_PAGE_ACCESS_COMPRESSION_TEST
+// #define COMPRESSION_ALLOCATOR_TEST
+// #define CODEC_SELECTION_TEST
 #define ALL_TEST
 
 // #define USE_ZLIB_COMPRESSION // (1.2.11-1)
@@ -37,6 +39,27 @@
 // #define USE_ZSTD_COMPRESSION // (1.4.0-1)
 // #define USE_LZF_COMPRESSION // (3.6)
 // #define USE_LZ4HC_COMPRESSION // (1.9.0)
+// Software models of hardware cache-line compressors (no library needed)
+// #define USE_BDI_COMPRESSION
+// #define USE_FPC_COMPRESSION
+
+// Keep lock-free per-codec, per-input-size compression histograms, printed
+// with the compression summary and written every interval by the telemetry test
+#define COMPRESSION_TELEMETRY
+
+// Hand flushed output to a writer thread through a pair of swap buffers, so
+// intervals only format rows and never wait on the disk unless both are full
+#define ASYNC_FILE_WRITES
+
+// Publish live counts, rates, hook overhead, dropped events and the last
+// interval's compression ratios in a shared-memory page, `/heappulse-<pid>`,
+// for `heappulse-metrics` or any other monitor to read while the program runs
+// #define LIVE_METRICS
+
+// Write output tables zstd-compressed as `*.csv.zst` (and `*.hpcol.zst`), at
+// OUTPUT_COMPRESSION_LEVEL, ending a frame after every table write so a file
+// cut short still decompresses up to its last interval (needs libzstd)
+// #define COMPRESS_OUTPUT_FILES
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE 4096
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <config.hpp>
+#include <compressor.hpp>
+#include <stack_csv.hpp>
+#include <stack_map.hpp>
+
+#ifdef USE_ZSTD_COMPRESSION
+
+// The zstd window for the site and heap streams. Matches are only found
+// within this many bytes of each other, and zstd keeps a window's worth of
+// input buffered while streaming.
+#ifndef CROSS_PAGE_WINDOW_LOG
+#define CROSS_PAGE_WINDOW_LOG 27
+#endif
+// The same level `Compressor` uses for zstd pages, so only the extra context differs
+#define CROSS_PAGE_LEVEL 1
+// The most sites reported per interval
+#define CROSS_PAGE_SITES 10000
+
+/// @brief The per-page and streamed sizes of one group of pages.
+struct CrossPageStats {
+    uint64_t pages = 0;
+    uint64_t uncompressed_size = 0;
+    // The sum of the pages' individually compressed sizes
+    uint64_t page_compressed_size = 0;
+    // The size of all the pages compressed as one long-distance stream
+    uint64_t stream_compressed_size = 0;
+
+    double page_ratio() const {
+        return uncompressed_size == 0 ? 1.0 : (double)page_compressed_size / (double)uncompressed_size;
+    }
+
+    double stream_ratio() const {
+        return uncompressed_size == 0 ? 1.0 : (double)stream_compressed_size / (double)uncompressed_size;
+    }
+};
+
+/// @brief Measures redundancy across pages by streaming whole sites, and
+///        optionally the whole heap, through zstd with long-distance matching.
+///
+/// The page sweep visits one allocation site at a time, so each site is a
+/// single stream that is finished when the sweep moves on. The heap stream
+/// runs alongside it over every page. Pages are read in place as they are
+/// swept; nothing is copied besides zstd's own window.
+///
+/// Comparing a stream's size to the sum of the same pages compressed one at
+/// a time shows how much a larger compression unit would save.
+class CrossPageRedundancy {
+public:
+    CrossPageRedundancy() :
+        site_stream(CompressionSetting{COMPRESS_ZSTD, CROSS_PAGE_LEVEL, CROSS_PAGE_WINDOW_LOG, true}),
+        heap_stream(CompressionSetting{COMPRESS_ZSTD, CROSS_PAGE_LEVEL, CROSS_PAGE_WINDOW_LOG, true}) {}
+
+    /// @brief Start an interval's sweep.
+    /// @param whole_heap Also stream every page of the heap together
+    void begin(bool whole_heap) {
+        heap_enabled = whole_heap;
+        heap = CrossPageStats();
+        if (heap_enabled) {
+            heap_stream.begin_stream();
+        }
+    }
+
+    /// @brief Start the stream for the next site in the sweep.
+    void begin_site(uintptr_t site) {
+        current_site = site;
+        current = CrossPageStats();
+        site_stream.begin_stream();
+    }
+
+    /// @brief Feed a resident page to the current site's stream and the heap stream.
+    /// @param page The page's contents
+    /// @param size The page's size
+    /// @param page_compressed_size The page's size when compressed on its own
+    void add_page(const uint8_t *page, size_t size, uint64_t page_compressed_size) {
+        site_stream.stream(page, size);
+        current.pages++;
+        current.uncompressed_size += size;
+        current.page_compressed_size += page_compressed_size;
+
+        if (heap_enabled) {
+            heap_stream.stream(page, size);
+            heap.pages++;
+            heap.uncompressed_size += size;
+            heap.page_compressed_size += page_compressed_size;
+        }
+    }
+
+    /// @brief Finish the current site's stream.
+    void end_site() {
+        current.stream_compressed_size = site_stream.end_stream();
+        if (current.pages == 0) {
+            return;
+        }
+        if (sites.num_entries() >= CROSS_PAGE_SITES) {
+            stack_warnf("Cross-page redundancy is tracking too many sites, dropping site %p\n", (void*)current_site);
+            return;
+        }
+        sites.put(current_site, current);
+    }
+
+    /// @brief Finish the heap stream.
+    void end() {
+        if (heap_enabled) {
+            heap.stream_compressed_size = heap_stream.end_stream();
+        }
+    }
+
+    /// @brief Add a row per site, and one for the heap, to `csv` and start the next interval.
+    template<size_t Columns, size_t Rows>
+    void write(CSV<Columns, Rows> &csv, StackFile &file, uint64_t interval) {
+        sites.map([&](const uintptr_t &site, const CrossPageStats &stats) {
+            write_row(csv, interval, "Site", (void*)site, stats);
+            if (csv.full()) {
+                csv.write(file);
+                csv.clear();
+            }
+        });
+        if (heap_enabled && heap.pages > 0) {
+            write_row(csv, interval, "Heap", nullptr, heap);
+            stack_infof("Cross-page redundancy: heap compresses to %f as one stream, %f page by page\n", heap.stream_ratio(), heap.page_ratio());
+        }
+        sites.clear();
+    }
+
+    template<size_t Columns, size_t Rows>
+    static void add_titles(CSV<Columns, Rows> &csv) {
+        csv.title().add("Interval #");
+        csv.title().add("Scope");
+        csv.title().add("Allocation Site");
+        csv.title().add("Resident Pages");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Per-Page Compressed Size (bytes)");
+        csv.title().add("Per-Page Compression Ratio (compressed/uncompressed)");
+        csv.title().add("Stream Compressed Size (bytes)");
+        csv.title().add("Stream Compression Ratio (compressed/uncompressed)");
+        csv.title().add("Cross-Page Savings (bytes)");
+    }
+
+private:
+    Compressor<PAGE_SIZE, false> site_stream, heap_stream;
+    bool heap_enabled = false;
+    uintptr_t current_site = 0;
+    CrossPageStats current, heap;
+    StackMap<uintptr_t, CrossPageStats, CROSS_PAGE_SITES * 2> sites;
+
+    template<size_t Columns, size_t Rows>
+    static void write_row(CSV<Columns, Rows> &csv, uint64_t interval, const char *scope, void *site, const CrossPageStats &stats) {
+        auto &row = csv.new_row();
+        row.set(csv.title(), "Interval #", interval);
+        row.set(csv.title(), "Scope", scope);
+        row.set(csv.title(), "Allocation Site", site);
+        row.set(csv.title(), "Resident Pages", stats.pages);
+        row.set(csv.title(), "Uncompressed Size (bytes)", stats.uncompressed_size);
+        row.set(csv.title(), "Per-Page Compressed Size (bytes)", stats.page_compressed_size);
+        row.set(csv.title(), "Per-Page Compression Ratio (compressed/uncompressed)", stats.page_ratio());
+        row.set(csv.title(), "Stream Compressed Size (bytes)", stats.stream_compressed_size);
+        row.set(csv.title(), "Stream Compression Ratio (compressed/uncompressed)", stats.stream_ratio());
+        // Negative when the stream's framing costs more than it finds
+        row.set(csv.title(), "Cross-Page Savings (bytes)", (int64_t)stats.page_compressed_size - (int64_t)stats.stream_compressed_size);
+    }
+};
+#endif
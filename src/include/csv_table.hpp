@@ -0,0 +1,408 @@
+#pragma once
+
+#include <stack_csv.hpp>
+#include <stack_file.hpp>
+#include <stack_vec.hpp>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Declare a column for a `CSVSchema`: a tag type with the column's value type
+// and title. Values may be integers, floating point numbers, booleans,
+// pointers, or enums with a `csv_enum_name` overload giving each value's text.
+#define CSV_COLUMN(Name, Type, Title) \
+    struct Name { \
+        typedef Type type; \
+        static constexpr const char *title = Title; \
+    }
+
+// The index of `Column` among `Columns`
+template <typename Column, typename First, typename... Rest>
+constexpr size_t csv_column_index() {
+    if constexpr (std::is_same<Column, First>::value) {
+        return 0;
+    } else {
+        static_assert(sizeof...(Rest) > 0, "The column is not part of this schema");
+        if constexpr (sizeof...(Rest) > 0) {
+            return 1 + csv_column_index<Column, Rest...>();
+        } else {
+            return 0;
+        }
+    }
+}
+
+/// @brief The columns of a table, in order, with their types fixed at compile time.
+template <typename... Columns>
+struct CSVSchema {
+    static constexpr size_t width = sizeof...(Columns);
+    static_assert(width > 0 && width <= 64, "A schema has between 1 and 64 columns");
+
+    typedef std::tuple<typename Columns::type...> Values;
+
+    template <typename Column>
+    static constexpr size_t index() {
+        return csv_column_index<Column, Columns...>();
+    }
+
+    static const char *title(size_t col) {
+        static constexpr const char *titles[] = {Columns::title...};
+        return titles[col];
+    }
+};
+
+/// @brief One row of a `CSVTable`: the values in their own types, and which were set.
+template <typename Schema>
+struct CSVTableRow {
+    typename Schema::Values values;
+    uint64_t present = 0;
+
+    template <typename Column>
+    void set(typename Column::type value) {
+        constexpr size_t col = Schema::template index<Column>();
+        std::get<col>(values) = value;
+        present |= 1ULL << col;
+    }
+
+    template <typename Column>
+    const typename Column::type &get() const {
+        return std::get<Schema::template index<Column>()>(values);
+    }
+
+    bool has(size_t col) const {
+        return (present >> col) & 1;
+    }
+};
+
+static inline void csv_append_name(StackFile &file, const char *name) {
+    file.append(name, strlen(name));
+}
+
+static inline void csv_append_name(StackFile &file, const CSVString &name) {
+    for (size_t i=0; i<name.size() && name[i] != '\0'; i++) {
+        file.append(name[i]);
+    }
+}
+
+// Write a value as the text format would write the equivalent `CSVCell`
+template <typename T>
+void csv_write_value(StackFile &file, const T &value) {
+    if constexpr (std::is_enum<T>::value) {
+        csv_append_name(file, csv_enum_name(value));
+    } else if constexpr (std::is_same<T, bool>::value) {
+        if (value) {
+            file.append("true", 4);
+        } else {
+            file.append("false", 5);
+        }
+    } else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+        file.append_integer(value);
+    } else if constexpr (std::is_integral<T>::value) {
+        file.append_unsigned(value);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        file.append_float(value);
+    } else {
+        static_assert(std::is_pointer<T>::value, "Columns hold numbers, booleans, pointers or enums");
+        file.append_hex((uintptr_t)value);
+    }
+}
+
+// How a column of `T` is stored in the columnar format
+template <typename T>
+constexpr CSVColumnType csv_column_type() {
+    if constexpr (std::is_enum<T>::value) {
+        return CSVColumnType::DICTIONARY;
+    } else if constexpr (std::is_same<T, bool>::value) {
+        return CSVColumnType::BOOLEAN;
+    } else if constexpr (std::is_integral<T>::value) {
+        return CSVColumnType::INTEGER;
+    } else if constexpr (std::is_floating_point<T>::value) {
+        return CSVColumnType::FLOAT;
+    } else {
+        return CSVColumnType::POINTER;
+    }
+}
+
+/// @brief A table whose columns are declared once in a `CSVSchema`.
+///
+/// Rows hold each value in its own type, so a row is a few bytes per column
+/// instead of a `CSVCell` with a 128-byte string, and `set` finds its column
+/// at compile time instead of comparing titles. Enum columns are written by
+/// name, so string columns with a handful of values cost a byte each.
+///
+/// Both formats come out the same as a `CSV` with the same titles and cells
+/// would write them, except that every row has every column, with cells that
+/// were not set left empty.
+template <typename Schema, size_t Length>
+class CSVTable {
+public:
+    typedef CSVTableRow<Schema> Row;
+
+    Row &new_row() {
+        rows.push(Row());
+        return rows[rows.size() - 1];
+    }
+
+    // Drop the last row, once it turns out not to be needed
+    void pop_row() {
+        rows.pop();
+    }
+
+    bool full() const {
+        return rows.size() >= Length;
+    }
+
+    size_t size() const {
+        return rows.size();
+    }
+
+    void clear() {
+        rows.clear();
+    }
+
+    void set_format(CSVFormat format) {
+        this->format = format;
+    }
+
+    // Write the title before the first rows, then the rows
+    void write(StackFile &file) {
+        if (file.get_mode() == Mode::READ) {
+            stack_errorf("Not writing to % because it is not open for writing\n", file.get_filename());
+            throw std::runtime_error("File not open for writing");
+        }
+        if (is_first_write && file.get_mode() == Mode::WRITE) {
+            file.clear();
+        }
+        if (format == CSVFormat::COLUMNAR) {
+            is_first_write = false;
+            write_columnar(file);
+            return;
+        }
+
+        if (is_first_write) {
+            for (size_t col=0; col<Schema::width; col++) {
+                csv_append_name(file, Schema::title(col));
+                file.append(col + 1 < Schema::width ? ',' : '\n');
+            }
+            is_first_write = false;
+        }
+        for (size_t i=0; i<rows.size(); i++) {
+            write_row(file, rows[i], std::make_index_sequence<Schema::width>());
+            file.append('\n');
+        }
+        file.checkpoint();
+    }
+
+private:
+    StackVec<Row, Length> rows;
+    bool is_first_write = true;
+    CSVFormat format = CSVFormat::TEXT;
+
+    // Where each column's sections go in the chunk being written
+    struct ColumnLayout {
+        uint64_t name_size, validity_size, data_size, dictionary_size, dictionary_entries;
+        bool has_missing;
+    };
+
+    // The distinct values of the enum column being encoded, in order of first use
+    struct EnumDictionary {
+        int64_t values[CSV_COLUMNAR_MAX_DICTIONARY];
+        size_t size = 0;
+
+        uint32_t code(int64_t value) {
+            for (size_t i=0; i<size; i++) {
+                if (values[i] == value) {
+                    return i;
+                }
+            }
+            if (size >= CSV_COLUMNAR_MAX_DICTIONARY) {
+                stack_warnf("Enum column has more than %d values, writing the rest as the last one\n", CSV_COLUMNAR_MAX_DICTIONARY);
+                return size - 1;
+            }
+            values[size] = value;
+            return size++;
+        }
+    };
+
+    static EnumDictionary &dictionary() {
+        static EnumDictionary dictionary;
+        return dictionary;
+    }
+
+    template <size_t... Cols>
+    static void write_row(StackFile &file, const Row &row, std::index_sequence<Cols...>) {
+        ((Cols > 0 ? file.append(',') : (void)0,
+          row.has(Cols) ? csv_write_value(file, std::get<Cols>(row.values)) : (void)0), ...);
+    }
+
+    static uint64_t name_length(const char *name) {
+        return strlen(name);
+    }
+
+    static uint64_t name_length(const CSVString &name) {
+        uint64_t length = 0;
+        while (length < name.size() && name[length] != '\0') {
+            length++;
+        }
+        return length;
+    }
+
+    static void write_padding(StackFile &file, uint64_t written, uint64_t padded) {
+        for (; written < padded; written++) {
+            file.append('\0');
+        }
+    }
+
+    template <size_t Col>
+    ColumnLayout layout_column() {
+        typedef typename std::tuple_element<Col, typename Schema::Values>::type T;
+        ColumnLayout layout = {strlen(Schema::title(Col)), 0, 0, 0, 0, false};
+        uint64_t count = rows.size();
+        for (size_t i=0; i<rows.size(); i++) {
+            layout.has_missing = layout.has_missing || !rows[i].has(Col);
+        }
+        layout.validity_size = layout.has_missing ? csv_columnar_pad((count + 7) / 8) : 0;
+
+        switch (csv_column_type<T>()) {
+            case CSVColumnType::DICTIONARY:
+                layout.data_size = csv_columnar_pad(count * sizeof(uint32_t));
+                if constexpr (std::is_enum<T>::value) {
+                    EnumDictionary &dict = dictionary();
+                    dict.size = 0;
+                    for (size_t i=0; i<rows.size(); i++) {
+                        if (rows[i].has(Col)) {
+                            dict.code((int64_t)std::get<Col>(rows[i].values));
+                        }
+                    }
+                    layout.dictionary_entries = dict.size;
+                    for (size_t i=0; i<dict.size; i++) {
+                        layout.dictionary_size += sizeof(uint32_t) + name_length(csv_enum_name((T)dict.values[i]));
+                    }
+                    layout.dictionary_size = csv_columnar_pad(layout.dictionary_size);
+                }
+                break;
+            case CSVColumnType::BOOLEAN:
+                layout.data_size = csv_columnar_pad(count);
+                break;
+            default:
+                layout.data_size = count * 8;
+                break;
+        }
+        return layout;
+    }
+
+    template <size_t Col>
+    void write_column(StackFile &file, const ColumnLayout &layout) {
+        typedef typename std::tuple_element<Col, typename Schema::Values>::type T;
+        csv_append_name(file, Schema::title(Col));
+        write_padding(file, layout.name_size, csv_columnar_pad(layout.name_size));
+
+        if (layout.has_missing) {
+            uint8_t byte = 0;
+            for (size_t i=0; i<rows.size(); i++) {
+                byte |= rows[i].has(Col) << (i % 8);
+                if (i % 8 == 7) {
+                    file.append((char)byte);
+                    byte = 0;
+                }
+            }
+            if (rows.size() % 8 != 0) {
+                file.append((char)byte);
+            }
+            write_padding(file, (rows.size() + 7) / 8, layout.validity_size);
+        }
+
+        uint64_t written = 0;
+        if constexpr (std::is_enum<T>::value) {
+            // Rebuild the dictionary the layout was sized with; the codes come out the same
+            EnumDictionary &dict = dictionary();
+            dict.size = 0;
+            for (size_t i=0; i<rows.size(); i++) {
+                if (rows[i].has(Col)) {
+                    dict.code((int64_t)std::get<Col>(rows[i].values));
+                }
+            }
+            for (size_t i=0; i<dict.size; i++) {
+                auto name = csv_enum_name((T)dict.values[i]);
+                uint32_t length = name_length(name);
+                file.append((const char*)&length, sizeof(length));
+                csv_append_name(file, name);
+                written += sizeof(length) + length;
+            }
+            write_padding(file, written, layout.dictionary_size);
+            written = 0;
+        }
+
+        for (size_t i=0; i<rows.size(); i++) {
+            bool present = rows[i].has(Col);
+            const T &value = std::get<Col>(rows[i].values);
+            if constexpr (std::is_enum<T>::value) {
+                uint32_t code = present ? dictionary().code((int64_t)value) : 0;
+                file.append((const char*)&code, sizeof(code));
+                written += sizeof(code);
+            } else if constexpr (std::is_same<T, bool>::value) {
+                file.append((char)(present && value));
+                written++;
+            } else if constexpr (std::is_integral<T>::value) {
+                int64_t number = present ? (int64_t)value : 0;
+                file.append((const char*)&number, sizeof(number));
+                written += sizeof(number);
+            } else if constexpr (std::is_floating_point<T>::value) {
+                double number = present ? (double)value : 0.0;
+                file.append((const char*)&number, sizeof(number));
+                written += sizeof(number);
+            } else {
+                uint64_t address = present ? (uintptr_t)value : 0;
+                file.append((const char*)&address, sizeof(address));
+                written += sizeof(address);
+            }
+        }
+        write_padding(file, written, layout.data_size);
+    }
+
+    // Append the rows as one columnar chunk
+    template <size_t... Cols>
+    void write_columnar(StackFile &file, std::index_sequence<Cols...>) {
+        ColumnLayout layouts[] = {layout_column<Cols>()...};
+        CSVColumnType types[] = {csv_column_type<typename std::tuple_element<Cols, typename Schema::Values>::type>()...};
+        CSVColumnHeader headers[Schema::width];
+        uint64_t offset = sizeof(CSVChunkHeader) + Schema::width * sizeof(CSVColumnHeader);
+        for (size_t col=0; col<Schema::width; col++) {
+            const ColumnLayout &layout = layouts[col];
+            CSVColumnHeader &header = headers[col];
+            memset(&header, 0, sizeof(header));
+            header.type = (uint8_t)types[col];
+            header.name_size = layout.name_size;
+            header.name_offset = offset;
+            offset += csv_columnar_pad(layout.name_size);
+            header.validity_offset = layout.has_missing ? offset : 0;
+            offset += layout.validity_size;
+            header.dictionary_offset = offset;
+            header.dictionary_size = layout.dictionary_size;
+            header.dictionary_entries = layout.dictionary_entries;
+            offset += layout.dictionary_size;
+            header.data_offset = offset;
+            header.data_size = layout.data_size;
+            offset += layout.data_size;
+        }
+
+        CSVChunkHeader chunk;
+        memset(&chunk, 0, sizeof(chunk));
+        memcpy(chunk.magic, CSV_COLUMNAR_MAGIC, sizeof(chunk.magic));
+        chunk.version = CSV_COLUMNAR_VERSION;
+        chunk.size = offset;
+        chunk.rows = rows.size();
+        chunk.columns = Schema::width;
+        file.append((const char*)&chunk, sizeof(chunk));
+        file.append((const char*)headers, sizeof(headers));
+        (write_column<Cols>(file, layouts[Cols]), ...);
+        file.checkpoint();
+        stack_debugf("Wrote a columnar chunk of %d rows and %d bytes\n", rows.size(), offset);
+    }
+
+    void write_columnar(StackFile &file) {
+        if (rows.size() > 0) {
+            write_columnar(file, std::make_index_sequence<Schema::width>());
+        }
+    }
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <config.hpp>
+#include <stack_map.hpp>
+#include <stack_io.hpp>
+#include <compressor.hpp>
+
+// The most objects or pages, counting each compression type separately, a
+// tracker remembers between intervals. Anything past that is written as
+// untracked every interval. It is prime, since keys are mostly aligned addresses.
+#ifndef DELTA_TRACKED_ENTRIES
+#define DELTA_TRACKED_ENTRIES 262147
+#endif
+
+// How far a compressed size may drift from the one last written, as a
+// fraction of the uncompressed size, before a change row is written
+#ifndef DELTA_COMPRESSED_SIZE_THRESHOLD
+#define DELTA_COMPRESSED_SIZE_THRESHOLD 0.01
+#endif
+
+/// @brief Why a row of a delta table was written.
+///
+/// Every interval ends with an `END` row, so a reader knows which intervals
+/// are complete even when nothing changed in them. An `UNTRACKED` row is for
+/// something the tracker had no room to remember: it is live in its own
+/// interval only, and says nothing about the one before or after it.
+enum class DeltaEvent : uint8_t {
+    BIRTH,
+    CHANGE,
+    DEATH,
+    END,
+    UNTRACKED,
+};
+
+const char *csv_enum_name(DeltaEvent event) {
+    static const char *names[] = {"Birth", "Change", "Death", "End", "Untracked"};
+    return names[(size_t)event];
+}
+
+/// @brief The object or page, and compression type, a row of a delta table is about.
+struct DeltaKey {
+    uintptr_t address = 0;
+    // Objects only: a stale entry can leave an address live under two sites at once
+    uintptr_t site = 0;
+    CompressionType type = DEFAULT_COMPRESSION_TYPE;
+
+    bool operator==(const DeltaKey &other) const {
+        return address == other.address && site == other.site && type == other.type;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<DeltaKey> {
+        std::size_t operator()(const DeltaKey &key) const {
+            return key.address ^ (key.site * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)key.type << 56);
+        }
+    };
+}
+
+/// @brief What a delta table compares between intervals for one object or page.
+struct DeltaState {
+    // The interval the state was last written in
+    uint64_t interval = 0;
+    uintptr_t site = 0;
+    uint64_t age = 0;
+    uint64_t size = 0;
+    uint64_t compressed_size = 0;
+    // Pages only: the physical frame backing them
+    uintptr_t physical_address = 0;
+    bool written = false;
+
+    /// @brief Whether a reader replaying the last written state would now be wrong.
+    ///
+    /// Age is checked against the last written age plus the intervals since,
+    /// which is how a reader rebuilds it.
+    bool changed_since(const DeltaState &last) const {
+        uint64_t drift = compressed_size > last.compressed_size ? compressed_size - last.compressed_size : last.compressed_size - compressed_size;
+        return site != last.site
+            || size != last.size
+            || physical_address != last.physical_address
+            || written != last.written
+            || age != last.age + (interval - last.interval)
+            || (double)drift > DELTA_COMPRESSED_SIZE_THRESHOLD * (double)size;
+    }
+};
+
+/// @brief Decides which rows of a per-object or per-page table need writing.
+///
+/// Each interval, `update` is called for everything the table would have a
+/// row for, and `end_interval` once they all have been. Rows are only needed
+/// for births, for changes against the state last written, and for deaths.
+/// The state is kept as last written rather than as last seen, so that a
+/// slow drift in compressed size still adds up to a change row.
+///
+/// Once the tracker is full, the rest of the interval's keys are untracked:
+/// they get a full row every interval, and since they aren't remembered, one
+/// that was tracked last interval also gets a death row, which only ends
+/// what its earlier rows started.
+///
+/// The states of the last interval and this one are kept in two maps that
+/// swap each interval. Whatever the last interval's map holds that this
+/// one's doesn't has died, so deaths come from one pass at the end, with no
+/// seen mark per entry and no removals, which cost a backward shift each.
+template <size_t Capacity=DELTA_TRACKED_ENTRIES>
+class DeltaTracker {
+public:
+    /// @brief Record the state of a key this interval.
+    /// @param key The object or page
+    /// @param state Its state this interval
+    /// @param event Set to why a row is needed, if one is
+    /// @return True if the key needs a row this interval
+    bool update(const DeltaKey &key, const DeltaState &state, DeltaEvent &event) {
+        // Neither map is ever let fill up, since lookups in a full `StackMap` warn
+        if (current->num_entries() + 1 >= Capacity) {
+            if (!warned_full) {
+                stack_warnf("Delta tracker is full (%d entries), writing the rest as untracked\n", current->num_entries());
+                warned_full = true;
+            }
+            event = DeltaEvent::UNTRACKED;
+            return true;
+        }
+        if (!previous->has(key)) {
+            current->put(key, state);
+            event = DeltaEvent::BIRTH;
+            return true;
+        }
+        const DeltaState &last = previous->get(key);
+        if (state.changed_since(last)) {
+            current->put(key, state);
+            event = DeltaEvent::CHANGE;
+            return true;
+        }
+        current->put(key, last);
+        return false;
+    }
+
+    /// @brief Report every key seen last interval but not this one, then start the next interval.
+    template <typename OnDeath>
+    void end_interval(OnDeath on_death) {
+        previous->map([&](const DeltaKey &key, const DeltaState &state) {
+            if (!current->has(key)) {
+                on_death(key);
+            }
+        });
+        StackMap<DeltaKey, DeltaState, Capacity> *seen = previous;
+        previous = current;
+        current = seen;
+        current->clear();
+        warned_full = false;
+    }
+
+private:
+    StackMap<DeltaKey, DeltaState, Capacity> states[2];
+    StackMap<DeltaKey, DeltaState, Capacity> *previous = &states[0], *current = &states[1];
+    bool warned_full = false;
+};
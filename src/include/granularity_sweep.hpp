@@ -0,0 +1,267 @@
+#pragma once
+
+#include <config.hpp>
+#include <compressor.hpp>
+#include <stack_csv.hpp>
+#include <stack_vec.hpp>
+#include <timer.hpp>
+#include <sys/uio.h>
+
+// The most span sizes a sweep can evaluate
+#define GRANULARITY_SWEEP_MAX_GRANULARITIES 8
+// The largest span size; also bounds the pages gathered into one span
+#ifndef GRANULARITY_SWEEP_MAX_SPAN
+#define GRANULARITY_SWEEP_MAX_SPAN 0x200000
+#endif
+// The most largest-span-aligned regions gathering pages at once
+#ifndef GRANULARITY_SWEEP_OPEN_REGIONS
+#define GRANULARITY_SWEEP_OPEN_REGIONS 8
+#endif
+// Room for any codec's worst case on a largest span
+#define GRANULARITY_SWEEP_OUTPUT_SIZE (GRANULARITY_SWEEP_MAX_SPAN + GRANULARITY_SWEEP_MAX_SPAN / 4 + PAGE_SIZE)
+
+/// @brief The totals for one (span size, codec) pair over an interval.
+struct GranularitySweepResult {
+    uint64_t spans = 0, full_spans = 0, pages = 0;
+    uint64_t uncompressed_size = 0, compressed_size = 0;
+    uint64_t compression_ns = 0;
+
+    double ratio() const {
+        return uncompressed_size == 0 ? 1.0 : (double)compressed_size / (double)uncompressed_size;
+    }
+};
+
+/// @brief Compresses the resident pages of the page sweep as aligned spans
+///        of several sizes, to compare 4K pages against large folios.
+///
+/// As the page sweep reaches each resident page, the page joins the open
+/// region, aligned to the largest span size, that holds it. A region is
+/// measured, at every span size with every codec, once it is fully resident
+/// or when it is the least recently used and another region needs its slot;
+/// the rest are measured at the end of the sweep. So the pages of a region
+/// are compressed while the sweep has them in cache, and a region whose
+/// pages the sweep reaches far apart is measured as several partial spans.
+///
+/// A span holds only its resident pages, and is compressed as a single
+/// block of any size, as the kernel does for a folio. A run of contiguous
+/// pages is read in place; a sparse span is gathered into one buffer first,
+/// outside the timed compression.
+class GranularitySweep {
+public:
+    GranularitySweep() : compressor(DEFAULT_COMPRESSION_TYPE) {}
+
+    void add(size_t granularity) {
+        if (granularity < PAGE_SIZE || granularity > GRANULARITY_SWEEP_MAX_SPAN || (granularity & (granularity - 1)) != 0) {
+            stack_warnf("Granularity sweep ignoring span size %d, it must be a power of two from %d to %d\n", granularity, PAGE_SIZE, GRANULARITY_SWEEP_MAX_SPAN);
+            return;
+        }
+        if (granularities.full()) {
+            stack_warnf("Granularity sweep is full, ignoring span size %d\n", granularity);
+            return;
+        }
+        granularities.push(granularity);
+        granularities.sort();
+    }
+
+    /// @brief Add a resident page (or huge page) from the page sweep.
+    void sample(uintptr_t address, size_t size, const StackVec<CompressionType, 20> &types) {
+        if (granularities.empty()) {
+            return;
+        }
+        size_t region_size = granularities[granularities.size() - 1];
+        for (size_t offset=0; offset < size; offset += PAGE_SIZE) {
+            uintptr_t page = address + offset;
+            Region &region = open_region(page & ~(uintptr_t)(region_size - 1), types);
+            region.add(page);
+            if (region.num_pages == region_size / PAGE_SIZE) {
+                measure(region, types);
+            }
+        }
+    }
+
+    /// @brief Measure the regions still open at the end of the sweep.
+    void flush(const StackVec<CompressionType, 20> &types) {
+        for (size_t i=0; i<GRANULARITY_SWEEP_OPEN_REGIONS; i++) {
+            if (regions[i].num_pages > 0) {
+                measure(regions[i], types);
+            }
+        }
+    }
+
+    template<size_t Columns, size_t Rows>
+    void write(CSV<Columns, Rows> &csv, uint64_t interval, const StackVec<CompressionType, 20> &types) {
+        for (size_t g=0; g<granularities.size(); g++) {
+            for (size_t t=0; t<types.size() && t<MAX_COMPRESSION_TYPES; t++) {
+                const GranularitySweepResult &result = results[g][t];
+                if (result.spans == 0) {
+                    continue;
+                }
+                auto &row = csv.new_row();
+                row.set(csv.title(), "Interval #", interval);
+                row.set(csv.title(), "Compression Type", compression_to_string(types[t]));
+                row.set(csv.title(), "Granularity (bytes)", (uint64_t)granularities[g]);
+                row.set(csv.title(), "Spans", result.spans);
+                row.set(csv.title(), "Fully Resident Spans", result.full_spans);
+                row.set(csv.title(), "Resident Pages", result.pages);
+                row.set(csv.title(), "Uncompressed Size (bytes)", result.uncompressed_size);
+                row.set(csv.title(), "Compressed Size (bytes)", result.compressed_size);
+                row.set(csv.title(), "Compression Ratio (compressed/uncompressed)", result.ratio());
+                row.set(csv.title(), "Compression Time (ns/page)", (double)result.compression_ns / (double)result.pages);
+                // Bytes per nanosecond is GB/s, so scale up to MB/s
+                row.set(csv.title(), "Compression Throughput (MB/s)", result.compression_ns == 0 ? 0.0 : (double)result.uncompressed_size * 1000.0 / (double)result.compression_ns);
+            }
+        }
+        reset();
+    }
+
+    template<size_t Columns, size_t Rows>
+    static void add_titles(CSV<Columns, Rows> &csv) {
+        csv.title().add("Interval #");
+        csv.title().add("Compression Type");
+        csv.title().add("Granularity (bytes)");
+        csv.title().add("Spans");
+        csv.title().add("Fully Resident Spans");
+        csv.title().add("Resident Pages");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Compressed Size (bytes)");
+        csv.title().add("Compression Ratio (compressed/uncompressed)");
+        csv.title().add("Compression Time (ns/page)");
+        csv.title().add("Compression Throughput (MB/s)");
+    }
+
+private:
+    /// @brief The resident pages found so far in one largest-span-aligned region.
+    struct Region {
+        uintptr_t base = 0;
+        // Sorted, without duplicates
+        uintptr_t pages[GRANULARITY_SWEEP_MAX_SPAN / PAGE_SIZE];
+        size_t num_pages = 0;
+        // When the region last had a page added, to pick which to measure early
+        uint64_t last_used = 0;
+
+        void add(uintptr_t page) {
+            // The sweep mostly reaches a region's pages in order, so this rarely moves any
+            size_t i = num_pages;
+            while (i > 0 && pages[i - 1] > page) {
+                i--;
+            }
+            // A page shared by several allocations is only swept once, but stay safe against duplicates
+            if (i > 0 && pages[i - 1] == page) {
+                return;
+            }
+            memmove(&pages[i + 1], &pages[i], (num_pages - i) * sizeof(uintptr_t));
+            pages[i] = page;
+            num_pages++;
+        }
+    };
+
+    StackVec<size_t, GRANULARITY_SWEEP_MAX_GRANULARITIES> granularities;
+    GranularitySweepResult results[GRANULARITY_SWEEP_MAX_GRANULARITIES][MAX_COMPRESSION_TYPES];
+    Region regions[GRANULARITY_SWEEP_OPEN_REGIONS];
+    uint64_t pages_added = 0;
+
+    Compressor<PAGE_SIZE, false> compressor;
+    struct iovec segments[GRANULARITY_SWEEP_MAX_SPAN / PAGE_SIZE];
+    // Sparse spans are gathered here to be compressed as one block
+    uint8_t staging[GRANULARITY_SWEEP_MAX_SPAN];
+    uint8_t output[GRANULARITY_SWEEP_OUTPUT_SIZE];
+
+    /// @brief The open region starting at `base`, opening it if need be.
+    Region &open_region(uintptr_t base, const StackVec<CompressionType, 20> &types) {
+        Region *slot = nullptr;
+        for (size_t i=0; i<GRANULARITY_SWEEP_OPEN_REGIONS; i++) {
+            Region &region = regions[i];
+            if (region.num_pages > 0 && region.base == base) {
+                region.last_used = ++pages_added;
+                return region;
+            }
+            // Prefer an empty slot, then the least recently used
+            if (slot == nullptr || (slot->num_pages > 0 && (region.num_pages == 0 || region.last_used < slot->last_used))) {
+                slot = &region;
+            }
+        }
+        if (slot->num_pages > 0) {
+            measure(*slot, types);
+        }
+        slot->base = base;
+        slot->last_used = ++pages_added;
+        return *slot;
+    }
+
+    /// @brief Compress a region at every span size with every codec, then close it.
+    void measure(Region &region, const StackVec<CompressionType, 20> &types) {
+        for (size_t t=0; t<types.size() && t<MAX_COMPRESSION_TYPES; t++) {
+            compressor.configure(CompressionSetting{types[t], default_compression_level(types[t])});
+            for (size_t g=0; g<granularities.size(); g++) {
+                for (size_t first=0; first < region.num_pages;) {
+                    size_t last = span_end(region, first, granularities[g]);
+                    compress_span(region, first, last, granularities[g], results[g][t]);
+                    first = last;
+                }
+            }
+        }
+        region.num_pages = 0;
+    }
+
+    /// @brief The index just past the last page of `region` in the same `granularity`-aligned span as `first`.
+    size_t span_end(const Region &region, size_t first, size_t granularity) const {
+        uintptr_t span = region.pages[first] & ~(uintptr_t)(granularity - 1);
+        size_t last = first;
+        while (last < region.num_pages && (region.pages[last] & ~(uintptr_t)(granularity - 1)) == span) {
+            last++;
+        }
+        return last;
+    }
+
+    void compress_span(const Region &region, size_t first, size_t last, size_t granularity, GranularitySweepResult &result) {
+        // Coalesce runs of contiguous resident pages
+        size_t count = 0;
+        for (size_t i=first; i<last; i++) {
+            if (count > 0 && (uintptr_t)segments[count - 1].iov_base + segments[count - 1].iov_len == region.pages[i]) {
+                segments[count - 1].iov_len += PAGE_SIZE;
+            } else {
+                segments[count].iov_base = (void*)region.pages[i];
+                segments[count].iov_len = PAGE_SIZE;
+                count++;
+            }
+        }
+        size_t uncompressed_size = (last - first) * PAGE_SIZE;
+
+        const uint8_t *input = (const uint8_t*)segments[0].iov_base;
+        if (count > 1) {
+            uint8_t *end = staging;
+            for (size_t i=0; i<count; i++) {
+                memcpy(end, segments[i].iov_base, segments[i].iov_len);
+                end += segments[i].iov_len;
+            }
+            input = staging;
+        }
+
+        Timer timer;
+        timer.start();
+        size_t compressed_size = compressor.compress_block(input, uncompressed_size, output, sizeof(output));
+        uint64_t ns = timer.elapsed_nanoseconds();
+        if (compressed_size == 0) {
+            return;
+        }
+
+        result.spans++;
+        result.full_spans += uncompressed_size == granularity;
+        result.pages += last - first;
+        result.uncompressed_size += uncompressed_size;
+        result.compressed_size += compressed_size;
+        result.compression_ns += ns;
+    }
+
+    void reset() {
+        for (size_t g=0; g<GRANULARITY_SWEEP_MAX_GRANULARITIES; g++) {
+            for (size_t t=0; t<MAX_COMPRESSION_TYPES; t++) {
+                results[g][t] = GranularitySweepResult();
+            }
+        }
+        for (size_t i=0; i<GRANULARITY_SWEEP_OPEN_REGIONS; i++) {
+            regions[i].num_pages = 0;
+        }
+        pages_added = 0;
+    }
+};
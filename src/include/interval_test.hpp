@@ -267,6 +267,37 @@ void perform_clear_soft_dirty_bits() {
     IS_PROTECTED = protection;
 }
 
+/// Check whether the kernel tracks soft-dirty bits at all. Kernels built
+/// without CONFIG_MEM_SOFT_DIRTY report every page as clean, which would
+/// make every page look unwritten.
+bool soft_dirty_bits_supported() {
+    static int supported = -1;
+    if (supported >= 0) {
+        return supported;
+    }
+
+    // Write to a page and check that the write is reflected in the pagemap
+    static volatile uint8_t probe[PAGE_SIZE * 2];
+    volatile uint8_t *page = (volatile uint8_t*)(((uintptr_t)probe + PAGE_SIZE - 1) & ~((uintptr_t)PAGE_SIZE - 1));
+    page[0] = page[0] + 1;
+
+    uint64_t data = 0;
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0 || pread(fd, &data, sizeof(data), ((uintptr_t)page / PAGE_SIZE) * sizeof(data)) != sizeof(data)) {
+        perror("read pagemap");
+        data = 0;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    supported = (data >> 55) & 1;
+    if (!supported) {
+        stack_warnf("Soft-dirty bits are not supported by this kernel, every page will look clean\n");
+    }
+    return supported;
+}
+
 template<size_t Size>
 bool get_page_info(void *addr, uint64_t size_in_bytes, StackVec<PageInfo, Size> &page_info, BitVec<Size> &present_pages, std::function<bool(const PageInfo&)> filter) {
     bool protection = IS_PROTECTED;
@@ -424,6 +455,17 @@ void no_longer_working_thread() {
     IS_PROTECTED = false;
 }
 
+/// @brief A hook that gets the first look at every protection fault.
+/// @return True if the hook resolved the fault itself, e.g. by restoring
+///         memory it protected, and the access should simply be retried.
+typedef bool (*FaultHook)(void *address, bool is_write);
+static FaultHook FAULT_HOOK = NULL;
+
+/// @brief Install a hook that runs at the start of the protection handler.
+void set_fault_hook(FaultHook hook) {
+    FAULT_HOOK = hook;
+}
+
 
 
 // This is the handler for SIGSEGV. It's called when we try to access
@@ -481,6 +523,8 @@ void setup_protection_handler()
 const int TRACKED_ALLOCATIONS_PER_SITE = 10000;
 const int TRACKED_ALLOCATION_SITES = 1000;
 const int TOTAL_TRACKED_ALLOCATIONS = TRACKED_ALLOCATIONS_PER_SITE * TRACKED_ALLOCATION_SITES;
+// How many updates go by between looks at the heart beat clock
+const int HEART_BEAT_CHECK_PERIOD = 64;
 
 static int PKEY = -1;
 static bool PKEY_INITIALIZED = false;
@@ -1208,7 +1252,12 @@ public:
     }
 
 private:
+    /// @brief Log how far along the interval timer is, at most once a second, and flush the logs.
+    ///        The clock is only read every HEART_BEAT_CHECK_PERIOD calls, and never when it wouldn't be logged.
     void heart_beat() {
+        if (!log_enabled(LogLevel::Info) || ++heart_beat_calls % HEART_BEAT_CHECK_PERIOD != 0) {
+            return;
+        }
         if (second_timer.has_elapsed(1000)) {
             stack_infof("Heart beat (1 second has elapsed)\n");
             if (timer.elapsed_milliseconds() >= config.period_milliseconds) {
@@ -1218,6 +1267,7 @@ private:
             }
 
             second_timer.reset();
+            flush_logs();
         }
     }
 
@@ -1330,6 +1380,7 @@ private:
         // End time
         uint64_t time_taken = interval_timer.elapsed_milliseconds();
         stack_infof("Finished interval in %d milliseconds\n", time_taken);
+        flush_logs();
     }
 
     Allocation &alloc_from_addr(void *addr) {
@@ -1363,6 +1414,7 @@ private:
 
     StackVec<IntervalTest*, 10> tests;
     Timer timer, second_timer;
+    uint64_t heart_beat_calls = 0;
     IntervalTestConfig config;
 
     StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> allocation_sites;
@@ -1394,6 +1446,10 @@ static void protection_handler(int sig, siginfo_t *si, void *ucontext)
     void* aligned_address = (void*)((uint64_t)si->si_addr & ~(page_size - 1));
     uint64_t error_code = context->uc_mcontext.gregs[REG_ERR];
     bool is_write = error_code & 0x2;
+    if (FAULT_HOOK != NULL && FAULT_HOOK(si->si_addr, is_write)) {
+        return;
+    }
+
     static void *last_address = NULL;
     static size_t consecutive_faults_on_same_address = 0;
     if (last_address == si->si_addr) {
@@ -1404,13 +1460,13 @@ static void protection_handler(int sig, siginfo_t *si, void *ucontext)
     }
 
     if (consecutive_faults_on_same_address >= MAX_CONSECUTIVE_PAGE_FAULTS) {
-        stack_errorf("Caught %d consecutive faults on the same address\n", consecutive_faults_on_same_address);
+        stack_signal_errorf("Caught %d consecutive faults on the same address\n", consecutive_faults_on_same_address);
         exit(1);
     }
 
 
-    stack_debugf("PROTECTION HANDLER: Entering segfault handler with address %p and %s access\n", si->si_addr, is_write? "write": "read");
-    stack_debugf("Aligned address: %p\n", aligned_address);
+    stack_signal_debugf("PROTECTION HANDLER: Entering segfault handler with address %p and %s access\n", si->si_addr, is_write? "write": "read");
+    stack_signal_debugf("Aligned address: %p\n", aligned_address);
     [[maybe_unused]] char buf[1024];
     // bk_sprintf(buf, "cat /proc/%d/maps", (int)getpid());
     // system(buf);
@@ -1418,21 +1474,21 @@ static void protection_handler(int sig, siginfo_t *si, void *ucontext)
     std::lock_guard<std::mutex> lock(protection_lock);
 
     if (si->si_addr == NULL) {
-        stack_errorf("Caught NULL pointer access: segfault at NULL\n");
+        stack_signal_errorf("Caught NULL pointer access: segfault at NULL\n");
         // exit(1);
         return;
     } else {
-        stack_debugf("Caught segfault at %p\n", si->si_addr);
+        stack_signal_debugf("Caught segfault at %p\n", si->si_addr);
     }
 
 
     if (si->si_code == SEGV_ACCERR) {
         // printf("Invalid permissions for %s.\n", (si->si_code & 2) ? "write" : "read");
-        stack_debugf("Invalid permissions for %s.\n",is_write? "write" : "read");
+        stack_signal_debugf("Invalid permissions for %s.\n",is_write? "write" : "read");
     }
     
     if (is_working_thread()) {
-        stack_warnf("Working thread, giving back access: 0x%X\n", (uint64_t)si->si_addr);
+        stack_signal_warnf("Working thread, giving back access: 0x%X\n", (uint64_t)si->si_addr);
         // if (mprotect(aligned_address, getpagesize(), PROT_NONE) == -1) {
         //     perror("mprotect");
         //     exit(1);
@@ -1450,9 +1506,9 @@ static void protection_handler(int sig, siginfo_t *si, void *ucontext)
         }
     } else {
         // If the access is a write, add it to the write page faults
-        stack_debugf("Error code: %x\n", error_code);
+        stack_signal_debugf("Error code: %x\n", error_code);
         if (IS_PROTECTED) {
-            stack_warnf("PROTECTION HANDLER: Caught access of temporarily protected memory 0x%X\n", (void*)si->si_addr);
+            stack_signal_warnf("PROTECTION HANDLER: Caught access of temporarily protected memory 0x%X\n", (void*)si->si_addr);
             while (IS_PROTECTED) {}
         }
         
@@ -1494,20 +1550,20 @@ static void protection_handler(int sig, siginfo_t *si, void *ucontext)
         #ifdef GUARD_ACCESSES
         #ifndef SOFT_GUARD_ACCESSES
         if (is_write) {
-            stack_debugf("Giving back write access to 0x%X\n", (void*)si->si_addr);
+            stack_signal_debugf("Giving back write access to 0x%X\n", (void*)si->si_addr);
             if (mprotect(aligned_address, getpagesize(), PROT_WRITE | PROT_READ | PROT_EXEC) == -1) {
                 perror("mprotect");
                 exit(1);
             }
         } else {
-            stack_debugf("Giving back read access to 0x%X\n", (void*)si->si_addr);
+            stack_signal_debugf("Giving back read access to 0x%X\n", (void*)si->si_addr);
             if (mprotect(aligned_address, getpagesize(), PROT_READ | PROT_EXEC) == -1) {
                 perror("mprotect");
                 exit(1);
             }
         }
         #else
-        stack_debugf("Giving back read and write access to 0x%X\n", (void*)si->si_addr);
+        stack_signal_debugf("Giving back read and write access to 0x%X\n", (void*)si->si_addr);
         if (mprotect(aligned_address, getpagesize(), PROT_WRITE | PROT_READ | PROT_EXEC) == -1) {
             perror("mprotect");
             exit(1);
@@ -1520,7 +1576,7 @@ static void protection_handler(int sig, siginfo_t *si, void *ucontext)
         //     mprotect(aligned_address, getpagesize(), PROT_READ);
         // }
     }
-    stack_debugf("PROTECTION HANDLER: Leaving segfault handler\n");
+    stack_signal_debugf("PROTECTION HANDLER: Leaving segfault handler\n");
     return;
     /*
     if (is_working_thread()) {
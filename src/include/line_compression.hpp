@@ -0,0 +1,479 @@
+#pragma once
+
+#include <config.hpp>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Software models of hardware cache-line compressors. Every 64-byte line is
+// compressed on its own, so a line can be decompressed without touching its
+// neighbours, as a memory controller would. Each compressed line starts with
+// a one-byte tag standing in for the per-line metadata hardware keeps on the
+// side; a trailing partial line is stored raw after a `LINE_TAIL` tag.
+
+#define CACHE_LINE_SIZE 64
+// The largest a line can become: its tag plus the raw line
+#define MAX_COMPRESSED_LINE_SIZE (CACHE_LINE_SIZE + 1)
+// Tags the raw partial line at the end of a buffer; no codec uses it for a line
+#define LINE_TAIL 0xFF
+
+/// @brief An upper bound on the compressed size of a buffer for the line codecs.
+static inline size_t line_compression_bound(size_t size) {
+    return size + size / CACHE_LINE_SIZE + 1;
+}
+
+/// @brief Base-Delta-Immediate (Pekhimenko et al., PACT 2012) encodings.
+enum BdiEncoding : uint8_t {
+    BDI_ZEROS = 0,
+    BDI_REPEATED = 1,
+    BDI_BASE8_DELTA1 = 2,
+    BDI_BASE8_DELTA2 = 3,
+    BDI_BASE8_DELTA4 = 4,
+    BDI_BASE4_DELTA1 = 5,
+    BDI_BASE4_DELTA2 = 6,
+    BDI_BASE2_DELTA1 = 7,
+    BDI_UNCOMPRESSED = 8,
+};
+
+/// @brief True if `value` survives truncation to `Delta` and sign extension back.
+template<typename Word, typename Delta>
+static inline bool bdi_fits(Word value) {
+    typedef typename std::make_signed<Word>::type Signed;
+    typedef typename std::make_signed<Delta>::type SignedDelta;
+    return (Signed)value == (Signed)(SignedDelta)value;
+}
+
+/// @brief Try one base+delta encoding of a line.
+///
+/// Every word is either a small immediate (a delta from the implicit zero
+/// base) or a small delta from the line's base, which is its first word that
+/// is not an immediate. A bitmask records which base each word uses.
+/// The checks are branch-free over a fixed number of words so the compiler
+/// can vectorize them.
+/// @return The encoded size including the tag, or 0 if the line does not fit
+template<typename Word, typename Delta>
+static size_t bdi_encode(const uint8_t *line, uint8_t *output, uint8_t encoding) {
+    constexpr size_t words = CACHE_LINE_SIZE / sizeof(Word);
+    Word values[words];
+    memcpy(values, line, CACHE_LINE_SIZE);
+
+    bool immediate[words];
+    for (size_t i=0; i<words; i++) {
+        immediate[i] = bdi_fits<Word, Delta>(values[i]);
+    }
+    Word base = 0;
+    for (size_t i=0; i<words; i++) {
+        if (!immediate[i]) {
+            base = values[i];
+            break;
+        }
+    }
+
+    bool fits = true;
+    for (size_t i=0; i<words; i++) {
+        fits &= immediate[i] | bdi_fits<Word, Delta>((Word)(values[i] - base));
+    }
+    if (!fits) {
+        return 0;
+    }
+
+    uint8_t *out = output;
+    *out++ = encoding;
+    uint8_t mask[words / 8] = {0};
+    for (size_t i=0; i<words; i++) {
+        mask[i / 8] |= (uint8_t)(!immediate[i]) << (i % 8);
+    }
+    memcpy(out, mask, sizeof(mask));
+    out += sizeof(mask);
+    memcpy(out, &base, sizeof(base));
+    out += sizeof(base);
+    for (size_t i=0; i<words; i++) {
+        Delta delta = (Delta)(immediate[i] ? values[i] : (Word)(values[i] - base));
+        memcpy(out, &delta, sizeof(delta));
+        out += sizeof(delta);
+    }
+    return out - output;
+}
+
+template<typename Word, typename Delta>
+static size_t bdi_decode(const uint8_t *input, size_t input_size, uint8_t *line) {
+    constexpr size_t words = CACHE_LINE_SIZE / sizeof(Word);
+    constexpr size_t size = 1 + words / 8 + sizeof(Word) + words * sizeof(Delta);
+    if (input_size < size) {
+        return 0;
+    }
+    const uint8_t *mask = input + 1;
+    Word base;
+    memcpy(&base, mask + words / 8, sizeof(base));
+    const uint8_t *deltas = mask + words / 8 + sizeof(Word);
+
+    Word values[words];
+    for (size_t i=0; i<words; i++) {
+        Delta delta;
+        memcpy(&delta, deltas + i * sizeof(Delta), sizeof(delta));
+        typedef typename std::make_signed<Delta>::type SignedDelta;
+        Word value = (Word)(typename std::make_signed<Word>::type)(SignedDelta)delta;
+        values[i] = (mask[i / 8] >> (i % 8)) & 1 ? (Word)(value + base) : value;
+    }
+    memcpy(line, values, CACHE_LINE_SIZE);
+    return size;
+}
+
+/// @brief Compress one line with the smallest BDI encoding that fits.
+/// @return The compressed size including the tag
+static size_t bdi_compress_line(const uint8_t *line, uint8_t *output) {
+    uint64_t words[CACHE_LINE_SIZE / 8];
+    memcpy(words, line, CACHE_LINE_SIZE);
+    uint64_t any = 0, different = 0;
+    for (size_t i=0; i<CACHE_LINE_SIZE / 8; i++) {
+        any |= words[i];
+        different |= words[i] ^ words[0];
+    }
+    if (any == 0) {
+        output[0] = BDI_ZEROS;
+        return 1;
+    }
+    if (different == 0) {
+        output[0] = BDI_REPEATED;
+        memcpy(output + 1, &words[0], sizeof(words[0]));
+        return 1 + sizeof(words[0]);
+    }
+
+    // Hardware tries every encoding in parallel; try them from smallest to
+    // largest so the first fit is the best
+    size_t size;
+    if ((size = bdi_encode<uint64_t, uint8_t>(line, output, BDI_BASE8_DELTA1))) return size;
+    if ((size = bdi_encode<uint32_t, uint8_t>(line, output, BDI_BASE4_DELTA1))) return size;
+    if ((size = bdi_encode<uint64_t, uint16_t>(line, output, BDI_BASE8_DELTA2))) return size;
+    if ((size = bdi_encode<uint32_t, uint16_t>(line, output, BDI_BASE4_DELTA2))) return size;
+    if ((size = bdi_encode<uint16_t, uint8_t>(line, output, BDI_BASE2_DELTA1))) return size;
+    if ((size = bdi_encode<uint64_t, uint32_t>(line, output, BDI_BASE8_DELTA4))) return size;
+
+    output[0] = BDI_UNCOMPRESSED;
+    memcpy(output + 1, line, CACHE_LINE_SIZE);
+    return 1 + CACHE_LINE_SIZE;
+}
+
+/// @brief Decompress one BDI line.
+/// @return The number of input bytes consumed, or 0 if the input is malformed
+static size_t bdi_decompress_line(const uint8_t *input, size_t input_size, uint8_t *line) {
+    if (input_size == 0) {
+        return 0;
+    }
+    switch (input[0]) {
+        case BDI_ZEROS:
+            memset(line, 0, CACHE_LINE_SIZE);
+            return 1;
+        case BDI_REPEATED:
+            if (input_size < 9) {
+                return 0;
+            }
+            for (size_t i=0; i<CACHE_LINE_SIZE; i+=8) {
+                memcpy(line + i, input + 1, 8);
+            }
+            return 9;
+        case BDI_BASE8_DELTA1: return bdi_decode<uint64_t, uint8_t>(input, input_size, line);
+        case BDI_BASE8_DELTA2: return bdi_decode<uint64_t, uint16_t>(input, input_size, line);
+        case BDI_BASE8_DELTA4: return bdi_decode<uint64_t, uint32_t>(input, input_size, line);
+        case BDI_BASE4_DELTA1: return bdi_decode<uint32_t, uint8_t>(input, input_size, line);
+        case BDI_BASE4_DELTA2: return bdi_decode<uint32_t, uint16_t>(input, input_size, line);
+        case BDI_BASE2_DELTA1: return bdi_decode<uint16_t, uint8_t>(input, input_size, line);
+        case BDI_UNCOMPRESSED:
+            if (input_size < 1 + CACHE_LINE_SIZE) {
+                return 0;
+            }
+            memcpy(line, input + 1, CACHE_LINE_SIZE);
+            return 1 + CACHE_LINE_SIZE;
+    }
+    return 0;
+}
+
+/// @brief Frequent Pattern Compression (Alameldeen and Wood, 2004) prefixes.
+///
+/// Each 32-bit word gets a 3-bit prefix followed by its payload.
+enum FpcPattern : uint8_t {
+    // A run of 1 to 8 zero words; the payload is the run length minus one
+    FPC_ZERO_RUN = 0,
+    FPC_SIGN_EXTENDED_4 = 1,
+    FPC_SIGN_EXTENDED_8 = 2,
+    FPC_SIGN_EXTENDED_16 = 3,
+    // The low halfword is zero
+    FPC_HALFWORD_PADDED = 4,
+    // Each halfword is a sign-extended byte
+    FPC_TWO_SIGN_EXTENDED_8 = 5,
+    FPC_REPEATED_BYTES = 6,
+    FPC_UNCOMPRESSED = 7,
+};
+
+// Line tags for FPC
+#define FPC_LINE_COMPRESSED 0
+#define FPC_LINE_UNCOMPRESSED 1
+
+/// @brief Packs values LSB-first through a 64-bit accumulator.
+struct FpcBitWriter {
+    uint8_t *output;
+    size_t bits = 0;
+    uint64_t pending = 0;
+    size_t pending_bits = 0;
+
+    void write(uint32_t value, size_t count) {
+        pending |= (uint64_t)(value & (uint32_t)((1ull << count) - 1)) << pending_bits;
+        pending_bits += count;
+        bits += count;
+        while (pending_bits >= 8) {
+            *output++ = (uint8_t)pending;
+            pending >>= 8;
+            pending_bits -= 8;
+        }
+    }
+
+    /// @brief Write out the last partial byte.
+    void flush() {
+        if (pending_bits > 0) {
+            *output++ = (uint8_t)pending;
+            pending = 0;
+            pending_bits = 0;
+        }
+    }
+};
+
+struct FpcBitReader {
+    const uint8_t *input;
+    size_t size_bits, bits = 0;
+    uint64_t pending = 0;
+    size_t pending_bits = 0;
+
+    bool read(uint32_t &value, size_t count) {
+        if (bits + count > size_bits) {
+            return false;
+        }
+        while (pending_bits < count) {
+            pending |= (uint64_t)input[(bits + pending_bits) / 8] << pending_bits;
+            pending_bits += 8;
+        }
+        value = (uint32_t)(pending & ((1ull << count) - 1));
+        pending >>= count;
+        pending_bits -= count;
+        bits += count;
+        return true;
+    }
+};
+
+static inline bool fpc_sign_extends(uint32_t word, size_t bits) {
+    int32_t value = (int32_t)word;
+    int32_t limit = 1 << (bits - 1);
+    return value >= -limit && value < limit;
+}
+
+/// @brief Compress one line with FPC, falling back to the raw line when that is smaller.
+/// @return The compressed size including the tag
+static size_t fpc_compress_line(const uint8_t *line, uint8_t *output) {
+    constexpr size_t words = CACHE_LINE_SIZE / 4;
+    uint32_t values[words];
+    memcpy(values, line, CACHE_LINE_SIZE);
+
+    // Staged so a line that would expand can still be stored raw
+    uint8_t encoded[words * 5];
+    FpcBitWriter writer{encoded};
+    for (size_t i=0; i<words;) {
+        uint32_t word = values[i];
+        if (word == 0) {
+            size_t run = 1;
+            while (i + run < words && run < 8 && values[i + run] == 0) {
+                run++;
+            }
+            writer.write(FPC_ZERO_RUN, 3);
+            writer.write(run - 1, 3);
+            i += run;
+            continue;
+        }
+
+        uint16_t high = word >> 16, low = word & 0xFFFF;
+        uint8_t byte = word & 0xFF;
+        if (fpc_sign_extends(word, 4)) {
+            writer.write(FPC_SIGN_EXTENDED_4, 3);
+            writer.write(word, 4);
+        } else if (fpc_sign_extends(word, 8)) {
+            writer.write(FPC_SIGN_EXTENDED_8, 3);
+            writer.write(word, 8);
+        } else if (word == byte * 0x01010101u) {
+            writer.write(FPC_REPEATED_BYTES, 3);
+            writer.write(byte, 8);
+        } else if (fpc_sign_extends(word, 16)) {
+            writer.write(FPC_SIGN_EXTENDED_16, 3);
+            writer.write(word, 16);
+        } else if (low == 0) {
+            writer.write(FPC_HALFWORD_PADDED, 3);
+            writer.write(high, 16);
+        } else if ((int16_t)high == (int8_t)high && (int16_t)low == (int8_t)low) {
+            writer.write(FPC_TWO_SIGN_EXTENDED_8, 3);
+            writer.write((low & 0xFF) | (high & 0xFF) << 8, 16);
+        } else {
+            writer.write(FPC_UNCOMPRESSED, 3);
+            writer.write(word, 32);
+        }
+        i++;
+    }
+
+    writer.flush();
+    size_t size = (writer.bits + 7) / 8;
+    if (size >= CACHE_LINE_SIZE) {
+        output[0] = FPC_LINE_UNCOMPRESSED;
+        memcpy(output + 1, line, CACHE_LINE_SIZE);
+        return 1 + CACHE_LINE_SIZE;
+    }
+    output[0] = FPC_LINE_COMPRESSED;
+    memcpy(output + 1, encoded, size);
+    return 1 + size;
+}
+
+/// @brief Decompress one FPC line.
+/// @return The number of input bytes consumed, or 0 if the input is malformed
+static size_t fpc_decompress_line(const uint8_t *input, size_t input_size, uint8_t *line) {
+    if (input_size == 0) {
+        return 0;
+    }
+    if (input[0] == FPC_LINE_UNCOMPRESSED) {
+        if (input_size < 1 + CACHE_LINE_SIZE) {
+            return 0;
+        }
+        memcpy(line, input + 1, CACHE_LINE_SIZE);
+        return 1 + CACHE_LINE_SIZE;
+    }
+    if (input[0] != FPC_LINE_COMPRESSED) {
+        return 0;
+    }
+
+    constexpr size_t words = CACHE_LINE_SIZE / 4;
+    uint32_t values[words];
+    FpcBitReader reader{input + 1, (input_size - 1) * 8};
+    for (size_t i=0; i<words;) {
+        uint32_t prefix, payload;
+        if (!reader.read(prefix, 3)) {
+            return 0;
+        }
+        switch (prefix) {
+            case FPC_ZERO_RUN:
+                if (!reader.read(payload, 3) || i + payload + 1 > words) {
+                    return 0;
+                }
+                for (size_t run=0; run<=payload; run++) {
+                    values[i++] = 0;
+                }
+                continue;
+            case FPC_SIGN_EXTENDED_4:
+                if (!reader.read(payload, 4)) return 0;
+                values[i] = (uint32_t)((int32_t)(payload << 28) >> 28);
+                break;
+            case FPC_SIGN_EXTENDED_8:
+                if (!reader.read(payload, 8)) return 0;
+                values[i] = (uint32_t)(int32_t)(int8_t)payload;
+                break;
+            case FPC_SIGN_EXTENDED_16:
+                if (!reader.read(payload, 16)) return 0;
+                values[i] = (uint32_t)(int32_t)(int16_t)payload;
+                break;
+            case FPC_HALFWORD_PADDED:
+                if (!reader.read(payload, 16)) return 0;
+                values[i] = payload << 16;
+                break;
+            case FPC_TWO_SIGN_EXTENDED_8:
+                if (!reader.read(payload, 16)) return 0;
+                values[i] = (uint32_t)(uint16_t)(int16_t)(int8_t)(payload & 0xFF)
+                    | (uint32_t)(uint16_t)(int16_t)(int8_t)(payload >> 8) << 16;
+                break;
+            case FPC_REPEATED_BYTES:
+                if (!reader.read(payload, 8)) return 0;
+                values[i] = payload * 0x01010101u;
+                break;
+            default:
+                if (!reader.read(payload, 32)) return 0;
+                values[i] = payload;
+                break;
+        }
+        i++;
+    }
+    memcpy(line, values, CACHE_LINE_SIZE);
+    return 1 + (reader.bits + 7) / 8;
+}
+
+typedef size_t (*LineCompressFunction)(const uint8_t *line, uint8_t *output);
+typedef size_t (*LineDecompressFunction)(const uint8_t *input, size_t input_size, uint8_t *line);
+
+/// @brief Compress a buffer line by line.
+/// @return The compressed size, or 0 if the output buffer is too small
+static size_t compress_lines(LineCompressFunction compress_line, const uint8_t *input_buffer, size_t size, uint8_t *output_buffer, size_t output_size) {
+    uint8_t line[MAX_COMPRESSED_LINE_SIZE];
+    size_t written = 0, offset = 0;
+    for (; offset + CACHE_LINE_SIZE <= size; offset += CACHE_LINE_SIZE) {
+        size_t line_size = compress_line(input_buffer + offset, line);
+        if (written + line_size > output_size) {
+            return 0;
+        }
+        memcpy(output_buffer + written, line, line_size);
+        written += line_size;
+    }
+    // The tail is shorter than a line, so it is kept as is after the last line
+    size_t tail = size - offset;
+    if (tail == 0) {
+        return written;
+    }
+    if (written + 1 + tail > output_size) {
+        return 0;
+    }
+    output_buffer[written++] = LINE_TAIL;
+    memcpy(output_buffer + written, input_buffer + offset, tail);
+    return written + tail;
+}
+
+/// @brief Decompress a buffer produced by `compress_lines`.
+/// @param compressed_size The exact size of the compressed data
+/// @return The decompressed size, or 0 if the input is malformed or the output is too small
+static size_t decompress_lines(LineDecompressFunction decompress_line, const uint8_t *input_buffer, size_t compressed_size, uint8_t *output_buffer, size_t output_size) {
+    size_t read = 0, written = 0;
+    while (read < compressed_size) {
+        if (input_buffer[read] == LINE_TAIL) {
+            size_t tail = compressed_size - read - 1;
+            if (tail >= CACHE_LINE_SIZE || written + tail > output_size) {
+                return 0;
+            }
+            memcpy(output_buffer + written, input_buffer + read + 1, tail);
+            return written + tail;
+        }
+        if (written + CACHE_LINE_SIZE > output_size) {
+            return 0;
+        }
+        size_t consumed = decompress_line(input_buffer + read, compressed_size - read, output_buffer + written);
+        if (consumed == 0) {
+            return 0;
+        }
+        written += CACHE_LINE_SIZE;
+        read += consumed;
+    }
+    return written;
+}
+
+/// @brief A histogram of compressed line sizes, including each line's tag.
+struct LineSizeHistogram {
+    uint64_t lines[MAX_COMPRESSED_LINE_SIZE + 1] = {0};
+
+    /// @brief Count the compressed size of every full line in a buffer.
+    void add(LineCompressFunction compress_line, const uint8_t *buffer, size_t size) {
+        uint8_t line[MAX_COMPRESSED_LINE_SIZE];
+        for (size_t offset=0; offset + CACHE_LINE_SIZE <= size; offset += CACHE_LINE_SIZE) {
+            lines[compress_line(buffer + offset, line)]++;
+        }
+    }
+
+    uint64_t total() const {
+        uint64_t total = 0;
+        for (size_t i=0; i<=MAX_COMPRESSED_LINE_SIZE; i++) {
+            total += lines[i];
+        }
+        return total;
+    }
+
+    void clear() {
+        memset(lines, 0, sizeof(lines));
+    }
+};
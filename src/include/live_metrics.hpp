@@ -0,0 +1,191 @@
+#pragma once
+
+// The live metrics page: a small struct HeapPulse keeps up to date in a named
+// POSIX shared-memory segment, so a monitor can watch a running process
+// without parsing its output files. `heappulse-metrics <pid>` prints it.
+//
+// The page is written by one thread at a time under a sequence lock. The
+// sequence is odd while a write is in progress; a reader copies the data out
+// and retries if the sequence was odd or changed while it was copying.
+
+#include <stack_io.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The segment is named after the process, formatted with its pid
+#ifndef LIVE_METRICS_NAME
+#define LIVE_METRICS_NAME "/heappulse-%d"
+#endif
+
+// How often the hooks republish counts, rates and overhead
+#ifndef LIVE_METRICS_PERIOD_MS
+#define LIVE_METRICS_PERIOD_MS 250
+#endif
+
+// Most codecs the page has room for
+#define LIVE_METRICS_CODECS 16
+
+// "HPMETRIC", written last so a reader never sees a half-made page
+#define LIVE_METRICS_MAGIC 0x43495254454d5048ULL
+// Bumped whenever `LiveMetricsData` changes layout
+#define LIVE_METRICS_VERSION 1
+
+/// @brief What one codec did last interval, from the compression telemetry.
+struct LiveCodecMetrics {
+    char name[16];
+    uint64_t uncompressed_size;
+    uint64_t compressed_size;
+    double ratio;
+};
+
+/// @brief The metrics themselves, copied out whole by a reader.
+struct LiveMetricsData {
+    // When this was last written, since the hooks started
+    uint64_t updated_microseconds;
+    uint64_t malloc_count, free_count, mmap_count, munmap_count;
+    // Allocations (malloc and mmap) and frees per second over the last LIVE_METRICS_PERIOD_MS
+    double alloc_rate, free_rate;
+    // Objects the interval tests are tracking
+    uint64_t live_objects, live_bytes;
+    // Time spent in the hooks
+    uint64_t overhead_microseconds, update_microseconds, invalidate_microseconds;
+    // Allocations the hooks let go by untracked, mid-interval or with the lock taken
+    uint64_t dropped_events;
+    // Intervals finished so far
+    uint64_t intervals;
+    // The process's resident set as of the last interval
+    uint64_t resident_pages;
+    uint64_t codec_count;
+    LiveCodecMetrics codecs[LIVE_METRICS_CODECS];
+    // Set once the tests are done and nothing more will be written
+    uint64_t finished;
+};
+
+struct LiveMetricsPage {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint64_t pid;
+    std::atomic<uint64_t> sequence;
+    LiveMetricsData data;
+};
+
+/// @brief Copy the data out of a page under its sequence lock.
+/// @return False if a writer kept it busy for every attempt
+static bool read_live_metrics(const LiveMetricsPage *page, LiveMetricsData &data) {
+    for (int attempt=0; attempt<10000; attempt++) {
+        uint64_t before = page->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(&data, (const void*)&page->data, sizeof(data));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (page->sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief The writing side of the live metrics page.
+class LiveMetrics {
+public:
+    /// @brief Create this process's segment and map its page.
+    bool open() {
+        snprintf(name, sizeof(name), LIVE_METRICS_NAME, (int)getpid());
+        int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd == -1) {
+            stack_warnf("Could not create the live metrics segment %s\n", name);
+            return false;
+        }
+        if (ftruncate(fd, sizeof(LiveMetricsPage)) == -1) {
+            stack_warnf("Could not size the live metrics segment %s\n", name);
+            ::close(fd);
+            shm_unlink(name);
+            return false;
+        }
+        // Straight to the kernel, so bkmalloc's mmap hook doesn't track the page as an allocation
+        void *mapped = (void*)syscall(SYS_mmap, nullptr, sizeof(LiveMetricsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            stack_warnf("Could not map the live metrics segment %s\n", name);
+            shm_unlink(name);
+            return false;
+        }
+
+        LiveMetricsPage *fresh = (LiveMetricsPage*)mapped;
+        fresh->version = LIVE_METRICS_VERSION;
+        fresh->size = sizeof(LiveMetricsPage);
+        fresh->pid = getpid();
+        __atomic_store_n(&fresh->magic, LIVE_METRICS_MAGIC, __ATOMIC_RELEASE);
+        page.store(fresh, std::memory_order_release);
+        stack_infof("Publishing live metrics in shared memory as %s\n", name);
+        return true;
+    }
+
+    /// @brief Change the data under the sequence lock.
+    template <typename Write>
+    void update(Write write) {
+        while (writing.test_and_set(std::memory_order_acquire)) {}
+        // Loaded with `writing` held, so `close` can't unmap it until this is done
+        LiveMetricsPage *current = page.load(std::memory_order_acquire);
+        if (current != nullptr) {
+            write_locked(*current, write);
+        }
+        writing.clear(std::memory_order_release);
+    }
+
+    /// @brief Count an allocation the hooks let go by. Safe without any lock held.
+    void drop() {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t dropped_events() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Mark the page finished, unmap it and remove the segment.
+    ///
+    /// The page is taken away under the writer lock before it is unmapped, so
+    /// an `update` racing with this either finishes first or finds no page.
+    void close() {
+        while (writing.test_and_set(std::memory_order_acquire)) {}
+        LiveMetricsPage *current = page.load(std::memory_order_acquire);
+        if (current != nullptr) {
+            write_locked(*current, [](LiveMetricsData &data) {
+                data.finished = 1;
+            });
+            page.store(nullptr, std::memory_order_release);
+        }
+        writing.clear(std::memory_order_release);
+        if (current == nullptr) {
+            return;
+        }
+        syscall(SYS_munmap, current, sizeof(LiveMetricsPage));
+        shm_unlink(name);
+    }
+
+private:
+    // Only read or changed with `writing` held, past `open`
+    std::atomic<LiveMetricsPage*> page{nullptr};
+    char name[64] = {0};
+    std::atomic_flag writing = ATOMIC_FLAG_INIT;
+    std::atomic<uint64_t> dropped{0};
+
+    // Write `page`'s data as one sequence-lock update, with `writing` held
+    template <typename Write>
+    static void write_locked(LiveMetricsPage &page, Write write) {
+        uint64_t sequence = page.sequence.load(std::memory_order_relaxed);
+        page.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write(page.data);
+        page.sequence.store(sequence + 2, std::memory_order_release);
+    }
+};
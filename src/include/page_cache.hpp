@@ -0,0 +1,139 @@
+#pragma once
+
+#include <config.hpp>
+#include <stack_map.hpp>
+#include <stack_io.hpp>
+#include <interval_test.hpp>
+#include <compressor.hpp>
+
+#ifndef PAGE_CACHE_ENTRIES
+#define PAGE_CACHE_ENTRIES 1000000
+#endif
+
+// The number of compression type slots each cache entry holds. The
+// `CompressionType` enum value is used directly as the slot index.
+#define PAGE_CACHE_CODECS MAX_COMPRESSION_TYPES
+
+/// @brief The compressed sizes of a single virtual page, as of the
+///        interval they were last computed in.
+struct CachedPage {
+    uint64_t page_frame_number = 0;
+    uint64_t interval = 0;
+    // The last interval the page was looked up or stored in
+    uint64_t checked_interval = 0;
+    uint32_t valid = 0;
+    uint32_t compressed_sizes[PAGE_CACHE_CODECS] = {0};
+};
+
+/// @brief A cross-interval cache of per-page compressed sizes.
+///
+/// Pages are keyed by their virtual address. A cached size is only reused
+/// when the page is still backed by the same physical frame and has not been
+/// written since the soft-dirty bits were last cleared, so the result is the
+/// same one a recompression would give. The bits are cleared every interval,
+/// so that only holds for a page also checked in the interval before: one
+/// that went unchecked for an interval could have been written and cleared
+/// in between. Everything else is a miss, as is every lookup on kernels
+/// without soft-dirty tracking.
+class PageCompressionCache {
+public:
+    PageCompressionCache() : pages() {}
+
+    /// @brief Look up the compressed size of a page for a compression type.
+    /// @param page The page to look up
+    /// @param type The compression type the size was computed with
+    /// @param current_interval The interval doing the lookup
+    /// @param compressed_size Set to the cached compressed size on a hit
+    /// @param interval Set to the interval the size was computed in on a hit
+    /// @return True if the cached size is still valid for this page
+    bool lookup(const PageInfo &page, CompressionType type, uint64_t current_interval, uint64_t &compressed_size, uint64_t &interval) {
+        void *key = page.get_virtual_address();
+        // Without soft-dirty tracking a rewritten page looks clean, so nothing can be reused
+        if (!soft_dirty_bits_supported() || page.is_soft_dirty() || !pages.has(key)) {
+            misses++;
+            return false;
+        }
+
+        CachedPage &entry = pages.get(key);
+        if (entry.checked_interval + 1 < current_interval) {
+            // Not checked last interval, so clean now doesn't mean clean since
+            entry.valid = 0;
+        }
+        uint32_t slot = slot_of(type);
+        if (entry.page_frame_number != page.get_page_frame_number() || !(entry.valid & (1 << slot))) {
+            misses++;
+            return false;
+        }
+
+        compressed_size = entry.compressed_sizes[slot];
+        interval = entry.interval;
+        entry.checked_interval = current_interval;
+        hits++;
+        return true;
+    }
+
+    /// @brief Record the compressed size of a page for a compression type.
+    /// @param page The page that was compressed
+    /// @param type The compression type used
+    /// @param compressed_size The resulting compressed size
+    /// @param interval The interval the page was compressed in
+    void store(const PageInfo &page, CompressionType type, uint64_t compressed_size, uint64_t interval) {
+        void *key = page.get_virtual_address();
+        if (pages.full() && !pages.has(key)) {
+            // Entries for freed pages are never pruned individually, so start
+            // over when the cache fills up.
+            stack_warnf("Page compression cache is full (%d entries), flushing\n", pages.num_entries());
+            pages.clear();
+        }
+
+        bool is_new = !pages.has(key);
+        CachedPage &entry = pages.get(key);
+        if (is_new
+            || entry.valid == 0
+            || entry.page_frame_number != page.get_page_frame_number()
+            || (page.is_soft_dirty() && entry.interval != interval)
+            || entry.checked_interval + 1 < interval) {
+            // The page moved or was rewritten, or may have been: every other codec's size is stale
+            entry = CachedPage();
+            entry.page_frame_number = page.get_page_frame_number();
+            entry.interval = interval;
+        }
+        entry.checked_interval = interval;
+        uint32_t slot = slot_of(type);
+        entry.compressed_sizes[slot] = compressed_size;
+        entry.valid |= 1 << slot;
+    }
+
+    uint64_t get_hits() const {
+        return hits;
+    }
+
+    uint64_t get_misses() const {
+        return misses;
+    }
+
+    double hit_rate() const {
+        if (hits + misses == 0) {
+            return 0.0;
+        }
+        return (double)hits / (double)(hits + misses);
+    }
+
+    size_t size() const {
+        return pages.num_entries();
+    }
+
+    /// @brief Reset the hit/miss counters at the end of an interval.
+    void reset_statistics() {
+        hits = 0;
+        misses = 0;
+    }
+
+private:
+    StackMap<void*, CachedPage, PAGE_CACHE_ENTRIES> pages;
+    uint64_t hits = 0, misses = 0;
+
+    static uint32_t slot_of(CompressionType type) {
+        return (uint32_t)type % PAGE_CACHE_CODECS;
+    }
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <config.hpp>
+#include <stack_map.hpp>
+#include <stack_io.hpp>
+#include <interval_test.hpp>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <cpuid.h>
+#endif
+
+#ifndef PAGE_DEDUP_ENTRIES
+#define PAGE_DEDUP_ENTRIES 1000000
+#endif
+
+// How many alternate slots to try when two different pages share a fingerprint
+#define PAGE_DEDUP_PROBES 4
+
+#if defined(__x86_64__)
+/// @brief Fingerprint a buffer with CRC32C over four interleaved lanes.
+///
+/// `crc32` has a three cycle latency but a throughput of one per cycle, so
+/// running independent lanes keeps the unit busy. The buffer size must be a
+/// multiple of 32 bytes, which every page is.
+__attribute__((target("sse4.2")))
+static uint64_t page_fingerprint_crc32c(const uint8_t *data, size_t size) {
+    uint64_t lane0 = 0, lane1 = 0x9E3779B9, lane2 = 0x85EBCA6B, lane3 = 0xC2B2AE35;
+    const uint64_t *words = (const uint64_t*)data;
+    for (size_t i=0; i + 4 <= size / sizeof(uint64_t); i += 4) {
+        lane0 = _mm_crc32_u64(lane0, words[i]);
+        lane1 = _mm_crc32_u64(lane1, words[i + 1]);
+        lane2 = _mm_crc32_u64(lane2, words[i + 2]);
+        lane3 = _mm_crc32_u64(lane3, words[i + 3]);
+    }
+    return ((lane0 ^ (lane2 << 16)) << 32) ^ (lane1 ^ (lane3 << 8)) ^ size;
+}
+#endif
+
+/// @brief Portable fingerprint for CPUs without SSE4.2.
+static uint64_t page_fingerprint_scalar(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL ^ size;
+    const uint64_t *words = (const uint64_t*)data;
+    for (size_t i=0; i < size / sizeof(uint64_t); i++) {
+        hash ^= words[i];
+        hash *= 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+/// @brief A 64-bit content fingerprint of a page.
+/// @param data The start of the page
+/// @param size The size of the page in bytes
+/// @return The fingerprint. Equal pages always have equal fingerprints.
+uint64_t page_fingerprint(const void *data, size_t size) {
+    #if defined(__x86_64__)
+    // `__builtin_cpu_supports` needs libgcc's `__cpu_model`, which cannot be
+    // relocated into the hooks library, so ask `cpuid` directly
+    static bool has_sse4_2 = []() {
+        unsigned int eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+    }();
+    if (has_sse4_2) {
+        return page_fingerprint_crc32c((const uint8_t*)data, size);
+    }
+    #endif
+    return page_fingerprint_scalar((const uint8_t*)data, size);
+}
+
+/// @brief A set of pages this interval with identical contents.
+struct DedupGroup {
+    // The first page seen with these contents, used to confirm matches
+    const uint8_t *representative = nullptr;
+    // The allocation site of the representative page
+    uintptr_t site = 0;
+    uint64_t pages = 0;
+};
+
+/// @brief Per-allocation-site deduplication counts for one interval.
+struct SiteDedupStats {
+    uint64_t resident_pages = 0;
+    // Pages identical to a page seen earlier this interval
+    uint64_t duplicate_pages = 0;
+    // Duplicate pages whose first copy belongs to a different site
+    uint64_t cross_site_duplicate_pages = 0;
+
+    uint64_t savings() const {
+        return duplicate_pages * PAGE_SIZE;
+    }
+};
+
+/// @brief Counts how much memory same-page merging would reclaim.
+///
+/// Pages are fed in one at a time during the page sweep. Pages with equal
+/// fingerprints are compared with `memcmp` before being counted as
+/// duplicates, so a fingerprint collision never inflates the savings.
+/// Everything is reset at the start of each interval.
+class PageDedupTable {
+public:
+    PageDedupTable() : groups(), sites() {}
+
+    /// @brief Record a resident page.
+    /// @param page The page to record
+    /// @param site The allocation site the page belongs to
+    /// @return True if the page duplicates one recorded earlier this interval
+    bool insert(const PageInfo &page, uintptr_t site) {
+        const uint8_t *data = (const uint8_t*)page.get_virtual_address();
+        uint64_t fingerprint = page_fingerprint(data, page.size());
+        SiteDedupStats &stats = sites.get(site);
+        stats.resident_pages++;
+
+        for (uint64_t probe=0; probe<PAGE_DEDUP_PROBES; probe++) {
+            uint64_t key = fingerprint + probe;
+            if (!groups.has(key)) {
+                if (groups.full()) {
+                    stack_warnf("Page dedup table is full (%d groups)\n", groups.num_entries());
+                    return false;
+                }
+                DedupGroup &group = groups.get(key);
+                group.representative = data;
+                group.site = site;
+                group.pages = 1;
+                return false;
+            }
+
+            DedupGroup &group = groups.get(key);
+            if (memcmp(group.representative, data, page.size()) != 0) {
+                // A fingerprint collision, try the next slot
+                continue;
+            }
+
+            if (group.pages++ == 1) {
+                duplicate_groups++;
+            }
+            stats.duplicate_pages++;
+            if (group.site != site) {
+                stats.cross_site_duplicate_pages++;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /// @brief Call `func` with the deduplication counts of every site.
+    void map_sites(std::function<void(const uintptr_t&, const SiteDedupStats&)> func) const {
+        sites.map(func);
+    }
+
+    /// @brief The totals over every site this interval.
+    SiteDedupStats total() const {
+        return sites.reduce<SiteDedupStats>([](const uintptr_t &site, const SiteDedupStats &stats, SiteDedupStats acc) {
+            acc.resident_pages += stats.resident_pages;
+            acc.duplicate_pages += stats.duplicate_pages;
+            acc.cross_site_duplicate_pages += stats.cross_site_duplicate_pages;
+            return acc;
+        }, SiteDedupStats());
+    }
+
+    /// @brief The number of distinct page contents that appear more than once.
+    uint64_t get_duplicate_groups() const {
+        return duplicate_groups;
+    }
+
+    void clear() {
+        groups.clear();
+        sites.clear();
+        duplicate_groups = 0;
+    }
+
+private:
+    StackMap<uint64_t, DedupGroup, PAGE_DEDUP_ENTRIES> groups;
+    StackMap<uintptr_t, SiteDedupStats, TRACKED_ALLOCATION_SITES> sites;
+    uint64_t duplicate_groups = 0;
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <config.hpp>
+#include <stack_map.hpp>
+#include <stack_io.hpp>
+#include <string.h>
+
+#ifdef USE_ZSTD_COMPRESSION
+#include <zstd.h>
+#include <zdict.h>
+
+// The most allocation sites that get their own dictionary
+#ifndef SITE_DICTIONARY_SITES
+#define SITE_DICTIONARY_SITES 64
+#endif
+// Retrain each site's dictionary every this many intervals
+#ifndef SITE_DICTIONARY_RETRAIN_INTERVALS
+#define SITE_DICTIONARY_RETRAIN_INTERVALS 5
+#endif
+// A site needs this many live objects to count as hot
+#define SITE_DICTIONARY_MIN_OBJECTS 64
+// A site that allocates nothing for this many intervals can lose its slot to a new hot site
+#ifndef SITE_DICTIONARY_IDLE_INTERVALS
+#define SITE_DICTIONARY_IDLE_INTERVALS 2
+#endif
+// One object in this many is a training sample; only the rest are scored
+#define SITE_DICTIONARY_TRAINING_SHARE 4
+// Only objects up to this size are sampled; larger ones compress well alone
+#define SITE_DICTIONARY_MAX_OBJECT_SIZE 4096
+// Sample storage per site
+#define SITE_DICTIONARY_SAMPLE_BYTES 0x20000
+#define SITE_DICTIONARY_MAX_SAMPLES 1024
+// ZDICT needs a reasonable number of samples before it produces anything useful
+#define SITE_DICTIONARY_MIN_SAMPLES 32
+#define SITE_DICTIONARY_SIZE 0x4000
+// The same level `Compressor` uses for zstd, so sizes are comparable
+#define SITE_DICTIONARY_LEVEL 1
+
+/// @brief The samples and trained dictionary of a single allocation site.
+struct SiteDictionary {
+    uintptr_t site = 0;
+
+    uint8_t samples[SITE_DICTIONARY_SAMPLE_BYTES];
+    size_t sample_sizes[SITE_DICTIONARY_MAX_SAMPLES];
+    size_t num_samples = 0, sampled_bytes = 0;
+
+    uint8_t dictionary[SITE_DICTIONARY_SIZE];
+    size_t dictionary_size = 0;
+    ZSTD_CDict *cdict = nullptr;
+    uint64_t trained_interval = 0;
+    // The last interval the site had a new object in
+    uint64_t allocated_interval = 0;
+
+    bool has_room(size_t size) const {
+        return num_samples < SITE_DICTIONARY_MAX_SAMPLES && sampled_bytes + size <= SITE_DICTIONARY_SAMPLE_BYTES;
+    }
+
+    /// @brief Drop the dictionary and samples, to hand the slot to another site.
+    void reset(uintptr_t new_site) {
+        if (cdict != nullptr) {
+            ZSTD_freeCDict(cdict);
+            cdict = nullptr;
+        }
+        site = new_site;
+        num_samples = 0;
+        sampled_bytes = 0;
+        dictionary_size = 0;
+        trained_interval = 0;
+        allocated_interval = 0;
+    }
+};
+
+/// @brief Per-allocation-site zstd dictionaries trained from sampled objects.
+///
+/// Objects from hot sites are sampled during the object sweep. At the end of
+/// an interval, every site with enough samples that has no dictionary, or
+/// whose dictionary is `SITE_DICTIONARY_RETRAIN_INTERVALS` old, is (re)trained
+/// with `ZDICT_trainFromBuffer` and gets a fresh `ZSTD_CDict`. A dictionary
+/// is first used in the interval after the one it was trained in.
+///
+/// Objects are split by address: one in `SITE_DICTIONARY_TRAINING_SHARE` is
+/// only ever sampled, and only the others are compressed with a dictionary,
+/// so a dictionary is never scored on an object it was trained on.
+///
+/// Once every slot is taken, a new hot site that is allocating takes the slot
+/// of the site that has gone longest without allocating, if that is at least
+/// `SITE_DICTIONARY_IDLE_INTERVALS`.
+class SiteDictionaries {
+public:
+    SiteDictionaries() : index() {}
+
+    /// @brief Offer an object from a site, noting whether the site is allocating,
+    ///        and keep it as a training sample if it is a training object.
+    /// @param interval The current interval
+    /// @param site The allocation site of the object
+    /// @param live_objects The number of live objects from the site
+    /// @param age The object's age in intervals; 0 if it is new
+    /// @param object The object's contents
+    /// @param size The object's size
+    void sample(uint64_t interval, uintptr_t site, size_t live_objects, uint64_t age, const uint8_t *object, size_t size) {
+        if (size == 0 || size > SITE_DICTIONARY_MAX_OBJECT_SIZE || live_objects < SITE_DICTIONARY_MIN_OBJECTS) {
+            return;
+        }
+
+        SiteDictionary *dictionary = find(site);
+        if (dictionary == nullptr) {
+            // Only a site that is allocating may take a slot
+            if (age != 0 || (dictionary = claim(interval, site)) == nullptr) {
+                return;
+            }
+        }
+        if (age == 0) {
+            dictionary->allocated_interval = interval;
+        }
+
+        if (!is_training_object(object) || !dictionary->has_room(size)) {
+            return;
+        }
+        memcpy(dictionary->samples + dictionary->sampled_bytes, object, size);
+        dictionary->sample_sizes[dictionary->num_samples++] = size;
+        dictionary->sampled_bytes += size;
+    }
+
+    /// @brief Compress an object with its site's dictionary.
+    /// @return The compressed size, or 0 if the site has no dictionary yet or
+    ///         the object is one the dictionaries are trained on
+    size_t compress(uintptr_t site, const uint8_t *object, size_t size, uint8_t *output_buffer, size_t output_size) {
+        if (is_training_object(object)) {
+            return 0;
+        }
+        SiteDictionary *dictionary = find(site);
+        if (dictionary == nullptr || dictionary->cdict == nullptr) {
+            return 0;
+        }
+
+        if (cctx == nullptr) {
+            cctx = ZSTD_createCCtx();
+        }
+        size_t compressed_size = ZSTD_compress_usingCDict(cctx, output_buffer, output_size, object, size, dictionary->cdict);
+        if (ZSTD_isError(compressed_size)) {
+            stack_errorf("Zstd dictionary compression failed: %s\n", ZSTD_getErrorName(compressed_size));
+            return 0;
+        }
+        return compressed_size;
+    }
+
+    /// @brief The size of a site's dictionary, or 0 if it has none.
+    size_t dictionary_size(uintptr_t site) {
+        SiteDictionary *dictionary = find(site);
+        if (dictionary == nullptr || dictionary->cdict == nullptr) {
+            return 0;
+        }
+        return dictionary->dictionary_size;
+    }
+
+    /// @brief Train the dictionaries that are due at the end of an interval.
+    void train(uint64_t interval) {
+        for (size_t i=0; i<num_dictionaries; i++) {
+            SiteDictionary &dictionary = dictionaries[i];
+            bool due = dictionary.cdict == nullptr || interval - dictionary.trained_interval >= SITE_DICTIONARY_RETRAIN_INTERVALS;
+            if (!due || dictionary.num_samples < SITE_DICTIONARY_MIN_SAMPLES) {
+                continue;
+            }
+
+            size_t dictionary_size = ZDICT_trainFromBuffer(dictionary.dictionary, sizeof(dictionary.dictionary), dictionary.samples, dictionary.sample_sizes, dictionary.num_samples);
+            if (ZDICT_isError(dictionary_size)) {
+                stack_warnf("Could not train dictionary for site %p from %d samples: %s\n", (void*)dictionary.site, dictionary.num_samples, ZDICT_getErrorName(dictionary_size));
+            } else {
+                if (dictionary.cdict != nullptr) {
+                    ZSTD_freeCDict(dictionary.cdict);
+                }
+                dictionary.cdict = ZSTD_createCDict(dictionary.dictionary, dictionary_size, SITE_DICTIONARY_LEVEL);
+                dictionary.dictionary_size = dictionary_size;
+                dictionary.trained_interval = interval;
+                stack_infof("Trained %d byte dictionary for site %p from %d samples\n", dictionary_size, (void*)dictionary.site, dictionary.num_samples);
+            }
+
+            // Start collecting fresh samples for the next training
+            dictionary.num_samples = 0;
+            dictionary.sampled_bytes = 0;
+        }
+    }
+
+private:
+    SiteDictionary dictionaries[SITE_DICTIONARY_SITES];
+    size_t num_dictionaries = 0;
+    StackMap<uintptr_t, size_t, SITE_DICTIONARY_SITES * 2> index;
+    ZSTD_CCtx *cctx = nullptr;
+
+    SiteDictionary *find(uintptr_t site) {
+        if (!index.has(site)) {
+            return nullptr;
+        }
+        return &dictionaries[index.get(site)];
+    }
+
+    // Whether an object is kept for training rather than scored. Decided by
+    // address, so an object keeps its role for as long as it lives.
+    static bool is_training_object(const uint8_t *object) {
+        uint64_t bits = ((uintptr_t)object >> 4) * 0x9e3779b97f4a7c15ULL;
+        return (bits >> 32) % SITE_DICTIONARY_TRAINING_SHARE == 0;
+    }
+
+    // A slot for a new site: a free one, or the one of the site idle longest
+    // if it has been idle long enough; null if every site is still allocating
+    SiteDictionary *claim(uint64_t interval, uintptr_t site) {
+        size_t slot = num_dictionaries;
+        if (num_dictionaries < SITE_DICTIONARY_SITES) {
+            num_dictionaries++;
+        } else {
+            slot = 0;
+            for (size_t i=1; i<num_dictionaries; i++) {
+                if (dictionaries[i].allocated_interval < dictionaries[slot].allocated_interval) {
+                    slot = i;
+                }
+            }
+            if (interval - dictionaries[slot].allocated_interval < SITE_DICTIONARY_IDLE_INTERVALS) {
+                return nullptr;
+            }
+            stack_infof("Evicting the dictionary of site %p, idle since interval %d, for site %p\n", (void*)dictionaries[slot].site, dictionaries[slot].allocated_interval, (void*)site);
+            index.remove(dictionaries[slot].site);
+        }
+        dictionaries[slot].reset(site);
+        index.put(site, slot);
+        return &dictionaries[slot];
+    }
+};
+#endif
@@ -9,6 +9,72 @@ const size_t CSV_STR_SIZE = 128;
 
 typedef StackString<CSV_STR_SIZE> CSVString;
 
+// How a `CSV` is written out: as text, or as binary columnar chunks that
+// `heappulse-convert` turns back into the same text.
+enum class CSVFormat {
+    TEXT,
+    COLUMNAR,
+};
+
+// The columnar format is a sequence of self-describing chunks, one per call
+// to `CSV::write`, so a file is only ever appended to. A chunk is a
+// `CSVChunkHeader`, a `CSVColumnHeader` per column, and then each column's
+// name, validity bitmap, dictionary and data. Offsets are from the start of
+// the chunk and every section is padded to 8 bytes, so a mapped file can be
+// read in place.
+//
+// Integer, float and pointer columns hold 8 bytes per row and boolean
+// columns one. String columns with few distinct values are dictionary
+// encoded: the dictionary is a 4-byte length and the bytes of each entry,
+// and the data is a 4-byte code per row. Other string columns, and columns
+// whose cells are not all of one type, hold `rows + 1` 4-byte offsets into
+// the string bytes that follow them. Rows with no cells are left out.
+#define CSV_COLUMNAR_MAGIC "HPCC"
+#define CSV_COLUMNAR_VERSION 1
+// The most distinct strings a column can dictionary encode
+#define CSV_COLUMNAR_MAX_DICTIONARY 1024
+#define CSV_COLUMNAR_DICTIONARY_SLOTS (CSV_COLUMNAR_MAX_DICTIONARY * 4)
+
+enum class CSVColumnType : uint8_t {
+    EMPTY = 0,
+    INTEGER = 1,
+    FLOAT = 2,
+    POINTER = 3,
+    BOOLEAN = 4,
+    DICTIONARY = 5,
+    STRING = 6,
+};
+
+struct CSVChunkHeader {
+    char magic[4];
+    uint32_t version;
+    // The whole chunk, headers included
+    uint64_t size;
+    uint64_t rows;
+    uint32_t columns;
+    uint32_t reserved;
+};
+
+struct CSVColumnHeader {
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t name_size;
+    uint64_t name_offset;
+    // One bit per row, set if the row has a value; 0 if every row does
+    uint64_t validity_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t dictionary_offset;
+    uint64_t dictionary_size;
+    uint64_t dictionary_entries;
+};
+
+static_assert(sizeof(CSVChunkHeader) == 32 && sizeof(CSVColumnHeader) == 64, "Columnar headers must not have padding");
+
+static inline uint64_t csv_columnar_pad(uint64_t size) {
+    return (size + 7) & ~(uint64_t)7;
+}
+
 struct CSVCell {
     CSVCell() : type(Type::EMPTY), string() {}
 
@@ -79,23 +145,29 @@ struct CSVCell {
         }
     }
 
+    // Format the cell into the file's buffer; the CSV flushes it
     void write(StackFile &file) {
-        // stack_fprintf(file, "%s\n", to_string().c_str());
         switch (type) {
             case Type::STRING:
-                file.write(string);
+                for (size_t i=0; i<string.size() && string[i] != '\0'; i++) {
+                    file.append(string[i]);
+                }
                 break;
             case Type::INTEGER:
-                stack_fprintf(file, "%d", integer);
+                file.append_integer(integer);
                 break;
             case Type::FLOAT:
-                stack_fprintf(file, "%f", floating_point);
+                file.append_float(floating_point);
                 break;
             case Type::POINTER:
-                stack_fprintf(file, "%p", pointer);
+                file.append_hex((uintptr_t)pointer);
                 break;
             case Type::BOOLEAN:
-                stack_fprintf(file, "%s", boolean ? "true" : "false");
+                if (boolean) {
+                    file.append("true", 4);
+                } else {
+                    file.append("false", 5);
+                }
                 break;
             case Type::EMPTY:
             // default:
@@ -251,12 +323,16 @@ public:
         return cells.size();
     }
 
+    // The cell in a column, or null past the end of the row
+    const CSVCell *cell(size_t col) const {
+        return col < cells.size() ? &cells[col] : nullptr;
+    }
+
     void write(StackFile &file) {
         for (size_t i=0; i<size(); i++) {
             cells[i].write(file);
             if (i != size() - 1) {
-                // file.write(StackString<16>(","));
-                stack_fprintf(file, ",");
+                file.append(',');
             }
         }
     }
@@ -280,6 +356,330 @@ private:
     CSVRow<Width> title_row;
     StackVec<CSVRow<Width>, Length> rows;
     bool is_first_write = true;
+    CSVFormat format = CSVFormat::TEXT;
+
+    // Where each column's sections go in the chunk being written
+    struct ColumnLayout {
+        CSVColumnType type;
+        uint64_t name_size, validity_size, data_size, dictionary_size, dictionary_entries;
+        bool has_missing;
+    };
+
+    // The distinct strings of the column being encoded
+    struct Dictionary {
+        CSVString entries[CSV_COLUMNAR_MAX_DICTIONARY];
+        size_t size = 0;
+        // Index + 1 of the entry in each slot, or 0 for an empty slot
+        uint32_t slots[CSV_COLUMNAR_DICTIONARY_SLOTS];
+
+        void clear() {
+            size = 0;
+            memset(slots, 0, sizeof(slots));
+        }
+
+        // Find or add a string, returning its code, or -1 if the dictionary is full
+        int64_t code(const CSVString &string) {
+            uint64_t hash = 0xCBF29CE484222325ULL;
+            for (size_t i=0; i<string.size(); i++) {
+                hash = (hash ^ (uint8_t)string[i]) * 0x100000001B3ULL;
+            }
+            for (size_t probe=0; probe<CSV_COLUMNAR_DICTIONARY_SLOTS; probe++) {
+                uint32_t &slot = slots[(hash + probe) % CSV_COLUMNAR_DICTIONARY_SLOTS];
+                if (slot == 0) {
+                    if (size >= CSV_COLUMNAR_MAX_DICTIONARY) {
+                        return -1;
+                    }
+                    entries[size] = string;
+                    slot = ++size;
+                    return slot - 1;
+                }
+                if (entries[slot - 1] == string) {
+                    return slot - 1;
+                }
+            }
+            return -1;
+        }
+    };
+
+    static Dictionary &dictionary() {
+        static Dictionary dictionary;
+        return dictionary;
+    }
+
+    // A cell's text up to its first null, as the text format writes it
+    static CSVString cell_string(const CSVCell &cell) {
+        CSVString string = cell.to_string();
+        CSVString result;
+        for (size_t i=0; i<string.size() && string[i] != '\0'; i++) {
+            result.push(string[i]);
+        }
+        return result;
+    }
+
+    static bool has_value(const CSVCell *cell) {
+        return cell != nullptr && cell->type != CSVCell::Type::EMPTY;
+    }
+
+    // Pick a column's encoding and size its sections
+    ColumnLayout layout_column(size_t col) {
+        ColumnLayout layout = {CSVColumnType::EMPTY, 0, 0, 0, 0, 0, false};
+        size_t count = 0;
+        bool mixed = false;
+        CSVCell::Type type = CSVCell::Type::EMPTY;
+        for (size_t i=0; i<rows.size(); i++) {
+            if (rows[i].size() == 0) {
+                continue;
+            }
+            count++;
+            const CSVCell *cell = rows[i].cell(col);
+            if (!has_value(cell)) {
+                layout.has_missing = true;
+            } else if (type == CSVCell::Type::EMPTY) {
+                type = cell->type;
+            } else if (type != cell->type) {
+                mixed = true;
+            }
+        }
+        layout.validity_size = layout.has_missing ? csv_columnar_pad((count + 7) / 8) : 0;
+
+        if (mixed || type == CSVCell::Type::STRING) {
+            // Try a dictionary, falling back to plain strings if it overflows
+            Dictionary &dict = dictionary();
+            dict.clear();
+            bool fits = true;
+            uint64_t string_bytes = 0;
+            for (size_t i=0; i<rows.size(); i++) {
+                const CSVCell *cell = rows[i].cell(col);
+                if (rows[i].size() == 0 || !has_value(cell)) {
+                    continue;
+                }
+                CSVString string = cell_string(*cell);
+                string_bytes += string.size();
+                fits = fits && dict.code(string) >= 0;
+            }
+            if (fits) {
+                layout.type = CSVColumnType::DICTIONARY;
+                layout.dictionary_entries = dict.size;
+                for (size_t i=0; i<dict.size; i++) {
+                    layout.dictionary_size += sizeof(uint32_t) + dict.entries[i].size();
+                }
+                layout.dictionary_size = csv_columnar_pad(layout.dictionary_size);
+                layout.data_size = csv_columnar_pad(count * sizeof(uint32_t));
+            } else {
+                layout.type = CSVColumnType::STRING;
+                layout.data_size = csv_columnar_pad((count + 1) * sizeof(uint32_t)) + csv_columnar_pad(string_bytes);
+            }
+            return layout;
+        }
+
+        switch (type) {
+            case CSVCell::Type::INTEGER:
+                layout.type = CSVColumnType::INTEGER;
+                layout.data_size = count * sizeof(int64_t);
+                break;
+            case CSVCell::Type::FLOAT:
+                layout.type = CSVColumnType::FLOAT;
+                layout.data_size = count * sizeof(double);
+                break;
+            case CSVCell::Type::POINTER:
+                layout.type = CSVColumnType::POINTER;
+                layout.data_size = count * sizeof(uint64_t);
+                break;
+            case CSVCell::Type::BOOLEAN:
+                layout.type = CSVColumnType::BOOLEAN;
+                layout.data_size = csv_columnar_pad(count);
+                break;
+            default:
+                layout.type = CSVColumnType::EMPTY;
+                break;
+        }
+        return layout;
+    }
+
+    static void write_padding(StackFile &file, uint64_t written, uint64_t padded) {
+        for (; written < padded; written++) {
+            file.append('\0');
+        }
+    }
+
+    void write_column(StackFile &file, size_t col, const ColumnLayout &layout) {
+        if (layout.has_missing) {
+            uint8_t byte = 0;
+            uint64_t bits = 0;
+            for (size_t i=0; i<rows.size(); i++) {
+                if (rows[i].size() == 0) {
+                    continue;
+                }
+                byte |= has_value(rows[i].cell(col)) << (bits % 8);
+                if (++bits % 8 == 0) {
+                    file.append((char)byte);
+                    byte = 0;
+                }
+            }
+            if (bits % 8 != 0) {
+                file.append((char)byte);
+            }
+            write_padding(file, (bits + 7) / 8, layout.validity_size);
+        }
+
+        if (layout.type == CSVColumnType::DICTIONARY) {
+            // Rebuild the dictionary the layout was sized with; the codes come out the same
+            Dictionary &dict = dictionary();
+            dict.clear();
+            for (size_t i=0; i<rows.size(); i++) {
+                const CSVCell *cell = rows[i].cell(col);
+                if (rows[i].size() != 0 && has_value(cell)) {
+                    dict.code(cell_string(*cell));
+                }
+            }
+            uint64_t written = 0;
+            for (size_t i=0; i<dict.size; i++) {
+                uint32_t length = dict.entries[i].size();
+                file.append((const char*)&length, sizeof(length));
+                for (size_t j=0; j<length; j++) {
+                    file.append(dict.entries[i][j]);
+                }
+                written += sizeof(length) + length;
+            }
+            write_padding(file, written, layout.dictionary_size);
+        }
+
+        uint64_t written = 0;
+        uint32_t string_offset = 0;
+        if (layout.type == CSVColumnType::STRING) {
+            // Offsets first, then the bytes they point into
+            file.append((const char*)&string_offset, sizeof(string_offset));
+            written += sizeof(string_offset);
+        }
+        for (size_t i=0; i<rows.size(); i++) {
+            if (rows[i].size() == 0) {
+                continue;
+            }
+            const CSVCell *cell = rows[i].cell(col);
+            bool present = has_value(cell);
+            switch (layout.type) {
+                case CSVColumnType::INTEGER: {
+                    int64_t value = present ? cell->integer : 0;
+                    file.append((const char*)&value, sizeof(value));
+                    written += sizeof(value);
+                    break;
+                }
+                case CSVColumnType::FLOAT: {
+                    double value = present ? cell->floating_point : 0.0;
+                    file.append((const char*)&value, sizeof(value));
+                    written += sizeof(value);
+                    break;
+                }
+                case CSVColumnType::POINTER: {
+                    uint64_t value = present ? (uintptr_t)cell->pointer : 0;
+                    file.append((const char*)&value, sizeof(value));
+                    written += sizeof(value);
+                    break;
+                }
+                case CSVColumnType::BOOLEAN:
+                    file.append((char)(present && cell->boolean));
+                    written++;
+                    break;
+                case CSVColumnType::DICTIONARY: {
+                    uint32_t code = present ? dictionary().code(cell_string(*cell)) : 0;
+                    file.append((const char*)&code, sizeof(code));
+                    written += sizeof(code);
+                    break;
+                }
+                case CSVColumnType::STRING:
+                    string_offset += present ? cell_string(*cell).size() : 0;
+                    file.append((const char*)&string_offset, sizeof(string_offset));
+                    written += sizeof(string_offset);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (layout.type == CSVColumnType::STRING) {
+            write_padding(file, written, csv_columnar_pad(written));
+            for (size_t i=0; i<rows.size(); i++) {
+                const CSVCell *cell = rows[i].cell(col);
+                if (rows[i].size() == 0 || !has_value(cell)) {
+                    continue;
+                }
+                CSVString string = cell_string(*cell);
+                for (size_t j=0; j<string.size(); j++) {
+                    file.append(string[j]);
+                }
+            }
+            write_padding(file, csv_columnar_pad(written) + string_offset, layout.data_size);
+        } else {
+            write_padding(file, written, layout.data_size);
+        }
+    }
+
+    // Append the rows as one columnar chunk
+    void write_columnar(StackFile &file) {
+        if (is_first_write && file.get_mode() == Mode::WRITE) {
+            file.clear();
+        }
+        is_first_write = false;
+
+        uint64_t count = 0;
+        size_t columns = title_row.size();
+        for (size_t i=0; i<rows.size(); i++) {
+            if (rows[i].size() > 0) {
+                count++;
+                columns = max(columns, rows[i].size());
+            }
+        }
+        if (count == 0) {
+            return;
+        }
+
+        ColumnLayout layouts[Width];
+        CSVColumnHeader headers[Width];
+        uint64_t offset = sizeof(CSVChunkHeader) + columns * sizeof(CSVColumnHeader);
+        for (size_t col=0; col<columns; col++) {
+            ColumnLayout &layout = layouts[col];
+            layout = layout_column(col);
+            const CSVCell *title = title_row.cell(col);
+            layout.name_size = title == nullptr ? 0 : cell_string(*title).size();
+
+            CSVColumnHeader &header = headers[col];
+            memset(&header, 0, sizeof(header));
+            header.type = (uint8_t)layout.type;
+            header.name_size = layout.name_size;
+            header.name_offset = offset;
+            offset += csv_columnar_pad(layout.name_size);
+            header.validity_offset = layout.has_missing ? offset : 0;
+            offset += layout.validity_size;
+            header.dictionary_offset = offset;
+            header.dictionary_size = layout.dictionary_size;
+            header.dictionary_entries = layout.dictionary_entries;
+            offset += layout.dictionary_size;
+            header.data_offset = offset;
+            header.data_size = layout.data_size;
+            offset += layout.data_size;
+        }
+
+        CSVChunkHeader chunk;
+        memset(&chunk, 0, sizeof(chunk));
+        memcpy(chunk.magic, CSV_COLUMNAR_MAGIC, sizeof(chunk.magic));
+        chunk.version = CSV_COLUMNAR_VERSION;
+        chunk.size = offset;
+        chunk.rows = count;
+        chunk.columns = columns;
+        file.append((const char*)&chunk, sizeof(chunk));
+        file.append((const char*)headers, columns * sizeof(CSVColumnHeader));
+        for (size_t col=0; col<columns; col++) {
+            if (layouts[col].name_size > 0) {
+                CSVString name = cell_string(*title_row.cell(col));
+                for (size_t j=0; j<name.size(); j++) {
+                    file.append(name[j]);
+                }
+            }
+            write_padding(file, layouts[col].name_size, csv_columnar_pad(layouts[col].name_size));
+            write_column(file, col, layouts[col]);
+        }
+        file.checkpoint();
+        stack_debugf("Wrote a columnar chunk of %d rows and %d bytes\n", count, offset);
+    }
 
 public:
     void log() {
@@ -294,6 +694,10 @@ public:
     }
 
     void write(StackFile &file) {
+        if (format == CSVFormat::COLUMNAR) {
+            write_columnar(file);
+            return;
+        }
         stack_debugf("Writing % rows to CSV\n", rows.size());
         // stack_debugf("Writing to % with descriptor %\n", file.get_filename(), file.get_descriptor());
         // if (file.get_mode() == Mode::WRITE) {
@@ -304,7 +708,7 @@ public:
                 file.clear();
                 title_row.write(file);
                 if (title_row.size() > 0) {
-                    stack_fprintf(file, "\n");
+                    file.append('\n');
                 }
                 is_first_write = false;
             }
@@ -313,7 +717,7 @@ public:
                     stack_infof("%d percent done writing CSV\n", (int)((i + 1) * 100 / rows.size()));
                 }
                 rows[i].write(file);
-                stack_fprintf(file, "\n");
+                file.append('\n');
             }
             break;
         // } else if (file.get_mode() == Mode::APPEND) {
@@ -322,7 +726,7 @@ public:
             if (is_first_write) {
                 title_row.write(file);
                 if (title_row.size() > 0) {
-                    stack_fprintf(file, "\n");
+                    file.append('\n');
                 }
                 is_first_write = false;
             }
@@ -336,13 +740,15 @@ public:
                 }
                 // stack_debugf("Writing row %d\n", i);
                 rows[i].write(file);
-                stack_fprintf(file, "\n");
+                file.append('\n');
             }
             break;
         default:
             stack_errorf("Not writing to % because it is not open for writing\n", file.get_filename());
             throw std::runtime_error("File not open for writing");
         }
+        // A checkpoint ends a compressed file's frame, so every write can be read back
+        file.checkpoint();
         stack_debugf("Done writing CSV\n");
     }
 
@@ -350,6 +756,10 @@ public:
         return rows.size() >= Length;
     }
 
+    void set_format(CSVFormat format) {
+        this->format = format;
+    }
+
     CSVRow<Width> &new_row() {
         rows.push(CSVRow<Width>());
         return last();
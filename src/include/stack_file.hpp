@@ -10,6 +10,28 @@
 #include <stdexcept>
 #include "stack_io.hpp"
 #include "stack_string.hpp"
+#include "async_file_writer.hpp"
+
+#ifdef COMPRESS_OUTPUT_FILES
+#include <zstd.h>
+#endif
+
+// The user-space buffer each file collects writes in before a syscall
+#ifndef STACK_FILE_BUFFER_SIZE
+#define STACK_FILE_BUFFER_SIZE (1 << 16)
+#endif
+
+// The zstd level files named `*.zst` are compressed at
+#ifndef OUTPUT_COMPRESSION_LEVEL
+#define OUTPUT_COMPRESSION_LEVEL 3
+#endif
+
+// Appended to output file names, so they're compressed when COMPRESS_OUTPUT_FILES is on
+#ifdef COMPRESS_OUTPUT_FILES
+#define OUTPUT_FILE_SUFFIX ".zst"
+#else
+#define OUTPUT_FILE_SUFFIX ""
+#endif
 
 // A file object that only uses stack memory
 class StackFile;
@@ -35,6 +57,58 @@ private:
     // The mode
     Mode mode;
 
+    // Bytes appended but not yet written
+    char buffer[STACK_FILE_BUFFER_SIZE];
+    size_t buffered = 0;
+
+    #ifdef COMPRESS_OUTPUT_FILES
+    // The stream the buffer is compressed through, or null to write it as is
+    ZSTD_CCtx *zstd = nullptr;
+    char compressed[STACK_FILE_BUFFER_SIZE];
+    #endif
+
+    // Make room for `size` more bytes in the buffer
+    void reserve(size_t size) {
+        if (buffered + size > STACK_FILE_BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    // Write bytes to the file, or with ASYNC_FILE_WRITES, hand them to the writer thread
+    void write_out(const char *data, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        #ifdef ASYNC_FILE_WRITES
+        AsyncFileWriter::get().submit(fd, data, size);
+        #else
+        if (!write_fully(fd, data, size)) {
+            bk_printf("Could not write to file\n");
+            throw std::runtime_error("Could not write to file");
+        }
+        #endif
+        position += size;
+    }
+
+    #ifdef COMPRESS_OUTPUT_FILES
+    // Feed everything buffered to the zstd stream and write what comes out.
+    // `ZSTD_e_end` also finishes the frame, so the file decompresses up to here.
+    void compress_buffered(ZSTD_EndDirective directive) {
+        ZSTD_inBuffer input = {buffer, buffered, 0};
+        buffered = 0;
+        size_t remaining;
+        do {
+            ZSTD_outBuffer output = {compressed, sizeof(compressed), 0};
+            remaining = ZSTD_compressStream2(zstd, &output, &input, directive);
+            if (ZSTD_isError(remaining)) {
+                bk_printf("Could not compress file %s: %s\n", filename, ZSTD_getErrorName(remaining));
+                throw std::runtime_error("Could not compress file");
+            }
+            write_out(compressed, output.pos);
+        } while (directive == ZSTD_e_continue ? input.pos < input.size : remaining != 0);
+    }
+    #endif
+
 public:
     StackFile() : fd(-1), position(0) {
         memset(filename, 0, 256);
@@ -77,8 +151,33 @@ public:
             // bk_printf("Opening file %s with descriptor %d\n", filename, fd);
             // stack_debugf("Opened file %s with descriptor %d\n", buf, fd);
         }
+
+        #ifdef COMPRESS_OUTPUT_FILES
+        size_t length = strlen(filename);
+        if (mode != Mode::READ && length >= 4 && strcmp(filename + length - 4, ".zst") == 0) {
+            compress(OUTPUT_COMPRESSION_LEVEL);
+        }
+        #endif
     }
 
+    #ifdef COMPRESS_OUTPUT_FILES
+    // Compress everything written from here on as zstd frames at `level`.
+    // Appending to an existing file starts a new frame after the ones in it.
+    void compress(int level) {
+        flush();
+        if (zstd == nullptr) {
+            zstd = ZSTD_createCCtx();
+            if (zstd == nullptr) {
+                bk_printf("Could not create a zstd stream for file %s\n", filename);
+                throw std::runtime_error("Could not create a zstd stream");
+            }
+        }
+        ZSTD_CCtx_reset(zstd, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, level);
+        ZSTD_CCtx_setParameter(zstd, ZSTD_c_checksumFlag, 1);
+    }
+    #endif
+
     // Get the descriptor
     int get_descriptor() const {
         return fd;
@@ -90,7 +189,15 @@ public:
     // }
     // Wipe the file
     void clear() {
-        // Wipe all the contents of the file
+        // Wipe all the contents of the file, including anything still buffered
+        buffered = 0;
+        #ifdef COMPRESS_OUTPUT_FILES
+        // Drop the half-written frame along with the file
+        if (zstd != nullptr) {
+            ZSTD_CCtx_reset(zstd, ZSTD_reset_session_only);
+        }
+        #endif
+        drain();
         ::close(fd);
         // char buf[filename.max_size() + 1];
         // size_t i;
@@ -102,11 +209,19 @@ public:
     }
 
     void close() {
+        checkpoint();
+        drain();
         ::close(fd);
+        #ifdef COMPRESS_OUTPUT_FILES
+        ZSTD_freeCCtx(zstd);
+        zstd = nullptr;
+        #endif
     }
 
     // Seek to a position
     void seek(size_t position) {
+        flush();
+        drain();
         lseek(fd, position, SEEK_SET);
         this->position = position;
     }
@@ -114,6 +229,8 @@ public:
     // Read from the file
     template <size_t Size>
     StackString<Size> read() {
+        flush();
+        drain();
         StackString<Size> result;
         char buf[Size + 10] = {0};
         ssize_t bytes = read(fd, buf, Size);
@@ -127,23 +244,93 @@ public:
         return result;
     }
 
-    // Write to the file
+    // Write to the file, along with anything buffered before it
     template <size_t Size>
     void write(const StackString<Size>& data) {
-        char buf[Size + 10] = {0};
-        data.c_str(buf);
-        ssize_t bytes = ::write(fd, buf, strlen(buf));
-        if (bytes == -1) {
-            bk_printf("Could not write to file\n");
-            throw std::runtime_error("Could not write to file");
+        for (size_t i=0; i<data.size() && data[i] != '\0'; i++) {
+            append(data[i]);
         }
-        position += bytes;
+        flush();
+    }
+
+    // Buffer bytes to write on the next flush
+    void append(const char *data, size_t size) {
+        while (size > 0) {
+            reserve(size);
+            size_t chunk = size < STACK_FILE_BUFFER_SIZE - buffered ? size : STACK_FILE_BUFFER_SIZE - buffered;
+            memcpy(buffer + buffered, data, chunk);
+            buffered += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    void append(char c) {
+        reserve(1);
+        buffer[buffered++] = c;
+    }
+
+    // Format numbers straight into the buffer, exactly as `StackString::from_number` does
+    void append_integer(int64_t number) {
+        reserve(FORMAT_NUMBER_MAX_SIZE);
+        buffered = format_integer(buffer + buffered, number) - buffer;
+    }
+
+    void append_unsigned(uint64_t number) {
+        reserve(FORMAT_NUMBER_MAX_SIZE);
+        buffered = format_unsigned(buffer + buffered, number) - buffer;
+    }
+
+    void append_float(double number) {
+        reserve(FORMAT_NUMBER_MAX_SIZE);
+        buffered = format_float(buffer + buffered, number) - buffer;
+    }
+
+    // Upper case hex without a prefix; zero is written as nothing
+    void append_hex(uintptr_t number) {
+        reserve(FORMAT_NUMBER_MAX_SIZE);
+        buffered = format_hex(buffer + buffered, number) - buffer;
+    }
+
+    // Write everything buffered to the file, or with ASYNC_FILE_WRITES, hand it
+    // to the writer thread. A compressed file may hold some of it back in its
+    // zstd stream until the next checkpoint.
+    void flush() {
+        #ifdef COMPRESS_OUTPUT_FILES
+        if (zstd != nullptr) {
+            compress_buffered(ZSTD_e_continue);
+            return;
+        }
+        #endif
+        size_t pending = buffered;
+        buffered = 0;
+        write_out(buffer, pending);
+    }
+
+    // Flush, and end a compressed file's current frame, so that a reader can
+    // decompress everything written so far even if nothing more ever is
+    void checkpoint() {
+        #ifdef COMPRESS_OUTPUT_FILES
+        if (zstd != nullptr) {
+            compress_buffered(ZSTD_e_end);
+            return;
+        }
+        #endif
+        flush();
+    }
+
+    // Wait for the writer thread to write everything flushed so far, to any file
+    void drain() const {
+        #ifdef ASYNC_FILE_WRITES
+        AsyncFileWriter::get().drain();
+        #endif
     }
 
-    // Get the size of the file
+    // Get the size of the file, counting what is still buffered
     size_t size() const {
+        drain();
         struct stat st;
         fstat(fd, &st);
-        return st.st_size;
+        return st.st_size + buffered;
     }
 };
\ No newline at end of file
@@ -6,11 +6,15 @@
 #include "stack_file.hpp"
 #include <bkmalloc.h>
 
+#include <algorithm>
+#include <atomic>
+
 // Whether to print debug messages
 // #define DEBUG true
 // The log file to write to
 #ifndef DEBUG
 #define stack_debugf(...)
+#define stack_signal_debugf(...)
 #endif
 
 #ifdef LOG_FILE
@@ -92,136 +96,347 @@ void stack_logf(const char* format, Args... args) {
 }
 #endif
 
-static bool last_was_newline = true;
-
+// Log lines are formatted only when their level is enabled, into a buffer
+// owned by the logging thread, and written out in batches by `flush_logs`.
+// The analysis work flushes them: every heart beat, every stats report, and
+// at the end of every interval. Warnings and errors are flushed right away,
+// and whatever is left is flushed at exit.
+
+/// @brief How much is logged, set with LOG_LEVEL or at runtime with the
+///        `HEAPPULSE_LOG_LEVEL` environment variable (`debug`, `info`,
+///        `warn`, `error` or `off`). Debug messages are only compiled in
+///        with DEBUG.
+///
+/// The levels aren't capitalized like other enums, since DEBUG is a macro.
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off,
+};
+
+#ifndef LOG_LEVEL
 #ifdef DEBUG
-void stack_debugf(const char* str);
-template <typename... Args>
-void stack_debugf(const char* format, Args... args);
+#define LOG_LEVEL LogLevel::Debug
+#else
+#define LOG_LEVEL LogLevel::Info
+#endif
+#endif
 
-void stack_debugf(const char* str) {
-    #ifdef DEBUG
-    if (last_was_newline) {
-        stack_printf("[DEBUG] ");
-    }
-    stack_printf(str);
-    if (str[strlen(str) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
-    }
-    #endif
+// The buffer each logging thread collects its lines in
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE (1 << 16)
+#endif
+
+// Threads past this many alive at once write their lines out unbuffered
+#ifndef LOG_MAX_THREADS
+#define LOG_MAX_THREADS 64
+#endif
+
+// The longest line a single call logs
+#define LOG_LINE_SIZE (1 << 14)
+
+static LogLevel log_level = LOG_LEVEL;
+
+static bool log_enabled(LogLevel level) {
+    return level >= log_level;
 }
 
-template <typename... Args>
-void stack_debugf(const char* format, Args... args) {
-    #ifdef DEBUG
-    if (last_was_newline) {
-        stack_printf("[DEBUG] ");
+static void set_log_level(LogLevel level) {
+    log_level = level;
+}
+
+static bool configure_log_level() {
+    const char *level = getenv("HEAPPULSE_LOG_LEVEL");
+    if (level == nullptr) {
+        return false;
     }
-    stack_printf(format, args...);
-    if (format[strlen(format) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
+    static const char *names[] = {"debug", "info", "warn", "error", "off"};
+    for (size_t i=0; i<sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(level, names[i]) == 0) {
+            set_log_level((LogLevel)i);
+            return true;
+        }
     }
-    #endif
+    return false;
 }
 
-#endif
+static bool log_level_configured = configure_log_level();
+
+/// @brief One thread's log lines, waiting to be written.
+///
+/// Only the owning thread appends, moving `head`; only a flusher, holding
+/// `log_flush_lock`, writes them out and moves `tail`. Both only grow, and
+/// wrap around `data`. When its thread exits, a buffer is flushed and put on
+/// the free list for the next thread.
+struct LogBuffer {
+    std::atomic<uint64_t> head{0}, tail{0};
+    // The next buffer on the free list, while this one has no thread
+    LogBuffer *next_free = nullptr;
+    char data[LOG_BUFFER_SIZE];
+};
+
+static LogBuffer log_buffers[LOG_MAX_THREADS];
+// How many of `log_buffers` have ever been handed out; the rest are untouched
+static std::atomic<size_t> log_buffers_claimed{0};
+// Buffers whose threads have exited (guarded by `log_flush_lock`)
+static LogBuffer *log_free_buffers = nullptr;
+static std::atomic_flag log_flush_lock = ATOMIC_FLAG_INIT;
+// Set at exit, once nothing is left to flush the buffers
+static std::atomic<bool> log_unbuffered{false};
+
+static void log_lock() {
+    while (log_flush_lock.test_and_set(std::memory_order_acquire)) {}
+}
 
-void stack_infof(const char* str) {
-    if (last_was_newline) {
-        stack_printf("[INFO] ");
+static void log_unlock() {
+    log_flush_lock.clear(std::memory_order_release);
+}
+
+/// @brief Write out one buffer's lines (with `log_flush_lock` held).
+static void flush_log_buffer(LogBuffer &buffer, bool partial_lines) {
+    uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+    uint64_t head = buffer.head.load(std::memory_order_acquire);
+    if (!partial_lines) {
+        // Leave an unfinished line for the next flush, so it isn't split by another thread's
+        while (head > tail && buffer.data[(head - 1) % LOG_BUFFER_SIZE] != '\n') {
+            head--;
+        }
     }
-    stack_printf(str);
-    if (str[strlen(str) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
+    while (tail < head) {
+        size_t offset = tail % LOG_BUFFER_SIZE;
+        size_t size = std::min<uint64_t>(head - tail, LOG_BUFFER_SIZE - offset);
+        write_fully(1, buffer.data + offset, size);
+        tail += size;
     }
+    buffer.tail.store(tail, std::memory_order_release);
 }
 
-template <typename... Args>
-void stack_infof(const char* format, Args... args) {
-    if (last_was_newline) {
-        stack_printf("[INFO] ");
-    }
-    stack_printf(format, args...);
-    if (format[strlen(format) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
+/// @brief Write out every thread's buffered lines.
+/// @param partial_lines Also write lines that haven't been ended yet, as at exit
+static void flush_logs(bool partial_lines=false) {
+    log_lock();
+    size_t claimed = log_buffers_claimed.load(std::memory_order_acquire);
+    for (size_t i=0; i<claimed && i<LOG_MAX_THREADS; i++) {
+        flush_log_buffer(log_buffers[i], partial_lines);
     }
+    log_unlock();
 }
 
+/// @brief The calling thread's logging state, which gives its buffer back when the thread exits.
+struct ThreadLog {
+    LogBuffer *buffer = nullptr;
+    // Set once there was no buffer to take, or this thread's was given back
+    bool unbuffered = false;
+    // Whether this thread's next message starts a line, and so gets a prefix
+    bool last_was_newline = true;
+
+    /// @brief This thread's buffer, taking a free one the first time; null if it has to write unbuffered.
+    LogBuffer *claim() {
+        if (buffer != nullptr || unbuffered) {
+            return buffer;
+        }
+        log_lock();
+        if (log_free_buffers != nullptr) {
+            buffer = log_free_buffers;
+            log_free_buffers = buffer->next_free;
+        } else {
+            size_t index = log_buffers_claimed.load(std::memory_order_relaxed);
+            if (index < LOG_MAX_THREADS) {
+                buffer = &log_buffers[index];
+                log_buffers_claimed.store(index + 1, std::memory_order_release);
+            }
+        }
+        log_unlock();
+        unbuffered = buffer == nullptr;
+        return buffer;
+    }
 
+    ~ThreadLog() {
+        if (buffer == nullptr) {
+            return;
+        }
+        log_lock();
+        flush_log_buffer(*buffer, true);
+        buffer->next_free = log_free_buffers;
+        log_free_buffers = buffer;
+        log_unlock();
+        // Anything this thread logs from later destructors goes straight out
+        buffer = nullptr;
+        unbuffered = true;
+    }
+};
 
-void stack_warnf(const char* str) {
-    if (last_was_newline) {
-        stack_printf("[WARN] ");
+static thread_local ThreadLog thread_log;
+
+/// @brief Copy text into a log buffer at `head`, wrapping around its end.
+static void log_copy(LogBuffer &buffer, uint64_t head, const char *text, size_t size) {
+    for (size_t written=0; written < size;) {
+        size_t offset = (head + written) % LOG_BUFFER_SIZE;
+        size_t chunk = std::min(size - written, LOG_BUFFER_SIZE - offset);
+        memcpy(buffer.data + offset, text + written, chunk);
+        written += chunk;
     }
-    stack_printf(str);
-    if (last_was_newline) {
-        stack_logf("[WARN] ");
+}
+
+/// @brief Add a prefix and a message to this thread's buffer together, flushing first if it has no room.
+static void log_append(const char *prefix, size_t prefix_size, const char *text, size_t size) {
+    LogBuffer *claimed = thread_log.claim();
+    if (claimed == nullptr || log_unbuffered.load(std::memory_order_relaxed) || prefix_size + size > LOG_BUFFER_SIZE) {
+        write_fully(1, prefix, prefix_size);
+        write_fully(1, text, size);
+        return;
     }
-    stack_logf(str);
-    if (str[strlen(str) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
+
+    LogBuffer &buffer = *claimed;
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    auto room = [&]() {
+        return LOG_BUFFER_SIZE - (head - buffer.tail.load(std::memory_order_acquire));
+    };
+    if (room() < prefix_size + size) {
+        flush_logs();
+        if (room() < prefix_size + size) {
+            // Only a line longer than the buffer is left, so it has to be split
+            flush_logs(true);
+        }
     }
+    log_copy(buffer, head, prefix, prefix_size);
+    log_copy(buffer, head + prefix_size, text, size);
+    buffer.head.store(head + prefix_size + size, std::memory_order_release);
 }
 
-template <typename... Args>
-void stack_warnf(const char* format, Args... args) {
-    if (last_was_newline) {
-        stack_printf("[WARN] ");
+/// @brief Buffer one message, prefixed when it starts a line. Warnings and
+///        errors are copied to the log file too, with the same prefix.
+static void log_message(LogLevel level, const char *prefix, const char *text, size_t size) {
+    size_t prefix_size = thread_log.last_was_newline ? strlen(prefix) : 0;
+    thread_log.last_was_newline = size > 0 && text[size - 1] == '\n';
+    #ifdef LOG_FILE
+    if (level >= LogLevel::Warn) {
+        log_file.append(prefix, prefix_size);
+        log_file.append(text, size);
     }
-    stack_printf(format, args...);
-    if (last_was_newline) {
-        stack_logf("[WARN] ");
-    }
-    stack_logf(format, args...);
-    if (format[strlen(format) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
+    #endif
+    log_append(prefix, prefix_size, text, size);
+    if (level >= LogLevel::Warn) {
+        flush_logs();
     }
 }
 
+/// @brief Note where a message that isn't logged would have left the line,
+///        so the next one that is gets its prefix in the right place.
+static void log_skipped(const char *text) {
+    size_t size = strlen(text);
+    thread_log.last_was_newline = size > 0 && text[size - 1] == '\n';
+}
 
-void stack_errorf(const char* str) {
-    if (last_was_newline) {
-        stack_printf("[ERROR] ");
+template <typename... Args>
+static void stack_log(LogLevel level, const char *prefix, const char *format, Args... args) {
+    if (!log_enabled(level)) {
+        // Without formatting it, the format string's end stands in for the message's
+        log_skipped(format);
+        return;
     }
-    stack_printf(str);
-    if (last_was_newline) {
-        stack_logf("[ERROR] ");
+    StackString<LOG_LINE_SIZE> line = StackString<LOG_LINE_SIZE>::format(format, args...);
+    log_message(level, prefix, &line[0], line.size());
+}
+
+static void stack_log(LogLevel level, const char *prefix, const char *str) {
+    if (!log_enabled(level)) {
+        log_skipped(str);
+        return;
     }
-    stack_logf(str);
-    if (str[strlen(str) - 1] == '\n') {
-        last_was_newline = true;
-    } else {
-        last_was_newline = false;
+    log_message(level, prefix, str, strlen(str));
+}
+
+// Flushes whatever was logged once everything else has been torn down
+static struct LogExitFlush {
+    ~LogExitFlush() {
+        flush_logs(true);
+        log_unbuffered.store(true);
     }
+} log_exit_flush;
+
+#ifdef DEBUG
+void stack_debugf(const char* str) {
+    stack_log(LogLevel::Debug, "[DEBUG] ", str);
+}
+
+template <typename... Args>
+void stack_debugf(const char* format, Args... args) {
+    stack_log(LogLevel::Debug, "[DEBUG] ", format, args...);
+}
+#endif
+
+void stack_infof(const char* str) {
+    stack_log(LogLevel::Info, "[INFO] ", str);
+}
+
+template <typename... Args>
+void stack_infof(const char* format, Args... args) {
+    stack_log(LogLevel::Info, "[INFO] ", format, args...);
+}
+
+void stack_warnf(const char* str) {
+    stack_log(LogLevel::Warn, "[WARN] ", str);
+}
+
+template <typename... Args>
+void stack_warnf(const char* format, Args... args) {
+    stack_log(LogLevel::Warn, "[WARN] ", format, args...);
+}
+
+void stack_errorf(const char* str) {
+    stack_log(LogLevel::Error, "[ERROR] ", str);
 }
 
 template <typename... Args>
 void stack_errorf(const char* format, Args... args) {
-    if (last_was_newline) {
-        stack_printf("[ERROR] ");
-    }
-    stack_printf(format, args...);
-    if (last_was_newline) {
-        stack_logf("[ERROR] ");
+    stack_log(LogLevel::Error, "[ERROR] ", format, args...);
+}
+
+/// @brief Log a line from a signal handler, straight to stdout and the log file.
+///
+/// The handler may have interrupted its own thread mid-log, or another thread
+/// may hold the flush lock or the async file writer's mutex, so the line skips
+/// the thread buffers and `log_file`'s buffer and writer thread. It is
+/// formatted on the stack and written with one `write` to each.
+template <typename... Args>
+void stack_signal_logf(LogLevel level, const char *prefix, const char* format, Args... args) {
+    if (!log_enabled(level)) {
+        return;
     }
-    stack_logf(format, args...);
-    if (format[strlen(format) - 1] == '\n') {
-        last_was_newline = true;
+    StackString<LOG_LINE_SIZE> line;
+    if constexpr (sizeof...(Args) == 0) {
+        line = StackString<LOG_LINE_SIZE>(format);
     } else {
-        last_was_newline = false;
+        line = StackString<LOG_LINE_SIZE>::format(format, args...);
     }
+    char text[LOG_LINE_SIZE + 16];
+    size_t prefix_size = std::min<size_t>(strlen(prefix), 16);
+    memcpy(text, prefix, prefix_size);
+    memcpy(text + prefix_size, &line[0], line.size());
+    write_fully(1, text, prefix_size + line.size());
+    #ifdef LOG_FILE
+    write_fully(log_file.get_descriptor(), text, prefix_size + line.size());
+    #endif
+}
+
+#ifdef DEBUG
+template <typename... Args>
+void stack_signal_debugf(const char* format, Args... args) {
+    stack_signal_logf(LogLevel::Debug, "[DEBUG] ", format, args...);
+}
+#endif
+
+template <typename... Args>
+void stack_signal_warnf(const char* format, Args... args) {
+    stack_signal_logf(LogLevel::Warn, "[WARN] ", format, args...);
+}
+
+template <typename... Args>
+void stack_signal_errorf(const char* format, Args... args) {
+    stack_signal_logf(LogLevel::Error, "[ERROR] ", format, args...);
 }
 
 
@@ -231,4 +446,5 @@ void stack_errorf(const char* format, Args... args) {
 #define stack_infof(...)
 // #define stack_warnf(...)
 #define stack_debugf(...)
+#define stack_signal_debugf(...)
 #endif
@@ -4,139 +4,122 @@
 #include <cassert>
 #include <iostream>
 #include <stdint.h>
+#include <cstring>
 #include <functional>
+#include <new>
+#include <utility>
 #include <stack_vec.hpp>
 
 
+// A fixed-capacity open-addressing map with Robin Hood linear probing.
+//
+// Each slot has a probe count in a separate array: 0 for an empty slot,
+// otherwise one more than how far its entry sits from the slot its key hashes
+// to. Entries are kept so that probe counts never drop by more than one from
+// a slot to the next, which lets a lookup stop as soon as it passes a slot
+// whose entry is closer to home than the key would be. Removal shifts the rest
+// of the run back a slot instead of leaving a hole, so no probe chain is ever
+// broken. The table has an eighth more slots than `Size`, so a full map still
+// has empty slots and every probe ends.
 template <typename KeyType, typename ValueType, std::size_t Size>
 class StackMap {
+    static constexpr std::size_t Capacity = Size + Size / 8 + 1;
 public:
+    /// @brief The slot `key` hashes to.
     std::size_t hash(const KeyType& key) const {
-        return std::hash<KeyType>{}(key) % Size;
+        // `std::hash` is the identity for pointers and integers, which would
+        // leave aligned pointers in every 8th or 16th slot; mix the bits first
+        uint64_t bits = std::hash<KeyType>{}(key);
+        bits ^= bits >> 33;
+        bits *= 0xff51afd7ed558ccdULL;
+        bits ^= bits >> 33;
+        bits *= 0xc4ceb9fe1a85ec53ULL;
+        bits ^= bits >> 33;
+        // Scale to [0, Capacity) with a multiply instead of a `%`
+        return (std::size_t)(((unsigned __int128)bits * Capacity) >> 64);
     }
 
-    StackMap() : hashtable() {
+    StackMap() {
         clear();
     }
 
     StackMap &operator=(const StackMap &other) {
-        for (size_t i = 0; i < Size; i++) {
-            hashtable[i] = other.hashtable[i];
+        if (this == &other) {
+            return *this;
         }
+        probes = other.probes;
         entries = other.entries;
+        for_each_occupied([&](size_t i) {
+            hashtable[i] = other.hashtable[i];
+        });
         return *this;
     }
 
     StackMap(const StackMap &other) {
-        for (size_t i = 0; i < Size; i++) {
-            hashtable[i] = other.hashtable[i];
-        }
-        entries = other.entries;
+        *this = other;
     }
 
     void put(const KeyType& key, const ValueType& value) {
-        if (full() && !has(key)) {
+        std::size_t index = find(key);
+        if (index != Capacity) {
+            hashtable[index].value = value;  // Update value if key already exists
             return;
         }
-        // get(key) = value;
-        std::size_t index = hash(key);
-        size_t i=0;
-        while (hashtable[index].occupied && i++ < num_entries() * 2) {
-            if (hashtable[index].key == key) {
-                hashtable[index].value = value;  // Update value if key already exists
-                return;
-            }
-            // index = std::hash<size_t>{}(index) % Size;
-            index = (index + 1) % Size;  // Linear probing for collision resolution
-        }
-
         if (full()) {
-             return;
+            return;
         }
-
-        hashtable[index].key = key;
-        hashtable[index].value = value;
-        hashtable[index].occupied = true;
-        entries++;
+        hashtable[insert(key)].value = value;
     }
 
     ValueType &get(const KeyType& key) {
-        std::size_t index = hash(key);
-        size_t i=0;
-        while (hashtable[index].occupied && i++ < num_entries() * 2) {
-            if (hashtable[index].key == key) {
-                return hashtable[index].value;
-            }
-
-            // index = std::hash<size_t>{}(index) % Size;
-            index = (index + 1) % Size;  // Linear probing for collision resolution
+        std::size_t index = find(key);
+        if (index != Capacity) {
+            return hashtable[index].value;
         }
-
         if (full()) {
-            return hashtable[0].value;  // Return first value if map is full
+            // Nowhere to put the key: hand back a scratch value, so writes
+            // through it are dropped instead of landing on some other key
+            stack_warnf("Map is full: %d entries of %d max entries\n", num_entries(), max_size());
+            spare.~ValueType();
+            new (&spare) ValueType();
+            return spare;
         }
-        // Key not found
-        // throw std::out_of_range("Key not found");
-        hashtable[index].key = key;
-        hashtable[index].occupied = true;
-        entries++;
-        return hashtable[index].value;
+        ValueType &value = hashtable[insert(key)].value;
+        value.~ValueType();
+        new (&value) ValueType();
+        return value;
     }
 
     ValueType &operator[](const KeyType& key) {
-        /*
-        std::size_t index = hash(key);
-        while (hashtable[index].occupied) {
-            if (hashtable[index].key == key) {
-                return hashtable[index].value;
-            }
-            
-            // index = std::hash<size_t>{}(index) % Size;
-            index = (index + 1) % Size;  // Linear probing for collision resolution
-        }
-
-        hashtable[index].key = key;
-        hashtable[index].occupied = true;
-        entries++;
-        return hashtable[index].value;
-        */
         return get(key);
     }
 
     void remove(const KeyType& key) {
-        std::size_t index = hash(key);
-        for (size_t i=0; i<Size && hashtable[index].occupied; i++) {
-            if (hashtable[index].key == key) {
-                hashtable[index].occupied = false;
-                entries--;
-                return;
-            }
-            // index = std::hash<size_t>{}(index) % Size;
-            index = (index + 1) % Size;  // Linear probing for collision resolution
+        std::size_t index = find(key);
+        if (index == Capacity) {
+            return;
+        }
+        // Pull the rest of the run back a slot, up to an empty slot or an entry already at home
+        std::size_t next_index = next(index);
+        while (probes[next_index] > 1) {
+            hashtable[index] = std::move(hashtable[next_index]);
+            probes[index] = probes[next_index] - 1;
+            index = next_index;
+            next_index = next(next_index);
         }
+        probes[index] = 0;
+        entries--;
     }
 
     bool has(const KeyType& key) const {
-        std::size_t index = hash(key);
-        size_t i=0;
         if (full()) {
             stack_warnf("Map is full: %d entries of %d max entries\n", num_entries(), max_size());
         }
-        while (hashtable[index].occupied && i++ < num_entries() * 2) {
-            if (hashtable[index].key == key) {
-                return true;
-            }
-            // index = std::hash<size_t>{}(index) % Size;
-            index = (index + 1) % Size;  // Linear probing for collision resolution
-        }
-        return false;
+        return find(key) != Capacity;
     }
 
     void clear() {
-        // for (uint64_t i=0; i<Size; i++) {
-        //     hashtable[i].occupied = false;
-        // }
-        memset((uint8_t*)hashtable.data(), 0, sizeof(hashtable));
+        memset((uint8_t*)probes.data(), 0, sizeof(probes));
         entries = 0;
     }
 
@@ -158,42 +141,24 @@ public:
     }
 
     void map(std::function<void(const KeyType&, const ValueType&)> func) const {
-        if (entries == 0) {
-            return;
-        }
-        size_t j = 0;
-        for (uint64_t i=0; i<Size && j<num_entries(); i++) {
-            if (hashtable[i].occupied) {
-                func(hashtable[i].key, hashtable[i].value);
-                j++;
-            }
-        }
+        for_each_occupied([&](size_t i) {
+            func(hashtable[i].key, hashtable[i].value);
+        });
     }
 
     void map(std::function<void(KeyType&, ValueType&)> func) {
-        if (entries == 0) {
-            return;
-        }
-        size_t j = 0;
-        for (uint64_t i=0; i<Size && j<num_entries(); i++) {
-            if (hashtable[i].occupied) {
-                func(hashtable[i].key, hashtable[i].value);
-                j++;
-            }
-        }
+        for_each_occupied([&](size_t i) {
+            func(hashtable[i].key, hashtable[i].value);
+        });
     }
 
     // Reduce
     template <typename T>
     T reduce(std::function<T(const KeyType&, const ValueType&, T)> func, T initial) const {
         T result = initial;
-        uint64_t j = 0;
-        for (uint64_t i=0; i<Size && j<num_entries(); i++) {
-            if (hashtable[i].occupied) {
-                result = func(hashtable[i].key, hashtable[i].value, result);
-                j++;
-            }
-        }
+        for_each_occupied([&](size_t i) {
+            result = func(hashtable[i].key, hashtable[i].value, result);
+        });
         return result;
     }
 
@@ -201,25 +166,30 @@ public:
     template <typename T>
     T reduce(std::function<T(const KeyType&, ValueType&, T)> func, T initial) {
         T result = initial;
-        uint64_t j = 0;
-        for (uint64_t i=0; i<Size && j<num_entries(); i++) {
-            if (hashtable[i].occupied) {
-                result = func(hashtable[i].key, hashtable[i].value, result);
-                j++;
-            }
-        }
+        for_each_occupied([&](size_t i) {
+            result = func(hashtable[i].key, hashtable[i].value, result);
+        });
         return result;
     }
 
     struct Entry {
         KeyType key;
         ValueType value;
-        bool occupied;
 
-        Entry() : occupied(false) {}
-        Entry(const KeyType& key, const ValueType& value) : key(key), value(value), occupied(true) {}
+        Entry() {}
+        Entry(const KeyType& key, const ValueType& value) : key(key), value(value) {}
     };
 
+    /// @brief The number of slots, of which `max_size()` can be occupied at once.
+    size_t capacity() const {
+        return Capacity;
+    }
+
+    /// @brief Whether the slot at `index` (below `capacity()`) holds an entry.
+    bool occupied(size_t index) const {
+        return probes[index] != 0;
+    }
+
     Entry &operator[](size_t index) {
         return hashtable[index];
     }
@@ -238,28 +208,92 @@ public:
     template <size_t N>
     void keys(StackVec<KeyType, N> &keys) const {
         keys.clear();
-        uint64_t j = 0;
-        for (size_t i = 0; i < Size && j < num_entries(); i++) {
-            if (hashtable[i].occupied) {
-                keys.push(hashtable[i].key);
-                j++;
-            }
-        }
+        for_each_occupied([&](size_t i) {
+            keys.push(hashtable[i].key);
+        });
     }
 
     template <size_t N>
     void values(StackVec<ValueType, N> &values) const {
         values.clear();
-        uint64_t j = 0;
-        for (size_t i = 0; i < Size && j < num_entries(); i++) {
-            if (hashtable[i].occupied) {
-                values.push(hashtable[i].value);
-                j++;
+        for_each_occupied([&](size_t i) {
+            values.push(hashtable[i].value);
+        });
+    }
+private:
+    static std::size_t next(std::size_t index) {
+        return index + 1 == Capacity ? 0 : index + 1;
+    }
+
+    static std::size_t previous(std::size_t index) {
+        return index == 0 ? Capacity - 1 : index - 1;
+    }
+
+    // Call `visit` with the index of each occupied slot, in order. Slots are
+    // checked 64 at a time into a mask, so sparse and dense runs alike cost a
+    // branch per entry rather than a mispredicted one per slot.
+    template <typename Visit>
+    void for_each_occupied(Visit visit) const {
+        size_t seen = 0;
+        for (size_t base = 0; base < Capacity && seen < entries; base += 64) {
+            size_t group = Capacity - base < 64 ? Capacity - base : 64;
+            uint64_t mask = 0;
+            for (size_t i = 0; i < group; i++) {
+                mask |= (uint64_t)(probes[base + i] != 0) << i;
+            }
+            seen += __builtin_popcountll(mask);
+            while (mask) {
+                visit(base + __builtin_ctzll(mask));
+                mask &= mask - 1;
             }
         }
     }
-private:
-    std::array<Entry, Size> hashtable;
+
+    // The slot holding `key`, or `Capacity` if it isn't in the map
+    std::size_t find(const KeyType& key) const {
+        std::size_t index = hash(key);
+        for (uint32_t probe = 1;; probe++) {
+            // An empty slot, or an entry closer to home than `key` would be: `key` would have taken this slot
+            if (probes[index] < probe) {
+                return Capacity;
+            }
+            if (probes[index] == probe && hashtable[index].key == key) {
+                return index;
+            }
+            index = next(index);
+        }
+    }
+
+    // Make room for `key`, known not to be in the map, and return its slot.
+    // The caller sets its value.
+    std::size_t insert(const KeyType& key) {
+        std::size_t index = hash(key);
+        uint32_t probe = 1;
+        // Walk past the entries at least as far from home as `key` would be
+        while (probes[index] >= probe) {
+            index = next(index);
+            probe++;
+        }
+        // Shift the rest of the run forward a slot, from the empty slot that ends it back
+        std::size_t last = index;
+        while (probes[last]) {
+            last = next(last);
+        }
+        for (; last != index; last = previous(last)) {
+            std::size_t from = previous(last);
+            hashtable[last] = std::move(hashtable[from]);
+            probes[last] = probes[from] + 1;
+        }
+        hashtable[index].key = key;
+        probes[index] = probe;
+        entries++;
+        return index;
+    }
+
+    std::array<Entry, Capacity> hashtable;
+    std::array<uint16_t, Capacity> probes;
+    // What `get` returns for a new key when the map is full
+    ValueType spare;
 
     size_t entries = 0;
-};
\ No newline at end of file
+};
@@ -4,6 +4,9 @@
 #include <stack_vec.hpp>
 #include <stdint.h>
 #include <cassert>
+#include <charconv>
+#include <cmath>
+#include <type_traits>
 
 void strreverse(char* begin, char* end) {
 	char aux;
@@ -156,6 +159,95 @@ char *ftoa(double f, char * buf, int precision)
 	return buf;
 }
 
+// Room for the longest number the `format_*` functions write
+#define FORMAT_NUMBER_MAX_SIZE 32
+
+// The `format_*` functions write a number at `out` with `std::to_chars` and
+// return the end; they do not write a terminator. `out` must have
+// FORMAT_NUMBER_MAX_SIZE bytes of room.
+
+static inline char *format_integer(char *out, int64_t number) {
+    return std::to_chars(out, out + FORMAT_NUMBER_MAX_SIZE, number).ptr;
+}
+
+static inline char *format_unsigned(char *out, uint64_t number) {
+    return std::to_chars(out, out + FORMAT_NUMBER_MAX_SIZE, number).ptr;
+}
+
+// Upper case digits without a prefix. Zero is written as nothing, which is
+// how pointers have always appeared in the output.
+static inline char *format_radix(char *out, uint64_t number, int radix) {
+    if (number == 0) {
+        return out;
+    }
+    char *end = std::to_chars(out, out + FORMAT_NUMBER_MAX_SIZE, number, radix).ptr;
+    for (char *c=out; c<end; c++) {
+        if (*c >= 'a') {
+            *c -= 'a' - 'A';
+        }
+    }
+    return end;
+}
+
+// `format_radix` in base 16. `to_chars` only writes lower case, and fixing
+// up its digits costs more than writing them from a table to begin with.
+static inline char *format_hex(char *out, uint64_t number) {
+    if (number == 0) {
+        return out;
+    }
+    int digits = (64 - __builtin_clzll(number) + 3) / 4;
+    for (int i=digits - 1; i>=0; i--) {
+        out[i] = "0123456789ABCDEF"[number & 15];
+        number >>= 4;
+    }
+    return out + digits;
+}
+
+// Below this, a double scaled by 10^6 is still a whole number of at most 53
+// bits, so `format_float` can write it as a pair of integers
+#define FORMAT_FLOAT_FAST_LIMIT 1e9
+
+// Fixed point with 6 digits after the point, as `ftoa` wrote them. Exact
+// fixed point from `to_chars` is over twice as slow as `ftoa` was, so
+// numbers below FORMAT_FLOAT_FAST_LIMIT are rounded to millionths and
+// written as integers, with the same digits `to_chars` would give. A number
+// too large for fixed point in FORMAT_NUMBER_MAX_SIZE bytes gets its
+// shortest form.
+static inline char *format_float(char *out, double number) {
+    double magnitude = std::fabs(number);
+    if (magnitude < FORMAT_FLOAT_FAST_LIMIT) {
+        if (std::signbit(number)) {
+            *out++ = '-';
+        }
+        // `scaled` is off from `magnitude * 10^6` by at most half an ulp. Only
+        // that close to a halfway point is the exact error needed, so that
+        // rounding matches `to_chars`, with ties to even.
+        double scaled = magnitude * 1e6;
+        double whole = std::floor(scaled);
+        double past_half = (scaled - whole) - 0.5;
+        if (std::fabs(past_half) <= scaled * 0x1p-52) {
+            past_half += std::fma(magnitude, 1e6, -scaled);
+        }
+        uint64_t millionths = (uint64_t)whole;
+        if (past_half > 0 || (past_half == 0 && (millionths & 1))) {
+            millionths++;
+        }
+        out = format_unsigned(out, millionths / 1000000);
+        *out++ = '.';
+        uint64_t fraction = millionths % 1000000;
+        for (int i=5; i>=0; i--) {
+            out[i] = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        return out + 6;
+    }
+    std::to_chars_result result = std::to_chars(out, out + FORMAT_NUMBER_MAX_SIZE, number, std::chars_format::fixed, 6);
+    if (result.ec != std::errc()) {
+        return std::to_chars(out, out + FORMAT_NUMBER_MAX_SIZE, number).ptr;
+    }
+    return result.ptr;
+}
+
 template <size_t Size>
 class StackString {
 private:
@@ -344,48 +436,36 @@ public:
     // Create string from a number
     template <typename T>
     static StackString<Size> from_number(T number, size_t radix=10) {
-        if (radix == 10) {
-            if constexpr (std::is_integral<T>::value) {
-                char buf[Size];
-                itoa(number, buf, 10);
-                buf[Size - 1] = '\0';
-                return StackString<Size>(buf);
-            }
-        }
+        StackString<Size> str;
+        str.append_number(number, radix);
+        return str;
+    }
 
+    // Format a number straight onto the end of the string
+    template <typename T>
+    void append_number(T number, size_t radix=10) {
+        char buf[FORMAT_NUMBER_MAX_SIZE];
+        char *end = buf;
         if constexpr (std::is_floating_point<T>::value) {
             assert(radix == 10);
-            char buf[Size];
-            ftoa(number, buf, 6);
-            buf[Size - 1] = '\0';
-            return StackString<Size>(buf);
-        }
-
-        StackString<Size> str;
-        bool negative = false;
-        if constexpr (std::is_signed<T>::value) {
-            if (number < 0) {
-                negative = true;
-                number = -number;
+            end = format_float(buf, number);
+        } else if (radix == 10) {
+            if constexpr (std::is_signed<T>::value) {
+                end = format_integer(buf, number);
+            } else {
+                end = format_unsigned(buf, number);
             }
-        }
-        while (number > 0) {
-            // Confirm the number is an integer at compile time
-            if constexpr (std::is_integral<T>::value) {
-                if (number % radix < 10) {
-                    str.push('0' + (number % radix));
-                } else {
-                    str.push('A' + (number % radix) - 10);
+        } else {
+            uint64_t magnitude = number;
+            if constexpr (std::is_signed<T>::value) {
+                if (number < 0) {
+                    *end++ = '-';
+                    magnitude = -(uint64_t)number;
                 }
             }
-            number /= radix;
-        }
-        // bk_printf("%d -> %f -> %s\n", number, (double)number, str.data.array_pointer());
-
-        if (negative) {
-            str.push('-');
+            end = radix == 16 ? format_hex(end, magnitude) : format_radix(end, magnitude, radix);
         }
-        return str.reverse();
+        data.push(buf, end - buf);
     }
 
     // Reverse the string
@@ -629,15 +709,15 @@ private:
                     }
                 } else if (fmt[i + 1] == 'x' || fmt[i + 1] == 'X') {
                     if constexpr (std::is_same<Arg, int64_t>::value || std::is_same<Arg, int>::value) {
-                        format_append_impl(StackString<Size>::from_number((int64_t)arg, 16));
+                        append_number((int64_t)arg, 16);
                     } else if constexpr (std::is_same<Arg, size_t>::value) {
-                        format_append_impl(StackString<Size>::from_number((int64_t)arg, 16));
+                        append_number((int64_t)arg, 16);
                     } else {
                         format_append_impl(arg);
                     }
                 } else if (fmt[i + 1] == 's') {
                     if constexpr (std::is_same<Arg, char*>::value) {
-                        format_append_impl(StackString::from((const char *)arg));
+                        format_append_impl((const char *)arg);
                     } else {
                         format_append_impl(arg);
                     }
@@ -689,19 +769,12 @@ private:
     // Format a string and append it to this string
     template<typename T>
     void format_append_impl(T number) {
-        if constexpr (std::is_integral<T>::value) {
-            format_append_impl(StackString<Size>::from_number(number));
-        } else if constexpr (std::is_floating_point<T>::value) {
-            format_append_impl(StackString<Size>::from_number(number));
+        if constexpr (std::is_integral<T>::value || std::is_floating_point<T>::value) {
+            append_number(number);
         } else {
             format_append_impl(number);
         }
     }
-    
-    // // Format a string and append it to this string
-    // void format_append_impl(double number) {
-    //     format_append_impl(StackString<Size>::from_number(number));
-    // }
 
     // Format a string and append it to this string
     template <size_t N>
@@ -712,21 +785,23 @@ private:
     }
 
     // Format a string and append it to this string
-    void format_append_impl(char *str) {
-        format_append_impl(StackString<Size>::from(str));
+    void format_append_impl(const char *str) {
+        for (size_t i=0; str[i] != '\0' && i < Size; i++) {
+            data.push(str[i]);
+        }
     }
 
-    void format_append_impl(const char *str) {
-        format_append_impl(StackString<Size>::from(str));
+    void format_append_impl(char *str) {
+        format_append_impl((const char *)str);
     }
 
     void format_append_impl(const unsigned char *str) {
-        format_append_impl(StackString<Size>::from(str));
+        format_append_impl((const char *)str);
     }
 
     // Format a string and append it to this string
     void format_append_impl(void *ptr) {
-        format_append_impl(StackString<Size>::from_number((uintptr_t)ptr, 16));
+        append_number((uintptr_t)ptr, 16);
     }
 };
 
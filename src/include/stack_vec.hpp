@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <stdint.h>
 #include <functional>
@@ -24,6 +25,16 @@ public:
         data[elements++] = value;
     }
 
+    // Push `count` values at once, as many as fit
+    void push(const ValueType *values, size_t count) {
+        if (count > capacity - elements) {
+            stack_warnf("StackVec is full\n");
+            count = capacity - elements;
+        }
+        std::copy(values, values + count, data.begin() + elements);
+        elements += count;
+    }
+
     bool contains(const ValueType& value) const {
         for (size_t i=0; i<elements; i++) {
             if (data[i] == value) {
@@ -35,6 +35,12 @@ public:
         auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - this->start_time).count();
         return duration;
     }
+
+    uint64_t elapsed_nanoseconds() const {
+        auto end_time = std::chrono::steady_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - this->start_time).count();
+        return duration;
+    }
 };
 
 class Stopwatch {
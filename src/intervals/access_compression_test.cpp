@@ -2,7 +2,7 @@
 
 #include <config.hpp>
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <compressor.hpp>
 
 // #ifdef USE_ZLIB_COMPRESSION
@@ -216,7 +216,27 @@ public:
     AccessCompressionTest() : AccessCompressionTest(DEFAULT_COMPRESSION_TYPE) {}
 
 private:
-    CSV<64, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(ObjectAddressColumn, void*, "Object Address");
+    CSV_COLUMN(AllocationSiteColumn, void*, "Allocation Site");
+    CSV_COLUMN(AgeColumn, uint64_t, "Age (intervals)");
+    CSV_COLUMN(VirtualSizeColumn, uint64_t, "Virtual Size (bytes)");
+    CSV_COLUMN(PhysicalSizeColumn, uint64_t, "Physical Size (bytes)");
+    CSV_COLUMN(PhysicalCompressedSizeColumn, uint64_t, "Physical Compressed Size (bytes)");
+    CSV_COLUMN(IsNewColumn, bool, "New?");
+    CSV_COLUMN(WrittenColumn, bool, "Written?");
+    CSV_COLUMN(ReadColumn, bool, "Read?");
+    CSV_COLUMN(UnaccessedColumn, bool, "Unaccessed?");
+    CSV_COLUMN(CompressionRatioColumn, double, "Physical Compression Ratio (compressed/uncompressed)");
+    CSV_COLUMN(LiveVirtualBytesColumn, int64_t, "Live Virtual Bytes");
+
+    typedef CSVSchema<
+        IntervalColumn, ObjectAddressColumn, AllocationSiteColumn, AgeColumn, VirtualSizeColumn,
+        PhysicalSizeColumn, PhysicalCompressedSizeColumn, IsNewColumn, WrittenColumn, ReadColumn,
+        UnaccessedColumn, CompressionRatioColumn, LiveVirtualBytesColumn
+    > Schema;
+
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -252,24 +272,9 @@ private:
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
         // file = StackFile(StackString<256>("access-compression.csv"), Mode::APPEND);
-        file = StackFile(format<256>("access-%s-compression.csv", compression_to_string(compression_type)), Mode::APPEND);
+        file = StackFile(format<256>("access-%s-compression.csv" OUTPUT_FILE_SUFFIX, compression_to_string(compression_type)), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #");
-        csv.title().add("Object Address");
-        csv.title().add("Allocation Site");
-        csv.title().add("Age (intervals)");
-        csv.title().add("Virtual Size (bytes)");
-        csv.title().add("Physical Size (bytes)");
-        csv.title().add("Physical Compressed Size (bytes)");
-        csv.title().add("New?");
-        csv.title().add("Written?");
-        csv.title().add("Read?");
-        csv.title().add("Unaccessed?");
-        csv.title().add("Physical Compression Ratio (compressed/uncompressed)");
-        csv.title().add("Live Virtual Bytes");
-
-
         csv.write(file);
         csv.clear();
 
@@ -410,15 +415,15 @@ private:
             site.allocations.map([&](void *ptr, Allocation allocation) {
                 allocation.protect(PROT_READ);
                 auto &row = csv.new_row();
-                row.set(csv.title(), "Interval #", interval_count);
-                row.set(csv.title(), "Object Address", (void*)ptr);
-                row.set(csv.title(), "Allocation Site", (void*)return_address);
-                row.set(csv.title(), "Age (intervals)", allocation.age);
-                row.set(csv.title(), "New?", allocation.get_age() == 0);
-                row.set(csv.title(), "Written?", write_accessed_this_interval.has(allocation));
-                row.set(csv.title(), "Read?", read_accessed_this_interval.has(allocation));
-                row.set(csv.title(), "Unaccessed?", !accessed_this_interval.has(allocation));
-                row.set(csv.title(), "Live Virtual Bytes", total_bytes_live);
+                row.set<IntervalColumn>(interval_count);
+                row.set<ObjectAddressColumn>((void*)ptr);
+                row.set<AllocationSiteColumn>((void*)return_address);
+                row.set<AgeColumn>(allocation.age);
+                row.set<IsNewColumn>(allocation.get_age() == 0);
+                row.set<WrittenColumn>(write_accessed_this_interval.has(allocation));
+                row.set<ReadColumn>(read_accessed_this_interval.has(allocation));
+                row.set<UnaccessedColumn>(!accessed_this_interval.has(allocation));
+                row.set<LiveVirtualBytesColumn>(total_bytes_live);
 
                 auto physical_pages = allocation.physical_pages<10000>();
                 uint64_t total_uncompressed_size = 0;
@@ -432,13 +437,13 @@ private:
                     total_compressed_size += compressed_size;
                 });
 
-                row.set(csv.title(), "Virtual Size (bytes)", allocation.size);
-                row.set(csv.title(), "Physical Size (bytes)", total_uncompressed_size);
-                row.set(csv.title(), "Physical Compressed Size (bytes)", total_compressed_size);
+                row.set<VirtualSizeColumn>(allocation.size);
+                row.set<PhysicalSizeColumn>(total_uncompressed_size);
+                row.set<PhysicalCompressedSizeColumn>(total_compressed_size);
                 if (total_uncompressed_size == 0) {
-                    row.set(csv.title(), "Physical Compression Ratio (compressed/uncompressed)", 1.0);
+                    row.set<CompressionRatioColumn>(1.0);
                 } else {
-                    row.set(csv.title(), "Physical Compression Ratio (compressed/uncompressed)", (double)total_compressed_size / (double)total_uncompressed_size);
+                    row.set<CompressionRatioColumn>((double)total_compressed_size / (double)total_uncompressed_size);
                 }
             });
         });
@@ -1,14 +1,92 @@
 #pragma once
 
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <zlib.h>
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
 // Path: src/compression_test.cpp
 class AccessPatternTest : public IntervalTest {
-    CSV<64, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(LiveObjectsColumn, uint64_t, "Live Objects");
+    CSV_COLUMN(LiveBytesColumn, int64_t, "Live Bytes");
+    CSV_COLUMN(MemoryAllocatedSinceLastIntervalColumn, int64_t, "Memory Allocated Since Last Interval");
+    CSV_COLUMN(MemoryFreedSinceLastIntervalColumn, int64_t, "Memory Freed Since Last Interval");
+    CSV_COLUMN(TotalMemoryAllocatedColumn, int64_t, "Total Memory Allocated");
+    CSV_COLUMN(TotalMemoryFreedColumn, int64_t, "Total Memory Freed");
+    CSV_COLUMN(ObjectsAccessedThisIntervalColumn, uint64_t, "Objects Accessed This Interval");
+    CSV_COLUMN(ObjectsAccessedLastTwoIntervalsColumn, uint64_t, "Objects Accessed Last Two Intervals");
+    CSV_COLUMN(ObjectsAccessedLastThreeIntervalsColumn, uint64_t, "Objects Accessed Last Three Intervals");
+    CSV_COLUMN(ObjectsAccessedLastFourIntervalsColumn, uint64_t, "Objects Accessed Last Four Intervals");
+    CSV_COLUMN(ObjectsAccessedLastFiveIntervalsColumn, uint64_t, "Objects Accessed Last Five Intervals");
+    CSV_COLUMN(ObjectsAccessedLastSixIntervalsColumn, uint64_t, "Objects Accessed Last Six Intervals");
+    CSV_COLUMN(ObjectsWrittenToThisIntervalColumn, uint64_t, "Objects Written To This Interval");
+    CSV_COLUMN(ObjectsWrittenToLastTwoIntervalsColumn, uint64_t, "Objects Written To Last Two Intervals");
+    CSV_COLUMN(ObjectsWrittenToLastThreeIntervalsColumn, uint64_t, "Objects Written To Last Three Intervals");
+    CSV_COLUMN(ObjectsWrittenToLastFourIntervalsColumn, uint64_t, "Objects Written To Last Four Intervals");
+    CSV_COLUMN(ObjectsWrittenToLastFiveIntervalsColumn, uint64_t, "Objects Written To Last Five Intervals");
+    CSV_COLUMN(ObjectsWrittenToLastSixIntervalsColumn, uint64_t, "Objects Written To Last Six Intervals");
+    CSV_COLUMN(ObjectsReadFromThisIntervalColumn, uint64_t, "Objects Read From This Interval");
+    CSV_COLUMN(ObjectsReadFromLastTwoIntervalsColumn, uint64_t, "Objects Read From Last Two Intervals");
+    CSV_COLUMN(ObjectsReadFromLastThreeIntervalsColumn, uint64_t, "Objects Read From Last Three Intervals");
+    CSV_COLUMN(ObjectsReadFromLastFourIntervalsColumn, uint64_t, "Objects Read From Last Four Intervals");
+    CSV_COLUMN(ObjectsReadFromLastFiveIntervalsColumn, uint64_t, "Objects Read From Last Five Intervals");
+    CSV_COLUMN(ObjectsReadFromLastSixIntervalsColumn, uint64_t, "Objects Read From Last Six Intervals");
+    CSV_COLUMN(ObjectsUnaccessedThisIntervalColumn, uint64_t, "Objects Unaccessed This Interval");
+    CSV_COLUMN(ObjectsUnaccessedLastTwoIntervalsColumn, uint64_t, "Objects Unaccessed Last Two Intervals");
+    CSV_COLUMN(ObjectsUnaccessedLastThreeIntervalsColumn, uint64_t, "Objects Unaccessed Last Three Intervals");
+    CSV_COLUMN(ObjectsUnaccessedLastFourIntervalsColumn, uint64_t, "Objects Unaccessed Last Four Intervals");
+    CSV_COLUMN(ObjectsUnaccessedLastFiveIntervalsColumn, uint64_t, "Objects Unaccessed Last Five Intervals");
+    CSV_COLUMN(ObjectsUnaccessedLastSixIntervalsColumn, uint64_t, "Objects Unaccessed Last Six Intervals");
+    CSV_COLUMN(BytesAccessedThisIntervalColumn, int64_t, "Bytes Accessed This Interval");
+    CSV_COLUMN(BytesAccessedLastTwoIntervalsColumn, int64_t, "Bytes Accessed Last Two Intervals");
+    CSV_COLUMN(BytesAccessedLastThreeIntervalsColumn, int64_t, "Bytes Accessed Last Three Intervals");
+    CSV_COLUMN(BytesAccessedLastFourIntervalsColumn, int64_t, "Bytes Accessed Last Four Intervals");
+    CSV_COLUMN(BytesAccessedLastFiveIntervalsColumn, int64_t, "Bytes Accessed Last Five Intervals");
+    CSV_COLUMN(BytesAccessedLastSixIntervalsColumn, int64_t, "Bytes Accessed Last Six Intervals");
+    CSV_COLUMN(BytesWrittenToThisIntervalColumn, int64_t, "Bytes Written To This Interval");
+    CSV_COLUMN(BytesWrittenToLastTwoIntervalsColumn, int64_t, "Bytes Written To Last Two Intervals");
+    CSV_COLUMN(BytesWrittenToLastThreeIntervalsColumn, int64_t, "Bytes Written To Last Three Intervals");
+    CSV_COLUMN(BytesWrittenToLastFourIntervalsColumn, int64_t, "Bytes Written To Last Four Intervals");
+    CSV_COLUMN(BytesWrittenToLastFiveIntervalsColumn, int64_t, "Bytes Written To Last Five Intervals");
+    CSV_COLUMN(BytesWrittenToLastSixIntervalsColumn, int64_t, "Bytes Written To Last Six Intervals");
+    CSV_COLUMN(BytesReadFromThisIntervalColumn, int64_t, "Bytes Read From This Interval");
+    CSV_COLUMN(BytesReadFromLastTwoIntervalsColumn, int64_t, "Bytes Read From Last Two Intervals");
+    CSV_COLUMN(BytesReadFromLastThreeIntervalsColumn, int64_t, "Bytes Read From Last Three Intervals");
+    CSV_COLUMN(BytesReadFromLastFourIntervalsColumn, int64_t, "Bytes Read From Last Four Intervals");
+    CSV_COLUMN(BytesReadFromLastFiveIntervalsColumn, int64_t, "Bytes Read From Last Five Intervals");
+    CSV_COLUMN(BytesReadFromLastSixIntervalsColumn, int64_t, "Bytes Read From Last Six Intervals");
+    CSV_COLUMN(BytesUnaccessedThisIntervalColumn, int64_t, "Bytes Unaccessed This Interval");
+    CSV_COLUMN(BytesUnaccessedLastTwoIntervalsColumn, int64_t, "Bytes Unaccessed Last Two Intervals");
+    CSV_COLUMN(BytesUnaccessedLastThreeIntervalsColumn, int64_t, "Bytes Unaccessed Last Three Intervals");
+    CSV_COLUMN(BytesUnaccessedLastFourIntervalsColumn, int64_t, "Bytes Unaccessed Last Four Intervals");
+    CSV_COLUMN(BytesUnaccessedLastFiveIntervalsColumn, int64_t, "Bytes Unaccessed Last Five Intervals");
+    CSV_COLUMN(BytesUnaccessedLastSixIntervalsColumn, int64_t, "Bytes Unaccessed Last Six Intervals");
+
+    typedef CSVSchema<
+        IntervalColumn, LiveObjectsColumn, LiveBytesColumn,
+        MemoryAllocatedSinceLastIntervalColumn, MemoryFreedSinceLastIntervalColumn, TotalMemoryAllocatedColumn,
+        TotalMemoryFreedColumn, ObjectsAccessedThisIntervalColumn, ObjectsAccessedLastTwoIntervalsColumn,
+        ObjectsAccessedLastThreeIntervalsColumn, ObjectsAccessedLastFourIntervalsColumn, ObjectsAccessedLastFiveIntervalsColumn,
+        ObjectsAccessedLastSixIntervalsColumn, ObjectsWrittenToThisIntervalColumn, ObjectsWrittenToLastTwoIntervalsColumn,
+        ObjectsWrittenToLastThreeIntervalsColumn, ObjectsWrittenToLastFourIntervalsColumn, ObjectsWrittenToLastFiveIntervalsColumn,
+        ObjectsWrittenToLastSixIntervalsColumn, ObjectsReadFromThisIntervalColumn, ObjectsReadFromLastTwoIntervalsColumn,
+        ObjectsReadFromLastThreeIntervalsColumn, ObjectsReadFromLastFourIntervalsColumn, ObjectsReadFromLastFiveIntervalsColumn,
+        ObjectsReadFromLastSixIntervalsColumn, ObjectsUnaccessedThisIntervalColumn, ObjectsUnaccessedLastTwoIntervalsColumn,
+        ObjectsUnaccessedLastThreeIntervalsColumn, ObjectsUnaccessedLastFourIntervalsColumn, ObjectsUnaccessedLastFiveIntervalsColumn,
+        ObjectsUnaccessedLastSixIntervalsColumn, BytesAccessedThisIntervalColumn, BytesAccessedLastTwoIntervalsColumn,
+        BytesAccessedLastThreeIntervalsColumn, BytesAccessedLastFourIntervalsColumn, BytesAccessedLastFiveIntervalsColumn,
+        BytesAccessedLastSixIntervalsColumn, BytesWrittenToThisIntervalColumn, BytesWrittenToLastTwoIntervalsColumn,
+        BytesWrittenToLastThreeIntervalsColumn, BytesWrittenToLastFourIntervalsColumn, BytesWrittenToLastFiveIntervalsColumn,
+        BytesWrittenToLastSixIntervalsColumn, BytesReadFromThisIntervalColumn, BytesReadFromLastTwoIntervalsColumn,
+        BytesReadFromLastThreeIntervalsColumn, BytesReadFromLastFourIntervalsColumn, BytesReadFromLastFiveIntervalsColumn,
+        BytesReadFromLastSixIntervalsColumn, BytesUnaccessedThisIntervalColumn, BytesUnaccessedLastTwoIntervalsColumn,
+        BytesUnaccessedLastThreeIntervalsColumn, BytesUnaccessedLastFourIntervalsColumn, BytesUnaccessedLastFiveIntervalsColumn,
+        BytesUnaccessedLastSixIntervalsColumn
+    > Schema;
+
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -72,89 +150,20 @@ class AccessPatternTest : public IntervalTest {
         stack_debugf("Setup\n");
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
-        file = StackFile(StackString<256>("access_patterns.csv"), Mode::APPEND);
+        file = StackFile(StackString<256>("access_patterns.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #");
-        csv.title().add("Live Objects");
-        csv.title().add("Live Bytes");
-        csv.title().add("Memory Allocated Since Last Interval");
-        csv.title().add("Memory Freed Since Last Interval");
-        csv.title().add("Total Memory Allocated");
-        csv.title().add("Total Memory Freed");
-        // csv.title().add("Objects Accessed");
-        // csv.title().add("Objects Written To");
-        // csv.title().add("Objects Read From");
-        // csv.title().add("Objects Unaccessed");
-        // csv.title().add("Bytes Accessed");
-        // csv.title().add("Bytes Written To");
-        // csv.title().add("Bytes Read From");
-        // csv.title().add("Bytes Unaccessed");
-
-        // Now do interval based access pattern tracking
-        csv.title().add("Objects Accessed This Interval");
-        csv.title().add("Objects Accessed Last Two Intervals");
-        csv.title().add("Objects Accessed Last Three Intervals");
-        csv.title().add("Objects Accessed Last Four Intervals");
-        csv.title().add("Objects Accessed Last Five Intervals");
-        csv.title().add("Objects Accessed Last Six Intervals");
-
-        csv.title().add("Objects Written To This Interval");
-        csv.title().add("Objects Written To Last Two Intervals");
-        csv.title().add("Objects Written To Last Three Intervals");
-        csv.title().add("Objects Written To Last Four Intervals");
-        csv.title().add("Objects Written To Last Five Intervals");
-        csv.title().add("Objects Written To Last Six Intervals");
-
-        csv.title().add("Objects Read From This Interval");
-        csv.title().add("Objects Read From Last Two Intervals");
-        csv.title().add("Objects Read From Last Three Intervals");
-        csv.title().add("Objects Read From Last Four Intervals");
-        csv.title().add("Objects Read From Last Five Intervals");
-        csv.title().add("Objects Read From Last Six Intervals");
-
-        csv.title().add("Objects Unaccessed This Interval");
-        csv.title().add("Objects Unaccessed Last Two Intervals");
-        csv.title().add("Objects Unaccessed Last Three Intervals");
-        csv.title().add("Objects Unaccessed Last Four Intervals");
-        csv.title().add("Objects Unaccessed Last Five Intervals");
-        csv.title().add("Objects Unaccessed Last Six Intervals");
-
-        csv.title().add("Bytes Accessed This Interval");
-        csv.title().add("Bytes Accessed Last Two Intervals");
-        csv.title().add("Bytes Accessed Last Three Intervals");
-        csv.title().add("Bytes Accessed Last Four Intervals");
-        csv.title().add("Bytes Accessed Last Five Intervals");
-        csv.title().add("Bytes Accessed Last Six Intervals");
-
-        csv.title().add("Bytes Written To This Interval");
-        csv.title().add("Bytes Written To Last Two Intervals");
-        csv.title().add("Bytes Written To Last Three Intervals");
-        csv.title().add("Bytes Written To Last Four Intervals");
-        csv.title().add("Bytes Written To Last Five Intervals");
-        csv.title().add("Bytes Written To Last Six Intervals");
-
-        csv.title().add("Bytes Read From This Interval");
-        csv.title().add("Bytes Read From Last Two Intervals");
-        csv.title().add("Bytes Read From Last Three Intervals");
-        csv.title().add("Bytes Read From Last Four Intervals");
-        csv.title().add("Bytes Read From Last Five Intervals");
-        csv.title().add("Bytes Read From Last Six Intervals");
-
-        csv.title().add("Bytes Unaccessed This Interval");
-        csv.title().add("Bytes Unaccessed Last Two Intervals");
-        csv.title().add("Bytes Unaccessed Last Three Intervals");
-        csv.title().add("Bytes Unaccessed Last Four Intervals");
-        csv.title().add("Bytes Unaccessed Last Five Intervals");
-        csv.title().add("Bytes Unaccessed Last Six Intervals");
-
         csv.write(file);
         csv.clear();
 
         interval_count = 0;
     }
 
-    void summary() {
+    /// @brief Log the running totals, unless `level` is filtered out.
+    void summary(LogLevel level=LogLevel::Info) {
+        if (!log_enabled(level)) {
+            return;
+        }
         // stack_infof("Total allocations: %d\n", total_allocations);
         // stack_infof("Total frees: %d\n", total_frees);
         int64_t objects_accessed_this_interval = accessed_this_interval.size();
@@ -332,7 +341,7 @@ class AccessPatternTest : public IntervalTest {
         memory_allocated_since_last_interval += alloc.size;
         total_memory_allocated += alloc.size;
 
-        summary();
+        summary(LogLevel::Debug);
     }
 
     void on_free(const Allocation &alloc) override {
@@ -382,7 +391,7 @@ class AccessPatternTest : public IntervalTest {
         // write_accessed_last_6_intervals.remove(alloc);
         // read_accessed_last_6_intervals.remove(alloc);
      
-        summary();
+        summary(LogLevel::Debug);
     }
 
     void finish_interval() {
@@ -482,143 +491,143 @@ class AccessPatternTest : public IntervalTest {
         // int64_t objects_unaccessed_this_interval = total_objects_live - objects_accessed_this_interval;
         // int64_t bytes_unaccessed_this_interval = total_bytes_live - bytes_accessed_this_interval;
         
-        CSVRow<64> &row = csv.new_row();
-        row.set(csv.title(), "Interval #", interval_count);
-        row.set(csv.title(), "Total Memory Allocated", total_memory_allocated);
-        row.set(csv.title(), "Total Memory Freed", total_memory_freed);
-        row.set(csv.title(), "Memory Allocated Since Last Interval", memory_allocated_since_last_interval);
-        row.set(csv.title(), "Memory Freed Since Last Interval", memory_freed_since_last_interval);
-        // row.set(csv.title(), "Live Objects", total_objects_live);
-        // row.set(csv.title(), "Live Bytes", total_bytes_live);
+        auto &row = csv.new_row();
+        row.set<IntervalColumn>(interval_count);
+        row.set<TotalMemoryAllocatedColumn>(total_memory_allocated);
+        row.set<TotalMemoryFreedColumn>(total_memory_freed);
+        row.set<MemoryAllocatedSinceLastIntervalColumn>(memory_allocated_since_last_interval);
+        row.set<MemoryFreedSinceLastIntervalColumn>(memory_freed_since_last_interval);
+        // row.set<LiveObjectsColumn>(total_objects_live);
+        // row.set<LiveBytesColumn>(total_bytes_live);
         int64_t live_bytes = live_this_interval.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Live Objects", live_this_interval.size());
-        row.set(csv.title(), "Live Bytes", live_bytes);
+        row.set<LiveObjectsColumn>(live_this_interval.size());
+        row.set<LiveBytesColumn>(live_bytes);
         
-        row.set(csv.title(), "Objects Accessed This Interval", accessed_this_interval.size());
-        row.set(csv.title(), "Objects Written To This Interval", write_accessed_this_interval.size());
-        row.set(csv.title(), "Objects Read From This Interval", read_accessed_this_interval.size());
-        row.set(csv.title(), "Objects Unaccessed This Interval", unaccessed_this_interval.size());
-
-        row.set(csv.title(), "Bytes Accessed This Interval", bytes_accessed_this_interval);
-        row.set(csv.title(), "Bytes Written To This Interval", bytes_written_to_this_interval);
-        row.set(csv.title(), "Bytes Read From This Interval", bytes_read_from_this_interval);
+        row.set<ObjectsAccessedThisIntervalColumn>(accessed_this_interval.size());
+        row.set<ObjectsWrittenToThisIntervalColumn>(write_accessed_this_interval.size());
+        row.set<ObjectsReadFromThisIntervalColumn>(read_accessed_this_interval.size());
+        row.set<ObjectsUnaccessedThisIntervalColumn>(unaccessed_this_interval.size());
+
+        row.set<BytesAccessedThisIntervalColumn>(bytes_accessed_this_interval);
+        row.set<BytesWrittenToThisIntervalColumn>(bytes_written_to_this_interval);
+        row.set<BytesReadFromThisIntervalColumn>(bytes_read_from_this_interval);
         int64_t bytes_unaccessed_this_interval = unaccessed_this_interval.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Unaccessed This Interval", bytes_unaccessed_this_interval);
+        row.set<BytesUnaccessedThisIntervalColumn>(bytes_unaccessed_this_interval);
         
-        row.set(csv.title(), "Objects Accessed Last Two Intervals", accessed_last_2_intervals.size());
-        row.set(csv.title(), "Objects Written To Last Two Intervals", write_accessed_last_2_intervals.size());
-        row.set(csv.title(), "Objects Read From Last Two Intervals", read_accessed_last_2_intervals.size());
-        row.set(csv.title(), "Objects Unaccessed Last Two Intervals", unaccessed_last_2_intervals.size());
-        // row.set(csv.title(), "Objects Unaccessed Last Two Intervals", total_objects_live - accessed_last_2_intervals.size());
+        row.set<ObjectsAccessedLastTwoIntervalsColumn>(accessed_last_2_intervals.size());
+        row.set<ObjectsWrittenToLastTwoIntervalsColumn>(write_accessed_last_2_intervals.size());
+        row.set<ObjectsReadFromLastTwoIntervalsColumn>(read_accessed_last_2_intervals.size());
+        row.set<ObjectsUnaccessedLastTwoIntervalsColumn>(unaccessed_last_2_intervals.size());
+        // row.set<ObjectsUnaccessedLastTwoIntervalsColumn>(total_objects_live - accessed_last_2_intervals.size());
 
         int64_t bytes_accessed_last_2_intervals = accessed_last_2_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Accessed Last Two Intervals", bytes_accessed_last_2_intervals);
+        row.set<BytesAccessedLastTwoIntervalsColumn>(bytes_accessed_last_2_intervals);
         int64_t bytes_written_to_last_2_intervals = write_accessed_last_2_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Written To Last Two Intervals", bytes_written_to_last_2_intervals);
+        row.set<BytesWrittenToLastTwoIntervalsColumn>(bytes_written_to_last_2_intervals);
         int64_t bytes_read_from_last_2_intervals = read_accessed_last_2_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Read From Last Two Intervals", bytes_read_from_last_2_intervals);
+        row.set<BytesReadFromLastTwoIntervalsColumn>(bytes_read_from_last_2_intervals);
         int64_t bytes_unaccessed_last_2_intervals = unaccessed_last_2_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Unaccessed Last Two Intervals", bytes_unaccessed_last_2_intervals);
+        row.set<BytesUnaccessedLastTwoIntervalsColumn>(bytes_unaccessed_last_2_intervals);
 
-        row.set(csv.title(), "Objects Accessed Last Three Intervals", accessed_last_3_intervals.size());
-        row.set(csv.title(), "Objects Written To Last Three Intervals", write_accessed_last_3_intervals.size());
-        row.set(csv.title(), "Objects Read From Last Three Intervals", read_accessed_last_3_intervals.size());
-        row.set(csv.title(), "Objects Unaccessed Last Three Intervals", unaccessed_last_3_intervals.size());
+        row.set<ObjectsAccessedLastThreeIntervalsColumn>(accessed_last_3_intervals.size());
+        row.set<ObjectsWrittenToLastThreeIntervalsColumn>(write_accessed_last_3_intervals.size());
+        row.set<ObjectsReadFromLastThreeIntervalsColumn>(read_accessed_last_3_intervals.size());
+        row.set<ObjectsUnaccessedLastThreeIntervalsColumn>(unaccessed_last_3_intervals.size());
 
         int64_t bytes_accessed_last_3_intervals = accessed_last_3_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Accessed Last Three Intervals", bytes_accessed_last_3_intervals);
+        row.set<BytesAccessedLastThreeIntervalsColumn>(bytes_accessed_last_3_intervals);
         int64_t bytes_written_to_last_3_intervals = write_accessed_last_3_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Written To Last Three Intervals", bytes_written_to_last_3_intervals);
+        row.set<BytesWrittenToLastThreeIntervalsColumn>(bytes_written_to_last_3_intervals);
         int64_t bytes_read_from_last_3_intervals = read_accessed_last_3_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Read From Last Three Intervals", bytes_read_from_last_3_intervals);
+        row.set<BytesReadFromLastThreeIntervalsColumn>(bytes_read_from_last_3_intervals);
         int64_t bytes_unaccessed_last_3_intervals = unaccessed_last_3_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Unaccessed Last Three Intervals", bytes_unaccessed_last_3_intervals);
+        row.set<BytesUnaccessedLastThreeIntervalsColumn>(bytes_unaccessed_last_3_intervals);
 
-        row.set(csv.title(), "Objects Accessed Last Four Intervals", accessed_last_4_intervals.size());
-        row.set(csv.title(), "Objects Written To Last Four Intervals", write_accessed_last_4_intervals.size());
-        row.set(csv.title(), "Objects Read From Last Four Intervals", read_accessed_last_4_intervals.size());
-        row.set(csv.title(), "Objects Unaccessed Last Four Intervals", unaccessed_last_4_intervals.size());
+        row.set<ObjectsAccessedLastFourIntervalsColumn>(accessed_last_4_intervals.size());
+        row.set<ObjectsWrittenToLastFourIntervalsColumn>(write_accessed_last_4_intervals.size());
+        row.set<ObjectsReadFromLastFourIntervalsColumn>(read_accessed_last_4_intervals.size());
+        row.set<ObjectsUnaccessedLastFourIntervalsColumn>(unaccessed_last_4_intervals.size());
 
         int64_t bytes_accessed_last_4_intervals = accessed_last_4_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Accessed Last Four Intervals", bytes_accessed_last_4_intervals);
+        row.set<BytesAccessedLastFourIntervalsColumn>(bytes_accessed_last_4_intervals);
         int64_t bytes_written_to_last_4_intervals = write_accessed_last_4_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Written To Last Four Intervals", bytes_written_to_last_4_intervals);
+        row.set<BytesWrittenToLastFourIntervalsColumn>(bytes_written_to_last_4_intervals);
         int64_t bytes_read_from_last_4_intervals = read_accessed_last_4_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Read From Last Four Intervals", bytes_read_from_last_4_intervals);
+        row.set<BytesReadFromLastFourIntervalsColumn>(bytes_read_from_last_4_intervals);
         int64_t bytes_unaccessed_last_4_intervals = unaccessed_last_4_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Unaccessed Last Four Intervals", bytes_unaccessed_last_4_intervals);
+        row.set<BytesUnaccessedLastFourIntervalsColumn>(bytes_unaccessed_last_4_intervals);
         
-        row.set(csv.title(), "Objects Accessed Last Five Intervals", accessed_last_5_intervals.size());
-        row.set(csv.title(), "Objects Written To Last Five Intervals", write_accessed_last_5_intervals.size());
-        row.set(csv.title(), "Objects Read From Last Five Intervals", read_accessed_last_5_intervals.size());
-        row.set(csv.title(), "Objects Unaccessed Last Five Intervals", unaccessed_last_5_intervals.size());
+        row.set<ObjectsAccessedLastFiveIntervalsColumn>(accessed_last_5_intervals.size());
+        row.set<ObjectsWrittenToLastFiveIntervalsColumn>(write_accessed_last_5_intervals.size());
+        row.set<ObjectsReadFromLastFiveIntervalsColumn>(read_accessed_last_5_intervals.size());
+        row.set<ObjectsUnaccessedLastFiveIntervalsColumn>(unaccessed_last_5_intervals.size());
 
         int64_t bytes_accessed_last_5_intervals = accessed_last_5_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Accessed Last Five Intervals", bytes_accessed_last_5_intervals);
+        row.set<BytesAccessedLastFiveIntervalsColumn>(bytes_accessed_last_5_intervals);
         int64_t bytes_written_to_last_5_intervals = write_accessed_last_5_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Written To Last Five Intervals", bytes_written_to_last_5_intervals);
+        row.set<BytesWrittenToLastFiveIntervalsColumn>(bytes_written_to_last_5_intervals);
         int64_t bytes_read_from_last_5_intervals = read_accessed_last_5_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Read From Last Five Intervals", bytes_read_from_last_5_intervals);
+        row.set<BytesReadFromLastFiveIntervalsColumn>(bytes_read_from_last_5_intervals);
         int64_t bytes_unaccessed_last_5_intervals = unaccessed_last_5_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Unaccessed Last Five Intervals", unaccessed_last_5_intervals.size());
+        row.set<BytesUnaccessedLastFiveIntervalsColumn>(bytes_unaccessed_last_5_intervals);
 
-        row.set(csv.title(), "Objects Accessed Last Six Intervals", accessed_last_6_intervals.size());
-        row.set(csv.title(), "Objects Written To Last Six Intervals", write_accessed_last_6_intervals.size());
-        row.set(csv.title(), "Objects Read From Last Six Intervals", read_accessed_last_6_intervals.size());
-        row.set(csv.title(), "Objects Unaccessed Last Six Intervals", unaccessed_last_6_intervals.size());
+        row.set<ObjectsAccessedLastSixIntervalsColumn>(accessed_last_6_intervals.size());
+        row.set<ObjectsWrittenToLastSixIntervalsColumn>(write_accessed_last_6_intervals.size());
+        row.set<ObjectsReadFromLastSixIntervalsColumn>(read_accessed_last_6_intervals.size());
+        row.set<ObjectsUnaccessedLastSixIntervalsColumn>(unaccessed_last_6_intervals.size());
 
         int64_t bytes_accessed_last_6_intervals = accessed_last_6_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Accessed Last Six Intervals", bytes_accessed_last_6_intervals);
+        row.set<BytesAccessedLastSixIntervalsColumn>(bytes_accessed_last_6_intervals);
         int64_t bytes_written_to_last_6_intervals = write_accessed_last_6_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Written To Last Six Intervals", bytes_written_to_last_6_intervals);
+        row.set<BytesWrittenToLastSixIntervalsColumn>(bytes_written_to_last_6_intervals);
         int64_t bytes_read_from_last_6_intervals = read_accessed_last_6_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Read From Last Six Intervals", bytes_read_from_last_6_intervals);
+        row.set<BytesReadFromLastSixIntervalsColumn>(bytes_read_from_last_6_intervals);
         int64_t bytes_unaccessed_last_6_intervals = unaccessed_last_6_intervals.reduce<int64_t>([](const Allocation &alloc, int64_t acc) {
             return acc + alloc.size;
         }, 0);
-        row.set(csv.title(), "Bytes Unaccessed Last Six Intervals", bytes_unaccessed_last_6_intervals);
+        row.set<BytesUnaccessedLastSixIntervalsColumn>(bytes_unaccessed_last_6_intervals);
 
         stack_debugf("Finishing up interval\n");
         finish_interval();
@@ -3,7 +3,16 @@
 #include <config.hpp>
 #include <interval_test.hpp>
 #include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <compressor.hpp>
+#include <page_cache.hpp>
+#include <page_dedup.hpp>
+#include <site_dictionary.hpp>
+#include <compression_sweep.hpp>
+#include <granularity_sweep.hpp>
+#include <cross_page.hpp>
+#include <compressed_pool.hpp>
+#include <delta_output.hpp>
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
@@ -13,8 +22,163 @@
 #define TRACK_PAGES
 #define TRACK_HUGE_PAGES
 
-// #define MAX_COMPRESSED_SIZE 0x300000
-static uint8_t compressed_buffer[0x20000000];
+// Reuse a page's compressed sizes from an earlier interval when it is still
+// clean and on the same physical frame
+#define CACHE_PAGE_COMPRESSION
+
+// Count how many resident pages are identical to another resident page
+// (requires TRACK_PAGES)
+#define TRACK_PAGE_DEDUPLICATION
+
+// Round-trip every freshly compressed page through the decompressor, timing
+// it and checking the result (requires TRACK_PAGES)
+// #define MEASURE_DECOMPRESSION
+
+// Train a zstd dictionary per hot allocation site and report each object's
+// compressed size with it (requires TRACK_OBJECTS and USE_ZSTD_COMPRESSION)
+// #define TRAIN_SITE_DICTIONARIES
+
+#if defined(TRAIN_SITE_DICTIONARIES) && !defined(USE_ZSTD_COMPRESSION)
+#error "TRAIN_SITE_DICTIONARIES requires USE_ZSTD_COMPRESSION"
+#endif
+
+// Compress a sample of the page sweep with every setting in
+// `COMPRESSION_SWEEP_SETTINGS`, in blocks of every size in
+// `COMPRESSION_SWEEP_BLOCK_SIZES`, and write a per-interval Pareto table of
+// ratio against compression time (requires TRACK_PAGES)
+// #define SWEEP_COMPRESSION_SETTINGS
+
+#ifdef SWEEP_COMPRESSION_SETTINGS
+// (codec, level, window log) tuples; a window log of 0 keeps the codec's default
+static const CompressionSetting COMPRESSION_SWEEP_SETTINGS[] = {
+    #ifdef USE_ZLIB_COMPRESSION
+    {COMPRESS_ZLIB, 1}, {COMPRESS_ZLIB, 6}, {COMPRESS_ZLIB, 9}, {COMPRESS_ZLIB, 6, 10},
+    #endif
+    #ifdef USE_LZ4_COMPRESSION
+    {COMPRESS_LZ4, 1}, {COMPRESS_LZ4, 4}, {COMPRESS_LZ4, 16},
+    #endif
+    #ifdef USE_LZO_COMPRESSION
+    {COMPRESS_LZO, 0},
+    #endif
+    #ifdef USE_SNAPPY_COMPRESSION
+    {COMPRESS_SNAPPY, 0},
+    #endif
+    #ifdef USE_ZSTD_COMPRESSION
+    {COMPRESS_ZSTD, 1}, {COMPRESS_ZSTD, 3}, {COMPRESS_ZSTD, 9}, {COMPRESS_ZSTD, 19}, {COMPRESS_ZSTD, 3, 10},
+    #endif
+    #ifdef USE_LZF_COMPRESSION
+    {COMPRESS_LZF, 0},
+    #endif
+    #ifdef USE_LZ4HC_COMPRESSION
+    {COMPRESS_LZ4HC, 4}, {COMPRESS_LZ4HC, 9}, {COMPRESS_LZ4HC, LZ4HC_CLEVEL_MAX},
+    #endif
+    #ifdef USE_BDI_COMPRESSION
+    {COMPRESS_BDI, 0},
+    #endif
+    #ifdef USE_FPC_COMPRESSION
+    {COMPRESS_FPC, 0},
+    #endif
+};
+// Block sizes in bytes: base pages, 16K and 64K large folios, and 256K blocks
+static const size_t COMPRESSION_SWEEP_BLOCK_SIZES[] = {0x1000, 0x4000, 0x10000, 0x40000};
+#endif
+
+// Write the per-object and per-page tables in the binary columnar format, to
+// object-compression.hpcol and page-compression.hpcol. `heappulse-convert`
+// turns them back into CSV.
+// #define COLUMNAR_OUTPUT
+
+// Only write per-object and per-page rows for births, deaths and changes
+// (see delta_output.hpp), to object-delta and page-delta, with an `End` row
+// closing every interval. `heappulse-reconstruct` rebuilds the full tables.
+// #define DELTA_OUTPUT
+
+#ifdef DELTA_OUTPUT
+#define OBJECT_TABLE_NAME "object-delta"
+#define PAGE_TABLE_NAME "page-delta"
+#else
+#define OBJECT_TABLE_NAME "object-compression"
+#define PAGE_TABLE_NAME "page-compression"
+#endif
+
+// Compress the same resident pages as aligned spans of every size in
+// `PAGE_GRANULARITIES` with every type, and write one table comparing them
+// (requires TRACK_PAGES)
+// #define SWEEP_PAGE_GRANULARITIES
+
+// Stream each site's resident pages through zstd with long-distance
+// matching and compare against compressing them page by page (requires
+// TRACK_PAGES and USE_ZSTD_COMPRESSION)
+// #define TRACK_CROSS_PAGE_REDUNDANCY
+// Also stream every resident page of the heap as one stream
+#define CROSS_PAGE_WHOLE_HEAP
+
+#if defined(TRACK_CROSS_PAGE_REDUNDANCY) && !defined(USE_ZSTD_COMPRESSION)
+#error "TRACK_CROSS_PAGE_REDUNDANCY requires USE_ZSTD_COMPRESSION"
+#endif
+
+// Store every compressed page of the sweep in a model of a zsmalloc pool,
+// and report the pool's footprint and fragmentation for each type (requires
+// TRACK_PAGES)
+// #define SIMULATE_COMPRESSED_POOL
+
+#if defined(USE_BDI_COMPRESSION) || defined(USE_FPC_COMPRESSION)
+// Histogram the compressed size of every cache line of the page sweep for
+// the line codecs (requires TRACK_PAGES)
+#define TRACK_LINE_COMPRESSION
+#endif
+
+#ifdef SWEEP_PAGE_GRANULARITIES
+// Span sizes in bytes: base pages, 16K and 64K large folios, and PMD-sized huge pages
+static const size_t PAGE_GRANULARITIES[] = {0x1000, 0x4000, 0x10000, 0x200000};
+#endif
+
+// Holds the output of compressing up to one stream block in a single call;
+// anything larger is measured with a compression stream instead
+static uint8_t compressed_buffer[COMPRESSION_STREAM_BUFFER_SIZE];
+
+// How many intervals an object or page has been live: none, under 5, under 10, or more
+enum class AgeClass : uint8_t {
+    NEW,
+    YOUNG,
+    MIDDLE_AGED,
+    OLD,
+};
+
+const char *csv_enum_name(AgeClass age_class) {
+    static const char *names[] = {"New", "Young", "Middle-aged", "Old"};
+    return names[(size_t)age_class];
+}
+
+// The compressed size as a fraction of the uncompressed size, in tenths
+enum class CompressionClass : uint8_t {
+    NOT_APPLICABLE,
+    PERCENT_0_10,
+    PERCENT_10_20,
+    PERCENT_20_30,
+    PERCENT_30_40,
+    PERCENT_40_50,
+    PERCENT_50_60,
+    PERCENT_60_70,
+    PERCENT_70_80,
+    PERCENT_80_90,
+    PERCENT_90_100,
+};
+
+const char *csv_enum_name(CompressionClass compression_class) {
+    static const char *names[] = {"N/A", "0-10%", "10-20%", "20-30%", "30-40%", "40-50%", "50-60%", "60-70%", "70-80%", "80-90%", "90-100%"};
+    return names[(size_t)compression_class];
+}
+
+// Whether an object or page has been written to, going by its dirty bits
+enum class AccessType : uint8_t {
+    READ,
+    READ_WRITE,
+};
+
+const char *csv_enum_name(AccessType access_type) {
+    return access_type == AccessType::READ_WRITE ? "Read/Write" : "Read";
+}
 
 struct HugePage {
     uint8_t *address;
@@ -67,6 +231,17 @@ struct HugePage {
     }
 };
 
+// Decompression measurements for one compression type and page class
+struct DecompressionStats {
+    uint64_t pages = 0;
+    uint64_t uncompressed_size = 0;
+    uint64_t compressed_size = 0;
+    uint64_t total_nanoseconds = 0;
+    uint64_t max_nanoseconds = 0;
+    // Pages that did not decompress back to their original contents
+    uint64_t failures = 0;
+};
+
 // Define hash function for HugePage
 namespace std {
     template<>
@@ -84,7 +259,91 @@ public:
     }
 
 private:
-    CSV<20, 10000> object_csv, page_csv, huge_page_csv, interval_csv;
+    // The columns of the per-object, per-page and per-huge-page tables
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    #ifdef DELTA_OUTPUT
+    CSV_COLUMN(EventColumn, DeltaEvent, "Event");
+    #endif
+    CSV_COLUMN(AllocationSiteColumn, void*, "Allocation Site");
+    CSV_COLUMN(AgeColumn, uint64_t, "Age (intervals)");
+    CSV_COLUMN(AgeClassColumn, AgeClass, "Age Class");
+    CSV_COLUMN(ObjectAddressColumn, void*, "Object Address");
+    CSV_COLUMN(VirtualPageAddressColumn, void*, "Virtual Page Address");
+    CSV_COLUMN(PhysicalPageAddressColumn, void*, "Physical Page Address");
+    CSV_COLUMN(HugePageAddressColumn, void*, "Huge Page Address");
+    CSV_COLUMN(PageAddressColumn, void*, "Page Address");
+    CSV_COLUMN(SizeColumn, uint64_t, "Size (bytes)");
+    CSV_COLUMN(CompressionTypeColumn, CompressionType, "Compression Type");
+    CSV_COLUMN(CompressedSizeColumn, uint64_t, "Compressed Size (bytes)");
+    CSV_COLUMN(CompressionRatioColumn, double, "Compression Ratio (compressed/uncompressed)");
+    CSV_COLUMN(CompressionClassColumn, CompressionClass, "Compression Class");
+    CSV_COLUMN(AccessTypeColumn, AccessType, "Access Type");
+    CSV_COLUMN(SizeOccupiedColumn, uint64_t, "Size Occupied (bytes)");
+    CSV_COLUMN(CompressedInIntervalColumn, uint64_t, "Compressed In Interval #");
+    #ifdef MEASURE_DECOMPRESSION
+    CSV_COLUMN(DecompressionTimeColumn, uint64_t, "Decompression Time (ns)");
+    #endif
+    #ifdef TRAIN_SITE_DICTIONARIES
+    // Only filled in for zstd rows of sites with a trained dictionary, and only
+    // for objects held out from training (see `SiteDictionaries`)
+    CSV_COLUMN(DictionarySizeColumn, uint64_t, "Dictionary Size (bytes)");
+    CSV_COLUMN(DictionaryCompressedSizeColumn, uint64_t, "Dictionary Compressed Size (bytes)");
+    CSV_COLUMN(DictionaryCompressionRatioColumn, double, "Dictionary Compression Ratio (compressed/uncompressed)");
+    #endif
+    #ifdef TRACK_ACCESSES
+    CSV_COLUMN(AccessedColumn, bool, "Accessed?");
+    CSV_COLUMN(ReadColumn, bool, "Read?");
+    CSV_COLUMN(WrittenColumn, bool, "Written?");
+    CSV_COLUMN(UnaccessedColumn, bool, "Unaccessed?");
+    #endif
+
+    typedef CSVSchema<
+        IntervalColumn,
+        #ifdef DELTA_OUTPUT
+        EventColumn,
+        #endif
+        AllocationSiteColumn, AgeColumn, AgeClassColumn, ObjectAddressColumn, SizeColumn,
+        CompressionTypeColumn, CompressedSizeColumn, CompressionRatioColumn, CompressionClassColumn, AccessTypeColumn
+        #ifdef TRAIN_SITE_DICTIONARIES
+        , DictionarySizeColumn, DictionaryCompressedSizeColumn, DictionaryCompressionRatioColumn
+        #endif
+        #ifdef TRACK_ACCESSES
+        , AccessedColumn, ReadColumn, WrittenColumn, UnaccessedColumn
+        #endif
+    > ObjectSchema;
+
+    typedef CSVSchema<
+        IntervalColumn,
+        #ifdef DELTA_OUTPUT
+        EventColumn,
+        #endif
+        AllocationSiteColumn, AgeColumn, AgeClassColumn, VirtualPageAddressColumn, PhysicalPageAddressColumn, SizeColumn,
+        CompressionTypeColumn, CompressedSizeColumn, CompressionRatioColumn, CompressionClassColumn, AccessTypeColumn,
+        SizeOccupiedColumn, CompressedInIntervalColumn
+        #ifdef MEASURE_DECOMPRESSION
+        , DecompressionTimeColumn
+        #endif
+        #ifdef TRACK_ACCESSES
+        , AccessedColumn, ReadColumn, WrittenColumn, UnaccessedColumn
+        #endif
+    > PageSchema;
+
+    typedef CSVSchema<
+        IntervalColumn, AgeColumn, AgeClassColumn, HugePageAddressColumn, PageAddressColumn, SizeColumn,
+        CompressionTypeColumn, CompressedSizeColumn, CompressionRatioColumn, CompressionClassColumn, AccessTypeColumn,
+        SizeOccupiedColumn
+        #ifdef TRACK_ACCESSES
+        , AccessedColumn, ReadColumn, WrittenColumn, UnaccessedColumn
+        #endif
+    > HugePageSchema;
+
+    CSVTable<ObjectSchema, 10000> object_csv;
+    CSVTable<PageSchema, 10000> page_csv;
+    CSVTable<HugePageSchema, 10000> huge_page_csv;
+    CSV<20, 10000> interval_csv;
+    #ifdef DELTA_OUTPUT
+    DeltaTracker<> object_deltas, page_deltas;
+    #endif
     StackFile object_file, page_file, huge_page_file, interval_file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -105,6 +364,57 @@ private:
     int64_t bytes_written_to_this_interval = 0;
     int64_t bytes_read_from_this_interval = 0;
 
+    #ifdef CACHE_PAGE_COMPRESSION
+    PageCompressionCache page_cache;
+    #endif
+
+    #ifdef TRAIN_SITE_DICTIONARIES
+    SiteDictionaries site_dictionaries;
+    #endif
+
+    #ifdef MEASURE_DECOMPRESSION
+    // Indexed by compression type, age class, and whether the page was written
+    DecompressionStats decompression_stats[MAX_COMPRESSION_TYPES][4][2];
+    CSV<20, 10000> decompression_csv;
+    StackFile decompression_file;
+    #endif
+
+    #ifdef TRACK_PAGE_DEDUPLICATION
+    PageDedupTable page_dedup;
+    CSV<20, 10000> dedup_csv;
+    StackFile dedup_file;
+    #endif
+
+    #ifdef SWEEP_COMPRESSION_SETTINGS
+    CompressionSweep compression_sweep;
+    CSV<20, 1000> sweep_csv;
+    StackFile sweep_file;
+    #endif
+
+    #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+    CrossPageRedundancy cross_page;
+    CSV<20, 10000> cross_page_csv;
+    StackFile cross_page_file;
+    #endif
+
+    #ifdef TRACK_LINE_COMPRESSION
+    LineSizeHistogram line_sizes[MAX_COMPRESSION_TYPES];
+    CSV<20, 1000> line_csv;
+    StackFile line_file;
+    #endif
+
+    #ifdef SWEEP_PAGE_GRANULARITIES
+    GranularitySweep granularity_sweep;
+    CSV<20, 1000> granularity_csv;
+    StackFile granularity_file;
+    #endif
+
+    #ifdef SIMULATE_COMPRESSED_POOL
+    CompressedPool compressed_pool;
+    CSV<20, 10000> pool_csv;
+    StackFile pool_file;
+    #endif
+
     StackSet<HugePage, 30000> huge_page_liveset;
     StackSet<Allocation, 30000> accessed_this_interval,
                                 write_accessed_this_interval,
@@ -120,53 +430,77 @@ private:
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
 
-        object_file = StackFile(StackString<256>("object-compression.csv"), Mode::APPEND);
+        #ifdef COLUMNAR_OUTPUT
+        object_file = StackFile(StackString<256>(OBJECT_TABLE_NAME ".hpcol" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        object_csv.set_format(CSVFormat::COLUMNAR);
+        page_file = StackFile(StackString<256>(PAGE_TABLE_NAME ".hpcol" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        page_csv.set_format(CSVFormat::COLUMNAR);
+        #else
+        object_file = StackFile(StackString<256>(OBJECT_TABLE_NAME ".csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        page_file = StackFile(StackString<256>(PAGE_TABLE_NAME ".csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        #endif
         object_file.clear();
-        page_file = StackFile(StackString<256>("page-compression.csv"), Mode::APPEND);
         page_file.clear();
-        huge_page_file = StackFile(StackString<256>("huge-page-compression.csv"), Mode::APPEND);
+        huge_page_file = StackFile(StackString<256>("huge-page-compression.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         huge_page_file.clear();
-        interval_file = StackFile(StackString<256>("interval-info.csv"), Mode::APPEND);
+        interval_file = StackFile(StackString<256>("interval-info.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         interval_file.clear();
+        #ifdef MEASURE_DECOMPRESSION
+        decompression_file = StackFile(StackString<256>("decompression.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        decompression_file.clear();
+        #endif
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        dedup_file = StackFile(StackString<256>("page-dedup.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        dedup_file.clear();
+        #endif
+        #ifdef SWEEP_COMPRESSION_SETTINGS
+        sweep_file = StackFile(StackString<256>("compression-sweep.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        sweep_file.clear();
+        for (size_t i=0; i<sizeof(COMPRESSION_SWEEP_SETTINGS) / sizeof(COMPRESSION_SWEEP_SETTINGS[0]); i++) {
+            compression_sweep.add(COMPRESSION_SWEEP_SETTINGS[i]);
+        }
+        for (size_t i=0; i<sizeof(COMPRESSION_SWEEP_BLOCK_SIZES) / sizeof(COMPRESSION_SWEEP_BLOCK_SIZES[0]); i++) {
+            compression_sweep.add_block_size(COMPRESSION_SWEEP_BLOCK_SIZES[i]);
+        }
+        CompressionSweep::add_titles(sweep_csv);
+        #endif
+        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+        cross_page_file = StackFile(StackString<256>("cross-page-redundancy.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        cross_page_file.clear();
+        CrossPageRedundancy::add_titles(cross_page_csv);
+        #endif
+        #ifdef TRACK_LINE_COMPRESSION
+        line_file = StackFile(StackString<256>("line-compression.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        line_file.clear();
+        #endif
+        #ifdef SWEEP_PAGE_GRANULARITIES
+        granularity_file = StackFile(StackString<256>("granularity-compression.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        granularity_file.clear();
+        for (size_t i=0; i<sizeof(PAGE_GRANULARITIES) / sizeof(PAGE_GRANULARITIES[0]); i++) {
+            granularity_sweep.add(PAGE_GRANULARITIES[i]);
+        }
+        GranularitySweep::add_titles(granularity_csv);
+        #endif
+        #ifdef SIMULATE_COMPRESSED_POOL
+        pool_file = StackFile(StackString<256>("compressed-pool.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        pool_file.clear();
+        CompressedPool::add_titles(pool_csv);
+        #endif
 
-        object_csv.title().add("Interval #");
-        object_csv.title().add("Allocation Site");
-        object_csv.title().add("Age (intervals)");
-        object_csv.title().add("Age Class");
-        object_csv.title().add("Object Address");
-        object_csv.title().add("Size (bytes)");
-        object_csv.title().add("Compression Type");
-        object_csv.title().add("Compressed Size (bytes)");
-        object_csv.title().add("Compression Ratio (compressed/uncompressed)");
-        object_csv.title().add("Compression Class"); // 0-10%, 10-20%, 20-30%, 30-40%, 40-50%, 50-60%, 60-70%, 70-80%, 80-90%, 90-100%
-        object_csv.title().add("Access Type"); // Read, Read/Write
-
-        page_csv.title().add("Interval #");
-        page_csv.title().add("Allocation Site");
-        page_csv.title().add("Age (intervals)");
-        page_csv.title().add("Age Class");
-        page_csv.title().add("Virtual Page Address");
-        page_csv.title().add("Physical Page Address");
-        page_csv.title().add("Size (bytes)");
-        page_csv.title().add("Compression Type");
-        page_csv.title().add("Compressed Size (bytes)");
-        page_csv.title().add("Compression Ratio (compressed/uncompressed)");
-        page_csv.title().add("Compression Class"); // 0-10%, 10-20%, 20-30%, 30-40%, 40-50%, 50-60%, 60-70%, 70-80%, 80-90%, 90-100%
-        page_csv.title().add("Access Type"); // Read, Read/Write
-        page_csv.title().add("Size Occupied (bytes)");
-
-        huge_page_csv.title().add("Interval #");
-        huge_page_csv.title().add("Age (intervals)");
-        huge_page_csv.title().add("Age Class");
-        huge_page_csv.title().add("Huge Page Address");
-        huge_page_csv.title().add("Page Address");
-        huge_page_csv.title().add("Size (bytes)");
-        huge_page_csv.title().add("Compression Type");
-        huge_page_csv.title().add("Compressed Size (bytes)");
-        huge_page_csv.title().add("Compression Ratio (compressed/uncompressed)");
-        huge_page_csv.title().add("Compression Class"); // 0-10%, 10-20%, 20-30%, 30-40%, 40-50%, 50-60%, 60-70%, 70-80%, 80-90%, 90-100%
-        huge_page_csv.title().add("Access Type"); // Read, Read/Write
-        huge_page_csv.title().add("Size Occupied (bytes)");
+        #ifdef MEASURE_DECOMPRESSION
+        decompression_csv.title().add("Interval #");
+        decompression_csv.title().add("Compression Type");
+        decompression_csv.title().add("Age Class");
+        decompression_csv.title().add("Access Type");
+        decompression_csv.title().add("Pages");
+        decompression_csv.title().add("Uncompressed Size (bytes)");
+        decompression_csv.title().add("Compressed Size (bytes)");
+        decompression_csv.title().add("Compression Ratio (compressed/uncompressed)");
+        decompression_csv.title().add("Mean Decompression Time (ns)");
+        decompression_csv.title().add("Max Decompression Time (ns)");
+        decompression_csv.title().add("Decompression Throughput (MB/s)");
+        decompression_csv.title().add("Round-Trip Failures");
+        #endif
 
         interval_csv.title().add("Interval #");
         interval_csv.title().add("Live Objects");
@@ -178,27 +512,38 @@ private:
         interval_csv.title().add("Total Memory Freed");
         interval_csv.title().add("Memory Allocated This Interval");
         interval_csv.title().add("Memory Freed This Interval");
+        #ifdef CACHE_PAGE_COMPRESSION
+        interval_csv.title().add("Page Cache Hits");
+        interval_csv.title().add("Page Cache Misses");
+        interval_csv.title().add("Page Cache Hit Rate");
+        #endif
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        interval_csv.title().add("Duplicate Page Groups");
+        interval_csv.title().add("Duplicate Pages");
+        interval_csv.title().add("Cross-Site Duplicate Pages");
+        interval_csv.title().add("Dedup Savings (bytes)");
+
+        dedup_csv.title().add("Interval #");
+        dedup_csv.title().add("Allocation Site");
+        dedup_csv.title().add("Resident Pages");
+        dedup_csv.title().add("Duplicate Pages");
+        dedup_csv.title().add("Cross-Site Duplicate Pages");
+        dedup_csv.title().add("Dedup Savings (bytes)");
+        #endif
+
+        #ifdef TRACK_LINE_COMPRESSION
+        line_csv.title().add("Interval #");
+        line_csv.title().add("Compression Type");
+        line_csv.title().add("Compressed Line Size (bytes)");
+        line_csv.title().add("Lines");
+        line_csv.title().add("Fraction of Lines");
+        #endif
 
         // interval_csv.title().add("Compression Type");
         // interval_csv.title().add("Compressed Size (bytes)");
         // interval_csv.title().add("Compression Ratio (compressed/uncompressed)");
         // interval_csv.title().add("Compression Class");
 
-        #ifdef TRACK_ACCESSES
-        object_csv.title().add("Accessed?");
-        object_csv.title().add("Read?");
-        object_csv.title().add("Written?");
-        object_csv.title().add("Unaccessed?");
-        page_csv.title().add("Accessed?");
-        page_csv.title().add("Read?");
-        page_csv.title().add("Written?");
-        page_csv.title().add("Unaccessed?");
-        huge_page_csv.title().add("Accessed?");
-        huge_page_csv.title().add("Read?");
-        huge_page_csv.title().add("Written?");
-        huge_page_csv.title().add("Unaccessed?");
-        #endif
-
         object_csv.write(object_file);
         object_csv.clear();
 
@@ -211,6 +556,37 @@ private:
         interval_csv.write(interval_file);
         interval_csv.clear();
 
+        #ifdef MEASURE_DECOMPRESSION
+        decompression_csv.write(decompression_file);
+        decompression_csv.clear();
+        #endif
+
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        dedup_csv.write(dedup_file);
+        dedup_csv.clear();
+        #endif
+
+        #ifdef SWEEP_COMPRESSION_SETTINGS
+        sweep_csv.write(sweep_file);
+        sweep_csv.clear();
+        #endif
+        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+        cross_page_csv.write(cross_page_file);
+        cross_page_csv.clear();
+        #endif
+        #ifdef TRACK_LINE_COMPRESSION
+        line_csv.write(line_file);
+        line_csv.clear();
+        #endif
+        #ifdef SWEEP_PAGE_GRANULARITIES
+        granularity_csv.write(granularity_file);
+        granularity_csv.clear();
+        #endif
+        #ifdef SIMULATE_COMPRESSED_POOL
+        pool_csv.write(pool_file);
+        pool_csv.clear();
+        #endif
+
         interval_count = 0;
     }
 
@@ -376,6 +752,34 @@ private:
         interval_csv.write(interval_file);
         interval_csv.clear();
         stack_debugf("Wrote %d rows to interval file\n", interval_csv.size());
+        #ifdef MEASURE_DECOMPRESSION
+        decompression_csv.write(decompression_file);
+        decompression_csv.clear();
+        #endif
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        dedup_csv.write(dedup_file);
+        dedup_csv.clear();
+        #endif
+        #ifdef SWEEP_COMPRESSION_SETTINGS
+        sweep_csv.write(sweep_file);
+        sweep_csv.clear();
+        #endif
+        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+        cross_page_csv.write(cross_page_file);
+        cross_page_csv.clear();
+        #endif
+        #ifdef TRACK_LINE_COMPRESSION
+        line_csv.write(line_file);
+        line_csv.clear();
+        #endif
+        #ifdef SWEEP_PAGE_GRANULARITIES
+        granularity_csv.write(granularity_file);
+        granularity_csv.clear();
+        #endif
+        #ifdef SIMULATE_COMPRESSED_POOL
+        pool_csv.write(pool_file);
+        pool_csv.clear();
+        #endif
         stack_infof("Interval %d complete for %s test\n", interval_count, name());
     }
 
@@ -396,76 +800,98 @@ private:
         return page_info.is_dirty();
     }
 
-    CSVString age_class(uint64_t age) {
+    size_t age_class_index(uint64_t age) const {
         if (age == 0) {
-            return "New";
+            return 0;
         } else if (age < 5) {
-            return "Young";
+            return 1;
         } else if (age < 10) {
-            return "Middle-aged";
+            return 2;
         } else {
-            return "Old";
+            return 3;
         }
     }
 
-    CSVString compression_class(size_t compressed_size, size_t uncompressed_size) {
+    CSVString age_class_name(size_t index) {
+        return csv_enum_name((AgeClass)index);
+    }
+
+    AgeClass age_class(uint64_t age) {
+        return (AgeClass)age_class_index(age);
+    }
+
+    template <typename T>
+    AccessType access_type(T &object) const {
+        return is_write(object) ? AccessType::READ_WRITE : AccessType::READ;
+    }
+
+    CompressionClass compression_class(size_t compressed_size, size_t uncompressed_size) {
         if (uncompressed_size == 0) {
-            return "N/A";
+            return CompressionClass::NOT_APPLICABLE;
         }
 
         double ratio = (double)compressed_size / (double)uncompressed_size;
         if (ratio < 0.1) {
-            return "0-10%";
+            return CompressionClass::PERCENT_0_10;
         } else if (ratio < 0.2) {
-            return "10-20%";
+            return CompressionClass::PERCENT_10_20;
         } else if (ratio < 0.3) {
-            return "20-30%";
+            return CompressionClass::PERCENT_20_30;
         } else if (ratio < 0.4) {
-            return "30-40%";
+            return CompressionClass::PERCENT_30_40;
         } else if (ratio < 0.5) {
-            return "40-50%";
+            return CompressionClass::PERCENT_40_50;
         } else if (ratio < 0.6) {
-            return "50-60%";
+            return CompressionClass::PERCENT_50_60;
         } else if (ratio < 0.7) {
-            return "60-70%";
+            return CompressionClass::PERCENT_60_70;
         } else if (ratio < 0.8) {
-            return "70-80%";
+            return CompressionClass::PERCENT_70_80;
         } else if (ratio < 0.9) {
-            return "80-90%";
+            return CompressionClass::PERCENT_80_90;
         } else {
-            return "90-100%";
+            return CompressionClass::PERCENT_90_100;
+        }
+    }
+
+    // Compress small buffers in one call, and stream larger ones through the
+    // compressor block by block so they are measured in full
+    uint64_t compress_buffer(Compressor<sizeof(compressed_buffer), false> &compressor, const uint8_t *buffer, size_t size) {
+        if (size <= COMPRESSION_STREAM_BLOCK_SIZE) {
+            return compressor.compress(buffer, size, compressed_buffer, sizeof(compressed_buffer));
         }
+        return compressor.compress_stream(buffer, size);
     }
 
     void track_huge_pages(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites, CompressionType compression_type) {
         Compressor<sizeof(compressed_buffer), false> compressor(compression_type);
         huge_page_liveset.map([&](HugePage &page) {
             auto &row = huge_page_csv.new_row();
-            row.set(huge_page_csv.title(), "Interval #", interval_count);
-            row.set(huge_page_csv.title(), "Huge Page Address", (void*)page.address);
-            row.set(huge_page_csv.title(), "Age (intervals)", page.age);
-            row.set(huge_page_csv.title(), "Age Class", age_class(page.age));
-            row.set(huge_page_csv.title(), "Size (bytes)", page.size);
-            row.set(huge_page_csv.title(), "Compression Type", compression_to_string(compression_type));
+            row.set<IntervalColumn>(interval_count);
+            row.set<HugePageAddressColumn>((void*)page.address);
+            row.set<AgeColumn>(page.age);
+            row.set<AgeClassColumn>(age_class(page.age));
+            row.set<SizeColumn>(page.size);
+            row.set<CompressionTypeColumn>(compression_type);
             uint64_t uncompressed_size = page.size;
-            uint64_t compressed_size = compressor.compress((const uint8_t*)page.address, uncompressed_size, compressed_buffer, sizeof(compressed_buffer));
-            row.set(huge_page_csv.title(), "Compressed Size (bytes)", compressed_size);
+            uint64_t compressed_size = compress_buffer(compressor, (const uint8_t*)page.address, uncompressed_size);
+            row.set<CompressedSizeColumn>(compressed_size);
             if (uncompressed_size == 0) {
-                row.set(huge_page_csv.title(), "Compression Ratio (compressed/uncompressed)", 1.0);
+                row.set<CompressionRatioColumn>(1.0);
             } else {
-                row.set(huge_page_csv.title(), "Compression Ratio (compressed/uncompressed)", (double)compressed_size / (double)uncompressed_size);
+                row.set<CompressionRatioColumn>((double)compressed_size / (double)uncompressed_size);
             }
             // Compression class
-            row.set(huge_page_csv.title(), "Compression Class", compression_class(compressed_size, uncompressed_size));
-            row.set(huge_page_csv.title(), "Access Type", is_write(page) ? "Read/Write" : "Read");
-            row.set(huge_page_csv.title(), "Size Occupied (bytes)", count_bytes_used_huge_page(allocation_sites, page));
+            row.set<CompressionClassColumn>(compression_class(compressed_size, uncompressed_size));
+            row.set<AccessTypeColumn>(access_type(page));
+            row.set<SizeOccupiedColumn>(count_bytes_used_huge_page(allocation_sites, page));
 
 
             #ifdef TRACK_ACCESSES
-            row.set(huge_page_csv.title(), "Accessed?", page.accessed);
-            row.set(huge_page_csv.title(), "Read?", page.read_from);
-            row.set(huge_page_csv.title(), "Written?", page.written_to);
-            row.set(huge_page_csv.title(), "Unaccessed?", !page.accessed);
+            row.set<AccessedColumn>(page.accessed);
+            row.set<ReadColumn>(page.read_from);
+            row.set<WrittenColumn>(page.written_to);
+            row.set<UnaccessedColumn>(!page.accessed);
             #endif
 
             if (huge_page_csv.full()) {
@@ -499,12 +925,51 @@ private:
         return total_bytes_used_huge_page;
     }
 
-    void track_physical_pages(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites, CompressionType compression_type) {
+    uint64_t compress_page(const PageInfo &page_info, CompressionType compression_type, uint64_t &computed_interval, uint64_t &decompression_nanoseconds, bool &round_trip_ok) {
+        uint64_t compressed_size;
+        decompression_nanoseconds = 0;
+        round_trip_ok = true;
+        #ifdef CACHE_PAGE_COMPRESSION
+        if (page_cache.lookup(page_info, compression_type, interval_count, compressed_size, computed_interval)) {
+            return compressed_size;
+        }
+        #endif
+
         Compressor<sizeof(compressed_buffer), false> compressor(compression_type);
+        compressed_size = compressor.compress((const uint8_t*)page_info.get_virtual_address(), page_info.size(), compressed_buffer, sizeof(compressed_buffer));
+        computed_interval = interval_count;
+
+        #ifdef MEASURE_DECOMPRESSION
+        // A page the program writes to between the two steps also shows up as a failure
+        static uint8_t decompressed_page[PAGE_SIZE];
+        Timer timer;
+        size_t decompressed_size = compressor.decompress(compressed_buffer, compressed_size, decompressed_page, sizeof(decompressed_page));
+        decompression_nanoseconds = timer.elapsed_nanoseconds();
+        round_trip_ok = compressed_size > 0
+            && decompressed_size == page_info.size()
+            && memcmp(decompressed_page, page_info.get_virtual_address(), page_info.size()) == 0;
+        #endif
 
+        #ifdef CACHE_PAGE_COMPRESSION
+        page_cache.store(page_info, compression_type, compressed_size, interval_count);
+        #endif
+        return compressed_size;
+    }
+
+    void track_physical_pages(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites, const StackVec<CompressionType, 20> &types) {
         static StackSet<PageInfo, 10000000> tracked_pages;
         tracked_pages.clear();
+        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+        #ifdef CROSS_PAGE_WHOLE_HEAP
+        cross_page.begin(true);
+        #else
+        cross_page.begin(false);
+        #endif
+        #endif
         allocation_sites.map([&](auto return_address, AllocationSite site) {
+            #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+            cross_page.begin_site(return_address);
+            #endif
             site.allocations.map([&](void *ptr, Allocation allocation) {
                 auto physical_pages = allocation.physical_pages<30000>();
 
@@ -514,40 +979,198 @@ private:
                     } else {
                         tracked_pages.insert(page_info);
                     }
-                    auto &row = page_csv.new_row();
-                    row.set(page_csv.title(), "Interval #", interval_count);
-                    row.set(page_csv.title(), "Allocation Site", (void*)return_address);
-                    row.set(page_csv.title(), "Age (intervals)", allocation.age);
-                    row.set(page_csv.title(), "Age Class", age_class(allocation.age));
-                    row.set(page_csv.title(), "Virtual Page Address", (void*)page_info.get_virtual_address());
-                    row.set(page_csv.title(), "Physical Page Address", (void*)page_info.get_physical_address());
-                    row.set(page_csv.title(), "Size (bytes)", page_info.size());
-                    row.set(page_csv.title(), "Compression Type", compression_to_string(compression_type));
-                    uint64_t uncompressed_size = page_info.size();
-                    uint64_t compressed_size = compressor.compress((const uint8_t*)page_info.get_virtual_address(), uncompressed_size, compressed_buffer, sizeof(compressed_buffer));
-                    row.set(page_csv.title(), "Compressed Size (bytes)", compressed_size);
-                    if (uncompressed_size == 0) {
-                        row.set(page_csv.title(), "Compression Ratio (compressed/uncompressed)", 1.0);
-                    } else {
-                        row.set(page_csv.title(), "Compression Ratio (compressed/uncompressed)", (double)compressed_size / (double)uncompressed_size);
+                    #ifdef TRACK_PAGE_DEDUPLICATION
+                    page_dedup.insert(page_info, return_address);
+                    #endif
+                    #ifdef SWEEP_COMPRESSION_SETTINGS
+                    compression_sweep.sample((const uint8_t*)page_info.get_virtual_address(), page_info.size());
+                    #endif
+                    #ifdef SWEEP_PAGE_GRANULARITIES
+                    granularity_sweep.sample((uintptr_t)page_info.get_virtual_address(), page_info.size(), types);
+                    #endif
+                    #ifdef TRACK_LINE_COMPRESSION
+                    for (size_t i=0; i<types.size(); i++) {
+                        LineCompressFunction compress_line = line_compress_function(types[i]);
+                        if (compress_line != nullptr) {
+                            line_sizes[types[i] % MAX_COMPRESSION_TYPES].add(compress_line, (const uint8_t*)page_info.get_virtual_address(), page_info.size());
+                        }
                     }
-                    // Compression class
-                    row.set(page_csv.title(), "Compression Class", compression_class(compressed_size, uncompressed_size));
-                    row.set(page_csv.title(), "Access Type", is_write(page_info) ? "Read/Write" : "Read");
-                    row.set(page_csv.title(), "Size Occupied (bytes)", count_bytes_used_4k_page(allocation_sites, page_info));
-
-                    #ifdef TRACK_ACCESSES
-                    //! TODO
+                    #endif
+                    // Everything but the compressed size is shared between compression types
+                    uint64_t size_occupied = count_bytes_used_4k_page(allocation_sites, page_info);
+                    #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+                    uint64_t zstd_page_size = 0;
                     #endif
 
-                    if (page_csv.full()) {
-                        page_csv.write(page_file);
-                        page_csv.clear();
+                    for (size_t i=0; i<types.size(); i++) {
+                        CompressionType compression_type = types[i];
+                        auto &row = page_csv.new_row();
+                        row.set<IntervalColumn>(interval_count);
+                        row.set<AllocationSiteColumn>((void*)return_address);
+                        row.set<AgeColumn>(allocation.age);
+                        row.set<AgeClassColumn>(age_class(allocation.age));
+                        row.set<VirtualPageAddressColumn>((void*)page_info.get_virtual_address());
+                        row.set<PhysicalPageAddressColumn>((void*)page_info.get_physical_address());
+                        row.set<SizeColumn>(page_info.size());
+                        row.set<CompressionTypeColumn>(compression_type);
+                        uint64_t uncompressed_size = page_info.size();
+                        uint64_t computed_interval = interval_count, decompression_nanoseconds;
+                        bool round_trip_ok;
+                        uint64_t compressed_size = compress_page(page_info, compression_type, computed_interval, decompression_nanoseconds, round_trip_ok);
+                        row.set<CompressedSizeColumn>(compressed_size);
+                        #ifdef SIMULATE_COMPRESSED_POOL
+                        compressed_pool.add(compression_type, uncompressed_size, compressed_size);
+                        #endif
+                        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+                        if (compression_type == COMPRESS_ZSTD) {
+                            zstd_page_size = compressed_size;
+                        }
+                        #endif
+                        if (uncompressed_size == 0) {
+                            row.set<CompressionRatioColumn>(1.0);
+                        } else {
+                            row.set<CompressionRatioColumn>((double)compressed_size / (double)uncompressed_size);
+                        }
+                        // Compression class
+                        row.set<CompressionClassColumn>(compression_class(compressed_size, uncompressed_size));
+                        row.set<AccessTypeColumn>(access_type(page_info));
+                        row.set<SizeOccupiedColumn>(size_occupied);
+                        row.set<CompressedInIntervalColumn>(computed_interval);
+                        #ifdef MEASURE_DECOMPRESSION
+                        row.set<DecompressionTimeColumn>(decompression_nanoseconds);
+                        if (computed_interval == interval_count) {
+                            // Only pages compressed this interval were round-tripped
+                            auto &stats = decompression_stats[compression_type % MAX_COMPRESSION_TYPES][age_class_index(allocation.age)][is_write(page_info)];
+                            stats.pages++;
+                            stats.uncompressed_size += uncompressed_size;
+                            stats.compressed_size += compressed_size;
+                            stats.total_nanoseconds += decompression_nanoseconds;
+                            stats.max_nanoseconds = stats.max_nanoseconds > decompression_nanoseconds ? stats.max_nanoseconds : decompression_nanoseconds;
+                            stats.failures += !round_trip_ok;
+                        }
+                        #endif
+
+                        #ifdef TRACK_ACCESSES
+                        //! TODO
+                        #endif
+
+                        #ifdef DELTA_OUTPUT
+                        DeltaState state = {interval_count, return_address, allocation.age, uncompressed_size, compressed_size, (uintptr_t)page_info.get_physical_address(), is_write(page_info)};
+                        keep_if_changed(page_csv, row, page_deltas, {(uintptr_t)page_info.get_virtual_address(), 0, compression_type}, state);
+                        #endif
+
+                        if (page_csv.full()) {
+                            page_csv.write(page_file);
+                            page_csv.clear();
+                        }
                     }
+                    #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+                    cross_page.add_page((const uint8_t*)page_info.get_virtual_address(), page_info.size(), zstd_page_size);
+                    #endif
                 });
             });
+            #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+            cross_page.end_site();
+            #endif
         });
+        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+        cross_page.end();
+        #endif
+    }
+
+    #ifdef MEASURE_DECOMPRESSION
+    void track_decompression(const StackVec<CompressionType, 20> &types) {
+        for (size_t i=0; i<types.size(); i++) {
+            CompressionType compression_type = types[i];
+            for (size_t age_index=0; age_index<4; age_index++) {
+                for (size_t written=0; written<2; written++) {
+                    auto &stats = decompression_stats[compression_type % MAX_COMPRESSION_TYPES][age_index][written];
+                    if (stats.pages == 0) {
+                        continue;
+                    }
+                    auto &row = decompression_csv.new_row();
+                    row.set(decompression_csv.title(), "Interval #", interval_count);
+                    row.set(decompression_csv.title(), "Compression Type", compression_to_string(compression_type));
+                    row.set(decompression_csv.title(), "Age Class", age_class_name(age_index));
+                    row.set(decompression_csv.title(), "Access Type", csv_enum_name(written ? AccessType::READ_WRITE : AccessType::READ));
+                    row.set(decompression_csv.title(), "Pages", stats.pages);
+                    row.set(decompression_csv.title(), "Uncompressed Size (bytes)", stats.uncompressed_size);
+                    row.set(decompression_csv.title(), "Compressed Size (bytes)", stats.compressed_size);
+                    row.set(decompression_csv.title(), "Compression Ratio (compressed/uncompressed)", (double)stats.compressed_size / (double)stats.uncompressed_size);
+                    row.set(decompression_csv.title(), "Mean Decompression Time (ns)", stats.total_nanoseconds / stats.pages);
+                    row.set(decompression_csv.title(), "Max Decompression Time (ns)", stats.max_nanoseconds);
+                    // Bytes per nanosecond is GB/s, so scale up to MB/s
+                    row.set(decompression_csv.title(), "Decompression Throughput (MB/s)", stats.total_nanoseconds == 0 ? 0.0 : (double)stats.uncompressed_size * 1000.0 / (double)stats.total_nanoseconds);
+                    row.set(decompression_csv.title(), "Round-Trip Failures", stats.failures);
+                    stats = DecompressionStats();
+
+                    if (decompression_csv.full()) {
+                        decompression_csv.write(decompression_file);
+                        decompression_csv.clear();
+                    }
+                }
+            }
+        }
+    }
+    #endif
+
+    #ifdef TRACK_PAGE_DEDUPLICATION
+    void track_page_deduplication() {
+        page_dedup.map_sites([&](const uintptr_t &return_address, const SiteDedupStats &stats) {
+            auto &row = dedup_csv.new_row();
+            row.set(dedup_csv.title(), "Interval #", interval_count);
+            row.set(dedup_csv.title(), "Allocation Site", (void*)return_address);
+            row.set(dedup_csv.title(), "Resident Pages", stats.resident_pages);
+            row.set(dedup_csv.title(), "Duplicate Pages", stats.duplicate_pages);
+            row.set(dedup_csv.title(), "Cross-Site Duplicate Pages", stats.cross_site_duplicate_pages);
+            row.set(dedup_csv.title(), "Dedup Savings (bytes)", stats.savings());
+
+            if (dedup_csv.full()) {
+                dedup_csv.write(dedup_file);
+                dedup_csv.clear();
+            }
+        });
+    }
+    #endif
+
+    #ifdef TRACK_LINE_COMPRESSION
+    static LineCompressFunction line_compress_function(CompressionType compression_type) {
+        switch (compression_type) {
+            #ifdef USE_BDI_COMPRESSION
+            case COMPRESS_BDI:
+                return bdi_compress_line;
+            #endif
+            #ifdef USE_FPC_COMPRESSION
+            case COMPRESS_FPC:
+                return fpc_compress_line;
+            #endif
+            default:
+                return nullptr;
+        }
+    }
+
+    void track_line_compression(const StackVec<CompressionType, 20> &types) {
+        for (size_t i=0; i<types.size(); i++) {
+            if (line_compress_function(types[i]) == nullptr) {
+                continue;
+            }
+            LineSizeHistogram &histogram = line_sizes[types[i] % MAX_COMPRESSION_TYPES];
+            uint64_t total = histogram.total();
+            for (size_t size=0; size<=MAX_COMPRESSED_LINE_SIZE; size++) {
+                if (histogram.lines[size] == 0) {
+                    continue;
+                }
+                auto &row = line_csv.new_row();
+                row.set(line_csv.title(), "Interval #", interval_count);
+                row.set(line_csv.title(), "Compression Type", compression_to_string(types[i]));
+                row.set(line_csv.title(), "Compressed Line Size (bytes)", (uint64_t)size);
+                row.set(line_csv.title(), "Lines", histogram.lines[size]);
+                row.set(line_csv.title(), "Fraction of Lines", (double)histogram.lines[size] / (double)total);
+            }
+            histogram.clear();
+        }
     }
+    #endif
 
     void track_objects(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites, CompressionType compression_type) {
         Compressor<sizeof(compressed_buffer), false> compressor(compression_type);
@@ -557,30 +1180,48 @@ private:
                 if (i++ > 8000) return;
                 // allocation.protect(PROT_READ);
                 auto &row = object_csv.new_row();
-                row.set(object_csv.title(), "Interval #", interval_count);
-                row.set(object_csv.title(), "Object Address", (void*)ptr);
-                row.set(object_csv.title(), "Allocation Site", (void*)return_address);
-                row.set(object_csv.title(), "Age (intervals)", allocation.age);
-                row.set(object_csv.title(), "Age Class", age_class(allocation.age));
-                row.set(object_csv.title(), "Size (bytes)", allocation.size);
-                row.set(object_csv.title(), "Compression Type", compression_to_string(compression_type));
-                uint64_t uncompressed_size = min(allocation.size, sizeof(compressed_buffer));
-                uint64_t compressed_size = compressor.compress((const uint8_t*)ptr, uncompressed_size, compressed_buffer, sizeof(compressed_buffer));
-                row.set(object_csv.title(), "Compressed Size (bytes)", compressed_size);
+                row.set<IntervalColumn>(interval_count);
+                row.set<ObjectAddressColumn>((void*)ptr);
+                row.set<AllocationSiteColumn>((void*)return_address);
+                row.set<AgeColumn>(allocation.age);
+                row.set<AgeClassColumn>(age_class(allocation.age));
+                row.set<SizeColumn>(allocation.size);
+                row.set<CompressionTypeColumn>(compression_type);
+                uint64_t uncompressed_size = allocation.size;
+                uint64_t compressed_size = compress_buffer(compressor, (const uint8_t*)ptr, uncompressed_size);
+                row.set<CompressedSizeColumn>(compressed_size);
                 if (uncompressed_size == 0) {
-                    row.set(object_csv.title(), "Compression Ratio (compressed/uncompressed)", 1.0);
+                    row.set<CompressionRatioColumn>(1.0);
                 } else {
-                    row.set(object_csv.title(), "Compression Ratio (compressed/uncompressed)", (double)compressed_size / (double)uncompressed_size);
+                    row.set<CompressionRatioColumn>((double)compressed_size / (double)uncompressed_size);
                 }
                 // Compression class
-                row.set(object_csv.title(), "Compression Class", compression_class(compressed_size, uncompressed_size));
-                row.set(object_csv.title(), "Access Type", is_write(allocation) ? "Read/Write" : "Read");
+                row.set<CompressionClassColumn>(compression_class(compressed_size, uncompressed_size));
+                AccessType access = access_type(allocation);
+                row.set<AccessTypeColumn>(access);
+
+                #ifdef TRAIN_SITE_DICTIONARIES
+                if (compression_type == COMPRESS_ZSTD && uncompressed_size <= SITE_DICTIONARY_MAX_OBJECT_SIZE) {
+                    uint64_t dictionary_compressed_size = site_dictionaries.compress(return_address, (const uint8_t*)ptr, uncompressed_size, compressed_buffer, sizeof(compressed_buffer));
+                    if (dictionary_compressed_size > 0) {
+                        row.set<DictionarySizeColumn>(site_dictionaries.dictionary_size(return_address));
+                        row.set<DictionaryCompressedSizeColumn>(dictionary_compressed_size);
+                        row.set<DictionaryCompressionRatioColumn>((double)dictionary_compressed_size / (double)uncompressed_size);
+                    }
+                    site_dictionaries.sample(interval_count, return_address, site.allocations.num_entries(), allocation.age, (const uint8_t*)ptr, uncompressed_size);
+                }
+                #endif
 
                 #ifdef TRACK_ACCESSES
-                row.set(object_csv.title(), "Accessed?", accessed_this_interval.has(allocation));
-                row.set(object_csv.title(), "Read?", read_accessed_this_interval.has(allocation));
-                row.set(object_csv.title(), "Written?", write_accessed_this_interval.has(allocation));
-                row.set(object_csv.title(), "Unaccessed?", !accessed_this_interval.has(allocation));
+                row.set<AccessedColumn>(accessed_this_interval.has(allocation));
+                row.set<ReadColumn>(read_accessed_this_interval.has(allocation));
+                row.set<WrittenColumn>(write_accessed_this_interval.has(allocation));
+                row.set<UnaccessedColumn>(!accessed_this_interval.has(allocation));
+                #endif
+
+                #ifdef DELTA_OUTPUT
+                DeltaState state = {interval_count, return_address, allocation.age, uncompressed_size, compressed_size, 0, access == AccessType::READ_WRITE};
+                keep_if_changed(object_csv, row, object_deltas, {(uintptr_t)ptr, return_address, compression_type}, state);
                 #endif
 
                 if (object_csv.full()) {
@@ -591,6 +1232,42 @@ private:
         });
     }
 
+    #ifdef DELTA_OUTPUT
+    // Keep the row just filled in only if it's for a birth or a change
+    template <typename Table>
+    void keep_if_changed(Table &table, typename Table::Row &row, DeltaTracker<> &deltas, const DeltaKey &key, const DeltaState &state) {
+        DeltaEvent event;
+        if (deltas.update(key, state, event)) {
+            row.template set<EventColumn>(event);
+        } else {
+            table.pop_row();
+        }
+    }
+
+    // Write a death row for everything that had a row last interval but not
+    // this one, then the row marking the interval complete
+    template <typename AddressColumn, typename Table>
+    void end_delta_interval(Table &table, DeltaTracker<> &deltas, StackFile &file) {
+        deltas.end_interval([&](const DeltaKey &key) {
+            auto &row = table.new_row();
+            row.template set<IntervalColumn>(interval_count);
+            row.template set<EventColumn>(DeltaEvent::DEATH);
+            row.template set<AddressColumn>((void*)key.address);
+            if (key.site != 0) {
+                row.template set<AllocationSiteColumn>((void*)key.site);
+            }
+            row.template set<CompressionTypeColumn>(key.type);
+            if (table.full()) {
+                table.write(file);
+                table.clear();
+            }
+        });
+        auto &row = table.new_row();
+        row.template set<IntervalColumn>(interval_count);
+        row.template set<EventColumn>(DeltaEvent::END);
+    }
+    #endif
+
     void track_interval_info(
         const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites
     ) {
@@ -619,6 +1296,23 @@ private:
         row.set(interval_csv.title(), "Total Memory Freed", total_memory_freed);
         row.set(interval_csv.title(), "Memory Allocated This Interval", memory_allocated_since_last_interval);
         row.set(interval_csv.title(), "Memory Freed This Interval", memory_freed_since_last_interval);
+
+        #ifdef CACHE_PAGE_COMPRESSION
+        row.set(interval_csv.title(), "Page Cache Hits", page_cache.get_hits());
+        row.set(interval_csv.title(), "Page Cache Misses", page_cache.get_misses());
+        row.set(interval_csv.title(), "Page Cache Hit Rate", page_cache.hit_rate());
+        stack_infof("Page compression cache: %d hits, %d misses (hit rate %f), %d pages cached\n", page_cache.get_hits(), page_cache.get_misses(), page_cache.hit_rate(), page_cache.size());
+        page_cache.reset_statistics();
+        #endif
+
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        SiteDedupStats dedup = page_dedup.total();
+        row.set(interval_csv.title(), "Duplicate Page Groups", page_dedup.get_duplicate_groups());
+        row.set(interval_csv.title(), "Duplicate Pages", dedup.duplicate_pages);
+        row.set(interval_csv.title(), "Cross-Site Duplicate Pages", dedup.cross_site_duplicate_pages);
+        row.set(interval_csv.title(), "Dedup Savings (bytes)", dedup.savings());
+        stack_infof("Page deduplication: %d of %d resident pages are duplicates (%d bytes reclaimable)\n", dedup.duplicate_pages, dedup.resident_pages, dedup.savings());
+        #endif
     }
 
     void interval(
@@ -639,13 +1333,51 @@ private:
             #ifdef TRACK_OBJECTS
             track_objects(allocation_sites, type);
             #endif
-            #ifdef TRACK_PAGES
-            track_physical_pages(allocation_sites, type);
-            #endif
             #ifdef TRACK_HUGE_PAGES
             track_huge_pages(allocation_sites, type);
             #endif
         });
+        #if defined(TRACK_OBJECTS) && defined(DELTA_OUTPUT)
+        end_delta_interval<ObjectAddressColumn>(object_csv, object_deltas, object_file);
+        #endif
+
+        #ifdef TRAIN_SITE_DICTIONARIES
+        site_dictionaries.train(interval_count);
+        #endif
+
+        #ifdef TRACK_PAGES
+        // Pages are swept once, compressing each with every type
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        page_dedup.clear();
+        #endif
+        track_physical_pages(allocation_sites, types);
+        #ifdef DELTA_OUTPUT
+        end_delta_interval<VirtualPageAddressColumn>(page_csv, page_deltas, page_file);
+        #endif
+        #ifdef MEASURE_DECOMPRESSION
+        track_decompression(types);
+        #endif
+        #ifdef TRACK_PAGE_DEDUPLICATION
+        track_page_deduplication();
+        #endif
+        #ifdef SWEEP_COMPRESSION_SETTINGS
+        compression_sweep.write(sweep_csv, interval_count);
+        #endif
+        #ifdef TRACK_LINE_COMPRESSION
+        track_line_compression(types);
+        #endif
+        #ifdef TRACK_CROSS_PAGE_REDUNDANCY
+        cross_page.write(cross_page_csv, cross_page_file, interval_count);
+        #endif
+        #ifdef SWEEP_PAGE_GRANULARITIES
+        // Measure the regions the sweep left open
+        granularity_sweep.flush(types);
+        granularity_sweep.write(granularity_csv, interval_count, types);
+        #endif
+        #ifdef SIMULATE_COMPRESSED_POOL
+        compressed_pool.write(pool_csv, pool_file, interval_count, types);
+        #endif
+        #endif
 
         track_interval_info(allocation_sites);
 
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <interval_test.hpp>
+#include <stack_csv.hpp>
+#include <stack_map.hpp>
+#include <stack_set.hpp>
+#include <compressor.hpp>
+#include <timer.hpp>
+
+// Every candidate codec is run on about this many pages of each site per interval
+#ifndef CODEC_SELECTION_SAMPLE_PAGES
+#define CODEC_SELECTION_SAMPLE_PAGES 8
+#endif
+// How many compressed bytes one nanosecond of compression is worth when
+// ranking codecs. 0 picks the best ratio regardless of speed; 0.01 trades
+// 10 bytes of output for each microsecond saved.
+#ifndef CODEC_SELECTION_CPU_WEIGHT
+#define CODEC_SELECTION_CPU_WEIGHT 0.01
+#endif
+// The most distinct resident pages swept per interval
+#define CODEC_SELECTION_MAX_PAGES 1000000
+
+/// @brief Running totals for one codec at one site.
+struct CodecSample {
+    double uncompressed_size = 0, compressed_size = 0, nanoseconds = 0;
+
+    double ratio() const {
+        return uncompressed_size == 0 ? 1.0 : compressed_size / uncompressed_size;
+    }
+
+    /// @brief The objective to minimize, per uncompressed byte.
+    double cost() const {
+        return uncompressed_size == 0 ? 0.0 : (compressed_size + CODEC_SELECTION_CPU_WEIGHT * nanoseconds) / uncompressed_size;
+    }
+};
+
+/// @brief A site's codec statistics and what it did this interval.
+struct SiteCodecSelection {
+    // Decayed across intervals, so a site that changes behaviour changes codec
+    CodecSample samples[MAX_COMPRESSION_TYPES];
+    CompressionType selected;
+    bool has_selection = false;
+
+    // The site's resident pages last interval, which spaces out this interval's sample
+    uint64_t previous_pages = 0;
+
+    // This interval only
+    uint64_t pages = 0, sampled_pages = 0;
+    uint64_t uncompressed_size = 0;
+    // Every page stored with the codec selected at the time
+    uint64_t selected_size = 0, selected_nanoseconds = 0;
+    // Each codec's exact output on this interval's sample
+    uint64_t sampled_sizes[MAX_COMPRESSION_TYPES] = {0};
+    uint64_t sampled_nanoseconds[MAX_COMPRESSION_TYPES] = {0};
+    // Pages outside the sample, which only the codec selected at the time saw
+    uint64_t unsampled_size = 0;
+    uint64_t unsampled_sizes[MAX_COMPRESSION_TYPES] = {0};
+    uint64_t unsampled_compressed_sizes[MAX_COMPRESSION_TYPES] = {0};
+    uint64_t unsampled_nanoseconds[MAX_COMPRESSION_TYPES] = {0};
+
+    /// @brief Whether the next page, counting from 1, belongs in the sample.
+    /// @param random A uniformly random number
+    bool samples_page(uint64_t page, uint64_t random) const {
+        if (!has_selection || (page <= CODEC_SELECTION_SAMPLE_PAGES && previous_pages <= CODEC_SELECTION_SAMPLE_PAGES)) {
+            return true;
+        }
+        if (previous_pages == 0) {
+            // A new site samples every power of two
+            return (page & (page - 1)) == 0;
+        }
+        // Pick pages at random rather than at a stride, which can line up
+        // with the layout of the site's objects
+        return random % previous_pages < CODEC_SELECTION_SAMPLE_PAGES;
+    }
+
+    /// @brief Age the running totals and start the next interval, whether or
+    ///        not the site had any pages in this one.
+    void next_interval() {
+        for (size_t i=0; i<MAX_COMPRESSION_TYPES; i++) {
+            samples[i].uncompressed_size /= 2;
+            samples[i].compressed_size /= 2;
+            samples[i].nanoseconds /= 2;
+        }
+        SiteCodecSelection next;
+        memcpy(next.samples, samples, sizeof(next.samples));
+        next.selected = selected;
+        next.has_selection = has_selection;
+        next.previous_pages = pages;
+        *this = next;
+    }
+};
+
+// Picks a codec for each allocation site from a small per-site sample, then
+// compresses the rest of the site's pages with only that codec.
+//
+// Every interval, about `CODEC_SELECTION_SAMPLE_PAGES` resident pages spread
+// across each site are compressed with every candidate. The site's running
+// totals are updated and the codec with the lowest cost (compressed bytes
+// plus weighted CPU time) is selected. The site's other pages are compressed
+// with the selected codec alone. At the end of the interval the result is
+// compared with using any one codec everywhere, projecting each codec's size
+// on the pages it did not see from its ratio on the site's sample.
+class CodecSelectionTest : public IntervalTest {
+    StackMap<uintptr_t, SiteCodecSelection, TRACKED_ALLOCATION_SITES * 2> sites;
+    StackVec<CompressionType, 20> types;
+    uint8_t compressed_data[PAGE_SIZE * 2];
+    CSV<16, 10000> csv;
+    StackFile file;
+    size_t interval_count = 0;
+    uint64_t random_state = 0x9E3779B97F4A7C15;
+
+    const char *name() const override {
+        return "Codec Selection Test";
+    }
+
+    void setup() override {
+        file = StackFile(StackString<256>("codec-selection.csv" OUTPUT_FILE_SUFFIX), Mode::WRITE);
+        types = Compressor<>::supported_compression_types();
+        csv.title().add("Interval #");
+        csv.title().add("Scope");
+        csv.title().add("Allocation Site");
+        csv.title().add("Compression Type");
+        csv.title().add("Pages");
+        csv.title().add("Sampled Pages");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Compressed Size (bytes)");
+        csv.title().add("Compression Ratio (compressed/uncompressed)");
+        csv.title().add("Compression Time (ns)");
+        csv.title().add("Cost (per byte)");
+        csv.write(file);
+        csv.clear();
+        interval_count = 0;
+    }
+
+    void interval(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites) override {
+        stack_infof("Interval %d starting...\n", ++interval_count);
+        static StackSet<PageInfo, CODEC_SELECTION_MAX_PAGES> seen_pages;
+        seen_pages.clear();
+
+        Compressor<PAGE_SIZE, false> compressor(DEFAULT_COMPRESSION_TYPE);
+        uint64_t compressions = 0, exhaustive_compressions = 0;
+
+        allocation_sites.map([&](auto return_address, AllocationSite site) {
+            if (!sites.has(return_address)) {
+                sites.put(return_address, SiteCodecSelection());
+            }
+            SiteCodecSelection &selection = sites.get(return_address);
+
+            site.allocations.map([&](void *ptr, Allocation allocation) {
+                auto physical_pages = allocation.physical_pages<30000>();
+                physical_pages.map([&](auto page_info) {
+                    if (page_info.size() > PAGE_SIZE || seen_pages.has(page_info)) {
+                        return;
+                    }
+                    seen_pages.insert(page_info);
+                    const uint8_t *page = (const uint8_t*)page_info.get_virtual_address();
+                    size_t size = page_info.size();
+                    selection.pages++;
+                    selection.uncompressed_size += size;
+                    exhaustive_compressions += types.size();
+
+                    if (selection.samples_page(selection.pages, next_random())) {
+                        sample(compressor, selection, page, size);
+                        compressions += types.size();
+                    } else {
+                        uint64_t ns;
+                        size_t type = selection.selected % MAX_COMPRESSION_TYPES;
+                        size_t compressed_size = compress(compressor, selection.selected, page, size, ns);
+                        selection.selected_size += compressed_size;
+                        selection.selected_nanoseconds += ns;
+                        selection.unsampled_size += size;
+                        selection.unsampled_sizes[type] += size;
+                        selection.unsampled_compressed_sizes[type] += compressed_size;
+                        selection.unsampled_nanoseconds[type] += ns;
+                        compressions++;
+                    }
+                });
+            });
+        });
+
+        report();
+        stack_infof("Codec selection ran %d compressions instead of %d\n", compressions, exhaustive_compressions);
+        csv.write(file);
+        csv.clear();
+    }
+
+    /// @brief xorshift64, which is plenty for choosing pages.
+    uint64_t next_random() {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        return random_state;
+    }
+
+    size_t compress(Compressor<PAGE_SIZE, false> &compressor, CompressionType type, const uint8_t *page, size_t size, uint64_t &ns) {
+        compressor.configure(CompressionSetting{type, default_compression_level(type)});
+        Timer timer;
+        size_t compressed_size = compressor.compress_block(page, size, compressed_data, sizeof(compressed_data));
+        ns = timer.elapsed_nanoseconds();
+        // A failed compression keeps the page as it is
+        return compressed_size == 0 ? size : compressed_size;
+    }
+
+    void sample(Compressor<PAGE_SIZE, false> &compressor, SiteCodecSelection &selection, const uint8_t *page, size_t size) {
+        size_t compressed_sizes[MAX_COMPRESSION_TYPES] = {0};
+        uint64_t nanoseconds[MAX_COMPRESSION_TYPES] = {0};
+        selection.sampled_pages++;
+        for (size_t i=0; i<types.size(); i++) {
+            size_t type = types[i] % MAX_COMPRESSION_TYPES;
+            compressed_sizes[type] = compress(compressor, types[i], page, size, nanoseconds[type]);
+            CodecSample &sample = selection.samples[type];
+            sample.uncompressed_size += size;
+            sample.compressed_size += compressed_sizes[type];
+            sample.nanoseconds += nanoseconds[type];
+            selection.sampled_sizes[type] += compressed_sizes[type];
+            selection.sampled_nanoseconds[type] += nanoseconds[type];
+        }
+        // The page is stored with whichever codec wins once it is counted
+        select(selection);
+        selection.selected_size += compressed_sizes[selection.selected % MAX_COMPRESSION_TYPES];
+        selection.selected_nanoseconds += nanoseconds[selection.selected % MAX_COMPRESSION_TYPES];
+    }
+
+    void select(SiteCodecSelection &selection) {
+        double best_cost = 0;
+        for (size_t i=0; i<types.size(); i++) {
+            const CodecSample &sample = selection.samples[types[i] % MAX_COMPRESSION_TYPES];
+            if (!selection.has_selection || sample.cost() < best_cost) {
+                best_cost = sample.cost();
+                selection.selected = types[i];
+                selection.has_selection = true;
+            }
+        }
+    }
+
+    void report() {
+        // Totals for each codec used everywhere, and for per-site selection
+        double projected_sizes[MAX_COMPRESSION_TYPES] = {0}, projected_nanoseconds[MAX_COMPRESSION_TYPES] = {0};
+        double selected_size = 0, selected_nanoseconds = 0;
+        uint64_t pages = 0, sampled_pages = 0, uncompressed_size = 0;
+
+        sites.map([&](const uintptr_t &site, SiteCodecSelection &selection) {
+            if (selection.pages == 0) {
+                selection.next_interval();
+                return;
+            }
+            write_row("Site", (void*)site, compression_to_string(selection.selected), selection.pages, selection.sampled_pages,
+                selection.uncompressed_size, selection.selected_size, selection.selected_nanoseconds);
+
+            pages += selection.pages;
+            sampled_pages += selection.sampled_pages;
+            uncompressed_size += selection.uncompressed_size;
+            selected_size += selection.selected_size;
+            selected_nanoseconds += selection.selected_nanoseconds;
+            for (size_t i=0; i<types.size(); i++) {
+                size_t type = types[i] % MAX_COMPRESSION_TYPES;
+                const CodecSample &sample = selection.samples[type];
+                // Measured where the codec saw the page, projected where it did not
+                uint64_t unseen_size = selection.unsampled_size - selection.unsampled_sizes[type];
+                projected_sizes[type] += selection.sampled_sizes[type] + selection.unsampled_compressed_sizes[type] + unseen_size * sample.ratio();
+                projected_nanoseconds[type] += selection.sampled_nanoseconds[type] + selection.unsampled_nanoseconds[type];
+                if (sample.uncompressed_size > 0) {
+                    projected_nanoseconds[type] += unseen_size * sample.nanoseconds / sample.uncompressed_size;
+                }
+            }
+            selection.next_interval();
+
+            if (csv.full()) {
+                csv.write(file);
+                csv.clear();
+            }
+        });
+        if (pages == 0) {
+            return;
+        }
+
+        write_row("All Sites", nullptr, "per-site", pages, sampled_pages, uncompressed_size, selected_size, selected_nanoseconds);
+        CompressionType best_type = types[0];
+        double best_cost = 0;
+        for (size_t i=0; i<types.size(); i++) {
+            size_t type = types[i] % MAX_COMPRESSION_TYPES;
+            write_row("All Sites", nullptr, compression_to_string(types[i]), pages, sampled_pages, uncompressed_size, projected_sizes[type], projected_nanoseconds[type]);
+            double cost = projected_sizes[type] + CODEC_SELECTION_CPU_WEIGHT * projected_nanoseconds[type];
+            if (i == 0 || cost < best_cost) {
+                best_cost = cost;
+                best_type = types[i];
+            }
+        }
+        double best_size = projected_sizes[best_type % MAX_COMPRESSION_TYPES];
+        stack_infof("Per-site codec selection: %d bytes against %d bytes with %s everywhere (%d bytes saved)\n",
+            (uint64_t)selected_size, (uint64_t)best_size, compression_to_string(best_type), (int64_t)best_size - (int64_t)selected_size);
+    }
+
+    void write_row(const char *scope, void *site, CSVString type, uint64_t pages, uint64_t sampled_pages, uint64_t uncompressed_size, double compressed_size, double nanoseconds) {
+        auto &row = csv.new_row();
+        row.set(csv.title(), "Interval #", interval_count);
+        row.set(csv.title(), "Scope", scope);
+        row.set(csv.title(), "Allocation Site", site);
+        row.set(csv.title(), "Compression Type", type);
+        row.set(csv.title(), "Pages", pages);
+        row.set(csv.title(), "Sampled Pages", sampled_pages);
+        row.set(csv.title(), "Uncompressed Size (bytes)", uncompressed_size);
+        row.set(csv.title(), "Compressed Size (bytes)", (uint64_t)compressed_size);
+        row.set(csv.title(), "Compression Ratio (compressed/uncompressed)", uncompressed_size == 0 ? 1.0 : compressed_size / (double)uncompressed_size);
+        row.set(csv.title(), "Compression Time (ns)", (uint64_t)nanoseconds);
+        row.set(csv.title(), "Cost (per byte)", uncompressed_size == 0 ? 0.0 : (compressed_size + CODEC_SELECTION_CPU_WEIGHT * nanoseconds) / (double)uncompressed_size);
+    }
+};
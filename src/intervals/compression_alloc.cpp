@@ -2,32 +2,485 @@
 
 #include <interval_test.hpp>
 #include <stack_csv.hpp>
-#include <zlib.h>
 #include <stack_map.hpp>
 #include <stack_vec.hpp>
+#include <compressor.hpp>
+#include <timer.hpp>
+#include <sys/mman.h>
+#include <atomic>
+#include <fcntl.h>
+#include <mutex>
+#include <sched.h>
+#include <unistd.h>
 
+// These change the protections of whole objects, which would open a tiered
+// span with no fault: the program would read zeros, and the next restore would
+// write the stale compressed copy over whatever it had written since
+#if defined(COMPRESSION_TEST) || defined(OBJECT_LIVENESS_TEST) || defined(PAGE_LIVENESS_TEST) || defined(PAGE_TRACKING_TEST) \
+    || defined(ACCESS_PATTERN_TEST) || defined(ACCESS_COMPRESSION_TEST) || defined(HUGE_PAGE_ACCESS_COMPRESSION_TEST) || defined(GUARD_ACCESSES)
+#error "COMPRESSION_ALLOCATOR_TEST cannot run with tests that protect or unprotect objects"
+#endif
+
+// An object is compressed after this many intervals without a write
+#define COLD_INTERVALS 3
+// The most objects that can sit in the compressed tier at once
+#define COMPRESSED_TIER_OBJECTS 4096
+// The size of the pool that holds the compressed objects
+#define COMPRESSED_TIER_POOL_SIZE 0x10000000
+// Objects with larger page-aligned spans are left alone
+#define COMPRESSED_TIER_MAX_PAGES 0x10000
+// The most objects whose coldness is tracked at once
+#define COMPRESSED_TIER_TRACKED_OBJECTS 100000
+
+#ifdef USE_LZ4_COMPRESSION
+// LZ4 decompresses without allocating, which matters inside the fault handler
+#define COMPRESSED_TIER_TYPE COMPRESS_LZ4
+#else
+#define COMPRESSED_TIER_TYPE DEFAULT_COMPRESSION_TYPE
+#endif
+
+/// @brief The page-aligned span of a cold object, compressed into the pool.
+///
+/// Only whole pages inside the object are compressed, so neighbouring
+/// objects that share its first or last page are never protected.
 class CompressedAllocation {
 public:
     CompressedAllocation() {}
+
+    bool contains(void *address) const {
+        return (uint8_t*)address >= span && (uint8_t*)address < span + span_size;
+    }
+
+    uintptr_t site = 0;
+    // The address the object was allocated at
+    void *object = nullptr;
+    uint8_t *span = nullptr;
+    size_t span_size = 0;
+    // The resident memory the span held before it was compressed
+    size_t resident_size = 0;
+    // The compressed span in the pool
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    bool in_use = false;
+};
+
+/// @brief What the compressed tier did for one allocation site.
+struct CompressedTierSiteStats {
+    // Refreshed from the tier at the end of every interval
+    uint64_t objects = 0, span_size = 0, resident_size = 0, compressed_size = 0;
+    // Counted since the last interval
+    uint64_t compressed_objects = 0;
+    uint64_t refaults = 0, profiler_refaults = 0, freed_objects = 0;
+    uint64_t refaulted_bytes = 0, refault_ns = 0, max_refault_ns = 0;
+    // Pool space still held by the site's restored and freed objects
+    uint64_t pool_holes = 0;
+};
+
+/// @brief A spinlock the fault handler can take.
+///
+/// A `std::mutex` isn't async-signal-safe. This one also remembers which
+/// thread holds it, so a fault on that thread while it holds the lock stops
+/// the process with a message instead of spinning forever.
+class TierLock {
+public:
+    void lock() {
+        uint64_t self = (uint64_t)pthread_self();
+        if (holder.load(std::memory_order_relaxed) == self) {
+            static const char message[] = "Compressed tier: faulted on a compressed object while holding the tier lock\n";
+            write(STDERR_FILENO, message, sizeof(message) - 1);
+            abort();
+        }
+        uint64_t expected = 0;
+        while (!holder.compare_exchange_weak(expected, self, std::memory_order_acquire, std::memory_order_relaxed)) {
+            expected = 0;
+            sched_yield();
+        }
+    }
+
+    void unlock() {
+        holder.store(0, std::memory_order_release);
+    }
+
 private:
-    size_t size;
-    void *data;
+    std::atomic<uint64_t> holder{0};
 };
 
-// Path: src/compression_test.cpp
+/// @brief A userspace zswap for cold objects.
+///
+/// Objects that go `COLD_INTERVALS` intervals without a write have their
+/// page-aligned span compressed into a pool, dropped with `MADV_DONTNEED`,
+/// and left `PROT_NONE`. The first access to the span faults, and the fault
+/// hook decompresses it into a staging buffer, writes it into the still
+/// inaccessible span through /proc/self/mem, and only then opens the span,
+/// so no thread ever sees it half restored. Writes are detected with the
+/// soft-dirty bits, so on kernels without them every object looks cold and
+/// the refault columns show what that costs. The interval sweeps of the
+/// other tests read every object too, so with them running each compressed
+/// object comes back once an interval; those are the profiler refaults.
+/// Tests that change the protections of objects themselves would open a
+/// tiered span without a fault and lose its contents, so they cannot be
+/// built alongside this one.
 class CompressionAllocator : public IntervalTest {
 public:
-    StackMap<void*, CompressedAllocation, 1000> compressed_allocations;
+    CompressionAllocator() : compressor(COMPRESSED_TIER_TYPE) {}
 
     const char *name() const override {
         return "Compression Allocator Test";
     }
 
-    void setup() override {}
+    void setup() override {
+        stack_debugf("Setup\n");
+        pool = (uint8_t*)mmap(NULL, COMPRESSED_TIER_POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (pool == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+
+        staging = (uint8_t*)mmap(NULL, COMPRESSED_TIER_MAX_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (staging == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        // Lets a restore fill a span while it is still PROT_NONE
+        memory = open("/proc/self/mem", O_RDWR | O_CLOEXEC);
+        if (memory == -1) {
+            stack_warnf("Could not open /proc/self/mem, so no objects will be compressed\n");
+        }
+        compressor.reserve_decompression_workspace();
+
+        file = StackFile(StackString<256>("compressed-tier.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
+        file.clear();
+        csv.title().add("Interval #");
+        csv.title().add("Allocation Site");
+        csv.title().add("Compression Type");
+        csv.title().add("Objects In Tier");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Resident Size Before Compression (bytes)");
+        csv.title().add("Compressed Size (bytes)");
+        csv.title().add("Pool Holes (bytes)");
+        csv.title().add("RSS Saved (bytes)");
+        csv.title().add("Objects Compressed This Interval");
+        csv.title().add("Objects Freed While Compressed");
+        csv.title().add("Refaults");
+        csv.title().add("Profiler Refaults");
+        csv.title().add("Refaulted Bytes");
+        csv.title().add("Total Refault Latency (ns)");
+        csv.title().add("Mean Refault Latency (ns)");
+        csv.title().add("Max Refault Latency (ns)");
+        csv.write(file);
+        csv.clear();
+        interval_count = 0;
+
+        instance = this;
+        set_fault_hook(on_fault);
+    }
+
+    void cleanup() override {
+        stack_debugf("Cleanup\n");
+        std::lock_guard<TierLock> guard(lock);
+        // Give every object back before the tests go away
+        for (size_t i=0; i<COMPRESSED_TIER_OBJECTS; i++) {
+            if (entries[i].in_use) {
+                restore(entries[i]);
+            }
+        }
+        set_fault_hook(NULL);
+        if (memory != -1) {
+            close(memory);
+            memory = -1;
+        }
+        munmap(staging, COMPRESSED_TIER_MAX_PAGES * PAGE_SIZE);
+        file.close();
+    }
+
+    void on_free(const Allocation &alloc) override {
+        std::lock_guard<TierLock> guard(lock);
+        if (clean_intervals.has(alloc.ptr)) {
+            clean_intervals.get(alloc.ptr) = 0;
+        }
+
+        CompressedAllocation *entry = find_object(alloc.ptr);
+        if (entry == nullptr) {
+            return;
+        }
+        // The contents are dead, so there is nothing to restore: the span is
+        // handed back zeroed. It may already be unmapped, so a failure here is fine.
+        mprotect(entry->span, entry->span_size, PROT_READ | PROT_WRITE);
+        site_stats.get(entry->site).freed_objects++;
+        release(*entry);
+    }
 
     void interval(
         const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites
     ) override {
-        // 
+        ++interval_count;
+        stack_infof("Interval %d compressed tier starting...\n", interval_count);
+
+        std::lock_guard<TierLock> guard(lock);
+        allocation_sites.map([&](auto return_address, AllocationSite site) {
+            site.allocations.map([&](void *ptr, Allocation allocation) {
+                if (find_object(ptr) != nullptr) {
+                    return;
+                }
+
+                if (clean_intervals.full() && !clean_intervals.has(ptr)) {
+                    stack_warnf("Cold object table is full (%d objects), starting over\n", clean_intervals.num_entries());
+                    clean_intervals.clear();
+                }
+                uint64_t &clean = clean_intervals.get(ptr);
+                if (allocation.is_dirty()) {
+                    clean = 0;
+                    return;
+                }
+                if (++clean >= COLD_INTERVALS) {
+                    compress_object(site.return_address, allocation);
+                }
+            });
+        });
+
+        report();
+        stack_infof("Interval %d complete for compressed tier\n", interval_count);
+    }
+
+private:
+    static CompressionAllocator *instance;
+
+    CompressedAllocation entries[COMPRESSED_TIER_OBJECTS];
+    size_t live_entries = 0;
+    uint8_t *pool = nullptr;
+    size_t pool_used = 0;
+    StackMap<void*, uint64_t, COMPRESSED_TIER_TRACKED_OBJECTS> clean_intervals;
+    StackMap<uintptr_t, CompressedTierSiteStats, TRACKED_ALLOCATION_SITES> site_stats;
+    // The pool bytes each site's released objects still hold, until the pool empties
+    StackMap<uintptr_t, uint64_t, TRACKED_ALLOCATION_SITES> pool_holes;
+    Compressor<PAGE_SIZE, false> compressor;
+    // Spans are decompressed here before they are written into place
+    uint8_t *staging = nullptr;
+    // /proc/self/mem
+    int memory = -1;
+    // Held by the interval while it compresses and by the fault hook while it restores
+    TierLock lock;
+
+    CSV<20, 10000> csv;
+    StackFile file;
+    size_t interval_count = 0;
+
+    static bool on_fault(void *address, bool is_write) {
+        if (instance == nullptr) {
+            return false;
+        }
+        return instance->refault(address);
+    }
+
+    /// @brief Decompress the span containing a faulting address back in place.
+    /// @return True if the address belonged to a compressed object
+    bool refault(void *address) {
+        std::lock_guard<TierLock> guard(lock);
+        CompressedAllocation *entry = find_address(address);
+        if (entry == nullptr) {
+            return false;
+        }
+
+        Timer timer;
+        timer.start();
+        restore(*entry);
+        uint64_t ns = timer.elapsed_nanoseconds();
+
+        CompressedTierSiteStats &stats = site_stats.get(entry->site);
+        if (is_working_thread()) {
+            // Another test read the object during its sweep
+            stats.profiler_refaults++;
+        } else {
+            stats.refaults++;
+        }
+        stats.refaulted_bytes += entry->span_size;
+        stats.refault_ns += ns;
+        if (ns > stats.max_refault_ns) {
+            stats.max_refault_ns = ns;
+        }
+        if (clean_intervals.has(entry->object)) {
+            clean_intervals.get(entry->object) = 0;
+        }
+        release(*entry);
+        return true;
+    }
+
+    void compress_object(uintptr_t site, const Allocation &allocation) {
+        uint8_t *span = (uint8_t*)(((uintptr_t)allocation.ptr + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1));
+        uint8_t *span_end = (uint8_t*)(((uintptr_t)allocation.ptr + allocation.size) & ~(uintptr_t)(PAGE_SIZE - 1));
+        if (memory == -1 || span_end <= span || (size_t)(span_end - span) > COMPRESSED_TIER_MAX_PAGES * PAGE_SIZE) {
+            return;
+        }
+        size_t span_size = span_end - span;
+
+        CompressedAllocation *entry = free_entry();
+        size_t bound = compressor.max_compressed_size(span_size);
+        if (entry == nullptr || pool_used + bound > COMPRESSED_TIER_POOL_SIZE) {
+            stack_debugf("Compressed tier is full, skipping object at %p\n", allocation.ptr);
+            return;
+        }
+
+        size_t resident_size = Allocation(span, span_size).physical_pages<COMPRESSED_TIER_MAX_PAGES>(false).size() * PAGE_SIZE;
+        if (resident_size == 0) {
+            return;
+        }
+
+        // Writers fault and wait on the lock until the span is either compressed or given back
+        if (mprotect(span, span_size, PROT_READ) == -1) {
+            perror("mprotect");
+            exit(1);
+        }
+        size_t compressed_size = compressor.compress(span, span_size, pool + pool_used, bound);
+        if (compressed_size == 0 || compressed_size >= resident_size) {
+            mprotect(span, span_size, PROT_READ | PROT_WRITE);
+            return;
+        }
+
+        entry->site = site;
+        entry->object = allocation.ptr;
+        entry->span = span;
+        entry->span_size = span_size;
+        entry->resident_size = resident_size;
+        entry->data = pool + pool_used;
+        entry->size = compressed_size;
+        entry->in_use = true;
+        live_entries++;
+        // Keep the compressed spans 16-byte aligned
+        pool_used += (compressed_size + 15) & ~(size_t)15;
+
+        // Close the span before dropping its pages, or a read in between would see zeros
+        if (mprotect(span, span_size, PROT_NONE) == -1) {
+            perror("mprotect");
+            exit(1);
+        }
+        if (madvise(span, span_size, MADV_DONTNEED) == -1) {
+            perror("madvise");
+            exit(1);
+        }
+        site_stats.get(site).compressed_objects++;
+    }
+
+    // Decompress a span and put it back. The span stays PROT_NONE until its
+    // contents are complete, so other threads fault and wait on the lock.
+    void restore(CompressedAllocation &entry) {
+        size_t size = compressor.decompress(entry.data, entry.size, staging, entry.span_size);
+        if (size != entry.span_size) {
+            stack_errorf("Could not restore compressed object at %p: got %d of %d bytes\n", entry.object, size, entry.span_size);
+            exit(1);
+        }
+        // Writes through /proc/self/mem ignore the span's protection
+        for (size_t written = 0; written < entry.span_size;) {
+            ssize_t result = pwrite(memory, staging + written, entry.span_size - written, (off_t)(uintptr_t)(entry.span + written));
+            if (result <= 0) {
+                stack_errorf("Could not restore compressed object at %p through /proc/self/mem\n", entry.object);
+                exit(1);
+            }
+            written += result;
+        }
+        madvise(staging, entry.span_size, MADV_DONTNEED);
+        if (mprotect(entry.span, entry.span_size, PROT_READ | PROT_WRITE) == -1) {
+            perror("mprotect");
+            exit(1);
+        }
+    }
+
+    void release(CompressedAllocation &entry) {
+        entry.in_use = false;
+        if (--live_entries == 0) {
+            // Spans are never moved, so the pool is only reclaimed once it empties
+            madvise(pool, pool_used, MADV_DONTNEED);
+            pool_used = 0;
+            pool_holes.clear();
+        } else {
+            pool_holes.get(entry.site) += (entry.size + 15) & ~(size_t)15;
+        }
+    }
+
+    CompressedAllocation *free_entry() {
+        for (size_t i=0; i<COMPRESSED_TIER_OBJECTS; i++) {
+            if (!entries[i].in_use) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    CompressedAllocation *find_object(void *object) {
+        for (size_t i=0; i<COMPRESSED_TIER_OBJECTS && live_entries > 0; i++) {
+            if (entries[i].in_use && entries[i].object == object) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    CompressedAllocation *find_address(void *address) {
+        for (size_t i=0; i<COMPRESSED_TIER_OBJECTS && live_entries > 0; i++) {
+            if (entries[i].in_use && entries[i].contains(address)) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void report() {
+        site_stats.map([](const uintptr_t &site, CompressedTierSiteStats &stats) {
+            stats.objects = stats.span_size = stats.resident_size = stats.compressed_size = 0;
+        });
+        for (size_t i=0; i<COMPRESSED_TIER_OBJECTS; i++) {
+            if (!entries[i].in_use) {
+                continue;
+            }
+            CompressedTierSiteStats &stats = site_stats.get(entries[i].site);
+            stats.objects++;
+            stats.span_size += entries[i].span_size;
+            stats.resident_size += entries[i].resident_size;
+            stats.compressed_size += entries[i].size;
+        }
+        pool_holes.map([&](const uintptr_t &site, const uint64_t &holes) {
+            site_stats.get(site).pool_holes = holes;
+        });
+
+        CompressedTierSiteStats total;
+        site_stats.map([&](const uintptr_t &site, const CompressedTierSiteStats &stats) {
+            auto &row = csv.new_row();
+            row.set(csv.title(), "Interval #", interval_count);
+            row.set(csv.title(), "Allocation Site", (void*)site);
+            row.set(csv.title(), "Compression Type", compression_to_string(COMPRESSED_TIER_TYPE));
+            row.set(csv.title(), "Objects In Tier", stats.objects);
+            row.set(csv.title(), "Uncompressed Size (bytes)", stats.span_size);
+            row.set(csv.title(), "Resident Size Before Compression (bytes)", stats.resident_size);
+            row.set(csv.title(), "Compressed Size (bytes)", stats.compressed_size);
+            row.set(csv.title(), "Pool Holes (bytes)", stats.pool_holes);
+            // The holes stay resident in the pool until it empties, so they count against the savings
+            row.set(csv.title(), "RSS Saved (bytes)", (int64_t)stats.resident_size - (int64_t)stats.compressed_size - (int64_t)stats.pool_holes);
+            row.set(csv.title(), "Objects Compressed This Interval", stats.compressed_objects);
+            row.set(csv.title(), "Objects Freed While Compressed", stats.freed_objects);
+            row.set(csv.title(), "Refaults", stats.refaults);
+            row.set(csv.title(), "Profiler Refaults", stats.profiler_refaults);
+            row.set(csv.title(), "Refaulted Bytes", stats.refaulted_bytes);
+            row.set(csv.title(), "Total Refault Latency (ns)", stats.refault_ns);
+            uint64_t refaults = stats.refaults + stats.profiler_refaults;
+            row.set(csv.title(), "Mean Refault Latency (ns)", refaults == 0 ? 0 : stats.refault_ns / refaults);
+            row.set(csv.title(), "Max Refault Latency (ns)", stats.max_refault_ns);
+
+            total.objects += stats.objects;
+            total.resident_size += stats.resident_size;
+            total.pool_holes += stats.pool_holes;
+            total.refaults += stats.refaults;
+            total.profiler_refaults += stats.profiler_refaults;
+            total.refault_ns += stats.refault_ns;
+        });
+        csv.write(file);
+        csv.clear();
+
+        uint64_t refaults = total.refaults + total.profiler_refaults;
+        stack_infof("Compressed tier holds %d objects: %d resident bytes in a %d byte pool (%d bytes of holes), %d refaults taking %d ns\n",
+            total.objects, total.resident_size, pool_used, total.pool_holes, refaults, total.refault_ns);
+
+        // Start counting the next interval's compressions and refaults
+        site_stats.clear();
     }
 };
+
+CompressionAllocator *CompressionAllocator::instance = nullptr;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <interval_test.hpp>
+#include <compressor.hpp>
+#include <stack_csv.hpp>
+
+// Writes the compression telemetry gathered by every `Compressor` during an
+// interval. It is registered after the other tests, so each interval's rows
+// cover everything they compressed in that interval.
+class CompressionTelemetryTest : public IntervalTest {
+    CSV<24, 1000> csv;
+    StackFile file;
+    size_t interval_count = 0;
+    // The totals as of the end of the previous interval
+    TelemetrySnapshot previous[MAX_COMPRESSION_TYPES][TELEMETRY_SIZE_BUCKETS];
+
+    const char *name() const override {
+        return "Compression Telemetry";
+    }
+
+    void setup() override {
+        file = StackFile(StackString<256>("compression-telemetry.csv" OUTPUT_FILE_SUFFIX), Mode::WRITE);
+        csv.title().add("Interval #");
+        csv.title().add("Compression Type");
+        csv.title().add("Input Size Up To (bytes)");
+        csv.title().add("Calls");
+        csv.title().add("Failures");
+        csv.title().add("Zero-Length Inputs");
+        csv.title().add("Uncompressed Size (bytes)");
+        csv.title().add("Compressed Size (bytes)");
+        csv.title().add("Compression Ratio (compressed/uncompressed)");
+        csv.title().add("Compression Time (ns/byte)");
+        csv.title().add("Ratio 0.0-0.1");
+        csv.title().add("Ratio 0.1-0.2");
+        csv.title().add("Ratio 0.2-0.3");
+        csv.title().add("Ratio 0.3-0.4");
+        csv.title().add("Ratio 0.4-0.5");
+        csv.title().add("Ratio 0.5-0.6");
+        csv.title().add("Ratio 0.6-0.7");
+        csv.title().add("Ratio 0.7-0.8");
+        csv.title().add("Ratio 0.8-0.9");
+        csv.title().add("Ratio 0.9-1.0");
+        csv.title().add("Ratio 1.0+");
+        csv.write(file);
+        csv.clear();
+        interval_count = 0;
+    }
+
+    void interval(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites) override {
+        ++interval_count;
+        static const char *ratio_titles[TELEMETRY_RATIO_BUCKETS] = {
+            "Ratio 0.0-0.1", "Ratio 0.1-0.2", "Ratio 0.2-0.3", "Ratio 0.3-0.4", "Ratio 0.4-0.5",
+            "Ratio 0.5-0.6", "Ratio 0.6-0.7", "Ratio 0.7-0.8", "Ratio 0.8-0.9", "Ratio 0.9-1.0", "Ratio 1.0+"
+        };
+
+        auto types = Compressor<>::supported_compression_types();
+        for (size_t i=0; i<types.size(); i++) {
+            CompressionType type = types[i];
+            uint64_t failures = 0;
+            for (size_t bucket=0; bucket<TELEMETRY_SIZE_BUCKETS; bucket++) {
+                TelemetrySnapshot total = compression_telemetry.snapshot(type, bucket);
+                TelemetrySnapshot stats = total - previous[type % MAX_COMPRESSION_TYPES][bucket];
+                previous[type % MAX_COMPRESSION_TYPES][bucket] = total;
+                if (stats.calls == 0) {
+                    continue;
+                }
+                failures += stats.failures;
+
+                auto &row = csv.new_row();
+                row.set(csv.title(), "Interval #", interval_count);
+                row.set(csv.title(), "Compression Type", compression_to_string(type));
+                row.set(csv.title(), "Input Size Up To (bytes)", CompressionTelemetry::size_bucket_limit(bucket));
+                row.set(csv.title(), "Calls", stats.calls);
+                row.set(csv.title(), "Failures", stats.failures);
+                row.set(csv.title(), "Zero-Length Inputs", stats.zero_length);
+                row.set(csv.title(), "Uncompressed Size (bytes)", stats.uncompressed_size);
+                row.set(csv.title(), "Compressed Size (bytes)", stats.compressed_size);
+                row.set(csv.title(), "Compression Ratio (compressed/uncompressed)", stats.ratio());
+                row.set(csv.title(), "Compression Time (ns/byte)", stats.ns_per_byte());
+                for (size_t j=0; j<TELEMETRY_RATIO_BUCKETS; j++) {
+                    row.set(csv.title(), ratio_titles[j], stats.ratios[j]);
+                }
+            }
+            if (failures > 0) {
+                stack_warnf("%s failed %d times this interval, those calls are left out of its sizes\n", compression_to_string(type), failures);
+            }
+        }
+
+        csv.write(file);
+        csv.clear();
+    }
+};
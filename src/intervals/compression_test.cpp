@@ -2,16 +2,19 @@
 
 #include <interval_test.hpp>
 #include <stack_csv.hpp>
+#include <timer.hpp>
 #include <zlib.h>
 
 // Path: src/compression_test.cpp
 #define MAX_COMPRESSED_SIZE 0x100000
 #define MAX_PAGES 0x10000
 
-static uint8_t buffer[MAX_COMPRESSED_SIZE];
-
 class CompressionTest : public IntervalTest {
-    uint8_t compressed_data[MAX_COMPRESSED_SIZE];
+    // Objects are compressed a page at a time, straight from their pages
+    uint8_t compressed_data[PAGE_SIZE * 2];
+    // Bytes compressed in place this interval
+    uint64_t bytes_in_place = 0;
+    Stopwatch compression_time;
     CSV<16, 10000> csv;
     StackFile file;
     size_t interval_count = 0;
@@ -22,7 +25,7 @@ class CompressionTest : public IntervalTest {
 
     void setup() override {
         stack_debugf("Setup\n");
-        file = StackFile(StackString<256>("compression.csv"), Mode::WRITE);
+        file = StackFile(StackString<256>("compression.csv" OUTPUT_FILE_SUFFIX), Mode::WRITE);
         // CSVRow<4> &row = 
         csv.title().add("Interval #");
         csv.title().add("Allocation Site");
@@ -60,6 +63,8 @@ class CompressionTest : public IntervalTest {
         uint64_t allocation_sites_tracked = 0;
 
         uint64_t tracked_allocations = 0;
+        bytes_in_place = 0;
+        compression_time.reset();
         double tracked_allocation_size = 0;
         allocation_sites.map([&](auto return_address, AllocationSite site) {
             stack_debugf("site.return_address: %p\n", site.return_address);
@@ -107,35 +112,13 @@ class CompressionTest : public IntervalTest {
                 // stack_debugf("About to compress %d bytes to %d bytes from address %p\n", allocation.size, compressed_size, ptr);
                 total_uncompressed_resident_size += allocation.size;
                 uint64_t size = allocation.size;
-                if (size > MAX_COMPRESSED_SIZE) {
-                    size = MAX_COMPRESSED_SIZE;
-                    stack_warnf("Truncating allocation size of %d to %d bytes\n", (uint64_t)allocation.size, (uint64_t)size);
-                } else {
-                    stack_debugf("Allocation size: %d\n", size);
-                    // allocation.backtrace.print();
-                }
+                stack_debugf("Allocation size: %d\n", size);
 
                 allocation.protect();
                 stack_debugf("Protected\n");
-                StackVec<PageInfo, TRACKED_ALLOCATIONS_PER_SITE> pages = allocation.page_info<TRACKED_ALLOCATIONS_PER_SITE>();
-                // Copy to buffer
-                stack_debugf("Unprotected\n");
-
-                memcpy(buffer, (const uint8_t*)ptr, size);
-                allocation.unprotect();
-                // Count the zero and non-zero bytes
-                for (size_t i=0; i<size; i++) {
-                    if (buffer[i] == 0) {
-                        total_zero_bytes++;
-                    } else {
-                        total_non_zero_bytes++;
-                    }
-                }
+                StackVec<PageInfo, MAX_PAGES> pages = allocation.physical_pages<MAX_PAGES>(false);
 
                 for (size_t j=0; j<pages.size(); j++) {
-                    if (j * PAGE_SIZE >= size) {
-                        break;
-                    }
                     stack_debugf("j: %d\n", j);
                     if (pages[j].is_zero()) {
                         stack_debugf("Zero page\n");
@@ -143,19 +126,28 @@ class CompressionTest : public IntervalTest {
                         continue;
                     }
 
-                    uint64_t estimated_compressed_size = compressBound(PAGE_SIZE);
-                    uint64_t compressed_size = estimated_compressed_size;
-                    
-                    // Compress the page in the buffer
-                    // stack_debugf("About to compress %d bytes to %d bytes from address %p\n", PAGE_SIZE, compressed_size, buffer + j * PAGE_SIZE);
-                    stack_debugf("About to compress %d bytes!\n", compressed_size);
-                    // Dont read past end of buffer
-                    uint64_t len = PAGE_SIZE;
-                    if (j * PAGE_SIZE + PAGE_SIZE > size) {
-                        stack_debugf("Truncating page size of %d to %d bytes\n", (uint64_t)PAGE_SIZE, (uint64_t)(size - j * PAGE_SIZE));
-                        len = size - j * PAGE_SIZE;
+                    // Only the part of the page that belongs to the object is compressed
+                    uintptr_t page_start = (uintptr_t)pages[j].get_virtual_address();
+                    uintptr_t start = page_start > (uintptr_t)ptr ? page_start : (uintptr_t)ptr;
+                    uintptr_t end = page_start + PAGE_SIZE < (uintptr_t)ptr + size ? page_start + PAGE_SIZE : (uintptr_t)ptr + size;
+                    uint64_t len = end - start;
+                    const uint8_t *data = (const uint8_t*)start;
+
+                    // Count the zero and non-zero bytes
+                    for (size_t i=0; i<len; i++) {
+                        if (data[i] == 0) {
+                            total_zero_bytes++;
+                        } else {
+                            total_non_zero_bytes++;
+                        }
                     }
-                    int result = compress(compressed_data, &compressed_size, buffer + j * PAGE_SIZE, len);
+
+                    uint64_t compressed_size = sizeof(compressed_data);
+                    stack_debugf("About to compress %d bytes!\n", len);
+                    compression_time.start();
+                    int result = compress(compressed_data, &compressed_size, data, len);
+                    compression_time.stop();
+                    bytes_in_place += len;
 
                     if (result != Z_OK) {
                         stack_warnf("Error: Unable to compress data\n");
@@ -184,6 +176,8 @@ class CompressionTest : public IntervalTest {
                         total_compressed_clean_size += compressed_size;
                     }
                 }
+                allocation.unprotect();
+                stack_debugf("Unprotected\n");
                 tracked_allocations++;
                 tracked_allocation_size += allocation.size;
             });
@@ -238,6 +232,7 @@ class CompressionTest : public IntervalTest {
 
         csv.write(file);
         stack_infof("Tracked %d allocations with total size %f\n", tracked_allocations, tracked_allocation_size);
+        stack_infof("Compressed %d bytes in place in %d ms\n", bytes_in_place, compression_time.elapsed_milliseconds());
         stack_infof("Interval %d done\n", interval_count);
     }
 };
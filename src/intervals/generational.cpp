@@ -1,14 +1,60 @@
 #pragma once
 
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <zlib.h>
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
 // Path: src/compression_test.cpp
 class GenerationalTest : public IntervalTest {
-    CSV<48, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(TotalAllocatedColumn, int64_t, "Total Memory Allocated");
+    CSV_COLUMN(TotalFreedColumn, int64_t, "Total Memory Freed");
+    CSV_COLUMN(AllocatedSinceLastIntervalColumn, int64_t, "Memory Allocated Since Last Interval");
+    CSV_COLUMN(FreedSinceLastIntervalColumn, int64_t, "Memory Freed Since Last Interval");
+    CSV_COLUMN(LiveThisIntervalPhysicalColumn, int64_t, "Objects Live This Interval Physical Size");
+    CSV_COLUMN(Live2IntervalsPhysicalColumn, int64_t, "Objects Live >=2 Intervals Physical Size");
+    CSV_COLUMN(Live4IntervalsPhysicalColumn, int64_t, "Objects Live >=4 Intervals Physical Size");
+    CSV_COLUMN(Live8IntervalsPhysicalColumn, int64_t, "Objects Live >=8 Intervals Physical Size");
+    CSV_COLUMN(Live10IntervalsPhysicalColumn, int64_t, "Objects Live >=10 Intervals Physical Size");
+    CSV_COLUMN(Live16IntervalsPhysicalColumn, int64_t, "Objects Live >=16 Intervals Physical Size");
+    CSV_COLUMN(Live24IntervalsPhysicalColumn, int64_t, "Objects Live >=24 Intervals Physical Size");
+    CSV_COLUMN(Live32IntervalsPhysicalColumn, int64_t, "Objects Live >=32 Intervals Physical Size");
+    CSV_COLUMN(LiveThisIntervalPhysicalWrittenColumn, int64_t, "Objects Live This Interval Physical Size (Written)");
+    CSV_COLUMN(Live2IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=2 Intervals Physical Size (Written)");
+    CSV_COLUMN(Live4IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=4 Intervals Physical Size (Written)");
+    CSV_COLUMN(Live8IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=8 Intervals Physical Size (Written)");
+    CSV_COLUMN(Live10IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=10 Intervals Physical Size (Written)");
+    CSV_COLUMN(Live16IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=16 Intervals Physical Size (Written)");
+    CSV_COLUMN(Live24IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=24 Intervals Physical Size (Written)");
+    CSV_COLUMN(Live32IntervalsPhysicalWrittenColumn, int64_t, "Objects Live >=32 Intervals Physical Size (Written)");
+    CSV_COLUMN(LiveThisIntervalPhysicalReadOnlyColumn, int64_t, "Objects Live This Interval Physical Size (Read-Only)");
+    CSV_COLUMN(Live2IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=2 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(Live4IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=4 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(Live8IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=8 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(Live10IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=10 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(Live16IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=16 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(Live24IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=24 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(Live32IntervalsPhysicalReadOnlyColumn, int64_t, "Objects Live >=32 Intervals Physical Size (Read-Only)");
+    CSV_COLUMN(LiveThisIntervalVirtualColumn, int64_t, "Objects Live This Interval Virtual Size");
+    CSV_COLUMN(Live2IntervalsVirtualColumn, int64_t, "Objects Live >=2 Intervals Virtual Size");
+    CSV_COLUMN(Live4IntervalsVirtualColumn, int64_t, "Objects Live >=4 Intervals Virtual Size");
+    CSV_COLUMN(Live8IntervalsVirtualColumn, int64_t, "Objects Live >=8 Intervals Virtual Size");
+    CSV_COLUMN(Live10IntervalsVirtualColumn, int64_t, "Objects Live >=10 Intervals Virtual Size");
+    CSV_COLUMN(Live16IntervalsVirtualColumn, int64_t, "Objects Live >=16 Intervals Virtual Size");
+    CSV_COLUMN(Live24IntervalsVirtualColumn, int64_t, "Objects Live >=24 Intervals Virtual Size");
+    CSV_COLUMN(Live32IntervalsVirtualColumn, int64_t, "Objects Live >=32 Intervals Virtual Size");
+
+    typedef CSVSchema<
+        IntervalColumn, TotalAllocatedColumn, TotalFreedColumn, AllocatedSinceLastIntervalColumn, FreedSinceLastIntervalColumn,
+        LiveThisIntervalPhysicalColumn, Live2IntervalsPhysicalColumn, Live4IntervalsPhysicalColumn, Live8IntervalsPhysicalColumn, Live10IntervalsPhysicalColumn, Live16IntervalsPhysicalColumn, Live24IntervalsPhysicalColumn, Live32IntervalsPhysicalColumn,
+        LiveThisIntervalPhysicalWrittenColumn, Live2IntervalsPhysicalWrittenColumn, Live4IntervalsPhysicalWrittenColumn, Live8IntervalsPhysicalWrittenColumn, Live10IntervalsPhysicalWrittenColumn, Live16IntervalsPhysicalWrittenColumn, Live24IntervalsPhysicalWrittenColumn, Live32IntervalsPhysicalWrittenColumn,
+        LiveThisIntervalPhysicalReadOnlyColumn, Live2IntervalsPhysicalReadOnlyColumn, Live4IntervalsPhysicalReadOnlyColumn, Live8IntervalsPhysicalReadOnlyColumn, Live10IntervalsPhysicalReadOnlyColumn, Live16IntervalsPhysicalReadOnlyColumn, Live24IntervalsPhysicalReadOnlyColumn, Live32IntervalsPhysicalReadOnlyColumn,
+        LiveThisIntervalVirtualColumn, Live2IntervalsVirtualColumn, Live4IntervalsVirtualColumn, Live8IntervalsVirtualColumn, Live10IntervalsVirtualColumn, Live16IntervalsVirtualColumn, Live24IntervalsVirtualColumn, Live32IntervalsVirtualColumn
+    > Schema;
+
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -31,58 +77,20 @@ class GenerationalTest : public IntervalTest {
         stack_debugf("Setup\n");
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
-        file = StackFile(StackString<256>("generational.csv"), Mode::APPEND);
+        file = StackFile(StackString<256>("generational.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #");
-        csv.title().add("Total Memory Allocated");
-        csv.title().add("Total Memory Freed");
-        csv.title().add("Memory Allocated Since Last Interval");
-        csv.title().add("Memory Freed Since Last Interval");
-
-        csv.title().add("Objects Live This Interval Physical Size");
-        csv.title().add("Objects Live >=2 Intervals Physical Size");
-        csv.title().add("Objects Live >=4 Intervals Physical Size");
-        csv.title().add("Objects Live >=8 Intervals Physical Size");
-        csv.title().add("Objects Live >=10 Intervals Physical Size");
-        csv.title().add("Objects Live >=16 Intervals Physical Size");
-        csv.title().add("Objects Live >=24 Intervals Physical Size");
-        csv.title().add("Objects Live >=32 Intervals Physical Size");
-        
-        csv.title().add("Objects Live This Interval Physical Size (Written)");
-        csv.title().add("Objects Live >=2 Intervals Physical Size (Written)");
-        csv.title().add("Objects Live >=4 Intervals Physical Size (Written)");
-        csv.title().add("Objects Live >=8 Intervals Physical Size (Written)");
-        csv.title().add("Objects Live >=10 Intervals Physical Size (Written)");
-        csv.title().add("Objects Live >=16 Intervals Physical Size (Written)");
-        csv.title().add("Objects Live >=24 Intervals Physical Size (Written)");
-        csv.title().add("Objects Live >=32 Intervals Physical Size (Written)");
-
-        csv.title().add("Objects Live This Interval Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=2 Intervals Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=4 Intervals Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=8 Intervals Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=10 Intervals Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=16 Intervals Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=24 Intervals Physical Size (Read-Only)");
-        csv.title().add("Objects Live >=32 Intervals Physical Size (Read-Only)");
-
-        csv.title().add("Objects Live This Interval Virtual Size");
-        csv.title().add("Objects Live >=2 Intervals Virtual Size");
-        csv.title().add("Objects Live >=4 Intervals Virtual Size");
-        csv.title().add("Objects Live >=8 Intervals Virtual Size");
-        csv.title().add("Objects Live >=10 Intervals Virtual Size");
-        csv.title().add("Objects Live >=16 Intervals Virtual Size");
-        csv.title().add("Objects Live >=24 Intervals Virtual Size");
-        csv.title().add("Objects Live >=32 Intervals Virtual Size");
-
         csv.write(file);
         csv.clear();
 
         interval_count = 0;
     }
 
-    void summary() {
+    /// @brief Log the running totals, unless `level` is filtered out.
+    void summary(LogLevel level=LogLevel::Info) {
+        if (!log_enabled(level)) {
+            return;
+        }
         stack_infof("Total allocations: %d\n", total_allocations);
         stack_infof("Total frees: %d\n", total_frees);
         stack_infof("Memory allocated since last interval: %d\n", memory_allocated_since_last_interval);
@@ -98,7 +106,7 @@ class GenerationalTest : public IntervalTest {
         memory_allocated_since_last_interval += alloc.size;
         total_memory_allocated += alloc.size;
 
-        summary();
+        summary(LogLevel::Debug);
     }
 
     void on_free(const Allocation &alloc) override {
@@ -108,7 +116,7 @@ class GenerationalTest : public IntervalTest {
         memory_freed_since_last_interval += alloc.size;
         total_memory_freed += alloc.size;
      
-        summary();
+        summary(LogLevel::Debug);
     }
 
     void finish_interval() {
@@ -315,48 +323,48 @@ class GenerationalTest : public IntervalTest {
         // csv.last().add(objects_live_24_intervals_virtual_size);
         // csv.last().add(objects_live_32_intervals_virtual_size);
 
-        CSVRow<48> &row = csv.new_row();
-        row.set(csv.title(), "Interval #", interval_count);
-        row.set(csv.title(), "Total Memory Allocated", total_memory_allocated);
-        row.set(csv.title(), "Total Memory Freed", total_memory_freed);
-        row.set(csv.title(), "Memory Allocated Since Last Interval", memory_allocated_since_last_interval);
-        row.set(csv.title(), "Memory Freed Since Last Interval", memory_freed_since_last_interval);
-
-        row.set(csv.title(), "Objects Live This Interval Physical Size", objects_live_this_interval_physical_size);
-        row.set(csv.title(), "Objects Live >=2 Intervals Physical Size", objects_live_2_intervals_physical_size);
-        row.set(csv.title(), "Objects Live >=4 Intervals Physical Size", objects_live_4_intervals_physical_size);
-        row.set(csv.title(), "Objects Live >=8 Intervals Physical Size", objects_live_8_intervals_physical_size);
-        row.set(csv.title(), "Objects Live >=10 Intervals Physical Size", objects_live_10_intervals_physical_size);
-        row.set(csv.title(), "Objects Live >=16 Intervals Physical Size", objects_live_16_intervals_physical_size);
-        row.set(csv.title(), "Objects Live >=24 Intervals Physical Size", objects_live_24_intervals_physical_size);
-        row.set(csv.title(), "Objects Live >=32 Intervals Physical Size", objects_live_32_intervals_physical_size);
-
-        row.set(csv.title(), "Objects Live This Interval Physical Size (Written)", objects_live_this_interval_physical_size_written);
-        row.set(csv.title(), "Objects Live >=2 Intervals Physical Size (Written)", objects_live_2_intervals_physical_size_written);
-        row.set(csv.title(), "Objects Live >=4 Intervals Physical Size (Written)", objects_live_4_intervals_physical_size_written);
-        row.set(csv.title(), "Objects Live >=8 Intervals Physical Size (Written)", objects_live_8_intervals_physical_size_written);
-        row.set(csv.title(), "Objects Live >=10 Intervals Physical Size (Written)", objects_live_10_intervals_physical_size_written);
-        row.set(csv.title(), "Objects Live >=16 Intervals Physical Size (Written)", objects_live_16_intervals_physical_size_written);
-        row.set(csv.title(), "Objects Live >=24 Intervals Physical Size (Written)", objects_live_24_intervals_physical_size_written);
-        row.set(csv.title(), "Objects Live >=32 Intervals Physical Size (Written)", objects_live_32_intervals_physical_size_written);
-
-        row.set(csv.title(), "Objects Live This Interval Physical Size (Read-Only)", objects_live_this_interval_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=2 Intervals Physical Size (Read-Only)", objects_live_2_intervals_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=4 Intervals Physical Size (Read-Only)", objects_live_4_intervals_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=8 Intervals Physical Size (Read-Only)", objects_live_8_intervals_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=10 Intervals Physical Size (Read-Only)", objects_live_10_intervals_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=16 Intervals Physical Size (Read-Only)", objects_live_16_intervals_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=24 Intervals Physical Size (Read-Only)", objects_live_24_intervals_physical_size_readonly);
-        row.set(csv.title(), "Objects Live >=32 Intervals Physical Size (Read-Only)", objects_live_32_intervals_physical_size_readonly);
-
-        row.set(csv.title(), "Objects Live This Interval Virtual Size", objects_live_this_interval_virtual_size);
-        row.set(csv.title(), "Objects Live >=2 Intervals Virtual Size", objects_live_2_intervals_virtual_size);
-        row.set(csv.title(), "Objects Live >=4 Intervals Virtual Size", objects_live_4_intervals_virtual_size);
-        row.set(csv.title(), "Objects Live >=8 Intervals Virtual Size", objects_live_8_intervals_virtual_size);
-        row.set(csv.title(), "Objects Live >=10 Intervals Virtual Size", objects_live_10_intervals_virtual_size);
-        row.set(csv.title(), "Objects Live >=16 Intervals Virtual Size", objects_live_16_intervals_virtual_size);
-        row.set(csv.title(), "Objects Live >=24 Intervals Virtual Size", objects_live_24_intervals_virtual_size);
-        row.set(csv.title(), "Objects Live >=32 Intervals Virtual Size", objects_live_32_intervals_virtual_size);
+        auto &row = csv.new_row();
+        row.set<IntervalColumn>(interval_count);
+        row.set<TotalAllocatedColumn>(total_memory_allocated);
+        row.set<TotalFreedColumn>(total_memory_freed);
+        row.set<AllocatedSinceLastIntervalColumn>(memory_allocated_since_last_interval);
+        row.set<FreedSinceLastIntervalColumn>(memory_freed_since_last_interval);
+
+        row.set<LiveThisIntervalPhysicalColumn>(objects_live_this_interval_physical_size);
+        row.set<Live2IntervalsPhysicalColumn>(objects_live_2_intervals_physical_size);
+        row.set<Live4IntervalsPhysicalColumn>(objects_live_4_intervals_physical_size);
+        row.set<Live8IntervalsPhysicalColumn>(objects_live_8_intervals_physical_size);
+        row.set<Live10IntervalsPhysicalColumn>(objects_live_10_intervals_physical_size);
+        row.set<Live16IntervalsPhysicalColumn>(objects_live_16_intervals_physical_size);
+        row.set<Live24IntervalsPhysicalColumn>(objects_live_24_intervals_physical_size);
+        row.set<Live32IntervalsPhysicalColumn>(objects_live_32_intervals_physical_size);
+
+        row.set<LiveThisIntervalPhysicalWrittenColumn>(objects_live_this_interval_physical_size_written);
+        row.set<Live2IntervalsPhysicalWrittenColumn>(objects_live_2_intervals_physical_size_written);
+        row.set<Live4IntervalsPhysicalWrittenColumn>(objects_live_4_intervals_physical_size_written);
+        row.set<Live8IntervalsPhysicalWrittenColumn>(objects_live_8_intervals_physical_size_written);
+        row.set<Live10IntervalsPhysicalWrittenColumn>(objects_live_10_intervals_physical_size_written);
+        row.set<Live16IntervalsPhysicalWrittenColumn>(objects_live_16_intervals_physical_size_written);
+        row.set<Live24IntervalsPhysicalWrittenColumn>(objects_live_24_intervals_physical_size_written);
+        row.set<Live32IntervalsPhysicalWrittenColumn>(objects_live_32_intervals_physical_size_written);
+
+        row.set<LiveThisIntervalPhysicalReadOnlyColumn>(objects_live_this_interval_physical_size_readonly);
+        row.set<Live2IntervalsPhysicalReadOnlyColumn>(objects_live_2_intervals_physical_size_readonly);
+        row.set<Live4IntervalsPhysicalReadOnlyColumn>(objects_live_4_intervals_physical_size_readonly);
+        row.set<Live8IntervalsPhysicalReadOnlyColumn>(objects_live_8_intervals_physical_size_readonly);
+        row.set<Live10IntervalsPhysicalReadOnlyColumn>(objects_live_10_intervals_physical_size_readonly);
+        row.set<Live16IntervalsPhysicalReadOnlyColumn>(objects_live_16_intervals_physical_size_readonly);
+        row.set<Live24IntervalsPhysicalReadOnlyColumn>(objects_live_24_intervals_physical_size_readonly);
+        row.set<Live32IntervalsPhysicalReadOnlyColumn>(objects_live_32_intervals_physical_size_readonly);
+
+        row.set<LiveThisIntervalVirtualColumn>(objects_live_this_interval_virtual_size);
+        row.set<Live2IntervalsVirtualColumn>(objects_live_2_intervals_virtual_size);
+        row.set<Live4IntervalsVirtualColumn>(objects_live_4_intervals_virtual_size);
+        row.set<Live8IntervalsVirtualColumn>(objects_live_8_intervals_virtual_size);
+        row.set<Live10IntervalsVirtualColumn>(objects_live_10_intervals_virtual_size);
+        row.set<Live16IntervalsVirtualColumn>(objects_live_16_intervals_virtual_size);
+        row.set<Live24IntervalsVirtualColumn>(objects_live_24_intervals_virtual_size);
+        row.set<Live32IntervalsVirtualColumn>(objects_live_32_intervals_virtual_size);
 
         stack_debugf("Finishing up interval\n");
         finish_interval();
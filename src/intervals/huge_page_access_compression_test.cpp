@@ -2,7 +2,7 @@
 
 #include <config.hpp>
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <compressor.hpp>
 
 // #define MAX_COMPRESSED_SIZE 0x100000
@@ -58,7 +58,25 @@ public:
 
     HugePageAccessCompressionTest() : HugePageAccessCompressionTest(DEFAULT_COMPRESSION_TYPE) {}
 private:
-    CSV<64, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(HugePageAddressColumn, void*, "Huge Page Address");
+    CSV_COLUMN(AgeColumn, uint64_t, "Age (intervals)");
+    CSV_COLUMN(PageSizeColumn, uint64_t, "Page Size (bytes)");
+    CSV_COLUMN(CompressedSizeColumn, uint64_t, "Compressed Size (bytes)");
+    CSV_COLUMN(IsNewColumn, bool, "New?");
+    CSV_COLUMN(WrittenColumn, bool, "Written?");
+    CSV_COLUMN(ReadColumn, bool, "Read?");
+    CSV_COLUMN(UnaccessedColumn, bool, "Unaccessed?");
+    CSV_COLUMN(CompressionRatioColumn, double, "Compression Ratio (compressed/uncompressed)");
+    CSV_COLUMN(LivePagesColumn, uint64_t, "Live Pages");
+
+    typedef CSVSchema<
+        IntervalColumn, HugePageAddressColumn, AgeColumn, PageSizeColumn, CompressedSizeColumn,
+        IsNewColumn, WrittenColumn, ReadColumn, UnaccessedColumn, CompressionRatioColumn,
+        LivePagesColumn
+    > Schema;
+
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -96,22 +114,9 @@ private:
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
         // file = StackFile(StackString<256>("access-compression.csv"), Mode::APPEND);
-        file = StackFile(format<256>("huge-page-access-%s-compression.csv", compression_to_string(compression_type)), Mode::APPEND);
+        file = StackFile(format<256>("huge-page-access-%s-compression.csv" OUTPUT_FILE_SUFFIX, compression_to_string(compression_type)), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #");
-        csv.title().add("Huge Page Address");
-        csv.title().add("Age (intervals)");
-        csv.title().add("Page Size (bytes)");
-        csv.title().add("Compressed Size (bytes)");
-        csv.title().add("New?");
-        csv.title().add("Written?");
-        csv.title().add("Read?");
-        csv.title().add("Unaccessed?");
-        csv.title().add("Compression Ratio (compressed/uncompressed)");
-        csv.title().add("Live Pages");
-
-
         csv.write(file);
         csv.clear();
 
@@ -302,24 +307,24 @@ private:
             // mprotect(page.address, page.size, PROT_READ | PROT_EXEC);
             stack_infof("Compressing page %d/%d\n", ++i, huge_page_liveset.size());
             auto &row = csv.new_row();
-            row.set(csv.title(), "Interval #", interval_count);
-            row.set(csv.title(), "Huge Page Address", (void*)page.address);
-            row.set(csv.title(), "Age (intervals)", page.age);
-            row.set(csv.title(), "New?", page.age == 0);
-            row.set(csv.title(), "Written?", page.written_to);
-            row.set(csv.title(), "Read?", page.read_from);
-            row.set(csv.title(), "Unaccessed?", !page.accessed);
-            row.set(csv.title(), "Live Pages", huge_page_liveset.size());
+            row.set<IntervalColumn>(interval_count);
+            row.set<HugePageAddressColumn>((void*)page.address);
+            row.set<AgeColumn>(page.age);
+            row.set<IsNewColumn>(page.age == 0);
+            row.set<WrittenColumn>(page.written_to);
+            row.set<ReadColumn>(page.read_from);
+            row.set<UnaccessedColumn>(!page.accessed);
+            row.set<LivePagesColumn>(huge_page_liveset.size());
 
             uint64_t compressed_size = compressor.compress((const uint8_t*)page.address, page.size);
             uint64_t uncompressed_size = page.size;
 
-            row.set(csv.title(), "Page Size (bytes)", page.size);
-            row.set(csv.title(), "Compressed Size (bytes)", compressed_size);
+            row.set<PageSizeColumn>(page.size);
+            row.set<CompressedSizeColumn>(compressed_size);
             if (uncompressed_size == 0) {
-                row.set(csv.title(), "Compression Ratio (compressed/uncompressed)", 1.0);
+                row.set<CompressionRatioColumn>(1.0);
             } else {
-                row.set(csv.title(), "Compression Ratio (compressed/uncompressed)", (double)compressed_size / (double)uncompressed_size);
+                row.set<CompressionRatioColumn>((double)compressed_size / (double)uncompressed_size);
             }
         });
 
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <interval_test.hpp>
+#include <compressor.hpp>
+#include <live_metrics.hpp>
+
+static LiveMetrics live_metrics;
+
+// Keeps the per-interval half of the live metrics page: what is being
+// tracked, the resident set, and with COMPRESSION_TELEMETRY how each codec
+// did. The hooks publish the counts, rates and overhead between intervals,
+// and close the page at exit after their last publish. It is registered
+// last, so it sees everything compressed in the interval.
+class LiveMetricsTest : public IntervalTest {
+    size_t interval_count = 0;
+    #ifdef COMPRESSION_TELEMETRY
+    // The totals as of the end of the previous interval
+    TelemetrySnapshot previous[MAX_COMPRESSION_TYPES];
+    #endif
+
+    const char *name() const override {
+        return "Live Metrics";
+    }
+
+    void setup() override {
+        live_metrics.open();
+        interval_count = 0;
+    }
+
+    void interval(const StackMap<uintptr_t, AllocationSite, TRACKED_ALLOCATION_SITES> &allocation_sites) override {
+        ++interval_count;
+        uint64_t live_objects = 0, live_bytes = 0;
+        allocation_sites.map([&](uintptr_t key, const AllocationSite &site) {
+            site.allocations.map([&](void *ptr, const Allocation &alloc) {
+                live_objects++;
+                live_bytes += alloc.size;
+            });
+        });
+        uint64_t resident = resident_pages();
+
+        LiveCodecMetrics codecs[LIVE_METRICS_CODECS] = {};
+        size_t codec_count = 0;
+        #ifdef COMPRESSION_TELEMETRY
+        auto types = Compressor<>::supported_compression_types();
+        for (size_t i=0; i<types.size() && codec_count<LIVE_METRICS_CODECS; i++) {
+            CompressionType type = types[i];
+            TelemetrySnapshot total;
+            for (size_t bucket=0; bucket<TELEMETRY_SIZE_BUCKETS; bucket++) {
+                TelemetrySnapshot stats = compression_telemetry.snapshot(type, bucket);
+                total.uncompressed_size += stats.uncompressed_size;
+                total.compressed_size += stats.compressed_size;
+            }
+            TelemetrySnapshot stats = total - previous[type % MAX_COMPRESSION_TYPES];
+            previous[type % MAX_COMPRESSION_TYPES] = total;
+
+            LiveCodecMetrics &codec = codecs[codec_count++];
+            char name[129];
+            compression_to_string(type).c_str(name);
+            snprintf(codec.name, sizeof(codec.name), "%.15s", name);
+            codec.uncompressed_size = stats.uncompressed_size;
+            codec.compressed_size = stats.compressed_size;
+            codec.ratio = stats.ratio();
+        }
+        #endif
+
+        live_metrics.update([&](LiveMetricsData &data) {
+            data.intervals = interval_count;
+            data.live_objects = live_objects;
+            data.live_bytes = live_bytes;
+            data.resident_pages = resident;
+            data.codec_count = codec_count;
+            memcpy(data.codecs, codecs, sizeof(codecs));
+        });
+    }
+
+    // The second field of /proc/self/statm
+    static uint64_t resident_pages() {
+        char buffer[128] = {0};
+        int fd = open("/proc/self/statm", O_RDONLY);
+        if (fd == -1) {
+            return 0;
+        }
+        ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (length <= 0) {
+            return 0;
+        }
+        const char *resident = strchr(buffer, ' ');
+        return resident == nullptr ? 0 : strtoull(resident + 1, nullptr, 10);
+    }
+};
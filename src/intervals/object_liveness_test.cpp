@@ -1,19 +1,44 @@
 #pragma once
 
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
-#include <zlib.h>
+#include <csv_table.hpp>
+#include <compressor.hpp>
+#include <timer.hpp>
 #include <sys/mman.h>
+#include <sys/uio.h>
 
-#define MAX_COMPRESSED_SIZE 0x10000000
-#define MAX_PAGES (MAX_COMPRESSED_SIZE / PAGE_SIZE)
+#define MAX_OBJECT_PAGES 0x10000
 
-uint8_t uncompressed_buffer[MAX_COMPRESSED_SIZE], compressed_buffer[MAX_COMPRESSED_SIZE];
+#ifndef USE_ZLIB_COMPRESSION
+#error "OBJECT_LIVENESS_TEST requires USE_ZLIB_COMPRESSION"
+#endif
 
 
 // Path: src/compression_test.cpp
 class ObjectLivenessTest : public IntervalTest {
-    CSV<16, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(AllocationSiteColumn, void*, "Allocation Site");
+    CSV_COLUMN(AgeColumn, uint64_t, "Age (intervals)");
+    CSV_COLUMN(AgeMillisecondsColumn, int64_t, "Age (ms since allocated)");
+    CSV_COLUMN(IsNewColumn, uint64_t, "Is new?");
+    CSV_COLUMN(ObjectAddressColumn, void*, "Object Address");
+    CSV_COLUMN(TimeAllocatedColumn, uint64_t, "Time allocated (ms since start)");
+    CSV_COLUMN(WrittenColumn, uint64_t, "Written During This Interval?");
+    CSV_COLUMN(VirtualSizeColumn, uint64_t, "Object Virtual Size (bytes)");
+    CSV_COLUMN(PhysicalSizeColumn, uint64_t, "Object Physical Size (bytes)");
+    CSV_COLUMN(CompressionSavingsColumn, uint64_t, "Object Physical Page Compression Savings (bytes)");
+
+    typedef CSVSchema<
+        IntervalColumn, AllocationSiteColumn, AgeColumn, AgeMillisecondsColumn, IsNewColumn, ObjectAddressColumn,
+        TimeAllocatedColumn, WrittenColumn, VirtualSizeColumn, PhysicalSizeColumn, CompressionSavingsColumn
+    > Schema;
+
+    // The runs of contiguous non-zero pages of the object being compressed
+    struct iovec segments[MAX_OBJECT_PAGES];
+    // Bytes compressed straight from the object's pages this interval
+    uint64_t bytes_in_place = 0;
+    Stopwatch compression_time;
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -27,21 +52,9 @@ class ObjectLivenessTest : public IntervalTest {
         stack_debugf("Setup\n");
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
-        file = StackFile(StackString<256>("object-liveness.csv"), Mode::APPEND);
+        file = StackFile(StackString<256>("object-liveness.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #");
-        csv.title().add("Allocation Site");
-        csv.title().add("Age (intervals)");
-        csv.title().add("Age (ms since allocated)");
-        csv.title().add("Is new?");
-        csv.title().add("Object Address");
-        csv.title().add("Time allocated (ms since start)");
-        csv.title().add("Written During This Interval?");
-        csv.title().add("Object Virtual Size (bytes)");
-        csv.title().add("Object Physical Size (bytes)");
-        csv.title().add("Object Physical Page Compression Savings (bytes)");
-
         csv.write(file);
         csv.clear();
         interval_count = 0;
@@ -52,6 +65,12 @@ class ObjectLivenessTest : public IntervalTest {
     ) override {
         ++interval_count;
         size_t objects_tracked = 0;
+        // Local, like AllTest's, so its streaming contexts are not torn down with
+        // the static test while a final interval runs during process exit.
+        // The savings column has always measured zlib, whatever the default codec.
+        Compressor<PAGE_SIZE, false> compressor(COMPRESS_ZLIB);
+        bytes_in_place = 0;
+        compression_time.reset();
         stack_infof("Interval %d object liveness starting...\n", interval_count);
         allocation_sites.map([&](auto return_address, AllocationSite site) {
             if (site.allocations.num_entries() == 0) return;
@@ -59,28 +78,23 @@ class ObjectLivenessTest : public IntervalTest {
             site.allocations.map([&](void *ptr, Allocation allocation) {
                 objects_tracked++;
                 stack_debugf("Object at 0x%x, age=%d, new=%d, dirty=%d\n", ptr, allocation.get_age(), allocation.is_new(), allocation.is_dirty());
-                csv.new_row();
-                csv.last()[0] = interval_count;
-                csv.last()[1] = CSVString::format("0x%x", site.return_address);
-                csv.last()[2] = allocation.get_age() + 1;
+                auto &row = csv.new_row();
+                row.set<IntervalColumn>(interval_count);
+                row.set<AllocationSiteColumn>((void*)site.return_address);
+                row.set<AgeColumn>(allocation.get_age() + 1);
                 // Age in milliseconds since allocated
-                csv.last()[3] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - allocation.get_time_allocated()).count();
-                csv.last()[4] = (uint64_t)allocation.is_new();
-                csv.last()[5] = CSVString::format("0x%x", ptr);
-                csv.last()[6] = allocation.get_time_allocated_ms() - test_start_time_ms;
-                csv.last()[7] = (uint64_t)allocation.is_dirty();
-
-                memset(uncompressed_buffer, 0, MAX_COMPRESSED_SIZE);
+                row.set<AgeMillisecondsColumn>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - allocation.get_time_allocated()).count());
+                row.set<IsNewColumn>(allocation.is_new());
+                row.set<ObjectAddressColumn>(ptr);
+                row.set<TimeAllocatedColumn>(allocation.get_time_allocated_ms() - test_start_time_ms);
+                row.set<WrittenColumn>(allocation.is_dirty());
 
                 allocation.protect(PROT_READ);
-                // Get the physical pages, compress them, and calculate the savings in bytes
-                auto pages = allocation.physical_pages<MAX_PAGES>(true);
+                // Get the physical pages, compress them as one stream, and calculate the savings in bytes
+                auto pages = allocation.physical_pages<MAX_OBJECT_PAGES>(true);
+                size_t num_segments = 0;
                 size_t original_physical_size = pages.reduce<size_t>([&](auto page, auto acc) {
                     // stack_infof("Found physical page at 0x%x (virtual=0x%x, dirty=%, zero=%)\n", page.get_physical_address(), page.get_virtual_address(), page.is_dirty(), page.is_zero());
-                    if (uncompressed_buffer + acc + page.size() > uncompressed_buffer + MAX_COMPRESSED_SIZE) {
-                        stack_debugf("Original size %d too large, truncating to %d\n", original_physical_size, MAX_COMPRESSED_SIZE);
-                        return acc;  // Stop if we're going to overflow the buffer
-                    }
                     if (page.is_zero()) {
                         // stack_infof("Zero page, skipping\n");
                         // Go through bytes and see if they're all zero
@@ -95,30 +109,39 @@ class ObjectLivenessTest : public IntervalTest {
                         return acc;
                     }
 
-                    memcpy(uncompressed_buffer + acc, page.get_virtual_address(), page.size());
+                    // Extend the current run if this page follows it, otherwise start a new one
+                    uint8_t *start = (uint8_t*)page.get_virtual_address();
+                    if (num_segments > 0 && (uint8_t*)segments[num_segments - 1].iov_base + segments[num_segments - 1].iov_len == start) {
+                        segments[num_segments - 1].iov_len += page.size();
+                    } else {
+                        segments[num_segments].iov_base = start;
+                        segments[num_segments].iov_len = page.size();
+                        num_segments++;
+                    }
                     return acc + page.size();
                 }, 0);
-                allocation.unprotect();
-                
-                uint64_t estimated_compressed_size = compressBound(original_physical_size);
-                uint64_t compressed_size = estimated_compressed_size;
 
-                stack_debugf("Compressing %d bytes\n", original_physical_size);
+                stack_debugf("Compressing %d bytes in %d segments\n", original_physical_size, num_segments);
 
-                int result = compress(compressed_buffer, &compressed_size, uncompressed_buffer, original_physical_size);
+                // The pages are read in place while the object is read-only
+                compression_time.start();
+                uint64_t compressed_size = compressor.compress_stream(segments, num_segments);
+                compression_time.stop();
+                allocation.unprotect();
+                bytes_in_place += original_physical_size;
 
-                if (result != Z_OK) {
-                    stack_errorf("Compression failed with result %d\n", result);
+                if (compressed_size == 0 && original_physical_size > 0) {
+                    stack_errorf("Compression failed\n");
                     exit(1);
                 }
 
                 stack_debugf("Compressed from %d bytes to %d bytes\n", original_physical_size, compressed_size);
 
-                csv.last()[8] = allocation.size;
-                csv.last()[9] = original_physical_size;
+                row.set<VirtualSizeColumn>(allocation.size);
+                row.set<PhysicalSizeColumn>(original_physical_size);
                 
-                // Calculate the savings
-                csv.last()[10] = original_physical_size - compressed_size;
+                // Calculate the savings; none when the stream outgrows tiny or incompressible objects
+                row.set<CompressionSavingsColumn>(original_physical_size > compressed_size ? original_physical_size - compressed_size : 0);
             });
             stack_infof("Site 0x%x complete\n", return_address);
         });
@@ -127,6 +150,7 @@ class ObjectLivenessTest : public IntervalTest {
         csv.clear();
         stack_infof("Interval %d complete for object liveness\n", interval_count);
         stack_infof("Tracked %d objects\n", objects_tracked);
+        stack_infof("Compressed %d bytes in place in %d ms\n", bytes_in_place, compression_time.elapsed_milliseconds());
     }
 
     void cleanup() override {
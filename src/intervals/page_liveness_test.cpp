@@ -1,12 +1,29 @@
 #pragma once
 
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <zlib.h>
 
 // Path: src/compression_test.cpp
 class PageLivenessTest : public IntervalTest {
-    CSV<16, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(AllocationSiteColumn, void*, "Allocation Site");
+    CSV_COLUMN(AgeColumn, uint64_t, "Age (intervals)");
+    CSV_COLUMN(AgeMillisecondsColumn, int64_t, "Age (ms since allocated)");
+    CSV_COLUMN(IsNewColumn, uint64_t, "Is new?");
+    CSV_COLUMN(ObjectAddressColumn, void*, "Object Address");
+    CSV_COLUMN(VirtualPageAddressColumn, void*, "Virtual Page Address");
+    CSV_COLUMN(PhysicalPageAddressColumn, void*, "Physical Page Address");
+    CSV_COLUMN(TimeAllocatedColumn, uint64_t, "Time allocated (ms since start)");
+    CSV_COLUMN(WrittenColumn, uint64_t, "Written During This Interval?");
+    CSV_COLUMN(CompressionSavingsColumn, uint64_t, "Compression Savings (bytes)");
+
+    typedef CSVSchema<
+        IntervalColumn, AllocationSiteColumn, AgeColumn, AgeMillisecondsColumn, IsNewColumn, ObjectAddressColumn,
+        VirtualPageAddressColumn, PhysicalPageAddressColumn, TimeAllocatedColumn, WrittenColumn, CompressionSavingsColumn
+    > Schema;
+
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -20,21 +37,9 @@ class PageLivenessTest : public IntervalTest {
         stack_debugf("Setup\n");
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
-        file = StackFile(StackString<256>("page-liveness.csv"), Mode::APPEND);
+        file = StackFile(StackString<256>("page-liveness.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #");
-        csv.title().add("Allocation Site");
-        csv.title().add("Age (intervals)");
-        csv.title().add("Age (ms since allocated)");
-        csv.title().add("Is new?");
-        csv.title().add("Object Address");
-        csv.title().add("Virtual Page Address");
-        csv.title().add("Physical Page Address");
-        csv.title().add("Time allocated (ms since start)");
-        csv.title().add("Written During This Interval?");
-        csv.title().add("Compression Savings (bytes)");
-
         csv.write(file);
         csv.clear();
         interval_count = 0;
@@ -53,18 +58,18 @@ class PageLivenessTest : public IntervalTest {
                     if (page.is_zero()) {
                         return;
                     }
-                    csv.new_row();
-                    csv.last()[0] = interval_count;
-                    csv.last()[1] = CSVString::format("0x%x", site.return_address);
-                    csv.last()[2] = allocation.get_age() + 1;
+                    auto &row = csv.new_row();
+                    row.set<IntervalColumn>(interval_count);
+                    row.set<AllocationSiteColumn>((void*)site.return_address);
+                    row.set<AgeColumn>(allocation.get_age() + 1);
                     // Age in milliseconds since allocated
-                    csv.last()[3] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - allocation.get_time_allocated()).count();
-                    csv.last()[4] = (uint64_t)allocation.is_new();
-                    csv.last()[5] = CSVString::format("0x%x", ptr);
-                    csv.last()[6] = CSVString::format("0x%x", page.get_virtual_address());
-                    csv.last()[7] = CSVString::format("0x%x", page.get_physical_address());
-                    csv.last()[8] = allocation.get_time_allocated_ms() - test_start_time_ms;
-                    csv.last()[9] = (uint64_t)allocation.is_dirty();
+                    row.set<AgeMillisecondsColumn>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - allocation.get_time_allocated()).count());
+                    row.set<IsNewColumn>(allocation.is_new());
+                    row.set<ObjectAddressColumn>(ptr);
+                    row.set<VirtualPageAddressColumn>(page.get_virtual_address());
+                    row.set<PhysicalPageAddressColumn>(page.get_physical_address());
+                    row.set<TimeAllocatedColumn>(allocation.get_time_allocated_ms() - test_start_time_ms);
+                    row.set<WrittenColumn>(allocation.is_dirty());
                     // Compress the page
                     size_t original_physical_size = page.size();
                     uint64_t estimated_compressed_size = compressBound(original_physical_size);
@@ -78,7 +83,7 @@ class PageLivenessTest : public IntervalTest {
                         stack_errorf("Compression failed with result %d\n", result);
                         exit(1);
                     }
-                    csv.last()[10] = original_physical_size - compressed_size;
+                    row.set<CompressionSavingsColumn>(original_physical_size - compressed_size);
                 });
             });
             stack_infof("Site 0x%x complete\n", return_address);
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <interval_test.hpp>
-#include <stack_csv.hpp>
+#include <csv_table.hpp>
 #include <zlib.h>
 #include <stack_map.hpp>
 #include <stack_vec.hpp>
@@ -50,7 +50,24 @@ struct PageTracking {
 
 // Path: src/compression_test.cpp
 class PageTrackingTest : public IntervalTest {
-    CSV<12, 80000> csv;
+    CSV_COLUMN(IntervalColumn, uint64_t, "Interval #");
+    CSV_COLUMN(AllocationSiteColumn, void*, "Allocation Site");
+    CSV_COLUMN(AgeColumn, uint64_t, "Age (intervals)");
+    CSV_COLUMN(IsNewColumn, bool, "Is New Page?");
+    CSV_COLUMN(VirtualPageAddressColumn, void*, "Virtual Page Address");
+    CSV_COLUMN(PhysicalPageAddressColumn, void*, "Physical Page Address");
+    CSV_COLUMN(ModifiedThisIntervalColumn, bool, "Modified This Interval?");
+    CSV_COLUMN(ModifiedLastIntervalColumn, bool, "Modified Last Interval?");
+    CSV_COLUMN(HasNewObjectsColumn, bool, "Has New Objects?");
+    CSV_COLUMN(WriteCountColumn, uint64_t, "Write Count");
+    CSV_COLUMN(AgeSinceLastWriteColumn, uint64_t, "Age Since Last Write");
+
+    typedef CSVSchema<
+        IntervalColumn, AllocationSiteColumn, AgeColumn, IsNewColumn, VirtualPageAddressColumn, PhysicalPageAddressColumn,
+        ModifiedThisIntervalColumn, ModifiedLastIntervalColumn, HasNewObjectsColumn, WriteCountColumn, AgeSinceLastWriteColumn
+    > Schema;
+
+    CSVTable<Schema, 80000> csv;
     StackFile file;
     size_t interval_count = 0;
     std::chrono::steady_clock::time_point test_start_time;
@@ -66,21 +83,9 @@ class PageTrackingTest : public IntervalTest {
         stack_debugf("Setup\n");
         test_start_time = std::chrono::steady_clock::now();
         test_start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(test_start_time.time_since_epoch()).count();
-        file = StackFile(StackString<256>("page-tracking.csv"), Mode::APPEND);
+        file = StackFile(StackString<256>("page-tracking.csv" OUTPUT_FILE_SUFFIX), Mode::APPEND);
         file.clear();
 
-        csv.title().add("Interval #"); // 0
-        csv.title().add("Allocation Site"); // 1
-        csv.title().add("Age (intervals)"); // 2
-        csv.title().add("Is New Page?"); // 3
-        csv.title().add("Virtual Page Address"); // 4
-        csv.title().add("Physical Page Address"); // 5
-        csv.title().add("Modified This Interval?"); // 6
-        csv.title().add("Modified Last Interval?"); // 7
-        csv.title().add("Has New Objects?"); // 8
-        csv.title().add("Write Count"); // 9
-        csv.title().add("Age Since Last Write"); // 10
-
         csv.write(file);
         csv.clear();
         interval_count = 0;
@@ -178,31 +183,31 @@ class PageTrackingTest : public IntervalTest {
                     allocation_page_count++;
                     site_page_count++;
 
-                    csv.new_row();
-                    csv.last()[0] = interval_count;
-                    csv.last()[1] = CSVString::format("0x%x", site.return_address);
-                    csv.last()[3] = is_page_new(page.get_physical_address());
+                    auto &row = csv.new_row();
+                    row.set<IntervalColumn>(interval_count);
+                    row.set<AllocationSiteColumn>((void*)site.return_address);
+                    row.set<IsNewColumn>(is_page_new(page.get_physical_address()));
 
                     add_page(page.get_physical_address(), page.get_virtual_address(), interval_count);
                     
-                    csv.last()[2] = get_age_in_intervals(page.get_physical_address());
+                    row.set<AgeColumn>(get_age_in_intervals(page.get_physical_address()));
                     if (page.is_dirty()) {
                         write(page.get_physical_address());
                     } else {
                         no_write(page.get_physical_address());
                     }
 
-                    csv.last()[4] = CSVString::format("0x%x", page.get_virtual_address());
-                    csv.last()[5] = CSVString::format("0x%x", page.get_physical_address());
+                    row.set<VirtualPageAddressColumn>(page.get_virtual_address());
+                    row.set<PhysicalPageAddressColumn>(page.get_physical_address());
 
-                    csv.last()[6] = was_modified_this_interval(page.get_physical_address());
-                    csv.last()[7] = was_modified_last_interval(page.get_physical_address());
+                    row.set<ModifiedThisIntervalColumn>(was_modified_this_interval(page.get_physical_address()));
+                    row.set<ModifiedLastIntervalColumn>(was_modified_last_interval(page.get_physical_address()));
                     if (allocation.is_new()) {
                         add_new_objects(page.get_physical_address());
                     }
-                    csv.last()[8] = has_new_objects(page.get_physical_address());
-                    csv.last()[9] = get_write_count(page.get_physical_address());
-                    csv.last()[10] = get_interval_since_last_write(page.get_physical_address());
+                    row.set<HasNewObjectsColumn>(has_new_objects(page.get_physical_address()));
+                    row.set<WriteCountColumn>(get_write_count(page.get_physical_address()));
+                    row.set<AgeSinceLastWriteColumn>(get_interval_since_last_write(page.get_physical_address()));
                 });
                 allocation.protect();
                 stack_infof("Tracked %d pages for allocation\n", allocation_page_count);
@@ -0,0 +1,199 @@
+#pragma once
+
+// Reads the chunks of a table written in the columnar format
+// (`CSVFormat::COLUMNAR` in stack_csv.hpp) in place, for the offline tools.
+// Every offset in a chunk is checked against its size before it is used.
+
+#include <stack_csv.hpp>
+
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+struct ColumnReader {
+    const CSVColumnHeader *header;
+    const uint8_t *validity, *data;
+    // Where each dictionary entry starts, and its length
+    std::vector<std::pair<const char*, uint32_t>> dictionary;
+    // String columns keep their bytes after the offsets
+    const char *strings;
+
+    bool has_value(uint64_t row) const {
+        return validity == nullptr || (validity[row / 8] >> (row % 8)) & 1;
+    }
+
+    CSVCell cell(uint64_t row) const {
+        if (!has_value(row)) {
+            return CSVCell();
+        }
+        switch ((CSVColumnType)header->type) {
+            case CSVColumnType::INTEGER:
+                return CSVCell(((const int64_t*)data)[row]);
+            case CSVColumnType::FLOAT:
+                return CSVCell(((const double*)data)[row]);
+            case CSVColumnType::POINTER:
+                return CSVCell((void*)(uintptr_t)((const uint64_t*)data)[row]);
+            case CSVColumnType::BOOLEAN:
+                return CSVCell((bool)data[row]);
+            case CSVColumnType::DICTIONARY: {
+                const auto &entry = dictionary[((const uint32_t*)data)[row]];
+                return CSVCell(string(entry.first, entry.second));
+            }
+            case CSVColumnType::STRING: {
+                const uint32_t *offsets = (const uint32_t*)data;
+                return CSVCell(string(strings + offsets[row], offsets[row + 1] - offsets[row]));
+            }
+            default:
+                return CSVCell();
+        }
+    }
+
+    /// @brief A numeric cell as an unsigned integer, or false if it is empty or not a number.
+    bool number(uint64_t row, uint64_t &value) const {
+        if (!has_value(row)) {
+            return false;
+        }
+        switch ((CSVColumnType)header->type) {
+            case CSVColumnType::INTEGER:
+            case CSVColumnType::POINTER:
+                value = ((const uint64_t*)data)[row];
+                return true;
+            case CSVColumnType::BOOLEAN:
+                value = data[row];
+                return true;
+            case CSVColumnType::FLOAT:
+                value = (uint64_t)((const double*)data)[row];
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /// @brief A dictionary or string cell's bytes, in place.
+    std::string_view text(uint64_t row) const {
+        if (!has_value(row)) {
+            return std::string_view();
+        }
+        switch ((CSVColumnType)header->type) {
+            case CSVColumnType::DICTIONARY: {
+                const auto &entry = dictionary[((const uint32_t*)data)[row]];
+                return std::string_view(entry.first, entry.second);
+            }
+            case CSVColumnType::STRING: {
+                const uint32_t *offsets = (const uint32_t*)data;
+                return std::string_view(strings + offsets[row], offsets[row + 1] - offsets[row]);
+            }
+            default:
+                return std::string_view();
+        }
+    }
+
+    static CSVString string(const char *bytes, size_t size) {
+        CSVString result;
+        for (size_t i=0; i<size && i<CSV_STR_SIZE; i++) {
+            result.push(bytes[i]);
+        }
+        return result;
+    }
+};
+
+static bool in_bounds(const CSVChunkHeader &chunk, uint64_t offset, uint64_t size) {
+    return offset <= chunk.size && size <= chunk.size - offset;
+}
+
+// Check a column's sections lie inside its chunk and set up a reader for it
+static bool open_column(const uint8_t *base, const CSVChunkHeader &chunk, const CSVColumnHeader &header, ColumnReader &reader) {
+    reader.header = &header;
+    reader.validity = nullptr;
+    reader.strings = nullptr;
+    reader.dictionary.clear();
+    if (!in_bounds(chunk, header.name_offset, header.name_size) || !in_bounds(chunk, header.data_offset, header.data_size)) {
+        return false;
+    }
+    if (header.validity_offset != 0) {
+        if (!in_bounds(chunk, header.validity_offset, (chunk.rows + 7) / 8)) {
+            return false;
+        }
+        reader.validity = base + header.validity_offset;
+    }
+    reader.data = base + header.data_offset;
+
+    uint64_t rows = chunk.rows;
+    switch ((CSVColumnType)header.type) {
+        case CSVColumnType::EMPTY:
+            return true;
+        case CSVColumnType::INTEGER:
+        case CSVColumnType::FLOAT:
+        case CSVColumnType::POINTER:
+            return header.data_size >= rows * 8;
+        case CSVColumnType::BOOLEAN:
+            return header.data_size >= rows;
+        case CSVColumnType::DICTIONARY: {
+            if (!in_bounds(chunk, header.dictionary_offset, header.dictionary_size) || header.data_size < rows * sizeof(uint32_t)) {
+                return false;
+            }
+            const uint8_t *entry = base + header.dictionary_offset, *end = entry + header.dictionary_size;
+            for (uint64_t i=0; i<header.dictionary_entries; i++) {
+                uint32_t length;
+                if ((uint64_t)(end - entry) < sizeof(length)) {
+                    return false;
+                }
+                memcpy(&length, entry, sizeof(length));
+                entry += sizeof(length);
+                if ((uint64_t)(end - entry) < length) {
+                    return false;
+                }
+                reader.dictionary.push_back({(const char*)entry, length});
+                entry += length;
+            }
+            const uint32_t *codes = (const uint32_t*)reader.data;
+            for (uint64_t row=0; row<rows; row++) {
+                if (reader.has_value(row) && codes[row] >= reader.dictionary.size()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case CSVColumnType::STRING: {
+            uint64_t offsets_size = csv_columnar_pad((rows + 1) * sizeof(uint32_t));
+            if (header.data_size < offsets_size) {
+                return false;
+            }
+            const uint32_t *offsets = (const uint32_t*)reader.data;
+            reader.strings = (const char*)reader.data + offsets_size;
+            for (uint64_t row=0; row<rows; row++) {
+                if (offsets[row + 1] < offsets[row] || offsets[row + 1] > header.data_size - offsets_size) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/// @brief Check the chunk starting at `offset` of a columnar file, printing why to stderr if it is bad.
+/// @param max_columns The most columns the caller has readers for
+static bool read_chunk_header(const char *name, const uint8_t *file, uint64_t file_size, uint64_t offset, uint32_t max_columns, CSVChunkHeader &chunk) {
+    if (file_size - offset < sizeof(chunk)) {
+        fprintf(stderr, "%s is truncated at byte %lu\n", name, (unsigned long)offset);
+        return false;
+    }
+    memcpy(&chunk, file + offset, sizeof(chunk));
+    if (memcmp(chunk.magic, CSV_COLUMNAR_MAGIC, sizeof(chunk.magic)) != 0 || chunk.version != CSV_COLUMNAR_VERSION) {
+        fprintf(stderr, "%s has no chunk at byte %lu, or it is from another version\n", name, (unsigned long)offset);
+        return false;
+    }
+    if (chunk.size > file_size - offset || chunk.columns > max_columns
+        || chunk.size < sizeof(chunk) + (uint64_t)chunk.columns * sizeof(CSVColumnHeader)) {
+        fprintf(stderr, "The chunk at byte %lu of %s is truncated or corrupt\n", (unsigned long)offset, name);
+        return false;
+    }
+    return true;
+}
+
+/// @brief Whether a file starts with a columnar chunk, rather than CSV text.
+static bool is_columnar(const uint8_t *file, uint64_t file_size) {
+    return file_size >= sizeof(CSVChunkHeader) && memcmp(file, CSV_COLUMNAR_MAGIC, sizeof(CSVChunkHeader::magic)) == 0;
+}
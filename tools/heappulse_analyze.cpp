@@ -0,0 +1,448 @@
+// Computes the standard aggregates of HeapPulse's per-object, per-page and
+// per-huge-page tables, without loading them whole, and writes them as small
+// CSV tables the notebooks in `analysis/` can plot directly.
+//
+//     heappulse-analyze [-j threads] [-o directory] object-compression.csv page-compression.hpcol ...
+//
+// Each table is mapped and split among the threads: CSV text at line breaks
+// near even byte offsets, columnar tables a chunk at a time. Every thread
+// aggregates its share on its own, and the shares are merged at the end.
+// For a table named `<name>.csv` (or `.hpcol`, either maybe `.zst`), it writes
+//
+//     <name>-by-age-class.csv  per interval, compression type and age class
+//     <name>-by-site.csv       per allocation site and compression type
+//     <name>-generational.csv  per age and compression type, with how many
+//                              rows survive to that age relative to age 0
+//     <name>-by-access.csv     per interval, compression type and access type
+//
+// each with the rows, total size, compressed size and overall ratio of the
+// group. A table without the columns an aggregate needs skips it. A delta
+// table is rebuilt with heappulse-reconstruct first.
+
+#include "input_file.hpp"
+#include "columnar_reader.hpp"
+#include <timer.hpp>
+
+#include <charconv>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// The widest table the analyzer reads
+#define ANALYZE_MAX_COLUMNS 1024
+
+/// @brief Where the columns the aggregates read are, or -1 if the table doesn't have them.
+struct Columns {
+    int interval = -1, site = -1, age = -1, age_class = -1, size = -1, type = -1, compressed_size = -1, access = -1, event = -1;
+
+    // Match a column name to the column it is, if it's one that is read
+    void match(std::string_view name, int col) {
+        if (name == "Interval #") interval = col;
+        else if (name == "Allocation Site") site = col;
+        else if (name == "Age (intervals)") age = col;
+        else if (name == "Age Class") age_class = col;
+        else if (name == "Size (bytes)") size = col;
+        else if (name == "Compression Type") type = col;
+        else if (name == "Compressed Size (bytes)") compressed_size = col;
+        else if (name == "Access Type") access = col;
+        else if (name == "Event") event = col;
+    }
+
+    bool usable() const {
+        return interval != -1 && size != -1 && type != -1 && compressed_size != -1;
+    }
+};
+
+/// @brief The cells of one row the aggregates read. Strings point into the table.
+struct Row {
+    uint64_t interval = 0, site = 0, age = 0, size = 0, compressed_size = 0;
+    std::string_view type, age_class, access;
+};
+
+struct Totals {
+    uint64_t rows = 0, size = 0, compressed_size = 0;
+
+    void add(const Row &row) {
+        rows++;
+        size += row.size;
+        compressed_size += row.compressed_size;
+    }
+
+    void merge(const Totals &other) {
+        rows += other.rows;
+        size += other.size;
+        compressed_size += other.compressed_size;
+    }
+
+    double ratio() const {
+        return size == 0 ? 1.0 : (double)compressed_size / (double)size;
+    }
+};
+
+struct SiteTotals : Totals {
+    uint64_t age_sum = 0;
+    uint64_t first_interval = UINT64_MAX, last_interval = 0;
+
+    void add(const Row &row) {
+        Totals::add(row);
+        age_sum += row.age;
+        first_interval = (std::min)(first_interval, row.interval);
+        last_interval = (std::max)(last_interval, row.interval);
+    }
+
+    void merge(const SiteTotals &other) {
+        Totals::merge(other);
+        age_sum += other.age_sum;
+        first_interval = (std::min)(first_interval, other.first_interval);
+        last_interval = (std::max)(last_interval, other.last_interval);
+    }
+};
+
+/// @brief The aggregates of a share of a table, or of all of it once merged.
+struct Aggregates {
+    // By interval, compression type and age class
+    std::map<std::tuple<uint64_t, std::string_view, std::string_view>, Totals> by_age_class;
+    // By site and compression type
+    std::map<std::tuple<uint64_t, std::string_view>, SiteTotals> by_site;
+    // By age and compression type
+    std::map<std::tuple<uint64_t, std::string_view>, Totals> by_age;
+    // By interval, compression type and access type
+    std::map<std::tuple<uint64_t, std::string_view, std::string_view>, Totals> by_access;
+    uint64_t rows = 0, skipped = 0;
+
+    void add(const Columns &columns, const Row &row) {
+        rows++;
+        if (columns.age_class != -1) {
+            by_age_class[{row.interval, row.type, row.age_class}].add(row);
+        }
+        if (columns.site != -1) {
+            by_site[{row.site, row.type}].add(row);
+        }
+        if (columns.age != -1) {
+            by_age[{row.age, row.type}].add(row);
+        }
+        if (columns.access != -1) {
+            by_access[{row.interval, row.type, row.access}].add(row);
+        }
+    }
+
+    void merge(const Aggregates &other) {
+        for (const auto &entry : other.by_age_class) by_age_class[entry.first].merge(entry.second);
+        for (const auto &entry : other.by_site) by_site[entry.first].merge(entry.second);
+        for (const auto &entry : other.by_age) by_age[entry.first].merge(entry.second);
+        for (const auto &entry : other.by_access) by_access[entry.first].merge(entry.second);
+        rows += other.rows;
+        skipped += other.skipped;
+    }
+};
+
+static bool parse_number(std::string_view cell, uint64_t &value, int base=10) {
+    if (cell.empty()) {
+        return false;
+    }
+    auto result = std::from_chars(cell.data(), cell.data() + cell.size(), value, base);
+    return result.ec == std::errc() && result.ptr == cell.data() + cell.size();
+}
+
+// Find the columns in a line of CSV titles
+static Columns csv_columns(const char *line, const char *end) {
+    Columns columns;
+    int col = 0;
+    for (const char *cell = line; cell <= end; col++) {
+        const char *comma = (const char*)memchr(cell, ',', end - cell);
+        const char *cell_end = comma == nullptr ? end : comma;
+        columns.match(std::string_view(cell, cell_end - cell), col);
+        cell = cell_end + 1;
+    }
+    return columns;
+}
+
+// Aggregate the CSV rows in [text, end), which starts and ends at line breaks
+static void aggregate_csv(const char *text, const char *end, const Columns &columns, Aggregates &aggregates) {
+    int last_column = (std::max)({columns.interval, columns.site, columns.age, columns.age_class,
+                                columns.size, columns.type, columns.compressed_size, columns.access});
+    for (const char *line = text; line < end;) {
+        const char *line_end = (const char*)memchr(line, '\n', end - line);
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+
+        Row row;
+        bool ok = true;
+        int col = 0;
+        for (const char *cell = line; cell <= line_end && col <= last_column; col++) {
+            const char *comma = (const char*)memchr(cell, ',', line_end - cell);
+            const char *cell_end = comma == nullptr ? line_end : comma;
+            std::string_view value(cell, cell_end - cell);
+            if (col == columns.interval) ok = parse_number(value, row.interval) && ok;
+            else if (col == columns.size) ok = parse_number(value, row.size) && ok;
+            else if (col == columns.compressed_size) ok = parse_number(value, row.compressed_size) && ok;
+            else if (col == columns.age) ok = parse_number(value, row.age) && ok;
+            else if (col == columns.site) ok = parse_number(value, row.site, 16) && ok;
+            else if (col == columns.type) row.type = value;
+            else if (col == columns.age_class) row.age_class = value;
+            else if (col == columns.access) row.access = value;
+            cell = cell_end + 1;
+        }
+
+        // Titles repeated mid-table, blank lines and short rows are left out
+        if (ok && col > last_column) {
+            aggregates.add(columns, row);
+        } else if (line_end > line) {
+            aggregates.skipped++;
+        }
+        line = line_end + 1;
+    }
+}
+
+// Aggregate the columnar chunks starting at `offsets`
+static void aggregate_chunks(const uint8_t *file, const std::vector<uint64_t> &offsets, Aggregates &aggregates) {
+    std::vector<ColumnReader> readers(ANALYZE_MAX_COLUMNS);
+    for (uint64_t offset : offsets) {
+        CSVChunkHeader chunk;
+        memcpy(&chunk, file + offset, sizeof(chunk));
+        const uint8_t *base = file + offset;
+        const CSVColumnHeader *headers = (const CSVColumnHeader*)(base + sizeof(chunk));
+
+        Columns columns;
+        bool ok = true;
+        for (uint32_t col=0; col<chunk.columns; col++) {
+            ok = open_column(base, chunk, headers[col], readers[col]) && ok;
+            columns.match(std::string_view((const char*)base + headers[col].name_offset, headers[col].name_size), col);
+        }
+        if (!ok || !columns.usable() || columns.event != -1) {
+            fprintf(stderr, "Skipping the chunk at byte %lu: %s\n", (unsigned long)offset,
+                !ok ? "it is corrupt" : columns.event != -1 ? "it is from a delta table" : "it is not from a per-object, per-page or per-huge-page table");
+            aggregates.skipped += chunk.rows;
+            continue;
+        }
+
+        for (uint64_t r=0; r<chunk.rows; r++) {
+            Row row;
+            bool has = readers[columns.interval].number(r, row.interval)
+                    && readers[columns.size].number(r, row.size)
+                    && readers[columns.compressed_size].number(r, row.compressed_size);
+            if (columns.age != -1) has = readers[columns.age].number(r, row.age) && has;
+            if (columns.site != -1) has = readers[columns.site].number(r, row.site) && has;
+            row.type = readers[columns.type].text(r);
+            if (columns.age_class != -1) row.age_class = readers[columns.age_class].text(r);
+            if (columns.access != -1) row.access = readers[columns.access].text(r);
+            if (has) {
+                aggregates.add(columns, row);
+            } else {
+                aggregates.skipped++;
+            }
+        }
+    }
+}
+
+/// @brief Writes a summary table a cell at a time.
+struct SummaryFile {
+    StackFile file;
+    bool first = true;
+
+    explicit SummaryFile(const std::string &name) : file(StackString<256>(name.c_str()), Mode::WRITE) {}
+
+    void separate() {
+        if (!first) {
+            file.append(',');
+        }
+        first = false;
+    }
+
+    SummaryFile &operator<<(uint64_t value) { separate(); file.append_unsigned(value); return *this; }
+    SummaryFile &operator<<(double value) { separate(); file.append_float(value); return *this; }
+    SummaryFile &operator<<(std::string_view value) { separate(); file.append(value.data(), value.size()); return *this; }
+    SummaryFile &operator<<(const char *value) { return *this << std::string_view(value); }
+
+    SummaryFile &hex(uint64_t value) { separate(); file.append_hex(value); return *this; }
+
+    SummaryFile &totals(const Totals &totals) {
+        return *this << totals.rows << totals.size << totals.compressed_size << totals.ratio();
+    }
+
+    void end_row() {
+        file.append('\n');
+        first = true;
+    }
+
+    ~SummaryFile() {
+        file.checkpoint();
+    }
+};
+
+#define TOTALS_TITLES "Rows", "Size (bytes)", "Compressed Size (bytes)", "Compression Ratio (compressed/uncompressed)"
+
+static void write_summaries(const std::string &prefix, const Aggregates &aggregates) {
+    if (!aggregates.by_age_class.empty()) {
+        SummaryFile out(prefix + "-by-age-class.csv");
+        for (const char *title : {"Interval #", "Compression Type", "Age Class", TOTALS_TITLES}) out << title;
+        out.end_row();
+        for (const auto &entry : aggregates.by_age_class) {
+            out << std::get<0>(entry.first) << std::get<1>(entry.first) << std::get<2>(entry.first);
+            out.totals(entry.second).end_row();
+        }
+    }
+
+    if (!aggregates.by_site.empty()) {
+        SummaryFile out(prefix + "-by-site.csv");
+        for (const char *title : {"Allocation Site", "Compression Type", TOTALS_TITLES, "Mean Age (intervals)", "First Interval #", "Last Interval #"}) out << title;
+        out.end_row();
+        for (const auto &entry : aggregates.by_site) {
+            const SiteTotals &site = entry.second;
+            out.hex(std::get<0>(entry.first)) << std::get<1>(entry.first);
+            out.totals(site) << (double)site.age_sum / (double)site.rows << site.first_interval << site.last_interval;
+            out.end_row();
+        }
+    }
+
+    if (!aggregates.by_age.empty()) {
+        // Rows at age 0 of each compression type, to measure survival against
+        std::map<std::string_view, uint64_t> born;
+        for (const auto &entry : aggregates.by_age) {
+            if (std::get<0>(entry.first) == 0) {
+                born[std::get<1>(entry.first)] = entry.second.rows;
+            }
+        }
+        SummaryFile out(prefix + "-generational.csv");
+        for (const char *title : {"Age (intervals)", "Compression Type", TOTALS_TITLES, "Survival (rows / rows at age 0)"}) out << title;
+        out.end_row();
+        for (const auto &entry : aggregates.by_age) {
+            uint64_t at_birth = born.count(std::get<1>(entry.first)) ? born[std::get<1>(entry.first)] : 0;
+            out << std::get<0>(entry.first) << std::get<1>(entry.first);
+            out.totals(entry.second) << (at_birth == 0 ? 0.0 : (double)entry.second.rows / (double)at_birth);
+            out.end_row();
+        }
+    }
+
+    if (!aggregates.by_access.empty()) {
+        SummaryFile out(prefix + "-by-access.csv");
+        for (const char *title : {"Interval #", "Compression Type", "Access Type", TOTALS_TITLES}) out << title;
+        out.end_row();
+        for (const auto &entry : aggregates.by_access) {
+            out << std::get<0>(entry.first) << std::get<1>(entry.first) << std::get<2>(entry.first);
+            out.totals(entry.second).end_row();
+        }
+    }
+}
+
+// The table's file name without its directory or extensions
+static std::string table_name(const char *path) {
+    std::string name(path);
+    size_t slash = name.rfind('/');
+    if (slash != std::string::npos) {
+        name = name.substr(slash + 1);
+    }
+    for (const char *suffix : {".zst", ".csv", ".hpcol"}) {
+        if (ends_with(name.c_str(), suffix)) {
+            name.resize(name.size() - strlen(suffix));
+        }
+    }
+    return name;
+}
+
+// Aggregate one table with `threads` threads. The aggregates point into
+// `input`, so it has to outlive them.
+static bool analyze(const char *path, InputFile &input, unsigned threads, Aggregates &total) {
+    if (!input.open(path)) {
+        return false;
+    }
+    std::vector<Aggregates> shares(threads);
+    std::vector<std::thread> workers;
+    // The chunks each thread reads, for a columnar table
+    std::vector<std::vector<uint64_t>> runs(threads);
+
+    if (is_columnar(input.data, input.size)) {
+        // Walk the chunk headers, and deal the chunks out in runs of about the same size
+        std::vector<uint64_t> offsets;
+        for (uint64_t offset=0; offset < input.size;) {
+            CSVChunkHeader chunk;
+            if (!read_chunk_header(path, input.data, input.size, offset, ANALYZE_MAX_COLUMNS, chunk)) {
+                break;
+            }
+            offsets.push_back(offset);
+            offset += chunk.size;
+        }
+        for (size_t i=0; i<offsets.size(); i++) {
+            runs[i * threads / offsets.size()].push_back(offsets[i]);
+        }
+        for (unsigned t=0; t<threads; t++) {
+            workers.emplace_back(aggregate_chunks, input.data, std::cref(runs[t]), std::ref(shares[t]));
+        }
+    } else {
+        const char *text = (const char*)input.data, *end = text + input.size;
+        const char *title_end = (const char*)memchr(text, '\n', end - text);
+        if (title_end == nullptr) {
+            fprintf(stderr, "%s has no title row\n", path);
+            return false;
+        }
+        Columns columns = csv_columns(text, title_end);
+        if (columns.event != -1) {
+            fprintf(stderr, "%s is a delta table; rebuild it with heappulse-reconstruct first\n", path);
+            return false;
+        }
+        if (!columns.usable()) {
+            fprintf(stderr, "%s is not a per-object, per-page or per-huge-page table\n", path);
+            return false;
+        }
+        // Split the rows near even offsets, moved up to the next line break
+        const char *body = title_end + 1, *start = body;
+        for (unsigned t=0; t<threads; t++) {
+            const char *stop = t + 1 == threads ? end : body + (end - body) * (t + 1) / threads;
+            if (stop < start) {
+                stop = start;
+            }
+            const char *line_break = (const char*)memchr(stop, '\n', end - stop);
+            stop = line_break == nullptr ? end : line_break + 1;
+            workers.emplace_back(aggregate_csv, start, stop, columns, std::ref(shares[t]));
+            start = stop;
+        }
+    }
+
+    for (unsigned t=0; t<threads; t++) {
+        workers[t].join();
+        total.merge(shares[t]);
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = (std::max)(1u, std::thread::hardware_concurrency());
+    std::string directory = ".";
+    int first_table = 1;
+    for (; first_table < argc && argv[first_table][0] == '-'; first_table++) {
+        if (strcmp(argv[first_table], "-j") == 0 && first_table + 1 < argc) {
+            threads = (std::max)(1, atoi(argv[++first_table]));
+        } else if (strcmp(argv[first_table], "-o") == 0 && first_table + 1 < argc) {
+            directory = argv[++first_table];
+        } else {
+            first_table = argc;
+        }
+    }
+    if (first_table >= argc) {
+        fprintf(stderr, "usage: %s [-j threads] [-o directory] <table>...\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i=first_table; i<argc; i++) {
+        Timer timer;
+        InputFile input;
+        Aggregates aggregates;
+        if (!analyze(argv[i], input, threads, aggregates)) {
+            failed++;
+            continue;
+        }
+        write_summaries(directory + "/" + table_name(argv[i]), aggregates);
+        fprintf(stderr, "%s: %lu rows in %lu ms", argv[i], (unsigned long)aggregates.rows, (unsigned long)timer.elapsed_milliseconds());
+        if (aggregates.skipped > 0) {
+            fprintf(stderr, ", skipped %lu malformed rows", (unsigned long)aggregates.skipped);
+        }
+        fprintf(stderr, "\n");
+    }
+    return failed == 0 ? 0 : 1;
+}
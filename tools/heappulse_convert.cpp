@@ -0,0 +1,82 @@
+// Converts a table written in the columnar format (`CSVFormat::COLUMNAR` in
+// stack_csv.hpp) back into the CSV text HeapPulse would have written.
+//
+//     heappulse-convert page-compression.hpcol page-compression.csv
+//
+// The input is mapped and read in place one chunk at a time, and cells are
+// written with the same `CSVCell::write` as the text format, so values come
+// out exactly as they would have. Rows shorter than the table are padded
+// with empty cells.
+//
+// With COMPRESS_OUTPUT_FILES, a `.hpcol.zst` input is decompressed first, up
+// to its last complete frame, and a `.csv.zst` output is compressed.
+
+#include "input_file.hpp"
+#include "columnar_reader.hpp"
+
+#include <cstdio>
+#include <vector>
+
+// The widest table the converter reads
+#define CONVERT_MAX_COLUMNS 1024
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <input.hpcol> <output.csv>\n", argv[0]);
+        return 1;
+    }
+
+    InputFile input;
+    if (!input.open(argv[1])) {
+        return 1;
+    }
+    const uint8_t *file = input.data;
+    uint64_t file_size = input.size;
+
+    StackFile output(StackString<256>(argv[2]), Mode::WRITE);
+    std::vector<ColumnReader> columns(CONVERT_MAX_COLUMNS);
+    uint64_t chunks = 0, rows = 0;
+    for (uint64_t offset=0; offset < file_size;) {
+        CSVChunkHeader chunk;
+        if (!read_chunk_header(argv[1], file, file_size, offset, CONVERT_MAX_COLUMNS, chunk)) {
+            return 1;
+        }
+
+        const uint8_t *base = file + offset;
+        const CSVColumnHeader *headers = (const CSVColumnHeader*)(base + sizeof(chunk));
+        for (uint32_t col=0; col<chunk.columns; col++) {
+            if (!open_column(base, chunk, headers[col], columns[col])) {
+                fprintf(stderr, "Column %u of the chunk at byte %lu of %s is corrupt\n", col, (unsigned long)offset, argv[1]);
+                return 1;
+            }
+        }
+
+        // The text format writes its title once, before the first rows
+        if (chunks == 0) {
+            uint32_t named = 0;
+            for (uint32_t col=0; col<chunk.columns; col++) {
+                named = headers[col].name_size > 0 ? col + 1 : named;
+            }
+            for (uint32_t col=0; col<named; col++) {
+                output.append((const char*)base + headers[col].name_offset, headers[col].name_size);
+                output.append(col + 1 < named ? ',' : '\n');
+            }
+        }
+
+        for (uint64_t row=0; row<chunk.rows; row++) {
+            for (uint32_t col=0; col<chunk.columns; col++) {
+                columns[col].cell(row).write(output);
+                if (col + 1 < chunk.columns) {
+                    output.append(',');
+                }
+            }
+            output.append('\n');
+        }
+        rows += chunk.rows;
+        chunks++;
+        offset += chunk.size;
+    }
+    output.checkpoint();
+    fprintf(stderr, "Converted %lu rows in %lu chunks\n", (unsigned long)rows, (unsigned long)chunks);
+    return 0;
+}
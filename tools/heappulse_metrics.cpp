@@ -0,0 +1,85 @@
+// Prints the live metrics page of a process running HeapPulse built with
+// LIVE_METRICS (see live_metrics.hpp).
+//
+//     heappulse-metrics <pid> [period-ms]
+//
+// With a period, the page is printed again every period until the process
+// finishes or exits. Counts and overhead are as of the last
+// LIVE_METRICS_PERIOD_MS; live objects, the resident set and the codec
+// ratios are as of the last interval.
+
+#include <bkmalloc.h>
+#include <config.hpp>
+#include <live_metrics.hpp>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+static void print(const LiveMetricsData &data) {
+    printf("Updated:           %.3f s after start\n", data.updated_microseconds / 1e6);
+    printf("Intervals:         %lu\n", (unsigned long)data.intervals);
+    printf("Mallocs / frees:   %lu / %lu\n", (unsigned long)data.malloc_count, (unsigned long)data.free_count);
+    printf("Mmaps / munmaps:   %lu / %lu\n", (unsigned long)data.mmap_count, (unsigned long)data.munmap_count);
+    printf("Alloc / free rate: %.1f / %.1f per second\n", data.alloc_rate, data.free_rate);
+    printf("Live objects:      %lu (%lu bytes)\n", (unsigned long)data.live_objects, (unsigned long)data.live_bytes);
+    printf("Resident pages:    %lu\n", (unsigned long)data.resident_pages);
+    printf("Hook overhead:     %.3f ms (update %.3f ms, invalidate %.3f ms)\n",
+        data.overhead_microseconds / 1e3, data.update_microseconds / 1e3, data.invalidate_microseconds / 1e3);
+    printf("Dropped events:    %lu\n", (unsigned long)data.dropped_events);
+    uint64_t codecs = data.codec_count < LIVE_METRICS_CODECS ? data.codec_count : LIVE_METRICS_CODECS;
+    for (uint64_t i=0; i<codecs; i++) {
+        const LiveCodecMetrics &codec = data.codecs[i];
+        printf("  %-8.16s %lu -> %lu bytes, ratio %.4f\n", codec.name,
+            (unsigned long)codec.uncompressed_size, (unsigned long)codec.compressed_size, codec.ratio);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <pid> [period-ms]\n", argv[0]);
+        return 1;
+    }
+    int pid = atoi(argv[1]);
+    long period = argc == 3 ? atol(argv[2]) : 0;
+
+    char name[64];
+    snprintf(name, sizeof(name), LIVE_METRICS_NAME, pid);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        fprintf(stderr, "No live metrics for pid %d (%s); is it running with LIVE_METRICS?\n", pid, name);
+        return 1;
+    }
+    const LiveMetricsPage *page = (const LiveMetricsPage*)mmap(nullptr, sizeof(LiveMetricsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", name);
+        return 1;
+    }
+    if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != LIVE_METRICS_MAGIC) {
+        fprintf(stderr, "%s is not a live metrics page, or is still being made\n", name);
+        return 1;
+    }
+    if (page->version != LIVE_METRICS_VERSION || page->size != sizeof(LiveMetricsPage)) {
+        fprintf(stderr, "%s is version %u (%u bytes), this reader is version %u (%lu bytes)\n",
+            name, page->version, page->size, LIVE_METRICS_VERSION, (unsigned long)sizeof(LiveMetricsPage));
+        return 1;
+    }
+
+    LiveMetricsData data;
+    while (true) {
+        if (!read_live_metrics(page, data)) {
+            fprintf(stderr, "The page was being written on every attempt to read it\n");
+            return 1;
+        }
+        print(data);
+        if (period <= 0 || data.finished || (kill(pid, 0) == -1 && errno == ESRCH)) {
+            break;
+        }
+        usleep(period * 1000);
+        printf("\n");
+    }
+    return 0;
+}
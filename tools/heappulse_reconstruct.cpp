@@ -0,0 +1,195 @@
+// Rebuilds the full per-object or per-page table from one written with
+// DELTA_OUTPUT (see delta_output.hpp), with a row for everything live in
+// every interval, as HeapPulse writes it without DELTA_OUTPUT.
+//
+//     heappulse-reconstruct page-delta.csv page-compression.csv
+//
+// Birth and change rows replace what is known about an object or page,
+// death rows forget it, and each `End` row writes out everything known at
+// the end of that interval. `Untracked` rows, for what the tracker had no
+// room for, are written out by the next `End` row only. Ages are advanced by the intervals since the row
+// they came from, and age classes follow them. Every other cell is as of the
+// last row written for the object or page, so compressed sizes are within
+// DELTA_COMPRESSED_SIZE_THRESHOLD of the real ones. Rows within an interval
+// come out ordered by address, site and compression type.
+//
+// Rows after the last `End` row are from an interval that never finished,
+// and are left out. A columnar delta table is turned into CSV with
+// heappulse-convert first.
+
+#include "input_file.hpp"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+typedef std::vector<std::string> Cells;
+
+// Split a line of CSV text into its cells; HeapPulse never quotes them
+static void split(const char *line, const char *end, Cells &cells) {
+    cells.clear();
+    const char *cell = line;
+    for (const char *c=line; ; c++) {
+        if (c == end || *c == ',') {
+            cells.emplace_back(cell, c - cell);
+            if (c == end) {
+                break;
+            }
+            cell = c + 1;
+        }
+    }
+}
+
+static int column(const Cells &title, const char *name) {
+    for (size_t i=0; i<title.size(); i++) {
+        if (title[i] == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The age classes of `AllTest::age_class_index`
+static const char *age_class(uint64_t age) {
+    if (age == 0) {
+        return "New";
+    } else if (age < 5) {
+        return "Young";
+    } else if (age < 10) {
+        return "Middle-aged";
+    } else {
+        return "Old";
+    }
+}
+
+struct LiveRow {
+    Cells cells;
+    // The interval the row was written in
+    uint64_t interval;
+};
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <delta.csv> <output.csv>\n", argv[0]);
+        return 1;
+    }
+
+    InputFile input;
+    if (!input.open(argv[1])) {
+        return 1;
+    }
+    const char *text = (const char*)input.data, *text_end = text + input.size;
+
+    Cells title, cells;
+    const char *line_end = (const char*)memchr(text, '\n', text_end - text);
+    if (line_end == nullptr) {
+        fprintf(stderr, "%s has no title row\n", argv[1]);
+        return 1;
+    }
+    split(text, line_end, title);
+    int interval_column = column(title, "Interval #"),
+        event_column = column(title, "Event"),
+        address_column = column(title, "Object Address"),
+        type_column = column(title, "Compression Type"),
+        age_column = column(title, "Age (intervals)"),
+        age_class_column = column(title, "Age Class"),
+        // Objects are told apart by site too, since the same address can be live under two
+        site_column = address_column == -1 ? -1 : column(title, "Allocation Site");
+    if (address_column == -1) {
+        address_column = column(title, "Virtual Page Address");
+    }
+    if (interval_column == -1 || event_column == -1 || address_column == -1 || type_column == -1) {
+        fprintf(stderr, "%s is not a delta table of objects or pages\n", argv[1]);
+        return 1;
+    }
+
+    StackFile output(StackString<256>(argv[2]), Mode::WRITE);
+    // Write a row of cells, leaving out the event
+    auto write_row = [&](const Cells &row) {
+        bool first = true;
+        for (size_t col=0; col<row.size(); col++) {
+            if ((int)col == event_column) {
+                continue;
+            }
+            if (!first) {
+                output.append(',');
+            }
+            output.append(row[col].data(), row[col].size());
+            first = false;
+        }
+        output.append('\n');
+    };
+    write_row(title);
+
+    // Keyed by address, site and compression type
+    std::map<std::tuple<uint64_t, uint64_t, std::string>, LiveRow> live, untracked;
+    uint64_t intervals = 0, rows = 0, unfinished = 0;
+    for (const char *line = line_end + 1; line < text_end; line = line_end + 1) {
+        line_end = (const char*)memchr(line, '\n', text_end - line);
+        if (line_end == nullptr) {
+            line_end = text_end;
+        }
+        if (line == line_end) {
+            continue;
+        }
+        split(line, line_end, cells);
+        if (cells.size() != title.size()) {
+            fprintf(stderr, "Skipping a row of %lu cells instead of %lu\n", (unsigned long)cells.size(), (unsigned long)title.size());
+            continue;
+        }
+        uint64_t interval = strtoull(cells[interval_column].c_str(), nullptr, 10);
+        const std::string &event = cells[event_column];
+        unfinished++;
+
+        if (event == "End") {
+            // Untracked rows are current as written, and come out in order with the rest
+            for (auto &entry : untracked) {
+                live.erase(entry.first);
+            }
+            live.insert(untracked.begin(), untracked.end());
+            for (auto &entry : live) {
+                Cells row = entry.second.cells;
+                row[interval_column] = std::to_string(interval);
+                if (age_column != -1) {
+                    uint64_t age = strtoull(row[age_column].c_str(), nullptr, 10) + (interval - entry.second.interval);
+                    row[age_column] = std::to_string(age);
+                    if (age_class_column != -1) {
+                        row[age_class_column] = age_class(age);
+                    }
+                }
+                write_row(row);
+            }
+            rows += live.size();
+            for (auto &entry : untracked) {
+                live.erase(entry.first);
+            }
+            untracked.clear();
+            intervals++;
+            unfinished = 0;
+            continue;
+        }
+
+        uint64_t site = site_column == -1 ? 0 : strtoull(cells[site_column].c_str(), nullptr, 16);
+        auto key = std::make_tuple(strtoull(cells[address_column].c_str(), nullptr, 16), site, cells[type_column]);
+        if (event == "Birth" || event == "Change") {
+            live[key] = {cells, interval};
+        } else if (event == "Death") {
+            live.erase(key);
+        } else if (event == "Untracked") {
+            // Whatever was known about it before is out of date
+            live.erase(key);
+            untracked[key] = {cells, interval};
+        } else {
+            fprintf(stderr, "Skipping a row with the unknown event \"%s\"\n", event.c_str());
+        }
+    }
+    output.checkpoint();
+
+    if (unfinished > 0) {
+        fprintf(stderr, "Left out %lu rows after the last complete interval\n", (unsigned long)unfinished);
+    }
+    fprintf(stderr, "Rebuilt %lu rows over %lu intervals\n", (unsigned long)rows, (unsigned long)intervals);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// Reads a HeapPulse output file for the offline tools: mapped in place, or
+// with COMPRESS_OUTPUT_FILES, decompressed into memory when it ends in `.zst`.
+
+#include <bkmalloc.h>
+#include <config.hpp>
+#include <stack_io.hpp>
+
+#include <cstdio>
+#include <vector>
+#include <sys/mman.h>
+
+static bool ends_with(const char *string, const char *suffix) {
+    size_t length = strlen(string), suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(string + length - suffix_length, suffix) == 0;
+}
+
+#ifdef COMPRESS_OUTPUT_FILES
+// Decompress every complete zstd frame in `input`. A run that was cut short
+// leaves a partial last frame, which is skipped.
+static bool decompress_frames(const char *name, const uint8_t *input, uint64_t size, std::vector<uint8_t> &output) {
+    ZSTD_DCtx *zstd = ZSTD_createDCtx();
+    for (uint64_t offset=0; offset < size;) {
+        size_t frame_size = ZSTD_findFrameCompressedSize(input + offset, size - offset);
+        if (ZSTD_isError(frame_size)) {
+            fprintf(stderr, "Skipping the incomplete frame at byte %lu of %s\n", (unsigned long)offset, name);
+            break;
+        }
+        ZSTD_inBuffer in = {input + offset, frame_size, 0};
+        size_t remaining;
+        do {
+            size_t used = output.size();
+            output.resize(used + ZSTD_DStreamOutSize());
+            ZSTD_outBuffer out = {output.data() + used, ZSTD_DStreamOutSize(), 0};
+            remaining = ZSTD_decompressStream(zstd, &out, &in);
+            output.resize(used + out.pos);
+            if (ZSTD_isError(remaining)) {
+                fprintf(stderr, "Could not decompress the frame at byte %lu of %s: %s\n", (unsigned long)offset, name, ZSTD_getErrorName(remaining));
+                ZSTD_freeDCtx(zstd);
+                return false;
+            }
+        } while (remaining != 0);
+        offset += frame_size;
+    }
+    ZSTD_freeDCtx(zstd);
+    return true;
+}
+#endif
+
+/// @brief The bytes of an input file, printing why to stderr when it can't be read.
+struct InputFile {
+    const uint8_t *data = nullptr;
+    uint64_t size = 0;
+    std::vector<uint8_t> decompressed;
+
+    bool open(const char *name) {
+        int fd = ::open(name, O_RDONLY);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            fprintf(stderr, "Could not open %s\n", name);
+            return false;
+        }
+        size = st.st_size;
+        if (size > 0) {
+            data = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                fprintf(stderr, "Could not map %s\n", name);
+                return false;
+            }
+        }
+
+        if (ends_with(name, ".zst")) {
+            #ifdef COMPRESS_OUTPUT_FILES
+            if (!decompress_frames(name, data, size, decompressed)) {
+                return false;
+            }
+            data = decompressed.data();
+            size = decompressed.size();
+            #else
+            fprintf(stderr, "%s is compressed; build with COMPRESS_OUTPUT_FILES to read it\n", name);
+            return false;
+            #endif
+        }
+        return true;
+    }
+};